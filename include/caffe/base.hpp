@@ -63,15 +63,43 @@ CAFFE_API bool GPUAvailable();
  */
 CAFFE_API void SetMode(DeviceMode mode, int device);
 
-//// ThreadLocal Memory Pool API
+/*!
+ * \brief error relative to im2col and GEMM that reference Convolution layers
+ *  may trade for speed, 0 (exact) by default. Winograd F(4x4, 3x3) runs 3x3
+ *  convolutions of stride 1 from 2e-5 on. Layers choose when they are
+ *  reshaped, so a net loaded already switches on its next reshape, e.g. the
+ *  next Forward with new input shapes. conv_algorithm "direct" or
+ *  "winograd" of a layer overrides the choice.
+ */
+CAFFE_API void SetConvTolerance(float tolerance);
+CAFFE_API float GetConvTolerance();
+
+//// Memory Pool API
 
 struct MemPoolState {
-  int gpu_mem;  // gpu memory, calculate on all device memory used by this thread
-  int cpu_mem;  // cpu memory
-  int unused_gpu_mem;  // not used gpu memory
-  int unused_cpu_mem;  // not used cpu memory
+  size_t gpu_mem;  // gpu memory, calculate on all device memory
+  size_t cpu_mem;  // cpu memory, in use and cached
+  size_t unused_gpu_mem;  // not used gpu memory
+  size_t unused_cpu_mem;  // not used cpu memory
 };
 
+/*! \brief get memory held by the host memory pool, all sizes in bytes */
+CAFFE_API MemPoolState MemPoolGetState();
+/*! \brief free memory cached by the pool and not used by any blob */
+CAFFE_API void MemPoolClear();
+/*!
+ * \brief log every pool event, e.g. "[CPU] Requested 1.5 K, Get 1.5 K",
+ *  plot the log with tools/parse_mem.py
+ */
+CAFFE_API void MemPoolSetLogging(bool enable);
+/*! \brief back blocks from 2M on by transparent huge pages where supported */
+CAFFE_API void MemPoolSetHugePages(bool enable);
+/*!
+ * \brief host allocations made by the calling thread, blob memory requests
+ *  always count, every operator new with USE_ALLOC_AUDIT, see Net::SetAllocAudit
+ */
+CAFFE_API size_t AllocationCount();
+
 }  // namespace caffe
 
 #endif  // CAFFE_COMMON_HPP_
@@ -193,7 +193,9 @@ class CAFFE_API Blob {
   const real_t* cpu_data() const;
   real_t* mutable_cpu_data();
 
-  void FromProto(const BlobProto& proto, bool reshape = true);
+  /// @brief Copy shape and data of proto. With shape_only a proto without data
+  ///        only reshapes and its data is bound later, else data is required.
+  void FromProto(const BlobProto& proto, bool reshape = true, bool shape_only = false);
   void ToProto(BlobProto* proto) const;
 
   /**
@@ -208,9 +210,12 @@ class CAFFE_API Blob {
 
   bool ShapeEquals(const BlobProto& other);
 
+  /// @brief the SyncedMemory holding data, shared by Blob%s after ShareData
+  const shared_ptr<SyncedMemory>& data() const { return data_; }
+
   std::string name() { return name_; }
   void set_name(std::string name) { name_ = name; }
-  // Reset blob memory
+  /// @brief Give the blob new memory of its capacity, other blobs keep the old
   void ResetMemory();
 
   size_t prv_data_count() const {
@@ -262,7 +267,7 @@ class BlobInt : public Blob {
   const int* cpu_data() const;
   int* mutable_cpu_data();
 
-  void FromProto(const BlobProto& proto, bool reshape = true) = delete;
+  void FromProto(const BlobProto& proto, bool reshape = true, bool shape_only = false) = delete;
   void ToProto(BlobProto* proto) const = delete;
 
  protected:
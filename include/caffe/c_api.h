@@ -1,6 +1,8 @@
 #ifndef CAFFE_C_API_H_
 #define CAFFE_C_API_H_
 
+#include <stddef.h>
+
 #ifdef _MSC_VER
 #ifdef CAFFE_EXPORTS
 #define CAFFE_API __declspec(dllexport)
@@ -47,7 +49,8 @@ CAFFE_API int CaffeBlobShape(BlobHandle blob, int* shape_size, int** shape);
 /*!
  * \brief create network
  * \param net_path path to network prototxt file
- * \param model_path path to network caffemodel file
+ * \param model_path path to network caffemodel file, or flat weights file
+ *  written by CaffeNetSaveFlatWeights
  * \param net output NetHandle
  * \return return code, 0 for success, -1 for failed
  */
@@ -66,8 +69,25 @@ CAFFE_API int CaffeNetCreate(const char *net_path,
 CAFFE_API int CaffeNetCreateFromBuffer(const char *net_buffer, int nb_len,
                                        const char *model_buffer, int mb_len,
                                        NetHandle *net);
-/*! \brief destroy network */
+/*!
+ * \brief create an execution context sharing weights with a network
+ * \param model network holding the weights, destroy it after all contexts
+ * \param net output handle, every thread can forward its own context
+ * \return return code, 0 for success, -1 for failed
+ */
+CAFFE_API int CaffeNetCreateContext(NetHandle model, NetHandle *net);
+/*!
+ * \brief destroy network, queued requests of CaffeNetSubmit finish first and
+ *  concurrent CaffeNetSubmit calls fail
+ */
 CAFFE_API int CaffeNetDestroy(NetHandle net);
+/*!
+ * \brief save network parameters as flat weights, CaffeNetCreate maps such
+ *  file and uses its tensors in place
+ * \param net net handle
+ * \param path flat weights file path
+ */
+CAFFE_API int CaffeNetSaveFlatWeights(NetHandle net, const char *path);
 /*!
  * \brief mark internal blob as output
  * \param net net handle
@@ -79,6 +99,110 @@ CAFFE_API int CaffeNetMarkOutput(NetHandle net, const char *name);
  * \note  fill network input blobs before calling this function
  */
 CAFFE_API int CaffeNetForward(NetHandle net);
+/*!
+ * \brief forward only the layers needed to compute a blob
+ * \param net net handle
+ * \param name blob name, its data is valid until next forward
+ */
+CAFFE_API int CaffeNetForwardTo(NetHandle net, const char *name);
+/*!
+ * \brief remove layers not needed to compute given blobs
+ * \param net net handle
+ * \param n number of blobs
+ * \param names blob names, they become the only outputs of network
+ */
+CAFFE_API int CaffeNetPruneToOutputs(NetHandle net, int n, const char **names);
+/*!
+ * \brief callback of a request given to CaffeNetSubmit, called from the
+ *  batching thread once the batch holding the request is done
+ * \param status 0 for success, -1 for failed
+ * \param error error message if failed, else NULL, CaffeGetLastError of
+ *  the batching thread is not set
+ * \param n number of output blobs
+ * \param names output blob names
+ * \param data output data of this request, one sample of every output blob
+ * \param counts element count of every output sample
+ * \param user_data pointer given to CaffeNetSubmit
+ * \note  error, names and data are only valid during the callback
+ */
+typedef void (*CaffeNetCallback)(int status, const char *error,
+                                 int n, const char **names,
+                                 const real_t **data, const int *counts,
+                                 void *user_data);
+/*!
+ * \brief batch requests of CaffeNetSubmit along axis 0 of input blobs
+ * \param net net handle, don't call CaffeNetForward on it afterwards
+ * \param max_batch max number of requests in one forward
+ * \param timeout_us max microseconds a request waits for others to batch
+ * \note  input blobs keep their current shape except axis 0, batches are
+ *  padded to a power of 2 or max_batch and the plan cache keeps a plan of
+ *  every such size, see CaffeNetSetPlanCacheSize
+ */
+CAFFE_API int CaffeNetEnableBatching(NetHandle net, int max_batch, int timeout_us);
+/*!
+ * \brief submit one request to batched network, returns without waiting
+ * \param net net handle with batching enabled
+ * \param inputs data of one sample for every input blob, in order of the
+ *  Input layer tops, copied before returning
+ * \param callback called with outputs of the request
+ * \param user_data passed to callback
+ */
+CAFFE_API int CaffeNetSubmit(NetHandle net, const real_t **inputs,
+                             CaffeNetCallback callback, void *user_data);
+/*!
+ * \brief run independent layers of network at the same time
+ * \param net net handle
+ * \param num_threads max number of layers running concurrently, 1 by default
+ */
+CAFFE_API int CaffeNetSetInterOpThreads(NetHandle net, int num_threads);
+/*!
+ * \brief split loops of reference CPU layers across threads
+ * \param net net handle
+ * \param num_threads threads working on a layer, 1 by default
+ * \param spin_us microseconds idle threads wait for work before sleeping
+ * \param affinity pin threads to cores if not 0
+ */
+CAFFE_API int CaffeNetSetIntraOpThreads(NetHandle net, int num_threads,
+                                        int spin_us, int affinity);
+/*!
+ * \brief keep memory and primitives of recent input shapes, so switching back
+ *  to one of them in CaffeNetForward needs no setup
+ * \param net net handle
+ * \param size number of input shapes kept besides the current one, 0 by default
+ */
+CAFFE_API int CaffeNetSetPlanCacheSize(NetHandle net, int size);
+/*!
+ * \brief log layers allocating host memory in CaffeNetForward, for debugging
+ * \param net net handle
+ * \param warmup forwards with a new plan before auditing starts, 0 turns it off
+ */
+CAFFE_API int CaffeNetSetAllocAudit(NetHandle net, int warmup);
+/*!
+ * \brief get number of allocations found by the audit since it was turned on
+ * \param net net handle
+ * \param count return count
+ */
+CAFFE_API int CaffeNetGetAuditedAllocations(NetHandle net, size_t *count);
+/*!
+ * \brief get static cost of every layer at shapes of the last forward,
+ *  valid until next call in this thread
+ * \param net net handle
+ * \param n number of layers
+ * \param names layer names
+ * \param types layer types
+ * \param costs n x 5 values of each layer, multiply-accumulates, then bytes
+ *  of inputs, outputs, parameters and temporary blobs
+ */
+CAFFE_API int CaffeNetGetLayerCosts(NetHandle net, int *n, const char ***names,
+                                    const char ***types, const double **costs);
+/*!
+ * \brief log layer costs against a roofline, with achieved performance of
+ *  layers timed by the profiler layer statistics
+ * \param net net handle
+ * \param peak_gflops peak compute in GFLOP/s
+ * \param peak_gbps peak memory bandwidth in GB/s
+ */
+CAFFE_API int CaffeNetLogRoofline(NetHandle net, double peak_gflops, double peak_gbps);
 /*!
  * \brief get network internal blob by name
  * \param net NetHandle
@@ -113,7 +237,7 @@ CAFFE_API int CaffeNetListParam(NetHandle net,
                                 const char ***names,
                                 BlobHandle **params);
 
-// Profiler, don't enable Profiler in multi-thread Env
+// Profiler, scopes are recorded per thread, nets show as processes in the trace
 
 /*!
  * \brief enable profiler
@@ -137,6 +261,27 @@ CAFFE_API int CaffeProfilerScopeEnd();
  * \param fn file name or path
  */
 CAFFE_API int CaffeProfilerDump(const char *fn);
+/*!
+ * \brief collect latency statistics of every layer by name and type, works
+ *  without the trace being enabled
+ * \param enable 1 to collect, 0 to stop
+ */
+CAFFE_API int CaffeProfilerEnableLayerStats(int enable);
+/*!
+ * \brief drop collected layer statistics
+ */
+CAFFE_API int CaffeProfilerResetLayerStats();
+/*!
+ * \brief get layer statistics, valid until next call in this thread
+ * \param n number of layers
+ * \param names layer names
+ * \param types layer types
+ * \param stats n x 7 values of each layer, call count since reset, then mean,
+ *  p50, p90, p99, min and max in microseconds over the latest calls
+ */
+CAFFE_API int CaffeProfilerGetLayerStats(int *n, const char ***names,
+                                         const char ***types,
+                                         const double **stats);
 
 // Helper
 
@@ -157,8 +302,31 @@ CAFFE_API int CaffeSetMode(int mode, int device);
  */
 CAFFE_API const char *CaffeGetLastError();
 /*!
- * \brief clear unused memory in threaded memory pool
+ * \brief clear unused memory in memory pool
+ */
+CAFFE_API int CaffeMemPoolClear();
+/*!
+ * \brief get memory held by memory pool
+ * \param cpu_mem bytes of host memory in use and cached
+ * \param unused_cpu_mem bytes of host memory cached for reuse
+ */
+CAFFE_API int CaffeMemPoolGetState(size_t *cpu_mem, size_t *unused_cpu_mem);
+/*!
+ * \brief log memory pool events for tools/parse_mem.py
+ * \param enable 1 to log, 0 to stop
+ */
+CAFFE_API int CaffeMemPoolSetLogging(int enable);
+/*!
+ * \brief back large memory pool blocks by huge pages where supported
+ * \param enable 1 to use huge pages for new blocks, 0 to stop
+ */
+CAFFE_API int CaffeMemPoolSetHugePages(int enable);
+/*!
+ * \brief set error reference convolutions may trade for speed, layers of
+ *  nets loaded already pick it up when they are reshaped
+ * \param tolerance 0 (default) to keep im2col and GEMM, 2e-5 on for Winograd
  */
+CAFFE_API int CaffeSetConvTolerance(float tolerance);
 
 #ifdef __cplusplus
 }
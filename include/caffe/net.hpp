@@ -1,6 +1,8 @@
 #ifndef CAFFE_NET_HPP_
 #define CAFFE_NET_HPP_
 
+#include <atomic>
+#include <list>
 #include <map>
 #include <set>
 #include <string>
@@ -13,7 +15,10 @@
 namespace caffe {
 
 class Layer;
+class MappedFile;
 class NetParameter;
+class ThreadPool;
+class IntraOpPool;
 
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
@@ -24,19 +29,57 @@ class NetParameter;
 class CAFFE_API Net {
  public:
   explicit Net(const string& param_file);
-  explicit Net(NetParameter& param) {
-    Init(param);
+  /**
+   * @brief Load network and weights, compiling the network only once.
+   *
+   * `model_file` is a caffemodel or a flat weights file written by
+   * SaveFlatWeights. Parameters of a flat file point into its mapping, they
+   * are neither parsed nor copied.
+   */
+  Net(const string& param_file, const string& model_file);
+  explicit Net(NetParameter& param, NetParameter* weights = NULL)
+      : naive_memory_bytes_(0), planned_memory_bytes_(0),
+        inter_op_threads_(1), intra_op_threads_(1), plan_cache_size_(0),
+        alloc_audit_warmup_(0), alloc_audit_countdown_(0), audited_allocations_(0),
+        plans_placed_(0), model_(NULL), num_contexts_(0) {
+    Init(param, weights);
   }
+  /**
+   * @brief Create an execution context sharing parameters with `model`.
+   *
+   * The context owns its activations and layer states (e.g. MKLDNN
+   * primitives) while its parameters read the memory of `model`, so every
+   * thread can run its own context over a single copy of the weights.
+   * Blobs derived from the weights, e.g. the transformed weights of Winograd
+   * convolutions, are shared too.
+   * `model` must outlive the context and keep its parameters unchanged,
+   * its CopyTrainedLayersFrom fails while contexts exist.
+   */
+  explicit Net(const Net* model);
+  ~Net();
 
-  /// @brief Initialize a network with a NetParameter.
-  void Init(NetParameter& param);
+  /**
+   * @brief Initialize a network with a NetParameter.
+   *
+   * @param weights trained layers, their blobs are moved to layers of
+   *        `param` with the same name before compiling. This saves the
+   *        second compile of CopyTrainedLayersFrom.
+   */
+  void Init(NetParameter& param, NetParameter* weights = NULL);
 
   /**
    * @brief Run Forward and return the result.
    *
    * @param reshape, if your input data shape changes, reshape is need.
+   *        When the input shapes differ from the last planned ones, all
+   *        layers are reshaped and activation memory is placed again.
    */
   void Forward(bool reshape=true);
+  /**
+   * @brief Run only the layers needed to compute blob `name`, it is valid
+   *        until the next Forward.
+   */
+  void ForwardTo(const string& name, bool reshape=true);
 
   /**
    * @brief Reshape all layers from bottom to top.
@@ -109,16 +152,41 @@ class CAFFE_API Net {
   */
   static void CompilationRuleConvSumFusion(const NetParameter& param,
                                               NetParameter* param_compiled);
+  /**
+   * @brief Fold a ReLU reading a ConvolutionDepthwise top into the
+   *        relu/negative_slope of the depthwise layer, any engine.
+   */
+  static void CompilationRuleDepthwiseReluFusion(const NetParameter& param,
+                                                 NetParameter* param_compiled);
+  /**
+   * @brief Fuse ConvolutionDepthwise, optional BatchNorm, Scale and ReLU and
+   *        the 1x1 Convolution reading them into a SeparableConvolution,
+   *        for layers of the reference engines on CPU.
+   */
+  static void CompilationRuleSeparableFusion(const NetParameter& param,
+                                             NetParameter* param_compiled);
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
    * @brief For an already initialized net, copies the pre-trained layers from
-   *        another Net.
+   *        another Net. Only blobs of layers the net has are copied. Fails on
+   *        contexts and on nets with contexts, which read the weights.
    */
   void CopyTrainedLayersFrom(const NetParameter& param_inp);
+  /// @brief blobs of `param` are moved to the net rather than copied, `param`
+  ///        is left changed
+  void CopyTrainedLayersFrom(NetParameter* param);
   void CopyTrainedLayersFrom(const string& trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param) const;
+  /**
+   * @brief Write parameters as flat weights: an index of (layer, blob index,
+   *        shape, offset) followed by raw 64 bytes aligned tensors in native
+   *        byte order.
+   *
+   * Layers are named after compiling, load the file with the same engine.
+   */
+  void SaveFlatWeights(const string& file) const;
 
   /// @brief returns the network name.
   const string& name() const { return name_; }
@@ -171,9 +239,130 @@ class CAFFE_API Net {
 
   /// @brief mark extra output named blob
   void MarkOutputs(const std::vector<std::string>& outs);
+  /// @brief names of blobs kept after Forward, tops of the last layer and
+  ///        blobs marked by MarkOutputs
+  vector<string> output_blob_names() const;
+  /**
+   * @brief Remove layers not needed to compute blobs `outs`, which become the
+   *        only outputs of the net. Blobs of removed layers are released.
+   */
+  void PruneToOutputs(const std::vector<std::string>& outs);
+
+  /// @brief bytes activations take if every blob has its own memory
+  size_t naive_memory_bytes() const { return naive_memory_bytes_; }
+  /// @brief bytes of the activation arena placed by the memory planner
+  size_t planned_memory_bytes() const { return planned_memory_bytes_; }
+
+  /**
+   * @brief Run independent layers at the same time in Forward.
+   *
+   * @param num_threads max number of layers running concurrently, 1 (default)
+   *        runs layers one by one in order. Keep it small when layers are
+   *        multi-threaded themselves (MKLDNN, OpenMP BLAS).
+   */
+  void SetInterOpThreads(int num_threads);
+  int inter_op_threads() const { return inter_op_threads_; }
+
+  /**
+   * @brief Split the loops of reference CPU layers (over images, channels,
+   *        ROIs, ...) across threads of a work stealing pool of this net.
+   *
+   * @param num_threads threads working on a layer, including the one calling
+   *        Forward, 1 (default) runs layers in a single thread
+   * @param spin_us microseconds idle workers wait for the next loop before
+   *        going to sleep
+   * @param affinity pin workers to cores 1, 2, ... (core 0 left to the caller)
+   */
+  void SetIntraOpThreads(int num_threads, int spin_us = 50, bool affinity = false);
+  int intra_op_threads() const { return intra_op_threads_; }
+
+  /**
+   * @brief Keep placed memory and layer primitives of recent input shapes,
+   *        switching back to one of them skips planning and MKLDNN setup.
+   *
+   * @param size number of input shapes kept besides the current one, 0
+   *        (default) plans again on every shape change. Every kept shape
+   *        holds its own activation arena.
+   */
+  void SetPlanCacheSize(int size);
+  int plan_cache_size() const { return plan_cache_size_; }
+  /// @brief times memory was placed for new input shapes, cache hits not counted
+  size_t plans_placed() const { return plans_placed_; }
+
+  /**
+   * @brief Log every layer allocating host memory in Forward, a debug aid for
+   *        serving many nets at once.
+   *
+   * @param warmup forwards run with a new plan before auditing starts, 0
+   *        (default) turns the audit off. Blob memory is always counted, any
+   *        operator new only in builds with USE_ALLOC_AUDIT. Audited forwards
+   *        run layers one by one.
+   */
+  void SetAllocAudit(int warmup);
+  /// @brief allocations found by the audit since it was turned on
+  size_t audited_allocations() const { return audited_allocations_; }
+
+  /// @brief static cost of a layer at its current shapes
+  struct LayerCost {
+    string name;
+    string type;
+    /// multiply-accumulates of Convolution, Deconvolution, depthwise
+    /// convolution and InnerProduct, 0 for other layers
+    int64_t macs;
+    /// bytes of activations read and written
+    int64_t input_bytes;
+    int64_t output_bytes;
+    /// bytes of parameters read, and of blobs derived from them such as
+    /// Winograd weights
+    int64_t param_bytes;
+    /// bytes of temporary blobs, memory private to MKLDNN is not counted
+    int64_t workspace_bytes;
+  };
+  /**
+   * @brief Cost of every layer at the shapes of the last Forward or Reshape.
+   */
+  vector<LayerCost> GetLayerCosts();
+  /**
+   * @brief Log cost, arithmetic intensity and attainable performance of every
+   *        layer and of the whole net against a roofline.
+   *
+   * Layers timed by the layer statistics of the Profiler also get their
+   * achieved GFLOP/s and GB/s, from the mean time of their latest calls.
+   *
+   * @param peak_gflops peak compute of the machine, in GFLOP/s
+   * @param peak_gbps peak memory bandwidth of the machine, in GB/s
+   */
+  void LogRoofline(double peak_gflops, double peak_gbps);
 
  protected:
   // Helpers for Init.
+  /**
+   * @brief Move blobs of weights to layers of param by layer name.
+   *
+   * Compile rules only move blobs between layers (BN folding is disabled in
+   * CompileNet), so compiled layers get the blobs CopyTrainedLayersFrom
+   * would copy to them. InitLayers checks their count and shapes with
+   * CheckLayerWeights, LayerSetUp skips these checks for given blobs.
+   */
+  static void AttachWeights(NetParameter* param, NetParameter* weights);
+  /// @brief Init with parameters bound to a mapped flat weights file.
+  void InitFromFlatWeights(NetParameter& param, const string& model_file);
+  /**
+   * @brief Build layers of a compiled NetParameter and connect them.
+   *
+   * Blobs of `param` are released as soon as their layer holds them.
+   * `check_weights` compares given blobs with the shapes layers expect,
+   * see CheckLayerWeights.
+   */
+  void InitLayers(NetParameter& param, bool check_weights = true);
+  /**
+   * @brief Check the `num_weights` blobs given to layer `layer_id` and the
+   *        blobs it holds once set up against the shapes LayerSetUp gives
+   *        blobs it creates itself, which are neither filled nor allocated.
+   *        `layer_param` has no blobs.
+   */
+  void CheckLayerWeights(const LayerParameter& layer_param, int layer_id,
+                         int num_weights);
   /// @brief Append a new top blob to the net.
   void AppendTop(const NetParameter& param, const int layer_id,
                  const int top_id, std::set<string>* available_blobs,
@@ -186,7 +375,69 @@ class CAFFE_API Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /**
+   * @brief Reshape the net and place activation and temporary blobs in one
+   *        pre-sized arena.
+   *
+   * Blobs sharing a SyncedMemory are placed as one block living from its
+   * first producer to its last consumer (see blob_life_time_). Blocks whose
+   * lifetimes don't overlap may share the same offset. Input blobs keep
+   * their own memory, as they are filled before Forward.
+   */
   void PlaceMemory();
+  /// @brief memory placed at `offset` of `parent` instead of its own block
+  struct NestedMemory {
+    SyncedMemory* parent;
+    size_t offset;
+    size_t size;
+  };
+  /**
+   * @brief Find Concat bottoms to place inside the Concat top, so their
+   *        producers write the concatenated result directly.
+   *
+   * Only a Concat whose bottoms are contiguous ranges of its top qualifies
+   * (e.g. channels of batch 1). A bottom is skipped if it is pinned, already
+   * nested elsewhere, or written by MKLDNN layers in their own layout.
+   */
+  void FindNestedMemory(const std::set<SyncedMemory*>& pinned,
+                        std::map<SyncedMemory*, NestedMemory>* nested) const;
+  /**
+   * @brief Find the layers every layer has to wait for in parallel Forward.
+   *
+   * Layer j waits for an earlier layer i if one writes memory the other
+   * reads or writes, which covers data flow, in-place layers and blobs
+   * placed at overlapping offsets of the arena.
+   *
+   * @param placed arena range [begin, end) of placed SyncedMemory, others
+   *        only conflict with themselves
+   */
+  void BuildSchedule(
+      const std::map<SyncedMemory*, std::pair<size_t, size_t> >& placed);
+  /// @brief Run every layer on the thread pool once its dependencies are done
+  void ForwardParallel();
+  struct ForwardState;
+  void RunLayerChain(shared_ptr<ForwardState> state, int layer_id);
+  /**
+   * @brief Find layers whose tops only depend on weights and input shapes,
+   *        like PriorBox, Parameter and layers reading only such blobs.
+   *
+   * They run once in UpdatePlan instead of every Forward, their tops keep
+   * their own memory.
+   */
+  void FindConstantLayers();
+  /// @brief Get the profiler ids of layer names and statistics.
+  void InternProfilerNames();
+  /// @brief Place memory or take the cached plan if input shapes changed
+  void UpdatePlan();
+  /// @brief ids of layers whose tops `blob_ids` depend on, in order
+  vector<int> LayersProducing(std::set<int> blob_ids) const;
+  /// @brief blobs placed by PlaceMemory, all but input and temporary blobs
+  vector<Blob*> PlacedBlobs();
+  struct ExecutionPlan;
+  /// @brief Move memory and layer primitives of current shapes to a plan
+  shared_ptr<ExecutionPlan> SavePlan();
+  /// @brief Use a saved plan again, input blobs must have its shapes
+  void RestorePlan(const ExecutionPlan& plan);
 
   /// @brief The network name
   string name_;
@@ -194,6 +445,10 @@ class CAFFE_API Net {
   vector<shared_ptr<Layer> > layers_;
   vector<string> layer_names_;
   std::map<string, int> layer_names_index_;
+  /// @brief profiler ids of the net, its layer names and layer statistics
+  int profiler_net_id_;
+  vector<int> layer_name_ids_;
+  vector<int> layer_stats_ids_;
   /// @brief the blobs storing intermediate results between the layer.
   vector<shared_ptr<Blob> > blobs_;
   vector<string> blob_names_;
@@ -202,6 +457,8 @@ class CAFFE_API Net {
   /// @brief parameters in the network.
   vector<shared_ptr<Blob> > params_;
   vector<string> param_display_names_;
+  /// @brief mapping of flat weights file holding the parameters, if any
+  shared_ptr<MappedFile> weights_file_;
   vector<vector<int> > param_id_vecs_;
   std::map<string, int> param_names_index_;
   /// bottom_vecs stores the vectors containing the input for each layer.
@@ -212,6 +469,38 @@ class CAFFE_API Net {
   /// top_vecs stores the vectors containing the output for each layer
   vector<vector<Blob*> > top_vecs_;
   vector<vector<int> > top_id_vecs_;
+  /// @brief tops of all Input layers, filled by user before Forward
+  vector<int> net_input_blob_ids_;
+  /// @brief input shapes the memory is placed for
+  vector<vector<int> > planned_input_shapes_;
+  /// @brief memory holding all placed blobs
+  shared_ptr<SyncedMemory> memory_arena_;
+  size_t naive_memory_bytes_;
+  size_t planned_memory_bytes_;
+  /// @brief layers to notify after each layer and number of layers it waits
+  vector<vector<int> > layer_successors_;
+  vector<int> layer_num_deps_;
+  /// @brief layers computed once per input shapes, see FindConstantLayers
+  vector<bool> layer_constant_;
+  int inter_op_threads_;
+  shared_ptr<ThreadPool> thread_pool_;
+  int intra_op_threads_;
+  shared_ptr<IntraOpPool> intra_op_pool_;
+  /// @brief saved plans by input shapes, most recently used first
+  std::list<std::pair<vector<vector<int> >, shared_ptr<ExecutionPlan> > > plan_cache_;
+  int plan_cache_size_;
+  /// @brief forwards left before the allocation audit starts, see SetAllocAudit
+  int alloc_audit_warmup_;
+  int alloc_audit_countdown_;
+  size_t audited_allocations_;
+  size_t plans_placed_;
+  /// @brief net whose parameters a context reads, NULL for other nets
+  const Net* model_;
+  /// @brief contexts reading the parameters of this net
+  mutable std::atomic<int> num_contexts_;
+  /// @brief layers of Init before compiling, without blobs, so
+  ///        CopyTrainedLayersFrom compiles weights like Init does
+  shared_ptr<NetParameter> uncompiled_param_;
   /// @brief The engine name
   string engine_name_;
   bool bn_scale_remove_;
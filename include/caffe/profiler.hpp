@@ -1,15 +1,20 @@
 #ifndef CAFFE_PROFILER_HPP_
 #define CAFFE_PROFILER_HPP_
 
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
 #include <vector>
 #include <string>
+#include <unordered_map>
 
 #include "caffe/base.hpp"
 
 namespace caffe {
 
 /*!
- * \brief Profiler for Caffe, don't enable Profiler in Multi-thread Env
+ * \brief Profiler for Caffe, safe to use from many threads at once.
  *  This class is used to profile a range of source code as a scope.
  *  The basic usage is like below.
  *
@@ -22,65 +27,157 @@ namespace caffe {
  * ```
  *
  * Scope represents a range of source code. Nested scope is also supported.
+ * Every thread records into its own preallocated ring buffer without locking,
+ * the oldest scopes of a thread are overwritten once kEventsPerThread are
+ * kept. Buffers of exited threads are freed once dumped, or when more than
+ * kMaxExitedBuffers wait to be. Scope names are interned, every thread caches
+ * the ids of names it used, hot paths start scopes by name id.
  * Dump profile into a json file, then we can view the data from google chrome
- * in chrome://tracing/
+ * in chrome://tracing/, a Net shows as a process and threads by their ids.
+ *
+ * Independent of the trace, layer statistics aggregate the latency of every
+ * layer by name and type, they can be read while the service runs.
  */
 class CAFFE_API Profiler {
 public:
+  /*! \brief scopes kept per thread */
+  static const int kEventsPerThread = 1 << 16;
+  /*! \brief latest calls of a layer its statistics are computed on */
+  static const int kStatsWindow = 1024;
+  /*! \brief max number of distinct (layer name, type) statistics */
+  static const int kMaxStats = 1 << 14;
+  /*! \brief buffers of exited threads kept for DumpProfile, older ones are freed */
+  static const int kMaxExitedBuffers = 16;
+
+  /*! \brief latency of a layer, times in microseconds over the window */
+  struct LayerStats {
+    std::string name;
+    std::string type;
+    uint64_t count;  // calls since the last reset
+    double mean, p50, p90, p99, min, max;
+  };
+
   /*! \brief get global instance */
   static Profiler *Get();
   /*!
-   * \brief start a scope
+   * \brief id of a scope name, the same name always gets the same id
+   * \param name scope name
+   */
+  int Intern(const char *name);
+  /*!
+   * \brief register a Net, its scopes are grouped under the returned id
+   * \param name net name
+   */
+  int NewNetId(const std::string &name);
+  /*!
+   * \brief start a scope, names used before by the thread are found without
+   *  locking
    * \param name scope name
    */
   void ScopeStart(const char *name);
+  /*!
+   * \brief id of the statistics of a layer, -1 once kMaxStats are used
+   * \param name_id layer name id from Intern
+   * \param type layer type
+   */
+  int StatsId(int name_id, const char *type);
+  /*!
+   * \brief start a scope by interned name
+   * \param name_id scope name id from Intern
+   * \param net_id id from NewNetId, 0 for scopes outside of nets
+   * \param stats_id id from StatsId, -1 for scopes without statistics
+   */
+  void ScopeStart(int name_id, int net_id = 0, int stats_id = -1) {
+    if (mode_.load(std::memory_order_relaxed) == 0) return;
+    Push(name_id, net_id, stats_id);
+  }
   /*!
    * \brief end a scope
    */
-  void ScopeEnd();
+  void ScopeEnd() {
+    if (mode_.load(std::memory_order_relaxed) == 0) return;
+    Pop();
+  }
   /*!
    * \brief dump profile data
    * \param fn file name
    */
   void DumpProfile(const char *fn) const;
-  /*! \brief turn on profiler */
+  /*! \brief turn on profiler, scopes still open are dropped */
   void TurnON() {
-    CHECK_EQ(state_, kNotRunning) << "Profile is already running.";
-    state_ = kRunning;
+    CHECK(!(mode_.fetch_or(kTrace) & kTrace)) << "Profile is already running.";
+    epoch_.fetch_add(1);
   }
-  /*! \brief turn off profiler */
+  /*! \brief turn off profiler, scopes still open are dropped */
   void TurnOFF() {
-    CHECK_EQ(state_, kRunning) << "Profile is not running.";
-    CHECK(scope_stack_.empty()) << "Profile scope stack is not empty, with size = "
-        << scope_stack_.size();
-    state_ = kNotRunning;
+    CHECK(mode_.fetch_and(~kTrace) & kTrace) << "Profile is not running.";
+    epoch_.fetch_add(1);
   }
+  /*! \brief whether scopes are recorded */
+  bool running() const { return (mode_.load(std::memory_order_relaxed) & kTrace) != 0; }
+  /*! \brief collect layer statistics, off by default, scopes still open
+   *  are dropped */
+  void EnableLayerStats(bool enable) {
+    if (enable) mode_.fetch_or(kStats);
+    else mode_.fetch_and(~kStats);
+    epoch_.fetch_add(1);
+  }
+  /*! \brief statistics of all layers called since the last reset */
+  std::vector<LayerStats> GetLayerStats() const;
+  /*! \brief drop collected layer statistics */
+  void ResetLayerStats();
   /*! \brief timestamp, return in microseconds */
   uint64_t Now() const;
+  /*! \brief buffers of live threads and of exited ones not dumped yet */
+  int num_thread_buffers() const;
 
 private:
   Profiler();
   DISABLE_COPY_AND_ASSIGN(Profiler);
+  struct ThreadBuffer;
+  struct ThreadBufferOwner;
+  struct StatsWindow;
+  ThreadBuffer *GetThreadBuffer();
+  /*! \brief called once the thread of buffer exits */
+  void ReleaseThreadBuffer(ThreadBuffer *buffer);
+  /*! \brief free the buffer of an exited thread, mutex_ held */
+  std::vector<ThreadBuffer*>::iterator FreeExitedBuffer(
+      std::vector<ThreadBuffer*>::iterator it) const;
+  /*! \brief Intern with mutex_ held */
+  int InternLocked(const char *name);
+  void Push(int name_id, int net_id, int stats_id);
+  void Pop();
+  enum Mode {
+    kTrace = 1,
+    kStats = 2,
+  };
 
 private:
-  enum State {
-    kRunning,
-    kNotRunning,
-  };
-  struct Scope {
-    std::string name;
-    uint64_t start_microsec = 0;
-    uint64_t end_microsec = 0;
-  };
-  typedef std::shared_ptr<Scope> ScopePtr;
-  /*! \brief scope stack for nested scope */
-  std::vector<ScopePtr> scope_stack_;
-  /*! \brief all scopes used in profile, not including scopes in stack */
-  std::vector<ScopePtr> scopes_;
+  /*! \brief guards names, nets and the buffer list, not the buffers */
+  mutable std::mutex mutex_;
+  /*! \brief interned names, never moved, threads cache pointers to them */
+  std::deque<std::string> names_;
+  std::unordered_map<std::string, int> name_ids_;
+  std::vector<std::string> net_names_;
+  /*!
+   * \brief buffers of live threads and of exited ones not dumped yet,
+   *  DumpProfile frees the latter
+   */
+  mutable std::vector<ThreadBuffer*> buffers_;
+  mutable int num_exited_buffers_;
+  /*! \brief statistics by id, ids by (name id, type id), never freed */
+  StatsWindow *stats_[kMaxStats];
+  int num_stats_;
+  std::map<std::pair<int, int>, int> stats_ids_;
   /*! \brief init timestamp */
   uint64_t init_;
-  /*! \brief profile state */
-  State state_;
+  /*! \brief profile state, bits of Mode */
+  std::atomic<int> mode_;
+  /*!
+   * \brief changes of mode_, ScopeEnd skips Pop while the mode is 0, so a
+   *  thread drops its open scopes once it sees a new epoch
+   */
+  std::atomic<int> epoch_;
 };  // class Profiler
 
 }  // namespace
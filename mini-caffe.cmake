@@ -1,6 +1,7 @@
 # mini-caffe.cmake
 
 option(USE_MKLDNN "Use mkldnn support" ON)
+option(USE_ALLOC_AUDIT "Count every heap allocation for Net::SetAllocAudit" OFF)
 # select BLAS
 set(BLAS "openblas" CACHE STRING "Selected BLAS library")
 
@@ -8,6 +9,10 @@ if(USE_MKLDNN)
   add_definitions(-DUSE_MKLDNN)
 endif()
 
+if(USE_ALLOC_AUDIT)
+  add_definitions(-DUSE_ALLOC_AUDIT)
+endif()
+
 # turn on C++11
 if(CMAKE_COMPILER_IS_GNUCXX OR (CMAKE_CXX_COMPILER_ID MATCHES "Clang"))
   set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -std=c++11")
@@ -29,7 +34,7 @@ if(MSVC)
 else(MSVC)
   include_directories(${CMAKE_CURRENT_LIST_DIR}/include)
   include_directories(3rdparty/linux/include/mkldnn/)
-  list(APPEND Caffe_LINKER_LIBS protobuf)
+  list(APPEND Caffe_LINKER_LIBS protobuf pthread)
   if(BLAS STREQUAL "openblas")
     list(APPEND Caffe_LINKER_LIBS openblas)
     message(STATUS "Use OpenBLAS for blas library")
@@ -55,6 +60,20 @@ file(GLOB CAFFE_SRC_UTIL ${CMAKE_CURRENT_LIST_DIR}/src/util/*.hpp
 file(GLOB CAFFE_SRC_PROTO ${CMAKE_CURRENT_LIST_DIR}/src/proto/caffe.pb.h
                           ${CMAKE_CURRENT_LIST_DIR}/src/proto/caffe.pb.cc)
 
+# vector math and depthwise convolution kernels are built for their
+# instruction set, the one run is picked by CPUID, see src/util/vmath.hpp
+set(CAFFE_SRC_AVX2 ${CMAKE_CURRENT_LIST_DIR}/src/util/vmath_avx2.cpp
+                   ${CMAKE_CURRENT_LIST_DIR}/src/layers/conv_dw_avx2.cpp)
+set(CAFFE_SRC_AVX512 ${CMAKE_CURRENT_LIST_DIR}/src/util/vmath_avx512.cpp
+                     ${CMAKE_CURRENT_LIST_DIR}/src/layers/conv_dw_avx512.cpp)
+if(MSVC)
+  set_source_files_properties(${CAFFE_SRC_AVX2} PROPERTIES COMPILE_FLAGS "/arch:AVX2")
+  set_source_files_properties(${CAFFE_SRC_AVX512} PROPERTIES COMPILE_FLAGS "/arch:AVX512")
+elseif(CMAKE_SYSTEM_PROCESSOR MATCHES "^(x86_64|AMD64|amd64|i.86)$")
+  set_source_files_properties(${CAFFE_SRC_AVX2} PROPERTIES COMPILE_FLAGS "-mavx2 -mfma")
+  set_source_files_properties(${CAFFE_SRC_AVX512} PROPERTIES COMPILE_FLAGS "-mavx512f")
+endif()
+
 # cpp code
 set(CAFFE_COMPILE_CODE ${CAFFE_INCLUDE}
                        ${CAFFE_SRC}
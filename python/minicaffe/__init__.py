@@ -2,6 +2,8 @@
 """Mini-Caffe: A minimal runtime core of Caffe, Forward only and GPU support"""
 from .net import Net
 from .base import check_gpu_available, set_runtime_mode
+from .base import mem_pool_clear, mem_pool_state, set_mem_pool_logging, set_mem_pool_huge_pages
+from .base import set_conv_tolerance
 from .craft import LayerCrafter
 from .profiler import Profiler
 
@@ -128,3 +128,61 @@ def set_runtime_mode(mode, device_id=-1):
     """
     assert mode == 0 or mode == 1
     check_call(LIB.CaffeSetMode(mode, device_id))
+
+
+def mem_pool_clear():
+    """free memory cached by memory pool and not used by any blob
+    """
+    check_call(LIB.CaffeMemPoolClear())
+
+
+def mem_pool_state():
+    """get memory held by memory pool
+
+    Returns
+    -------
+    cpu_mem: int
+        bytes of host memory in use and cached
+    unused_cpu_mem: int
+        bytes of host memory cached for reuse
+    """
+    cpu_mem = ctypes.c_size_t()
+    unused_cpu_mem = ctypes.c_size_t()
+    check_call(LIB.CaffeMemPoolGetState(ctypes.byref(cpu_mem), ctypes.byref(unused_cpu_mem)))
+    return cpu_mem.value, unused_cpu_mem.value
+
+
+def set_mem_pool_logging(enable):
+    """log memory pool events, plot the log with tools/parse_mem.py
+
+    Parameters
+    ----------
+    enable: bool
+        True to log
+    """
+    check_call(LIB.CaffeMemPoolSetLogging(1 if enable else 0))
+
+
+def set_mem_pool_huge_pages(enable):
+    """back large memory pool blocks by huge pages where supported
+
+    Parameters
+    ----------
+    enable: bool
+        True to use huge pages for new blocks
+    """
+    check_call(LIB.CaffeMemPoolSetHugePages(1 if enable else 0))
+
+
+def set_conv_tolerance(tolerance):
+    """set error reference convolutions may trade for speed, 3x3
+    convolutions run by Winograd from 2e-5 on. Layers choose when they are
+    reshaped, so nets loaded already switch on their next reshape, e.g. a
+    forward with new input shapes
+
+    Parameters
+    ----------
+    tolerance: float
+        0 (default) to keep im2col and GEMM
+    """
+    check_call(LIB.CaffeSetConvTolerance(ctypes.c_float(tolerance)))
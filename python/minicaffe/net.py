@@ -4,12 +4,47 @@
 from __future__ import absolute_import
 from collections import defaultdict
 import ctypes
+import itertools
+import threading
+import numpy as np
 from .base import LIB
-from .base import c_str, py_str, check_call
-from .base import NetHandle, BlobHandle
+from .base import c_str, py_str, check_call, ctypes2numpy_shared
+from .base import NetHandle, BlobHandle, real_t
 from .blob import Blob
 
 
+# CaffeNetCallback of c_api.h
+SubmitCallback = ctypes.CFUNCTYPE(None, ctypes.c_int, ctypes.c_char_p, ctypes.c_int,
+                                  ctypes.POINTER(ctypes.c_char_p),
+                                  ctypes.POINTER(ctypes.POINTER(real_t)),
+                                  ctypes.POINTER(ctypes.c_int), ctypes.c_void_p)
+
+# requests of Net.submit waiting for their callback, by the id given as user_data
+_pending = {}
+_pending_lock = threading.Lock()
+_pending_ids = itertools.count(1)
+
+
+def _on_submit_done(status, error, n, names, data, counts, user_data):
+    """called from the batching thread, outputs are copied before returning"""
+    with _pending_lock:
+        net, callback = _pending.pop(user_data)
+    if status != 0:
+        callback(None, py_str(error))
+        return
+    outputs = {}
+    for i in range(n):
+        name = py_str(names[i])
+        # the blob holds the whole batch during the callback
+        shape = net.get_blob(name).shape[1:]
+        assert counts[i] == int(np.prod(shape))
+        outputs[name] = ctypes2numpy_shared(data[i], shape).copy()
+    callback(outputs, None)
+
+
+_submit_done = SubmitCallback(_on_submit_done)
+
+
 class Net(object):
     """Net in caffe
     """
@@ -22,7 +57,7 @@ class Net(object):
         prototxt: string
             caffe network prototxt file path
         caffemodel: string
-            caffe network caffemodel file path
+            caffe network caffemodel or flat weights file path
         """
         self.handle = NetHandle()
         check_call(LIB.CaffeNetCreate(c_str(prototxt),
@@ -34,6 +69,22 @@ class Net(object):
         """
         check_call(LIB.CaffeNetDestroy(self.handle))
 
+    def create_context(self):
+        """create an execution context sharing weights with this net,
+        every thread can forward its own context
+
+        Returns
+        -------
+        net: Net
+            network with its own internal blobs
+        """
+        net = Net.__new__(Net)
+        net.handle = NetHandle()
+        check_call(LIB.CaffeNetCreateContext(self.handle, ctypes.byref(net.handle)))
+        # weights are owned by this net, keep it alive
+        net.model = self
+        return net
+
     def get_blob(self, name):
         """get blob by name
 
@@ -107,6 +158,160 @@ class Net(object):
         """
         check_call(LIB.CaffeNetMarkOutput(self.handle, c_str(name)))
 
+    def prune_to_outputs(self, names):
+        """remove layers not needed to compute given blobs, they become the
+        only outputs of network
+
+        Parameters
+        ----------
+        names: list(string)
+            blob names to keep as outputs
+        """
+        ctypes_names = (ctypes.c_char_p * len(names))(*[c_str(name) for name in names])
+        check_call(LIB.CaffeNetPruneToOutputs(self.handle, len(names), ctypes_names))
+
+    def save_flat_weights(self, path):
+        """save parameters as flat weights, loading them maps the file
+        instead of parsing it
+
+        Parameters
+        ----------
+        path: string
+            flat weights file path
+        """
+        check_call(LIB.CaffeNetSaveFlatWeights(self.handle, c_str(path)))
+
+    def enable_batching(self, max_batch, timeout_us):
+        """batch requests of `submit` along axis 0 of input blobs, don't
+        call `forward` on this net afterwards
+
+        Parameters
+        ----------
+        max_batch: int
+            max number of requests in one forward
+        timeout_us: int
+            max microseconds a request waits for others to batch
+        """
+        check_call(LIB.CaffeNetEnableBatching(self.handle, max_batch, timeout_us))
+
+    def submit(self, inputs, callback):
+        """submit one request to the batched network, returns without waiting
+
+        Parameters
+        ----------
+        inputs: list(np.array)
+            one sample of every input blob, in order of the Input layer tops,
+            copied before returning
+        callback: function(outputs, error)
+            called from the batching thread, with a dict of output name to
+            the sample of this request and None, or None and the error message
+        """
+        arrays = [np.ascontiguousarray(x, dtype=np.float32) for x in inputs]
+        ctypes_inputs = (ctypes.POINTER(real_t) * len(arrays))(
+            *[x.ctypes.data_as(ctypes.POINTER(real_t)) for x in arrays])
+        with _pending_lock:
+            request_id = next(_pending_ids)
+            _pending[request_id] = (self, callback)
+        try:
+            check_call(LIB.CaffeNetSubmit(self.handle, ctypes_inputs, _submit_done,
+                                          ctypes.c_void_p(request_id)))
+        except:
+            with _pending_lock:
+                _pending.pop(request_id, None)
+            raise
+
+    def set_inter_op_threads(self, num_threads):
+        """run independent layers at the same time in forward
+
+        Parameters
+        ----------
+        num_threads: int
+            max number of layers running concurrently, 1 runs layers in order
+        """
+        check_call(LIB.CaffeNetSetInterOpThreads(self.handle, num_threads))
+
+    def set_intra_op_threads(self, num_threads, spin_us=50, affinity=False):
+        """split loops of reference CPU layers across threads
+
+        Parameters
+        ----------
+        num_threads: int
+            threads working on a layer, 1 runs every layer in one thread
+        spin_us: int
+            microseconds idle threads wait for work before sleeping
+        affinity: bool
+            pin threads to cores
+        """
+        check_call(LIB.CaffeNetSetIntraOpThreads(self.handle, num_threads,
+                                                 spin_us, int(affinity)))
+
+    def set_plan_cache_size(self, size):
+        """keep memory and primitives of recent input shapes, switching back
+        to one of them in forward needs no setup
+
+        Parameters
+        ----------
+        size: int
+            number of input shapes kept besides the current one, 0 by default
+        """
+        check_call(LIB.CaffeNetSetPlanCacheSize(self.handle, size))
+
+    def set_alloc_audit(self, warmup):
+        """log layers allocating host memory in forward, for debugging
+
+        Parameters
+        ----------
+        warmup: int
+            forwards with new input shapes before auditing starts, 0 turns
+            the audit off
+        """
+        check_call(LIB.CaffeNetSetAllocAudit(self.handle, warmup))
+
+    @property
+    def audited_allocations(self):
+        """number of allocations found by the audit since it was turned on"""
+        count = ctypes.c_size_t()
+        check_call(LIB.CaffeNetGetAuditedAllocations(self.handle, ctypes.byref(count)))
+        return count.value
+
+    def layer_costs(self):
+        """static cost of every layer at shapes of the last forward
+
+        Returns
+        -------
+        costs: list(dict)
+            name, type, macs (multiply-accumulates), input_bytes,
+            output_bytes, param_bytes and workspace_bytes of every layer
+        """
+        n = ctypes.c_int()
+        names = ctypes.POINTER(ctypes.c_char_p)()
+        types = ctypes.POINTER(ctypes.c_char_p)()
+        values = ctypes.POINTER(ctypes.c_double)()
+        check_call(LIB.CaffeNetGetLayerCosts(self.handle, ctypes.byref(n), ctypes.byref(names),
+                                             ctypes.byref(types), ctypes.byref(values)))
+        keys = ['macs', 'input_bytes', 'output_bytes', 'param_bytes', 'workspace_bytes']
+        costs = []
+        for i in range(n.value):
+            layer = {'name': py_str(names[i]), 'type': py_str(types[i])}
+            for j, key in enumerate(keys):
+                layer[key] = int(values[i * len(keys) + j])
+            costs.append(layer)
+        return costs
+
+    def log_roofline(self, peak_gflops, peak_gbps):
+        """log layer costs against a roofline, layers timed by
+        Profiler.enable_layer_stats also get their achieved GFLOP/s and GB/s
+
+        Parameters
+        ----------
+        peak_gflops: float
+            peak compute in GFLOP/s
+        peak_gbps: float
+            peak memory bandwidth in GB/s
+        """
+        check_call(LIB.CaffeNetLogRoofline(self.handle, ctypes.c_double(peak_gflops),
+                                           ctypes.c_double(peak_gbps)))
+
     def forward(self, **kwargs):
         """forward network, need to fill data blobs before call this function
 
@@ -120,3 +325,19 @@ class Net(object):
             blob.reshape(*v.shape)
             blob.data[...] = v
         check_call(LIB.CaffeNetForward(self.handle))
+
+    def forward_to(self, name, **kwargs):
+        """forward only the layers needed to compute a blob
+
+        Parameters
+        ==========
+        name: string
+            blob name, its data is valid until next forward
+        kwargs: dict(str: np.array)
+            input blob map
+        """
+        for k, v in kwargs.items():
+            blob = self.get_blob(k)
+            blob.reshape(*v.shape)
+            blob.data[...] = v
+        check_call(LIB.CaffeNetForwardTo(self.handle, c_str(name)))
@@ -1,8 +1,9 @@
 # coding = utf-8
 # pylint: disable=invalid-name
 """Profiler in mini-caffe"""
+import ctypes
 from .base import LIB
-from .base import c_str, check_call
+from .base import c_str, py_str, check_call
 
 
 class Profiler(object):
@@ -48,3 +49,46 @@ class Profiler(object):
             file path to save profiler data
         """
         check_call(LIB.CaffeProfilerDump(c_str(fn)))
+
+    @staticmethod
+    def enable_layer_stats(enable=True):
+        """collect latency statistics of every layer, independent of the trace
+
+        Parameters
+        ----------
+        enable: bool
+            False stops collecting
+        """
+        check_call(LIB.CaffeProfilerEnableLayerStats(int(enable)))
+
+    @staticmethod
+    def reset_layer_stats():
+        """drop collected layer statistics
+        """
+        check_call(LIB.CaffeProfilerResetLayerStats())
+
+    @staticmethod
+    def layer_stats():
+        """get layer statistics, times in microseconds over the latest calls
+
+        Returns
+        -------
+        stats: list(dict)
+            name, type, count since reset, mean, p50, p90, p99, min and max
+            of every layer called since reset
+        """
+        n = ctypes.c_int()
+        names = ctypes.POINTER(ctypes.c_char_p)()
+        types = ctypes.POINTER(ctypes.c_char_p)()
+        values = ctypes.POINTER(ctypes.c_double)()
+        check_call(LIB.CaffeProfilerGetLayerStats(ctypes.byref(n), ctypes.byref(names),
+                                                  ctypes.byref(types), ctypes.byref(values)))
+        keys = ['count', 'mean', 'p50', 'p90', 'p99', 'min', 'max']
+        stats = []
+        for i in range(n.value):
+            layer = {'name': py_str(names[i]), 'type': py_str(types[i])}
+            for j, key in enumerate(keys):
+                layer[key] = values[i * len(keys) + j]
+            layer['count'] = int(layer['count'])
+            stats.append(layer)
+        return stats
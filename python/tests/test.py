@@ -5,6 +5,7 @@ from __future__ import print_function
 import os
 import sys
 import time
+import threading
 import numpy as np
 
 
@@ -79,7 +80,236 @@ def test_network():
     print('}')
 
 
+def test_context():
+    """test execution contexts sharing weights"""
+    net = mcaffe.Net(os.path.join(model_dir, 'resnet.prototxt'),
+                     os.path.join(model_dir, 'resnet.caffemodel'))
+    shape = net.get_blob('data').shape
+    data = np.random.rand(*shape).astype(np.float32)
+    net.forward(data=data)
+    output = net.blobs['prob'].data.copy()
+    contexts = [net.create_context() for _ in range(4)]
+    results = [None] * len(contexts)
+    def run(i):
+        contexts[i].forward(data=data)
+        results[i] = contexts[i].blobs['prob'].data.copy()
+    threads = [threading.Thread(target=run, args=(i,)) for i in range(len(contexts))]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    for result in results:
+        assert np.allclose(output, result, atol=1e-5)
+
+
+def test_batching():
+    """test requests submitted from many threads get the outputs of a
+    forward of their sample alone"""
+    net = mcaffe.Net(os.path.join(model_dir, 'resnet.prototxt'),
+                     os.path.join(model_dir, 'resnet.caffemodel'))
+    shape = [1] + net.get_blob('data').shape[1:]
+    samples = [np.random.rand(*shape).astype(np.float32) for _ in range(16)]
+    expected = []
+    for x in samples:
+        net.forward(data=x)
+        expected.append(net.blobs['prob'].data[0].copy())
+    net.enable_batching(4, 2000)
+    results = [None] * len(samples)
+    done = threading.Semaphore(0)
+    def submit(i):
+        def callback(outputs, error):
+            results[i] = (outputs, error)
+            done.release()
+        net.submit([samples[i]], callback)
+    threads = [threading.Thread(target=submit, args=(i,)) for i in range(len(samples))]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    for _ in samples:
+        done.acquire()
+    for (outputs, error), output in zip(results, expected):
+        assert error is None
+        assert np.allclose(outputs['prob'], output, atol=1e-5)
+
+
+def test_plan_cache():
+    """test switching between cached input shapes"""
+    net = mcaffe.Net(os.path.join(model_dir, 'resnet.prototxt'),
+                     os.path.join(model_dir, 'resnet.caffemodel'))
+    shape = net.get_blob('data').shape
+    shapes = [shape, [2] + shape[1:]]
+    data = [np.random.rand(*s).astype(np.float32) for s in shapes]
+    outputs = []
+    for x in data:
+        net.forward(data=x)
+        outputs.append(net.blobs['prob'].data.copy())
+    net.set_plan_cache_size(2)
+    for _ in range(2):
+        for x, output in zip(data, outputs):
+            net.forward(data=x)
+            assert np.allclose(output, net.blobs['prob'].data, atol=1e-5)
+
+
+def test_intra_op_threads():
+    """test layers split across threads compute the same outputs"""
+    net = mcaffe.Net(os.path.join(model_dir, 'resnet.prototxt'),
+                     os.path.join(model_dir, 'resnet.caffemodel'))
+    shape = net.get_blob('data').shape
+    data = np.random.rand(*shape).astype(np.float32)
+    net.forward(data=data)
+    output = net.blobs['prob'].data.copy()
+    net.set_intra_op_threads(4)
+    for _ in range(2):
+        net.forward(data=data)
+        assert np.allclose(output, net.blobs['prob'].data, atol=1e-5)
+
+
+def test_flat_weights():
+    """test loading parameters from flat weights"""
+    prototxt = os.path.join(model_dir, 'resnet.prototxt')
+    net = mcaffe.Net(prototxt, os.path.join(model_dir, 'resnet.caffemodel'))
+    flat = os.path.join(model_dir, 'resnet.flat')
+    net.save_flat_weights(flat)
+    mapped = mcaffe.Net(prototxt, flat)
+    shape = net.get_blob('data').shape
+    data = np.random.rand(*shape).astype(np.float32)
+    net.forward(data=data)
+    mapped.forward(data=data)
+    assert np.allclose(net.blobs['prob'].data, mapped.blobs['prob'].data, atol=1e-5)
+
+
+def test_mem_pool():
+    """test memory pool state"""
+    net = mcaffe.Net(os.path.join(model_dir, 'resnet.prototxt'),
+                     os.path.join(model_dir, 'resnet.caffemodel'))
+    net.forward()
+    cpu_mem, unused_cpu_mem = mcaffe.mem_pool_state()
+    assert cpu_mem > 0 and unused_cpu_mem <= cpu_mem
+    del net
+    mcaffe.mem_pool_clear()
+    cpu_mem_cleared, unused_cpu_mem = mcaffe.mem_pool_state()
+    assert unused_cpu_mem == 0 and cpu_mem_cleared < cpu_mem
+
+
+def test_alloc_audit():
+    """test steady state forward allocates no blob memory"""
+    net = mcaffe.Net(os.path.join(model_dir, 'resnet.prototxt'),
+                     os.path.join(model_dir, 'resnet.caffemodel'))
+    net.set_alloc_audit(1)
+    for _ in range(3):
+        net.forward()
+    assert net.audited_allocations == 0
+
+
+def with_conv_algorithm(prototxt, algorithm):
+    """copy of prototxt whose convolutions all run algorithm"""
+    with open(prototxt) as f:
+        text = f.read()
+    text = text.replace('convolution_param {',
+                        'convolution_param {\n    conv_algorithm: "%s"' % algorithm)
+    path = '%s.%s' % (prototxt, algorithm)
+    with open(path, 'w') as f:
+        f.write(text)
+    return path
+
+
+def test_conv_tolerance():
+    """test Winograd convolutions stay close to im2col and GEMM"""
+    prototxt = os.path.join(model_dir, 'resnet.prototxt')
+    caffemodel = os.path.join(model_dir, 'resnet.caffemodel')
+    direct = mcaffe.Net(with_conv_algorithm(prototxt, 'direct'), caffemodel)
+    winograd = mcaffe.Net(with_conv_algorithm(prototxt, 'winograd'), caffemodel)
+    shape = direct.get_blob('data').shape
+    data = np.random.rand(*shape).astype(np.float32)
+    # every blob stays alive to compare convolution outputs
+    for name in direct.blobs:
+        direct.mark_output(name)
+        winograd.mark_output(name)
+    direct.forward(data=data)
+    winograd.forward(data=data)
+    convs = [layer['name'] for layer in direct.layer_costs()
+             if layer['type'] == 'Convolution']
+    assert len(convs) > 0
+    winograd_blobs = winograd.blobs
+    for name, blob in list(direct.blobs.items()):
+        if name not in convs:
+            continue
+        expected = blob.data
+        scale = np.abs(expected).max()
+        error = np.abs(winograd_blobs[name].data - expected).max()
+        # error of F(4x4, 3x3) relative to the largest output, see
+        # kWinogradF43Error
+        assert error <= 1e-4 * scale, '%s: %g of %g' % (name, error, scale)
+    # Winograd is opt-in, the default tolerance keeps im2col and GEMM
+    net = mcaffe.Net(prototxt, caffemodel)
+    net.forward(data=data)
+    assert np.array_equal(net.blobs['prob'].data, direct.blobs['prob'].data)
+
+
+def test_prune():
+    """test running part of network"""
+    prototxt = os.path.join(model_dir, 'resnet.prototxt')
+    caffemodel = os.path.join(model_dir, 'resnet.caffemodel')
+    net = mcaffe.Net(prototxt, caffemodel)
+    net.mark_output('conv1')
+    shape = net.get_blob('data').shape
+    data = np.random.rand(*shape).astype(np.float32)
+    net.forward(data=data)
+    output = net.blobs['conv1'].data.copy()
+    net.forward_to('conv1', data=data)
+    assert np.allclose(output, net.blobs['conv1'].data, atol=1e-5)
+    pruned = mcaffe.Net(prototxt, caffemodel)
+    pruned.prune_to_outputs(['conv1'])
+    assert 'prob' not in pruned.blobs
+    pruned.forward(data=data)
+    assert np.allclose(output, pruned.blobs['conv1'].data, atol=1e-5)
+
+
+def test_layer_stats():
+    """test per layer latency statistics"""
+    net = mcaffe.Net(os.path.join(model_dir, 'resnet.prototxt'),
+                     os.path.join(model_dir, 'resnet.caffemodel'))
+    mcaffe.Profiler.reset_layer_stats()
+    mcaffe.Profiler.enable_layer_stats()
+    for _ in range(3):
+        net.forward()
+    mcaffe.Profiler.enable_layer_stats(False)
+    stats = mcaffe.Profiler.layer_stats()
+    assert len(stats) > 0
+    for layer in stats:
+        assert layer['count'] == 3
+        assert layer['min'] <= layer['p50'] <= layer['p90'] <= layer['p99'] <= layer['max']
+    mcaffe.Profiler.reset_layer_stats()
+    assert len(mcaffe.Profiler.layer_stats()) == 0
+
+
+def test_layer_costs():
+    """test static layer costs"""
+    net = mcaffe.Net(os.path.join(model_dir, 'resnet.prototxt'),
+                     os.path.join(model_dir, 'resnet.caffemodel'))
+    net.forward()
+    costs = net.layer_costs()
+    assert len(costs) > 0
+    assert sum(layer['macs'] for layer in costs) > 0
+    for layer in costs:
+        if layer['type'] == 'Convolution':
+            assert layer['macs'] > 0 and layer['param_bytes'] > 0
+    net.log_roofline(1000., 100.)
+
+
 if __name__ == '__main__':
     # test crafter
     test_crafter()
     test_network()
+    test_context()
+    test_batching()
+    test_plan_cache()
+    test_prune()
+    test_intra_op_threads()
+    test_flat_weights()
+    test_mem_pool()
+    test_alloc_audit()
+    test_conv_tolerance()
+    test_layer_stats()
+    test_layer_costs()
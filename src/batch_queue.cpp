@@ -0,0 +1,134 @@
+#include <algorithm>
+
+#include "./batch_queue.hpp"
+
+namespace caffe {
+
+BatchQueue::BatchQueue(Net* net, int max_batch, int timeout_us)
+    : net_(net), max_batch_(max_batch), timeout_(timeout_us), stop_(false) {
+  CHECK(net_);
+  CHECK_GT(max_batch_, 0) << "max batch should be positive";
+  CHECK_GE(timeout_us, 0) << "timeout should not be negative";
+  for (int blob_id : net_->top_ids(0)) {
+    shared_ptr<Blob> blob = net_->blobs()[blob_id];
+    CHECK_GT(blob->num_axes(), 0) << "input " << blob->name() << " has no batch axis";
+    std::vector<int> shape(blob->shape().begin() + 1, blob->shape().end());
+    inputs_.push_back(blob);
+    sample_counts_.push_back(blob->count(1));
+    sample_shapes_.push_back(shape);
+  }
+  output_names_ = net_->output_blob_names();
+  // one plan per padded batch size, the current one isn't in the cache
+  int num_sizes = 1;
+  for (int num = 1; num < max_batch_; num = BatchSize(num + 1)) ++num_sizes;
+  if (net_->plan_cache_size() < num_sizes - 1) {
+    net_->SetPlanCacheSize(num_sizes - 1);
+  }
+  worker_ = std::thread([this]() { WorkerLoop(); });
+}
+
+BatchQueue::~BatchQueue() {
+  Stop();
+}
+
+void BatchQueue::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  if (worker_.joinable()) worker_.join();
+}
+
+int BatchQueue::BatchSize(int num) const {
+  int size = 1;
+  while (size < num) size *= 2;
+  return std::min(size, max_batch_);
+}
+
+void BatchQueue::Submit(const std::vector<const real_t*>& inputs, Callback callback) {
+  CHECK_EQ(inputs.size(), inputs_.size()) << "every input blob needs data";
+  Request request;
+  request.inputs.resize(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    request.inputs[i].assign(inputs[i], inputs[i] + sample_counts_[i]);
+  }
+  request.callback = std::move(callback);
+  request.arrive = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CHECK(!stop_) << "BatchQueue is stopped";
+    queue_.push_back(std::move(request));
+  }
+  cond_.notify_all();
+}
+
+void BatchQueue::WorkerLoop() {
+  std::vector<Request> batch;
+  batch.reserve(max_batch_);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) return;
+      // wait for more requests, but not longer than the oldest may wait
+      auto deadline = queue_.front().arrive + timeout_;
+      cond_.wait_until(lock, deadline, [this]() {
+        return stop_ || queue_.size() >= static_cast<size_t>(max_batch_);
+      });
+      const int num = std::min<int>(queue_.size(), max_batch_);
+      for (int i = 0; i < num; ++i) {
+        batch.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+    }
+    RunBatch(batch);
+    batch.clear();
+  }
+}
+
+void BatchQueue::RunBatch(std::vector<Request>& batch) {
+  const int num = batch.size();
+  const int batch_size = BatchSize(num);
+  std::vector<const real_t*> data(output_names_.size());
+  std::vector<int> counts(output_names_.size());
+  std::vector<shared_ptr<Blob> > outputs;
+  try {
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+      std::vector<int> shape(1, batch_size);
+      shape.insert(shape.end(), sample_shapes_[i].begin(), sample_shapes_[i].end());
+      inputs_[i]->Reshape(shape);
+      real_t* input_data = inputs_[i]->mutable_cpu_data();
+      for (int n = 0; n < num; ++n) {
+        std::copy(batch[n].inputs[i].begin(), batch[n].inputs[i].end(),
+                  input_data + n * sample_counts_[i]);
+      }
+      // outputs of padding samples are dropped
+      std::fill(input_data + num * sample_counts_[i],
+                input_data + batch_size * sample_counts_[i], real_t(0));
+    }
+    net_->Forward();
+    for (size_t k = 0; k < output_names_.size(); ++k) {
+      shared_ptr<Blob> blob = net_->blob_by_name(output_names_[k]);
+      CHECK(blob->num_axes() > 0 && blob->shape(0) == batch_size)
+          << "output " << output_names_[k] << " with shape "
+          << blob->shape_string() << " can't be split into " << batch_size << " samples";
+      outputs.push_back(blob);
+      counts[k] = blob->count(1);
+    }
+  }
+  catch (std::exception& e) {
+    for (auto& request : batch) {
+      request.callback(data, counts, e.what());
+    }
+    return;
+  }
+  for (int n = 0; n < num; ++n) {
+    for (size_t k = 0; k < outputs.size(); ++k) {
+      data[k] = outputs[k]->cpu_data() + n * counts[k];
+    }
+    batch[n].callback(data, counts, NULL);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,88 @@
+#ifndef CAFFE_BATCH_QUEUE_HPP_
+#define CAFFE_BATCH_QUEUE_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "caffe/net.hpp"
+
+namespace caffe {
+
+/*!
+ * \brief Coalesce single sample requests into one batched Forward.
+ *
+ *  Requests queue up until max_batch of them wait or the oldest one waited
+ *  timeout_us. Their inputs are stacked along axis 0 of the input blobs, the
+ *  Net runs once, and every callback gets its own sample of every output.
+ *  Batches are padded to a power of 2 (or max_batch) and the plan cache of
+ *  the Net grows to hold every such size, so changing load doesn't plan
+ *  memory again. The Net is owned by the batching thread, don't Forward it
+ *  elsewhere, and it must outlive the queue or its Stop.
+ */
+class BatchQueue {
+ public:
+  /*!
+   * \brief called from the batching thread when a request is done
+   * \param data one sample of every output blob, valid during the call
+   * \param counts element count of every output sample
+   * \param error NULL on success, else the error message
+   */
+  typedef std::function<void(const std::vector<const real_t*>& data,
+                             const std::vector<int>& counts,
+                             const char* error)> Callback;
+
+  BatchQueue(Net* net, int max_batch, int timeout_us);
+  /*! \brief calls Stop */
+  ~BatchQueue();
+  /*!
+   * \brief finish queued requests and join the batching thread, the Net is
+   *  not used after it returns. Submit fails afterwards.
+   */
+  void Stop();
+  /*!
+   * \brief queue one sample, inputs are copied before returning
+   * \param inputs one sample of every input blob, in Input layer order
+   */
+  void Submit(const std::vector<const real_t*>& inputs, Callback callback);
+  /*! \brief number of input blobs, a sample of each is submitted */
+  int num_inputs() const { return static_cast<int>(inputs_.size()); }
+  /*! \brief names of output blobs, in the order of callback data */
+  const std::vector<std::string>& output_names() const { return output_names_; }
+
+ private:
+  struct Request {
+    std::vector<std::vector<real_t> > inputs;
+    Callback callback;
+    std::chrono::steady_clock::time_point arrive;
+  };
+  void WorkerLoop();
+  void RunBatch(std::vector<Request>& batch);
+  /*! \brief padded size of a batch of num requests */
+  int BatchSize(int num) const;
+
+  Net* net_;
+  int max_batch_;
+  std::chrono::microseconds timeout_;
+  std::vector<shared_ptr<Blob> > inputs_;
+  /*! \brief input shapes without axis 0 */
+  std::vector<std::vector<int> > sample_shapes_;
+  std::vector<int> sample_counts_;
+  std::vector<std::string> output_names_;
+  std::deque<Request> queue_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stop_;
+  std::thread worker_;
+
+  DISABLE_COPY_AND_ASSIGN(BatchQueue);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_BATCH_QUEUE_HPP_
@@ -88,10 +88,8 @@ void Blob::ShareData(const Blob& other) {
 }
 
 void Blob::ResetMemory() {
-  if (!own_data_) {
-    own_data_ = true;
-    data_.reset(new SyncedMemory(capacity_ * sizeof(real_t)));
-  }
+  own_data_ = true;
+  data_.reset(new SyncedMemory(capacity_ * sizeof(real_t)));
 }
 
 bool Blob::ShapeEquals(const BlobProto& other) {
@@ -128,7 +126,7 @@ void Blob::CopyFrom(const Blob& source, bool reshape) {
              static_cast<real_t*>(data_->mutable_cpu_data()));
 }
 
-void Blob::FromProto(const BlobProto& proto, bool reshape) {
+void Blob::FromProto(const BlobProto& proto, bool reshape, bool shape_only) {
   if (reshape) {
     vector<int> shape;
     if (proto.has_num() || proto.has_channels() ||
@@ -150,6 +148,10 @@ void Blob::FromProto(const BlobProto& proto, bool reshape) {
   } else {
     CHECK(ShapeEquals(proto)) << "shape mismatch (reshape not set)";
   }
+  // shape only, data is bound later (see Net::InitFromFlatWeights)
+  if (shape_only && proto.data_size() == 0 && proto.double_data_size() == 0) {
+    return;
+  }
   // copy data
   real_t* data_vec = mutable_cpu_data();
   if (proto.double_data_size() > 0) {
@@ -1,9 +1,11 @@
+#include <map>
 #include <mutex>
 
 #include "caffe/c_api.h"
 #include "caffe/blob.hpp"
 #include "caffe/net.hpp"
 #include "caffe/profiler.hpp"
+#include "./batch_queue.hpp"
 #include "./thread_local.hpp"
 
 #define API_BEGIN() try {
@@ -56,11 +58,20 @@ int CaffeBlobShape(BlobHandle blob, int* shape_size, int** shape) {
   API_END();
 }
 
+// batching queues of nets, see CaffeNetEnableBatching
+struct BatchQueueRegistry {
+  std::mutex mutex;
+  std::map<caffe::Net*, std::shared_ptr<caffe::BatchQueue> > queues;
+  static BatchQueueRegistry *Get() {
+    static BatchQueueRegistry inst;
+    return &inst;
+  }
+};
+
 int CaffeNetCreate(const char *net_path, const char *model_path,
                    NetHandle *net) {
   API_BEGIN();
-  caffe::Net *net_ = new caffe::Net(net_path);
-  net_->CopyTrainedLayersFrom(model_path);
+  caffe::Net *net_ = new caffe::Net(net_path, model_path);
   *net = static_cast<NetHandle>(net_);
   API_END();
 }
@@ -69,22 +80,46 @@ int CaffeNetCreateFromBuffer(const char *net_buffer, int nb_len,
                              const char *model_buffer, int mb_len,
                              NetHandle *net) {
   API_BEGIN();
-  std::shared_ptr<caffe::NetParameter> np;
-  np = caffe::ReadBinaryNetParameterFromBuffer(model_buffer, mb_len);
+  std::shared_ptr<caffe::NetParameter> np, mp;
   np = caffe::ReadTextNetParameterFromBuffer(net_buffer, nb_len);
-  caffe::Net *net_ = new caffe::Net(*np.get());
-  np = caffe::ReadBinaryNetParameterFromBuffer(model_buffer, mb_len);
-  net_->CopyTrainedLayersFrom(*np.get());
+  mp = caffe::ReadBinaryNetParameterFromBuffer(model_buffer, mb_len);
+  caffe::Net *net_ = new caffe::Net(*np.get(), mp.get());
+  *net = static_cast<NetHandle>(net_);
+  API_END();
+}
+
+int CaffeNetCreateContext(NetHandle model, NetHandle *net) {
+  API_BEGIN();
+  caffe::Net *net_ = new caffe::Net(static_cast<caffe::Net*>(model));
   *net = static_cast<NetHandle>(net_);
   API_END();
 }
 
 int CaffeNetDestroy(NetHandle net) {
   API_BEGIN();
+  std::shared_ptr<caffe::BatchQueue> queue;
+  {
+    auto *registry = BatchQueueRegistry::Get();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    auto it = registry->queues.find(static_cast<caffe::Net*>(net));
+    if (it != registry->queues.end()) {
+      queue = it->second;
+      registry->queues.erase(it);
+    }
+  }
+  // finish queued requests before the net goes away, a concurrent Submit
+  // may still hold the queue but can't reach the net anymore
+  if (queue) queue->Stop();
   delete static_cast<caffe::Net*>(net);
   API_END();
 }
 
+int CaffeNetSaveFlatWeights(NetHandle net, const char *path) {
+  API_BEGIN();
+  static_cast<caffe::Net*>(net)->SaveFlatWeights(path);
+  API_END();
+}
+
 int CaffeNetMarkOutput(NetHandle net, const char *name) {
   API_BEGIN();
   static_cast<caffe::Net*>(net)->MarkOutputs({name});
@@ -97,6 +132,141 @@ int CaffeNetForward(NetHandle net) {
   API_END();
 }
 
+int CaffeNetForwardTo(NetHandle net, const char *name) {
+  API_BEGIN();
+  static_cast<caffe::Net*>(net)->ForwardTo(name, true);
+  API_END();
+}
+
+int CaffeNetPruneToOutputs(NetHandle net, int n, const char **names) {
+  API_BEGIN();
+  std::vector<std::string> outs(names, names + n);
+  static_cast<caffe::Net*>(net)->PruneToOutputs(outs);
+  API_END();
+}
+
+int CaffeNetEnableBatching(NetHandle net, int max_batch, int timeout_us) {
+  API_BEGIN();
+  caffe::Net *net_ = static_cast<caffe::Net*>(net);
+  auto *registry = BatchQueueRegistry::Get();
+  std::shared_ptr<caffe::BatchQueue> queue;
+  {
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    auto it = registry->queues.find(net_);
+    if (it != registry->queues.end()) {
+      queue = it->second;
+      registry->queues.erase(it);
+    }
+  }
+  // only one batching thread may run the net
+  if (queue) queue->Stop();
+  queue.reset(new caffe::BatchQueue(net_, max_batch, timeout_us));
+  std::lock_guard<std::mutex> lock(registry->mutex);
+  registry->queues[net_] = queue;
+  API_END();
+}
+
+int CaffeNetSubmit(NetHandle net, const real_t **inputs,
+                   CaffeNetCallback callback, void *user_data) {
+  API_BEGIN();
+  std::shared_ptr<caffe::BatchQueue> queue;
+  {
+    auto *registry = BatchQueueRegistry::Get();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    auto it = registry->queues.find(static_cast<caffe::Net*>(net));
+    CHECK(it != registry->queues.end()) << "batching is not enabled, call CaffeNetEnableBatching";
+    queue = it->second;
+  }
+  // the net may be destroyed meanwhile, only the queue is used from here
+  std::vector<const real_t*> inputs_(inputs, inputs + queue->num_inputs());
+  // the callback may outlive the queue, it keeps its own names
+  std::vector<std::string> names_ = queue->output_names();
+  queue->Submit(inputs_, [callback, user_data, names_](
+      const std::vector<const real_t*> &data, const std::vector<int> &counts,
+      const char *error) {
+    std::vector<const char*> names(names_.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+      names[i] = names_[i].c_str();
+    }
+    callback(error ? -1 : 0, error, static_cast<int>(names.size()), names.data(),
+             const_cast<const real_t**>(data.data()), counts.data(), user_data);
+  });
+  API_END();
+}
+
+int CaffeNetSetInterOpThreads(NetHandle net, int num_threads) {
+  API_BEGIN();
+  static_cast<caffe::Net*>(net)->SetInterOpThreads(num_threads);
+  API_END();
+}
+
+int CaffeNetSetIntraOpThreads(NetHandle net, int num_threads,
+                              int spin_us, int affinity) {
+  API_BEGIN();
+  static_cast<caffe::Net*>(net)->SetIntraOpThreads(num_threads, spin_us, affinity != 0);
+  API_END();
+}
+
+int CaffeNetSetPlanCacheSize(NetHandle net, int size) {
+  API_BEGIN();
+  static_cast<caffe::Net*>(net)->SetPlanCacheSize(size);
+  API_END();
+}
+
+int CaffeNetSetAllocAudit(NetHandle net, int warmup) {
+  API_BEGIN();
+  static_cast<caffe::Net*>(net)->SetAllocAudit(warmup);
+  API_END();
+}
+
+int CaffeNetGetAuditedAllocations(NetHandle net, size_t *count) {
+  API_BEGIN();
+  *count = static_cast<caffe::Net*>(net)->audited_allocations();
+  API_END();
+}
+
+struct LayerCostsEntry {
+  std::vector<caffe::Net::LayerCost> costs;
+  std::vector<const char*> names;
+  std::vector<const char*> types;
+  std::vector<double> values;
+};
+
+typedef ThreadLocalStore<LayerCostsEntry> LayerCostsStore;
+
+int CaffeNetGetLayerCosts(NetHandle net, int *n, const char ***names,
+                          const char ***types, const double **costs) {
+  API_BEGIN();
+  auto *ret = LayerCostsStore::Get();
+  ret->costs = static_cast<caffe::Net*>(net)->GetLayerCosts();
+  const int num = ret->costs.size();
+  ret->names.resize(num);
+  ret->types.resize(num);
+  ret->values.resize(num * 5);
+  for (int i = 0; i < num; ++i) {
+    const caffe::Net::LayerCost &layer = ret->costs[i];
+    ret->names[i] = layer.name.c_str();
+    ret->types[i] = layer.type.c_str();
+    double *values = &ret->values[i * 5];
+    values[0] = static_cast<double>(layer.macs);
+    values[1] = static_cast<double>(layer.input_bytes);
+    values[2] = static_cast<double>(layer.output_bytes);
+    values[3] = static_cast<double>(layer.param_bytes);
+    values[4] = static_cast<double>(layer.workspace_bytes);
+  }
+  *n = num;
+  *names = ret->names.data();
+  *types = ret->types.data();
+  *costs = ret->values.data();
+  API_END();
+}
+
+int CaffeNetLogRoofline(NetHandle net, double peak_gflops, double peak_gbps) {
+  API_BEGIN();
+  static_cast<caffe::Net*>(net)->LogRoofline(peak_gflops, peak_gbps);
+  API_END();
+}
+
 int CaffeNetGetBlob(NetHandle net, const char *name, BlobHandle *blob) {
   API_BEGIN();
   std::shared_ptr<caffe::Blob> blob_ = static_cast<caffe::Net*>(net)->blob_by_name(name);
@@ -134,6 +304,56 @@ int CaffeProfilerDump(const char *fn) {
   API_END();
 }
 
+int CaffeProfilerEnableLayerStats(int enable) {
+  API_BEGIN();
+  caffe::Profiler::Get()->EnableLayerStats(enable != 0);
+  API_END();
+}
+
+int CaffeProfilerResetLayerStats() {
+  API_BEGIN();
+  caffe::Profiler::Get()->ResetLayerStats();
+  API_END();
+}
+
+struct LayerStatsEntry {
+  std::vector<caffe::Profiler::LayerStats> stats;
+  std::vector<const char*> names;
+  std::vector<const char*> types;
+  std::vector<double> values;
+};
+
+typedef ThreadLocalStore<LayerStatsEntry> LayerStatsStore;
+
+int CaffeProfilerGetLayerStats(int *n, const char ***names,
+                               const char ***types, const double **stats) {
+  API_BEGIN();
+  auto *ret = LayerStatsStore::Get();
+  ret->stats = caffe::Profiler::Get()->GetLayerStats();
+  const int num = ret->stats.size();
+  ret->names.resize(num);
+  ret->types.resize(num);
+  ret->values.resize(num * 7);
+  for (int i = 0; i < num; ++i) {
+    const caffe::Profiler::LayerStats &layer = ret->stats[i];
+    ret->names[i] = layer.name.c_str();
+    ret->types[i] = layer.type.c_str();
+    double *values = &ret->values[i * 7];
+    values[0] = static_cast<double>(layer.count);
+    values[1] = layer.mean;
+    values[2] = layer.p50;
+    values[3] = layer.p90;
+    values[4] = layer.p99;
+    values[5] = layer.min;
+    values[6] = layer.max;
+  }
+  *n = num;
+  *names = ret->names.data();
+  *types = ret->types.data();
+  *stats = ret->values.data();
+  API_END();
+}
+
 struct BlobsEntry {
   std::vector<const char*> vec_charp;
   std::vector<void*> vec_handle;
@@ -201,6 +421,38 @@ int CaffeSetMode(int mode, int device) {
   API_END();
 }
 
+int CaffeMemPoolClear() {
+  API_BEGIN();
+  caffe::MemPoolClear();
+  API_END();
+}
+
+int CaffeMemPoolGetState(size_t *cpu_mem, size_t *unused_cpu_mem) {
+  API_BEGIN();
+  caffe::MemPoolState state = caffe::MemPoolGetState();
+  *cpu_mem = state.cpu_mem;
+  *unused_cpu_mem = state.unused_cpu_mem;
+  API_END();
+}
+
+int CaffeMemPoolSetLogging(int enable) {
+  API_BEGIN();
+  caffe::MemPoolSetLogging(enable != 0);
+  API_END();
+}
+
+int CaffeMemPoolSetHugePages(int enable) {
+  API_BEGIN();
+  caffe::MemPoolSetHugePages(enable != 0);
+  API_END();
+}
+
+int CaffeSetConvTolerance(float tolerance) {
+  API_BEGIN();
+  caffe::SetConvTolerance(tolerance);
+  API_END();
+}
+
 // Helper
 
 struct ErrorEntry {
@@ -1,3 +1,5 @@
+#include <atomic>
+
 #include "caffe/base.hpp"
 #include "./common.hpp"
 #include "./thread_local.hpp"
@@ -132,6 +134,21 @@ bool GPUAvailable() {
 #endif  // USE_CUDA
 }
 
+namespace {
+
+std::atomic<float> conv_tolerance(0.f);
+
+}  // namespace
+
+void SetConvTolerance(float tolerance) {
+  CHECK_GE(tolerance, 0) << "Convolution tolerance must not be negative";
+  conv_tolerance = tolerance;
+}
+
+float GetConvTolerance() {
+  return conv_tolerance;
+}
+
 void SetMode(DeviceMode mode, int device) {
   switch (mode) {
   case CPU:
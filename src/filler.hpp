@@ -8,6 +8,7 @@
 #include <string>
 
 #include "caffe/blob.hpp"
+#include "./thread_local.hpp"
 #include "./util/math_functions.hpp"
 #include "./proto/caffe.pb.h"
 
@@ -23,6 +24,23 @@ class Filler {
   FillerParameter filler_param_;
 };  // class Filler
 
+/**
+ * @brief While alive, fillers of the calling thread leave blobs unallocated,
+ *        so a layer set up in the scope only gets the shapes of its weights
+ *        (see Net::CheckLayerWeights).
+ */
+class ShapeOnlyFillScope {
+ public:
+  ShapeOnlyFillScope() : previous_(Active()) { Active() = true; }
+  ~ShapeOnlyFillScope() { Active() = previous_; }
+  static bool& Active() {
+    static THREAD_LOCAL bool active = false;
+    return active;
+  }
+ private:
+  bool previous_;
+};
+
 
 /// @brief Fills a Blob with constant values @f$ x = 0 @f$.
 class ConstantFiller : public Filler {
@@ -30,6 +48,7 @@ class ConstantFiller : public Filler {
   explicit ConstantFiller(const FillerParameter& param)
       : Filler(param) {}
   virtual void Fill(Blob* blob) {
+    if (ShapeOnlyFillScope::Active()) return;
     real_t* data = blob->mutable_cpu_data();
     const int count = blob->count();
     const real_t value = this->filler_param_.value();
@@ -42,6 +61,13 @@ class ConstantFiller : public Filler {
   }
 };
 
+/// @brief Fill a blob with `value`, a no-op in a ShapeOnlyFillScope.
+inline void FillConstant(Blob* blob, real_t value) {
+  FillerParameter param;
+  param.set_value(value);
+  ConstantFiller(param).Fill(blob);
+}
+
 /**
  * @brief Get a specific filler from the specification given in FillerParameter.
  *
@@ -9,9 +9,27 @@
 #include "./common.hpp"
 #include "./layer_factory.hpp"
 #include "./proto/caffe.pb.h"
+#include "./thread_local.hpp"
 
 namespace caffe {
 
+/**
+ * @brief While alive, layers constructed by the calling thread accept weights
+ *        given by shape only and leave them unallocated, the net binds their
+ *        memory afterwards (see Net::InitFromFlatWeights).
+ */
+class ShapeOnlyWeightsScope {
+ public:
+  ShapeOnlyWeightsScope() : previous_(Active()) { Active() = true; }
+  ~ShapeOnlyWeightsScope() { Active() = previous_; }
+  static bool& Active() {
+    static THREAD_LOCAL bool active = false;
+    return active;
+  }
+ private:
+  bool previous_;
+};
+
 /**
  * @brief An interface for the units of computation which can be composed into a
  *        Net.
@@ -36,8 +54,10 @@ class Layer {
       blobs_.resize(layer_param_.blobs_size());
       for (int i = 0; i < layer_param_.blobs_size(); ++i) {
         blobs_[i].reset(new Blob);
-        blobs_[i]->FromProto(layer_param_.blobs(i));
+        blobs_[i]->FromProto(layer_param_.blobs(i), true, ShapeOnlyWeightsScope::Active());
       }
+      // weights live in blobs_ only, ToProto writes them back
+      layer_param_.clear_blobs();
     }
   }
   virtual ~Layer() {}
@@ -117,6 +137,29 @@ class Layer {
 
   /*! \brief get internal temporary blobs to share memory */
   virtual std::vector<Blob*> GetTempBlobs() { return {}; }
+  /*! \brief false if top blobs only depend on shapes of bottom blobs */
+  virtual bool UsesBottomData() const { return true; }
+  /*!
+   * \brief blobs computed from the parameters, e.g. transformed weights, they
+   *  are read by Forward instead of the parameters and shared like them by
+   *  the execution contexts of a net
+   */
+  virtual std::vector<const Blob*> GetDerivedParams() const { return {}; }
+  /*! \brief share the derived parameters of `model`, the same layer of the
+   *  net this layer's net is an execution context of */
+  virtual void ShareDerivedParams(Layer* /*model*/) {}
+  /*! \brief parameters were written, compute derived ones again */
+  virtual void ParamsChanged() {}
+  /*!
+   * \brief whether top blob may share memory of bottom blob instead of a copy,
+   *  the net forbids it when a later layer writes either of them in place
+   */
+  bool top_aliasable(int top_id) const {
+    return top_aliasable_.empty() || top_aliasable_[top_id];
+  }
+  void set_top_aliasable(const vector<bool>& aliasable) {
+    top_aliasable_ = aliasable;
+  }
 
   /**
    * @brief Returns the vector of learnable parameter blobs.
@@ -200,6 +243,8 @@ class Layer {
   LayerParameter layer_param_;
   /** The vector that stores the learnable parameters as a set of blobs. */
   vector<shared_ptr<Blob> > blobs_;
+  /** Tops allowed to share bottom memory, empty for all. */
+  vector<bool> top_aliasable_;
 
   /** @brief Using the CPU device, compute the layer output. */
   virtual void Forward_cpu(const vector<Blob*>& bottom,
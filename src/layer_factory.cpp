@@ -0,0 +1,10 @@
+#include "./layer_factory.hpp"
+
+namespace caffe {
+
+LayerRegistry::CreatorRegistry& LayerRegistry::Registry() {
+  static CreatorRegistry* g_registry_ = new CreatorRegistry();
+  return *g_registry_;
+}
+
+}  // namespace caffe
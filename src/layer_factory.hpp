@@ -51,15 +51,13 @@ namespace caffe {
 
 class Layer;
 
-class LayerRegistry {
+class CAFFE_API LayerRegistry {
  public:
   using Creator = std::function<shared_ptr<Layer>(const LayerParameter&)>;
   using CreatorRegistry = std::map<string, Creator>;
 
-  static CreatorRegistry& Registry() {
-    static CreatorRegistry* g_registry_ = new CreatorRegistry();
-    return *g_registry_;
-  }
+  // Defined in the library, so tools linking it see the registered layers.
+  static CreatorRegistry& Registry();
 
   // Adds a creator.
   static void AddCreator(const string& type, Creator creator) {
@@ -116,6 +114,14 @@ class LayerRegister {
   }
 };
 
+/**
+ * @brief Whether a creator builds the MKLDNN version of a layer, engine
+ *        "CAFFE" of the layer asks for the reference implementation.
+ */
+inline bool UseMKLDNNEngine(const LayerParameter& param) {
+  return param.engine().compare(0, 5, "CAFFE") != 0;
+}
+
 #define REGISTER_LAYER_CREATOR(type, creator)                               \
   static LayerRegister layer_register(#type, creator)
 
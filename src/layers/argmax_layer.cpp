@@ -63,30 +63,30 @@ void ArgMaxLayer::Forward_cpu(const vector<Blob*>& bottom,
     axis_dist = 1;
   }
   int num = bottom[0]->count() / dim;
-  std::vector<std::pair<real_t, int> > bottom_data_vector(dim);
+  bottom_data_vector_.resize(dim);
   for (int i = 0; i < num; ++i) {
     for (int j = 0; j < dim; ++j) {
-      bottom_data_vector[j] = std::make_pair(
+      bottom_data_vector_[j] = std::make_pair(
         bottom_data[(i / axis_dist * dim + j) * axis_dist + i % axis_dist], j);
     }
     std::partial_sort(
-        bottom_data_vector.begin(), bottom_data_vector.begin() + top_k_,
-        bottom_data_vector.end(), std::greater<std::pair<real_t, int> >());
+        bottom_data_vector_.begin(), bottom_data_vector_.begin() + top_k_,
+        bottom_data_vector_.end(), std::greater<std::pair<real_t, int> >());
     for (int j = 0; j < top_k_; ++j) {
       if (out_max_val_) {
         if (has_axis_) {
           // Produces max_val per axis
           top_data[(i / axis_dist * top_k_ + j) * axis_dist + i % axis_dist]
-            = bottom_data_vector[j].first;
+            = bottom_data_vector_[j].first;
         } else {
           // Produces max_ind and max_val
-          top_data[2 * i * top_k_ + j] = bottom_data_vector[j].second;
-          top_data[2 * i * top_k_ + top_k_ + j] = bottom_data_vector[j].first;
+          top_data[2 * i * top_k_ + j] = bottom_data_vector_[j].second;
+          top_data[2 * i * top_k_ + top_k_ + j] = bottom_data_vector_[j].first;
         }
       } else {
         // Produces max_ind per axis
         top_data[(i / axis_dist * top_k_ + j) * axis_dist + i % axis_dist]
-          = bottom_data_vector[j].second;
+          = bottom_data_vector_[j].second;
       }
     }
   }
@@ -63,6 +63,8 @@ class ArgMaxLayer : public Layer {
   size_t top_k_;
   bool has_axis_;
   int axis_;
+  /// @brief (value, index) pairs of one row, kept across forwards
+  std::vector<std::pair<real_t, int> > bottom_data_vector_;
 };
 
 }  // namespace caffe
@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "./base_conv_layer.hpp"
+#include "./conv_winograd.hpp"
 #include "../filler.hpp"
 #include "../util/im2col.hpp"
 #include "../util/math_functions.hpp"
@@ -236,7 +237,14 @@ void BaseConvolutionLayer::Reshape(const vector<Blob*>& bottom,
       col_buffer_shape_.push_back(output_shape_[i]);
     }
   }
-  col_buffer_.Reshape(col_buffer_shape_);
+  // Winograd transforms tiles in buffers of its own instead of im2col
+  winograd_ = UseWinograd();
+  if (winograd_) {
+    col_buffer_.Reshape(vector<int>(1, 0));
+  }
+  else {
+    col_buffer_.Reshape(col_buffer_shape_);
+  }
   bottom_dim_ = bottom[0]->count(channel_axis_);
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
@@ -251,10 +259,91 @@ void BaseConvolutionLayer::Reshape(const vector<Blob*>& bottom,
   }
 }
 
+bool BaseConvolutionLayer::UseWinograd() {
+  const ConvolutionParameter& conv_param = this->layer_param_.convolution_param();
+  const int* kernel_shape_data = kernel_shape_.cpu_data();
+  const int* stride_data = stride_.cpu_data();
+  const int* dilation_data = dilation_.cpu_data();
+  const bool supported = !reverse_dimensions() && !force_nd_im2col_ &&
+      num_spatial_axes_ == 2 && kernel_shape_data[0] == 3 && kernel_shape_data[1] == 3 &&
+      stride_data[0] == 1 && stride_data[1] == 1 &&
+      dilation_data[0] == 1 && dilation_data[1] == 1;
+#ifdef USE_CUDA
+  // forward_gpu_gemm still runs im2col into col_buffer_
+  if (Caffe::mode() == Caffe::GPU) return false;
+#endif  // USE_CUDA
+  if (conv_param.has_conv_algorithm()) {
+    CHECK(conv_param.conv_algorithm() == "direct" ||
+          conv_param.conv_algorithm() == "winograd")
+        << "Unsupported convolution algorithm " << conv_param.conv_algorithm();
+    return supported && conv_param.conv_algorithm() == "winograd";
+  }
+  // transforms of a tile cost about as much as products of 8 channels, and
+  // the 36 GEMMs of fewer tiles than 5x5 lose to a single one of im2col
+  const int kMinChannels = 8;
+  const int kMinTiles = 25;
+  return supported && GetConvTolerance() >= kWinogradF43Error &&
+         conv_in_channels_ / group_ >= kMinChannels &&
+         conv_out_channels_ / group_ >= kMinChannels &&
+         (output_shape_[0] + 3) / 4 * ((output_shape_[1] + 3) / 4) >= kMinTiles;
+}
+
+const real_t* BaseConvolutionLayer::GetWinogradWeights(const real_t* weights) {
+  WinogradWeights& winograd = *winograd_weights_;
+  // contexts sharing the transform only lock when it has to be rebuilt
+  if (winograd.source.load(std::memory_order_acquire) == weights) {
+    return winograd.data.cpu_data();
+  }
+  std::lock_guard<std::mutex> lock(winograd.mutex);
+  if (winograd.source.load(std::memory_order_relaxed) != weights) {
+    const int in_channels = conv_in_channels_ / group_;
+    const int out_channels = conv_out_channels_ / group_;
+    const int64_t transformed_offset = WinogradF43WeightsCount(out_channels, in_channels);
+    winograd.data.Reshape(vector<int>(1, group_ * transformed_offset));
+    for (int g = 0; g < group_; ++g) {
+      WinogradF43Weights(weights + weight_offset_ * g, out_channels, in_channels,
+                         winograd.data.mutable_cpu_data() + transformed_offset * g);
+    }
+    winograd.source.store(weights, std::memory_order_release);
+  }
+  return winograd.data.cpu_data();
+}
+
+vector<const Blob*> BaseConvolutionLayer::GetDerivedParams() const {
+  if (!winograd_) return {};
+  return {&winograd_weights_->data};
+}
+
+void BaseConvolutionLayer::ShareDerivedParams(Layer* model) {
+  BaseConvolutionLayer* conv = dynamic_cast<BaseConvolutionLayer*>(model);
+  CHECK(conv) << "Layer " << this->layer_param_.name() << " of a context is no convolution";
+  winograd_weights_ = conv->winograd_weights_;
+}
+
+void BaseConvolutionLayer::ParamsChanged() {
+  std::lock_guard<std::mutex> lock(winograd_weights_->mutex);
+  winograd_weights_->source.store(NULL, std::memory_order_release);
+}
+
 void BaseConvolutionLayer::forward_cpu_gemm(const real_t* input,
                                             const real_t* weights,
                                             real_t* output,
                                             bool skip_im2col) {
+  if (winograd_) {
+    const int in_channels = conv_in_channels_ / group_;
+    const int out_channels = conv_out_channels_ / group_;
+    const int64_t transformed_offset = WinogradF43WeightsCount(out_channels, in_channels);
+    const real_t* transformed = GetWinogradWeights(weights);
+    const int height = conv_input_shape_.cpu_data()[1];
+    const int width = conv_input_shape_.cpu_data()[2];
+    for (int g = 0; g < group_; ++g) {
+      WinogradF43Forward(input + static_cast<int64_t>(in_channels) * height * width * g,
+                         in_channels, height, width, pad_.cpu_data()[0], pad_.cpu_data()[1],
+                         transformed + transformed_offset * g, out_channels,
+                         output_shape_[0], output_shape_[1], output + output_offset_ * g);
+    }
+    return;
+  }
   const real_t* col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
@@ -1,6 +1,8 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
+#include <atomic>
+#include <mutex>
 #include <vector>
 
 #include "../layer.hpp"
@@ -15,12 +17,15 @@ namespace caffe {
 class BaseConvolutionLayer : public Layer {
  public:
   explicit BaseConvolutionLayer(const LayerParameter& param)
-      : Layer(param) {}
+      : Layer(param), winograd_(false), winograd_weights_(new WinogradWeights) {}
   virtual void LayerSetUp(const vector<Blob*>& bottom,
                           const vector<Blob*>& top);
   virtual void Reshape(const vector<Blob*>& bottom,
                        const vector<Blob*>& top);
   virtual vector<Blob*> GetTempBlobs() { return {&col_buffer_}; }
+  virtual vector<const Blob*> GetDerivedParams() const;
+  virtual void ShareDerivedParams(Layer* model);
+  virtual void ParamsChanged();
 
   virtual int MinBottomBlobs() const { return 1; }
   virtual int MinTopBlobs() const { return 1; }
@@ -90,8 +95,17 @@ class BaseConvolutionLayer : public Layer {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief forward_cpu_gemm runs Winograd F(4x4, 3x3), see UseWinograd
+  bool winograd_;
 
  private:
+  /**
+   * @brief Whether 3x3 convolutions of stride 1 run Winograd F(4x4, 3x3):
+   *        always for conv_algorithm "winograd", never for "direct", else
+   *        when GetConvTolerance() allows its error and channels and tiles
+   *        are many enough to pay for the transforms. Never in GPU mode.
+   */
+  bool UseWinograd();
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
   inline void conv_im2col_cpu(const real_t* data, real_t* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -169,6 +183,22 @@ class BaseConvolutionLayer : public Layer {
 
   Blob col_buffer_;
   Blob bias_multiplier_;
+  /**
+   * @brief Weights transformed for Winograd, 4x the 3x3 weights. Computed
+   *        on the first forward and shared by the layers of all execution
+   *        contexts, like the weights.
+   */
+  struct WinogradWeights {
+    std::mutex mutex;
+    Blob data;
+    /// weights data was transformed from, NULL until the first forward or
+    /// after ParamsChanged. Published with release once data is complete
+    std::atomic<const real_t*> source;
+    WinogradWeights() : source(NULL) {}
+  };
+  /// @brief transformed `weights`, transform them unless done already
+  const real_t* GetWinogradWeights(const real_t* weights);
+  shared_ptr<WinogradWeights> winograd_weights_;
 };
 
 }  // namespace caffe
@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "./batch_norm_layer.hpp"
+#include "../filler.hpp"
 #include "../util/math_functions.hpp"
 #ifdef USE_MKLDNN
 #include "./intel/mkldnn_layers.hpp"
@@ -31,8 +32,7 @@ void BatchNormLayer::LayerSetUp(const vector<Blob*>& bottom,
     sz[0]=1;
     this->blobs_[2].reset(new Blob(sz));
     for (int i = 0; i < 3; ++i) {
-      caffe_set(this->blobs_[i]->count(), static_cast<real_t>(0),
-                this->blobs_[i]->mutable_cpu_data());
+      FillConstant(this->blobs_[i].get(), 0);
     }
   }
   // set temp blob name
@@ -123,19 +123,19 @@ void BatchNormLayer::Forward_cpu(const vector<Blob*>& bottom,
         variance_.mutable_cpu_data());  // E((X_EX)^2)
   }
 
-  // normalize variance
+  // inverse std, powx with -0.5 runs VmathInvSqrt
   caffe_add_scalar(variance_.count(), eps_, variance_.mutable_cpu_data());
-  caffe_powx(variance_.count(), variance_.cpu_data(), static_cast<real_t>(0.5),
+  caffe_powx(variance_.count(), variance_.cpu_data(), static_cast<real_t>(-0.5),
              variance_.mutable_cpu_data());
 
-  // replicate variance to input size
+  // replicate inverse std to input size
   caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
       batch_sum_multiplier_.cpu_data(), variance_.cpu_data(), static_cast<real_t>(0),
       num_by_chans_.mutable_cpu_data());
   caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, channels_ * num,
       spatial_dim, 1, static_cast<real_t>(1), num_by_chans_.cpu_data(),
       spatial_sum_multiplier_.cpu_data(), static_cast<real_t>(0), temp_.mutable_cpu_data());
-  caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
+  caffe_mul(temp_.count(), top_data, temp_.cpu_data(), top_data);
 }
 
 #ifndef USE_CUDA
@@ -144,7 +144,9 @@ STUB_GPU(BatchNormLayer);
 // Creator
 static shared_ptr<Layer> CreateLayer(const LayerParameter &param) {
 #ifdef USE_MKLDNN
-  return shared_ptr<Layer>(new MKLDNNBatchNormLayer(param));
+  if (UseMKLDNNEngine(param)) {
+    return shared_ptr<Layer>(new MKLDNNBatchNormLayer(param));
+  }
 #endif
   return shared_ptr<Layer>(new BatchNormLayer(param));
 }
@@ -36,12 +36,10 @@ void BNLayer::LayerSetUp(const vector<Blob*>& bottom,
     bias_filler->Fill(this->blobs_[1].get());
     // moving average mean
     this->blobs_[2].reset(new Blob(shape));
-    caffe_set(this->blobs_[2]->count(), static_cast<real_t>(0),
-        this->blobs_[2]->mutable_cpu_data());
+    FillConstant(this->blobs_[2].get(), 0);
     // moving average variance
     this->blobs_[3].reset(new Blob(shape));
-    caffe_set(this->blobs_[3]->count(), static_cast<real_t>(1),
-        this->blobs_[3]->mutable_cpu_data());
+    FillConstant(this->blobs_[3].get(), 1);
   }
   // set temp blob name
   broadcast_buffer_.set_name(this->layer_param_.name() + "__broadcast_buffer__");
@@ -1,7 +1,10 @@
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "./bnll_layer.hpp"
+#include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 
 namespace caffe {
 
@@ -10,11 +13,24 @@ void BNLLLayer::Forward_cpu(const vector<Blob*>& bottom,
   const real_t* bottom_data = bottom[0]->cpu_data();
   real_t* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = bottom_data[i] > 0 ?
-        bottom_data[i] + log(1. + exp(-bottom_data[i])) :
-        log(1. + exp(bottom_data[i]));
-  }
+  // max(x, 0) + log1p(exp(-|x|)), exp of blocks kept on the stack runs the
+  // vector kernel, log1p keeps the small results of negative x that
+  // log(1 + y) rounds to 0 below x = -17
+  parallel_for(0, count, ParallelGrain(32), [&](int64_t begin, int64_t end) {
+    const int kBlock = 256;
+    real_t exp_data[kBlock];
+    for (int64_t b = begin; b < end; b += kBlock) {
+      const int n = std::min<int64_t>(kBlock, end - b);
+      for (int i = 0; i < n; ++i) {
+        exp_data[i] = -std::abs(bottom_data[b + i]);
+      }
+      caffe_exp(n, exp_data, exp_data);
+      for (int i = 0; i < n; ++i) {
+        top_data[b + i] = std::max(bottom_data[b + i], static_cast<real_t>(0)) +
+                          std::log1p(exp_data[i]);
+      }
+    }
+  });
 }
 
 #ifndef USE_CUDA
@@ -47,20 +47,21 @@ void ConcatLayer::Reshape(const vector<Blob*>& bottom,
   }
   top[0]->Reshape(top_shape);
   CHECK_EQ(bottom_count_sum, top[0]->count());
-  if (bottom.size() == 1) {
+  if (bottom.size() == 1 && this->top_aliasable(0)) {
     top[0]->ShareData(*bottom[0]);
   }
 }
 
 void ConcatLayer::Forward_cpu(const vector<Blob*>& bottom,
                               const vector<Blob*>& top) {
-  if (bottom.size() == 1) { return; }
+  if (bottom.size() == 1 && top[0]->data() == bottom[0]->data()) { return; }
   real_t* top_data = top[0]->mutable_cpu_data();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
   for (int i = 0; i < bottom.size(); ++i) {
     const real_t* bottom_data = bottom[i]->cpu_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
+    // no copy for a bottom placed inside top, see Net::FindNestedMemory
     for (int n = 0; n < num_concats_; ++n) {
       caffe_copy(bottom_concat_axis * concat_input_size_,
         bottom_data + n * bottom_concat_axis * concat_input_size_,
@@ -77,7 +78,9 @@ STUB_GPU(ConcatLayer);
 // Creator
 static shared_ptr<Layer> CreateLayer(const LayerParameter &param) {
 #ifdef USE_MKLDNN
-  return shared_ptr<Layer>(new MKLDNNConcatLayer(param));
+  if (UseMKLDNNEngine(param)) {
+    return shared_ptr<Layer>(new MKLDNNConcatLayer(param));
+  }
 #endif
   return shared_ptr<Layer>(new ConcatLayer(param));
 }
@@ -23,6 +23,8 @@ class ConcatLayer : public Layer {
   virtual const char* type() const { return "Concat"; }
   virtual int MinBottomBlobs() const { return 1; }
   virtual int ExactNumTopBlobs() const { return 1; }
+  /// @brief true if every bottom is one contiguous range of top
+  bool contiguous() const { return num_concats_ == 1; }
 
  protected:
   /**
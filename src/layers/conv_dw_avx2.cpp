@@ -0,0 +1,26 @@
+// Built with AVX2 and FMA enabled, see mini-caffe.cmake.
+#include "./conv_dw_kernels.hpp"
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#include "../util/simd_avx2.hpp"
+
+namespace caffe {
+
+bool GetDepthwiseKernelsAVX2(DepthwiseKernels* kernels) {
+  FillDepthwiseKernels<AVX2>(kernels);
+  return true;
+}
+
+}  // namespace caffe
+
+#else
+
+namespace caffe {
+
+bool GetDepthwiseKernelsAVX2(DepthwiseKernels* kernels) {
+  return false;
+}
+
+}  // namespace caffe
+
+#endif
@@ -0,0 +1,26 @@
+// Built with AVX-512 enabled, see mini-caffe.cmake.
+#include "./conv_dw_kernels.hpp"
+
+#if defined(__AVX512F__)
+#include "../util/simd_avx512.hpp"
+
+namespace caffe {
+
+bool GetDepthwiseKernelsAVX512(DepthwiseKernels* kernels) {
+  FillDepthwiseKernels<AVX512>(kernels);
+  return true;
+}
+
+}  // namespace caffe
+
+#else
+
+namespace caffe {
+
+bool GetDepthwiseKernelsAVX512(DepthwiseKernels* kernels) {
+  return false;
+}
+
+}  // namespace caffe
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef CAFFE_CONV_DW_KERNELS_HPP_
+#define CAFFE_CONV_DW_KERNELS_HPP_
+
+// Depthwise convolution of KxK kernels with stride S and no dilation,
+// written once over a SIMD traits type V (see util/vmath_kernels.hpp) and
+// instantiated by the translation unit of every instruction set.
+// Planes stay NCHW, vectors run along the output width. Columns whose taps
+// all fall inside the image take the vector loop, the padded borders take
+// the checked scalar loop. Nothing with external linkage is instantiated
+// here, so code built for an instruction set stays in its own TU.
+
+#include <stdint.h>
+
+namespace caffe {
+
+/*! \brief arguments of a depthwise convolution over NCHW planes */
+struct DepthwiseArgs {
+  const float* bottom;
+  const float* weight;
+  // NULL without bias term
+  const float* bias;
+  // plane i of the output rows [row_begin, row_end) at top + i * top_stride
+  float* top;
+  int64_t top_stride;
+  int row_begin, row_end;
+  int channels;
+  int height, width;
+  int top_height, top_width;
+  int kernel_h, kernel_w;
+  int stride_h, stride_w;
+  int pad_h, pad_w;
+  int dilation_h, dilation_w;
+  // fused ReLU, y = max(x, 0) + negative_slope * min(x, 0)
+  bool relu;
+  float negative_slope;
+};
+
+/*! \brief convolve planes [begin, end) of num x channels */
+typedef void (*DepthwiseKernel)(const DepthwiseArgs& args, int64_t begin, int64_t end);
+
+/*! \brief kernel for the shape of args, SIMD ones when available */
+DepthwiseKernel GetDepthwiseKernel(const DepthwiseArgs& args);
+
+/*! \brief kernels of one instruction set, indexed by [kernel 3/5][stride 1/2] */
+struct DepthwiseKernels {
+  DepthwiseKernel kernel[2][2];
+};
+
+/*! \brief fill the kernels, false if they are not built for this target */
+bool GetDepthwiseKernelsAVX2(DepthwiseKernels* kernels);
+bool GetDepthwiseKernelsAVX512(DepthwiseKernels* kernels);
+
+namespace {
+
+template <class V, int K, int S>
+struct Depthwise {
+  typedef typename V::F F;
+
+  static inline int Min(int a, int b) { return a < b ? a : b; }
+  static inline int Max(int a, int b) { return a > b ? a : b; }
+
+  static inline F Tap(const float* p) {
+    return S == 1 ? V::Load(p) : V::LoadEven(p);
+  }
+  static inline F TapOdd(const float* p) {
+    return S == 1 ? V::Load(p + 1) : V::LoadOdd(p);
+  }
+
+  static inline F Activate(F x, const DepthwiseArgs& args) {
+    if (!args.relu) return x;
+    const F zero = V::Set(0.f);
+    if (args.negative_slope == 0.f) return V::Max(x, zero);
+    return V::Fma(V::Set(args.negative_slope), V::Min(x, zero), V::Max(x, zero));
+  }
+
+  static inline float ActivatePixel(float x, const DepthwiseArgs& args) {
+    if (!args.relu || x > 0.f) return x;
+    return x * args.negative_slope;
+  }
+
+  // output column ow of rows [kh0, kh1), taps outside the image are skipped
+  static inline float Pixel(const float* const* rows, const float* w, int kh0, int kh1,
+                            int ow, const DepthwiseArgs& args) {
+    const int iw0 = ow * S - args.pad_w;
+    float value = 0.f;
+    for (int kh = kh0; kh < kh1; ++kh) {
+      for (int kw = 0; kw < K; ++kw) {
+        const int iw = iw0 + kw;
+        if (iw >= 0 && iw < args.width) value += w[kh * K + kw] * rows[kh][iw];
+      }
+    }
+    return value;
+  }
+
+  // sum over rows [kh0, kh1) of the vector of output columns from ow
+  static inline F Vector(const float* const* rows, const F* w, int kh0, int kh1, int ow,
+                         const DepthwiseArgs& args) {
+    const int iw0 = ow * S - args.pad_w;
+    F acc = V::Set(0.f);
+    for (int kh = kh0; kh < kh1; ++kh) {
+      const float* p = rows[kh] + iw0;
+      for (int kw = 0; kw + 1 < K; kw += 2) {
+        acc = V::Fma(w[kh * K + kw], Tap(p + kw), acc);
+        acc = V::Fma(w[kh * K + kw + 1], TapOdd(p + kw), acc);
+      }
+      acc = V::Fma(w[kh * K + K - 1], Tap(p + K - 1), acc);
+    }
+    return acc;
+  }
+
+  static void Plane(const float* bottom, const float* weight, float bias, float* top,
+                    const DepthwiseArgs& args) {
+    const int width = args.width;
+    const int top_width = args.top_width;
+    F w[K * K];
+    for (int i = 0; i < K * K; ++i) w[i] = V::Set(weight[i]);
+    const F b = V::Set(bias);
+    // columns [lo, hi) read no padding
+    const int lo = Min(top_width, (args.pad_w + S - 1) / S);
+    const int last = width - K + args.pad_w;
+    const int hi = last < 0 ? lo : Max(lo, Min(top_width, last / S + 1));
+    // vectors of columns up to vector_hi load inside the row, LoadEven and
+    // LoadOdd read one float past the last tap
+    int vector_hi = hi;
+    if (S == 2) {
+      const int last_start = width - K - 2 * V::kWidth + 1 + args.pad_w;
+      vector_hi = last_start < 0 ? lo : Min(hi, last_start / 2 + V::kWidth);
+    }
+    const float* rows[K];
+    for (int oh = args.row_begin; oh < args.row_end; ++oh) {
+      const int ih0 = oh * S - args.pad_h;
+      const int kh0 = Max(0, -ih0);
+      const int kh1 = Min(K, args.height - ih0);
+      for (int kh = kh0; kh < kh1; ++kh) rows[kh] = bottom + (ih0 + kh) * width;
+      float* out = top + (oh - args.row_begin) * top_width;
+      int ow = 0;
+      for (; ow < lo; ++ow) out[ow] = ActivatePixel(Pixel(rows, weight, kh0, kh1, ow, args) + bias, args);
+      for (; ow + V::kWidth <= vector_hi; ow += V::kWidth) {
+        const F acc = V::Add(Vector(rows, w, kh0, kh1, ow, args), b);
+        V::Store(out + ow, Activate(acc, args));
+      }
+      if (ow < vector_hi && vector_hi - V::kWidth >= lo) {
+        // the last vector overlaps columns already written with equal values
+        ow = vector_hi - V::kWidth;
+        const F acc = V::Add(Vector(rows, w, kh0, kh1, ow, args), b);
+        V::Store(out + ow, Activate(acc, args));
+        ow = vector_hi;
+      }
+      if (S == 1 && V::kWidth > 1 && ow < hi) {
+        // tail of the interior, the masked loads read no further than its taps
+        const int n = hi - ow;
+        F acc = V::Set(0.f);
+        for (int kh = kh0; kh < kh1; ++kh) {
+          const float* p = rows[kh] + ow - args.pad_w;
+          for (int kw = 0; kw < K; ++kw) {
+            acc = V::Fma(w[kh * K + kw], V::LoadPartial(p + kw, n), acc);
+          }
+        }
+        V::StorePartial(out + ow, Activate(V::Add(acc, b), args), n);
+        ow = hi;
+      }
+      for (; ow < top_width; ++ow) out[ow] = ActivatePixel(Pixel(rows, weight, kh0, kh1, ow, args) + bias, args);
+    }
+  }
+
+  static void Run(const DepthwiseArgs& args, int64_t begin, int64_t end) {
+    const int64_t bottom_dim = static_cast<int64_t>(args.height) * args.width;
+    for (int64_t nc = begin; nc < end; ++nc) {
+      const int c = static_cast<int>(nc % args.channels);
+      Plane(args.bottom + nc * bottom_dim, args.weight + c * K * K,
+            args.bias ? args.bias[c] : 0.f, args.top + nc * args.top_stride, args);
+    }
+  }
+};
+
+template <class V>
+void FillDepthwiseKernels(DepthwiseKernels* kernels) {
+  kernels->kernel[0][0] = Depthwise<V, 3, 1>::Run;
+  kernels->kernel[0][1] = Depthwise<V, 3, 2>::Run;
+  kernels->kernel[1][0] = Depthwise<V, 5, 1>::Run;
+  kernels->kernel[1][1] = Depthwise<V, 5, 2>::Run;
+}
+
+}  // namespace
+
+}  // namespace caffe
+
+#endif  // CAFFE_CONV_DW_KERNELS_HPP_
@@ -3,9 +3,89 @@
 
 #include "../filler.hpp"
 #include "./conv_dw_layer.hpp"
+#include "./conv_dw_kernels.hpp"
+#include "../util/parallel.hpp"
+#include "../util/vmath.hpp"
 
 namespace caffe {
 
+namespace {
+
+// one lane traits for CPUs without AVX2
+struct Scalar {
+  typedef float F;
+  static const int kWidth = 1;
+
+  static inline F Load(const float* p) { return *p; }
+  static inline void Store(float* p, F x) { *p = x; }
+  static inline F LoadPartial(const float* p, int /*n*/) { return *p; }
+  static inline void StorePartial(float* p, F x, int /*n*/) { *p = x; }
+  static inline F LoadEven(const float* p) { return p[0]; }
+  static inline F LoadOdd(const float* p) { return p[1]; }
+  static inline F Set(float x) { return x; }
+  static inline F Add(F a, F b) { return a + b; }
+  static inline F Fma(F a, F b, F c) { return a * b + c; }
+  static inline F Min(F a, F b) { return std::min(a, b); }
+  static inline F Max(F a, F b) { return std::max(a, b); }
+};
+
+// kernels of the instruction set VmathGetIsa() runs
+const DepthwiseKernels& GetDepthwiseKernels() {
+  static struct Table {
+    DepthwiseKernels kernels[3];
+    bool available[3];
+    Table() {
+      FillDepthwiseKernels<Scalar>(&kernels[VMATH_SCALAR]);
+      available[VMATH_SCALAR] = true;
+      available[VMATH_AVX2] = GetDepthwiseKernelsAVX2(&kernels[VMATH_AVX2]);
+      available[VMATH_AVX512] = GetDepthwiseKernelsAVX512(&kernels[VMATH_AVX512]);
+    }
+  } table;
+  int isa = VmathGetIsa();
+  while (!table.available[isa]) --isa;
+  return table.kernels[isa];
+}
+
+void DepthwiseGeneric(const DepthwiseArgs& args, int64_t begin, int64_t end) {
+  const int bottom_height = args.height;
+  const int bottom_width = args.width;
+  for (int64_t nc = begin; nc < end; ++nc) {
+    const int c = nc % args.channels;
+    const real_t* bottom_plane = args.bottom + nc * bottom_height * bottom_width;
+    real_t* top_plane = args.top + nc * args.top_stride;
+    for (int h = args.row_begin; h < args.row_end; ++h) {
+      for (int w = 0; w < args.top_width; ++w) {
+        const real_t* weight_data = args.weight + c * args.kernel_h * args.kernel_w;
+        real_t value = 0;
+        for (int kh = 0; kh < args.kernel_h; ++kh) {
+          for (int kw = 0; kw < args.kernel_w; ++kw) {
+            int h_in = -args.pad_h + h * args.stride_h + kh * args.dilation_h;
+            int w_in = -args.pad_w + w * args.stride_w + kw * args.dilation_w;
+            if ((h_in >= 0) && (h_in < bottom_height) && (w_in >= 0) && (w_in < bottom_width)) {
+              value += (*weight_data) * bottom_plane[h_in * bottom_width + w_in];
+            }
+            ++weight_data;
+          }
+        }
+        if (args.bias) value += args.bias[c];
+        if (args.relu && value <= 0) value *= args.negative_slope;
+        *top_plane++ = value;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+DepthwiseKernel GetDepthwiseKernel(const DepthwiseArgs& args) {
+  if (args.kernel_h == args.kernel_w && (args.kernel_h == 3 || args.kernel_h == 5) &&
+      args.stride_h == args.stride_w && args.stride_h <= 2 &&
+      args.dilation_h == 1 && args.dilation_w == 1) {
+    return GetDepthwiseKernels().kernel[args.kernel_h / 2 - 1][args.stride_h - 1];
+  }
+  return DepthwiseGeneric;
+}
+
 void ConvolutionDepthwiseLayer::LayerSetUp(const vector<Blob*>& bottom,
                                            const vector<Blob*>& top) {
   ConvolutionParameter conv_param = this->layer_param_.convolution_param();
@@ -101,54 +181,45 @@ void ConvolutionDepthwiseLayer::Reshape(const vector<Blob*>& bottom,
   top[0]->Reshape(top_shape);
 }
 
+DepthwiseArgs ConvolutionDepthwiseLayer::GetArgs(const Blob& bottom) const {
+  const ConvolutionParameter& conv_param = this->layer_param_.convolution_param();
+  DepthwiseArgs args;
+  args.bottom = bottom.cpu_data();
+  args.weight = this->blobs_[0]->cpu_data();
+  args.bias = conv_param.bias_term() ? this->blobs_[1]->cpu_data() : NULL;
+  args.channels = bottom.channels();
+  args.height = bottom.height();
+  args.width = bottom.width();
+  args.kernel_h = kernel_h_;
+  args.kernel_w = kernel_w_;
+  args.stride_h = stride_h_;
+  args.stride_w = stride_w_;
+  args.pad_h = pad_h_;
+  args.pad_w = pad_w_;
+  args.dilation_h = dilation_h_;
+  args.dilation_w = dilation_w_;
+  args.top_height = (args.height + 2 * pad_h_ - (dilation_h_ * (kernel_h_ - 1) + 1)) / stride_h_ + 1;
+  args.top_width = (args.width + 2 * pad_w_ - (dilation_w_ * (kernel_w_ - 1) + 1)) / stride_w_ + 1;
+  args.top = NULL;
+  args.top_stride = static_cast<int64_t>(args.top_height) * args.top_width;
+  args.row_begin = 0;
+  args.row_end = args.top_height;
+  args.relu = conv_param.relu();
+  args.negative_slope = conv_param.negative_slope();
+  return args;
+}
+
 void ConvolutionDepthwiseLayer::Forward_cpu(const vector<Blob*>& bottom,
                                             const vector<Blob*>& top) {
-  const int num = top[0]->num();
-  const int channels = top[0]->channels();
-  const int top_height = top[0]->height();
-  const int top_width = top[0]->width();
-  const int bottom_height = bottom[0]->height();
-  const int bottom_width = bottom[0]->width();
-  const real_t* bottom_data = bottom[0]->cpu_data();
-  const real_t* weight_data_base = this->blobs_[0]->cpu_data();
-  real_t* top_data = top[0]->mutable_cpu_data();
-  for (int n = 0; n < num; ++n) {
-    for (int c = 0; c < channels; ++c) {
-      for (int h = 0; h < top_height; ++h) {
-        for (int w = 0; w < top_width; ++w) {
-          const real_t* weight_data = weight_data_base + c * kernel_h_ * kernel_w_;
-          real_t value = 0;
-          for (int kh = 0; kh < kernel_h_; ++kh) {
-            for (int kw = 0; kw < kernel_w_; ++kw) {
-              int h_in = -pad_h_ + h * stride_h_ + kh * dilation_h_;
-              int w_in = -pad_w_ + w * stride_w_ + kw * dilation_w_;
-              if ((h_in >= 0) && (h_in < bottom_height) && (w_in >= 0) && (w_in < bottom_width)) {
-                int offset = ((n * channels + c) * bottom_height + h_in) * bottom_width + w_in;
-                value += (*weight_data) * bottom_data[offset];
-              }
-              ++weight_data;
-            }
-          }
-          *top_data++ = value;
-        }
-      }
-    }
-  }
-  if (this->layer_param_.convolution_param().bias_term()) {
-    top_data = top[0]->mutable_cpu_data();
-    for (int n = 0; n < num; ++n) {
-      const real_t* bias_data = this->blobs_[1]->cpu_data();
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < top_height; ++h) {
-          for (int w = 0; w < top_width; ++w) {
-            *top_data += *bias_data;
-            ++top_data;
-          }
-        }
-        ++bias_data;
-      }
-    }
-  }
+  DepthwiseArgs args = GetArgs(*bottom[0]);
+  args.top = top[0]->mutable_cpu_data();
+  const DepthwiseKernel kernel = GetDepthwiseKernel(args);
+  // every task convolves its own channel planes
+  const int64_t plane_cost = args.top_stride * kernel_h_ * kernel_w_;
+  parallel_for(0, top[0]->num() * args.channels, ParallelGrain(plane_cost),
+               [&](int64_t begin, int64_t end) {
+    kernel(args, begin, end);
+  });
 }
 
 #ifndef USE_CUDA
@@ -46,6 +46,15 @@ __global__ void ConvolutionDepthwiseBiasForward(const int nthreads,
   }
 }
 
+template <typename Dtype>
+__global__ void ConvolutionDepthwiseReLUForward(const int nthreads,
+    const Dtype negative_slope, Dtype* const top_data) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const Dtype value = top_data[index];
+    top_data[index] = value > 0 ? value : value * negative_slope;
+  }
+}
+
 void ConvolutionDepthwiseLayer::Forward_gpu(const vector<Blob*>& bottom,
                                             const vector<Blob*>& top) {
   const real_t* bottom_data = bottom[0]->gpu_data();
@@ -69,6 +78,11 @@ void ConvolutionDepthwiseLayer::Forward_gpu(const vector<Blob*>& bottom,
         count, bias_data, num, channels,
         top_height, top_width, top_data);
   }
+  if (this->layer_param_.convolution_param().relu()) {
+    const real_t negative_slope = this->layer_param_.convolution_param().negative_slope();
+    ConvolutionDepthwiseReLUForward<<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+        count, negative_slope, top_data);
+  }
 }
 
 }  // namespace caffe
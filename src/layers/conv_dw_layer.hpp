@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "../layer.hpp"
+#include "./conv_dw_kernels.hpp"
 
 namespace caffe {
 
@@ -24,6 +25,8 @@ class ConvolutionDepthwiseLayer : public Layer {
                            const vector<Blob*>& top);
   virtual void Forward_gpu(const vector<Blob*>& bottom,
                            const vector<Blob*>& top);
+  /*! \brief arguments over all planes of bottom, but the top */
+  DepthwiseArgs GetArgs(const Blob& bottom) const;
   unsigned int kernel_h_;
   unsigned int kernel_w_;
   unsigned int stride_h_;
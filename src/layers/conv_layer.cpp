@@ -51,7 +51,9 @@ STUB_GPU(ConvolutionLayer);
 // Creator
 static shared_ptr<Layer> CreateLayer(const LayerParameter &param) {
 #ifdef USE_MKLDNN
-  return shared_ptr<Layer>(new MKLDNNConvolutionLayer(param));
+  if (UseMKLDNNEngine(param)) {
+    return shared_ptr<Layer>(new MKLDNNConvolutionLayer(param));
+  }
 #endif
   return shared_ptr<Layer>(new ConvolutionLayer(param));
 }
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <vector>
+
+#include "./conv_winograd.hpp"
+#include "../thread_local.hpp"
+#include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
+
+namespace caffe {
+
+namespace {
+
+// transformed tiles of a block and their products stay within this size,
+// unless the GEMMs would get fewer than kMinBlock tiles
+const int64_t kBlockBytes = 1 << 20;
+const int kMinBlock = 64;
+
+// transformed input and products of the tiles a thread works on
+struct WinogradBuffers {
+  vector<real_t> input;
+  vector<real_t> product;
+};
+
+// u = G g of a column of 3 weights
+inline void WeightTransform(const real_t* g, int stride, real_t* u, int u_stride) {
+  const real_t g0 = g[0], g1 = g[stride], g2 = g[2 * stride];
+  u[0] = g0 / 4;
+  u[u_stride] = -(g0 + g1 + g2) / 6;
+  u[2 * u_stride] = -(g0 - g1 + g2) / 6;
+  u[3 * u_stride] = g0 / 24 + g1 / 12 + g2 / 6;
+  u[4 * u_stride] = g0 / 24 - g1 / 12 + g2 / 6;
+  u[5 * u_stride] = g2;
+}
+
+// v = B^T d of a column of 6 inputs
+inline void InputTransform(const real_t* d, int stride, real_t* v, int v_stride) {
+  const real_t d0 = d[0], d1 = d[stride], d2 = d[2 * stride];
+  const real_t d3 = d[3 * stride], d4 = d[4 * stride], d5 = d[5 * stride];
+  v[0] = 4 * d0 - 5 * d2 + d4;
+  v[v_stride] = -4 * (d1 + d2) + d3 + d4;
+  v[2 * v_stride] = 4 * (d1 - d2) - d3 + d4;
+  v[3 * v_stride] = 2 * (d3 - d1) - d2 + d4;
+  v[4 * v_stride] = 2 * (d1 - d3) - d2 + d4;
+  v[5 * v_stride] = 4 * d1 - 5 * d3 + d5;
+}
+
+// y = A^T m of a column of 6 products
+inline void OutputTransform(const real_t* m, int stride, real_t* y, int y_stride) {
+  const real_t m0 = m[0], m1 = m[stride], m2 = m[2 * stride];
+  const real_t m3 = m[3 * stride], m4 = m[4 * stride], m5 = m[5 * stride];
+  const real_t a = m1 + m2, b = m1 - m2, c = m3 + m4, d = m3 - m4;
+  y[0] = m0 + a + c;
+  y[y_stride] = b + 2 * d;
+  y[2 * y_stride] = a + 4 * c;
+  y[3 * y_stride] = b + 8 * d + m5;
+}
+
+}  // namespace
+
+void WinogradF43Weights(const real_t* weight, int out_channels, int in_channels,
+                        real_t* transformed) {
+  const int64_t matrix = static_cast<int64_t>(out_channels) * in_channels;
+  for (int64_t kc = 0; kc < matrix; ++kc) {
+    // U = G g G^T, element i * 6 + j goes to matrix i * 6 + j
+    real_t rows[6 * 3], u[36];
+    for (int j = 0; j < 3; ++j) WeightTransform(weight + kc * 9 + j, 3, rows + j, 3);
+    for (int i = 0; i < 6; ++i) WeightTransform(rows + i * 3, 1, u + i * 6, 1);
+    for (int i = 0; i < 36; ++i) transformed[i * matrix + kc] = u[i];
+  }
+}
+
+void WinogradF43Forward(const real_t* input, int channels, int height, int width,
+                        int pad_h, int pad_w, const real_t* transformed,
+                        int out_channels, int top_height, int top_width,
+                        real_t* output) {
+  const int tiles_h = (top_height + 3) / 4;
+  const int tiles_w = (top_width + 3) / 4;
+  const int tiles = tiles_h * tiles_w;
+  const int64_t tile_bytes = 36 * sizeof(real_t) * static_cast<int64_t>(channels + out_channels);
+  const int block = static_cast<int>(std::max<int64_t>(kMinBlock, std::min<int64_t>(
+      tiles, kBlockBytes / tile_bytes)));
+  const int blocks = (tiles + block - 1) / block;
+  const int64_t block_cost = 36 * static_cast<int64_t>(block) * channels * out_channels;
+  const int64_t matrix = static_cast<int64_t>(out_channels) * channels;
+  parallel_for(0, blocks, ParallelGrain(block_cost), [&](int64_t begin, int64_t end) {
+    WinogradBuffers* buffers = ThreadLocalStore<WinogradBuffers>::Get();
+    buffers->input.resize(36 * static_cast<size_t>(channels) * block);
+    buffers->product.resize(36 * static_cast<size_t>(out_channels) * block);
+    real_t* v = buffers->input.data();
+    real_t* m = buffers->product.data();
+    for (int64_t b = begin; b < end; ++b) {
+      const int tile0 = b * block;
+      const int n = std::min(block, tiles - tile0);
+      // V = B^T d B of every channel and tile, element i lands in matrix i
+      const int64_t v_matrix = static_cast<int64_t>(channels) * n;
+      for (int c = 0; c < channels; ++c) {
+        const real_t* plane = input + static_cast<int64_t>(c) * height * width;
+        for (int t = 0; t < n; ++t) {
+          const int h0 = (tile0 + t) / tiles_w * 4 - pad_h;
+          const int w0 = (tile0 + t) % tiles_w * 4 - pad_w;
+          real_t d[36], rows[36], tile[36];
+          if (h0 >= 0 && w0 >= 0 && h0 + 6 <= height && w0 + 6 <= width) {
+            for (int i = 0; i < 6; ++i) {
+              std::copy(plane + (h0 + i) * width + w0, plane + (h0 + i) * width + w0 + 6, d + i * 6);
+            }
+          }
+          else {
+            for (int i = 0; i < 6; ++i) {
+              for (int j = 0; j < 6; ++j) {
+                const int h = h0 + i, w = w0 + j;
+                d[i * 6 + j] = h >= 0 && h < height && w >= 0 && w < width ?
+                    plane[h * width + w] : 0;
+              }
+            }
+          }
+          for (int j = 0; j < 6; ++j) InputTransform(d + j, 6, rows + j, 6);
+          for (int i = 0; i < 6; ++i) InputTransform(rows + i * 6, 1, tile + i * 6, 1);
+          for (int i = 0; i < 36; ++i) v[i * v_matrix + c * n + t] = tile[i];
+        }
+      }
+      // M = U V, out_channels x tiles for each of the 36 elements
+      for (int i = 0; i < 36; ++i) {
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, out_channels, n, channels,
+                    1, transformed + i * matrix, channels, v + i * v_matrix, n,
+                    0, m + i * out_channels * n, n);
+      }
+      // Y = A^T M A, clipped at the bottom and right borders
+      const int64_t m_matrix = static_cast<int64_t>(out_channels) * n;
+      for (int k = 0; k < out_channels; ++k) {
+        real_t* top = output + static_cast<int64_t>(k) * top_height * top_width;
+        for (int t = 0; t < n; ++t) {
+          real_t tile[36], rows[24], y[16];
+          for (int i = 0; i < 36; ++i) tile[i] = m[i * m_matrix + k * n + t];
+          for (int j = 0; j < 6; ++j) OutputTransform(tile + j, 6, rows + j, 6);
+          for (int i = 0; i < 4; ++i) OutputTransform(rows + i * 6, 1, y + i * 4, 1);
+          const int h0 = (tile0 + t) / tiles_w * 4;
+          const int w0 = (tile0 + t) % tiles_w * 4;
+          const int rows_out = std::min(4, top_height - h0);
+          const int cols_out = std::min(4, top_width - w0);
+          for (int i = 0; i < rows_out; ++i) {
+            std::copy(y + i * 4, y + i * 4 + cols_out, top + (h0 + i) * top_width + w0);
+          }
+        }
+      }
+    }
+  });
+}
+
+}  // namespace caffe
@@ -79,35 +79,30 @@ void DetectionOutputLayer::Forward_cpu(const vector<Blob*>& bottom,
   const int num = bottom[0]->num();
 
   // Retrieve all location predictions.
-  vector<LabelBBox> all_loc_preds;
   GetLocPredictions(loc_data, num, num_priors_, num_loc_classes_,
-                    share_location_, &all_loc_preds);
+                    share_location_, &all_loc_preds_);
 
   // Retrieve all confidences.
-  vector<map<int, vector<float> > > all_conf_scores;
   GetConfidenceScores(conf_data, num, num_priors_, num_classes_,
-                      &all_conf_scores);
+                      &all_conf_scores_);
 
   // Retrieve all prior bboxes. It is same within a batch since we assume all
   // images in a batch are of same dimension.
-  vector<NormalizedBBox> prior_bboxes;
-  vector<vector<float> > prior_variances;
-  GetPriorBBoxes(prior_data, num_priors_, &prior_bboxes, &prior_variances);
+  GetPriorBBoxes(prior_data, num_priors_, &prior_bboxes_, &prior_variances_);
 
   // Decode all loc predictions to bboxes.
-  vector<LabelBBox> all_decode_bboxes;
   const bool clip_bbox = false;
-  DecodeBBoxesAll(all_loc_preds, prior_bboxes, prior_variances, num,
+  DecodeBBoxesAll(all_loc_preds_, prior_bboxes_, prior_variances_, num,
                   share_location_, num_loc_classes_, background_label_id_,
                   code_type_, variance_encoded_in_target_, clip_bbox,
-                  &all_decode_bboxes);
+                  &all_decode_bboxes_);
 
   int num_kept = 0;
-  vector<map<int, vector<int> > > all_indices;
+  all_indices_.resize(num);
   for (int i = 0; i < num; ++i) {
-    const LabelBBox& decode_bboxes = all_decode_bboxes[i];
-    const map<int, vector<float> >& conf_scores = all_conf_scores[i];
-    map<int, vector<int> > indices;
+    const LabelBBox& decode_bboxes = all_decode_bboxes_[i];
+    const map<int, vector<float> >& conf_scores = all_conf_scores_[i];
+    map<int, vector<int> >& indices = all_indices_[i];
     int num_det = 0;
     for (int c = 0; c < num_classes_; ++c) {
       if (c == background_label_id_) {
@@ -127,11 +122,11 @@ void DetectionOutputLayer::Forward_cpu(const vector<Blob*>& bottom,
       }
       const vector<NormalizedBBox>& bboxes = decode_bboxes.find(label)->second;
       ApplyNMSFast(bboxes, scores, confidence_threshold_, nms_threshold_, eta_,
-          top_k_, &(indices[c]));
+          top_k_, &(indices[c]), &score_index_vec_);
       num_det += indices[c].size();
     }
     if (keep_top_k_ > -1 && num_det > keep_top_k_) {
-      vector<pair<float, pair<int, int> > > score_index_pairs;
+      score_index_pairs_.clear();
       for (map<int, vector<int> >::iterator it = indices.begin();
            it != indices.end(); ++it) {
         int label = it->first;
@@ -145,54 +140,54 @@ void DetectionOutputLayer::Forward_cpu(const vector<Blob*>& bottom,
         for (int j = 0; j < label_indices.size(); ++j) {
           int idx = label_indices[j];
           CHECK_LT(idx, scores.size());
-          score_index_pairs.push_back(std::make_pair(
+          score_index_pairs_.push_back(std::make_pair(
                   scores[idx], std::make_pair(label, idx)));
         }
       }
       // Keep top k results per image.
-      std::sort(score_index_pairs.begin(), score_index_pairs.end(),
+      std::sort(score_index_pairs_.begin(), score_index_pairs_.end(),
                 SortScorePairDescend<pair<int, int> >);
-      score_index_pairs.resize(keep_top_k_);
-      // Store the new indices.
-      map<int, vector<int> > new_indices;
-      for (int j = 0; j < score_index_pairs.size(); ++j) {
-        int label = score_index_pairs[j].second.first;
-        int idx = score_index_pairs[j].second.second;
-        new_indices[label].push_back(idx);
+      score_index_pairs_.resize(keep_top_k_);
+      // Store the new indices, labels without any left stay empty.
+      for (map<int, vector<int> >::iterator it = indices.begin();
+           it != indices.end(); ++it) {
+        it->second.clear();
+      }
+      for (int j = 0; j < score_index_pairs_.size(); ++j) {
+        int label = score_index_pairs_[j].second.first;
+        int idx = score_index_pairs_[j].second.second;
+        indices[label].push_back(idx);
       }
-      all_indices.push_back(new_indices);
       num_kept += keep_top_k_;
     } else {
-      all_indices.push_back(indices);
       num_kept += num_det;
     }
   }
 
-  vector<int> top_shape(2, 1);
-  top_shape[0] = num_kept;
-  top_shape[1] = 7;
-  real_t* top_data;
+  top_shape_.resize(2);
+  top_shape_[0] = num_kept;
+  top_shape_[1] = 7;
+  if (num_kept == 0) {
+    top_shape_[0] = num;
+  }
+  // the top only grows, fewer detections keep its memory
+  top[0]->Reshape(top_shape_, top_shape_[0] * 7 > top[0]->capacity());
+  real_t* top_data = top[0]->mutable_cpu_data();
   if (num_kept == 0) {
-    top_shape[0] = num;
-    top[0]->Reshape(top_shape);
-    top_data = top[0]->mutable_cpu_data();
     caffe_set(top[0]->count(), -1, top_data);
     // Generate fake results per image.
     for (int i = 0; i < num; ++i) {
       top_data[0] = i;
       top_data += 7;
     }
-  } else {
-    top[0]->Reshape(top_shape);
-    top_data = top[0]->mutable_cpu_data();
   }
 
   int count = 0;
   for (int i = 0; i < num; ++i) {
-    const map<int, vector<float> >& conf_scores = all_conf_scores[i];
-    const LabelBBox& decode_bboxes = all_decode_bboxes[i];
-    for (map<int, vector<int> >::iterator it = all_indices[i].begin();
-         it != all_indices[i].end(); ++it) {
+    const map<int, vector<float> >& conf_scores = all_conf_scores_[i];
+    const LabelBBox& decode_bboxes = all_decode_bboxes_[i];
+    for (map<int, vector<int> >::iterator it = all_indices_[i].begin();
+         it != all_indices_[i].end(); ++it) {
       int label = it->first;
       if (conf_scores.find(label) == conf_scores.end()) {
         // Something bad happened if there are no predictions for current label.
@@ -81,6 +81,18 @@ class DetectionOutputLayer : public Layer {
   Blob bbox_preds_;
   Blob bbox_permute_;
   Blob conf_permute_;
+
+  // workspaces of Forward_cpu, reused so that steady state runs allocate
+  // nothing once their capacity is reached
+  vector<LabelBBox> all_loc_preds_;
+  vector<map<int, vector<float> > > all_conf_scores_;
+  vector<NormalizedBBox> prior_bboxes_;
+  vector<vector<float> > prior_variances_;
+  vector<LabelBBox> all_decode_bboxes_;
+  vector<map<int, vector<int> > > all_indices_;
+  vector<pair<float, int> > score_index_vec_;
+  vector<pair<float, pair<int, int> > > score_index_pairs_;
+  vector<int> top_shape_;
 };
 
 }  // namespace caffe
@@ -3,6 +3,7 @@
 
 #include "./eltwise_layer.hpp"
 #include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 #ifdef USE_MKLDNN
 #include "./intel/mkldnn_layers.hpp"
 #endif
@@ -38,45 +39,47 @@ void EltwiseLayer::Reshape(const vector<Blob*>& bottom,
 
 void EltwiseLayer::Forward_cpu(const vector<Blob*>& bottom,
                                const vector<Blob*>& top) {
-  int* mask = NULL;
-  const real_t* bottom_data_a = NULL;
-  const real_t* bottom_data_b = NULL;
   const int count = top[0]->count();
   real_t* top_data = top[0]->mutable_cpu_data();
-  switch (op_) {
-  case EltwiseParameter_EltwiseOp_PROD:
-    caffe_mul(count, bottom[0]->cpu_data(), bottom[1]->cpu_data(), top_data);
-    for (int i = 2; i < bottom.size(); ++i) {
-      caffe_mul(count, top_data, bottom[i]->cpu_data(), top_data);
-    }
-    break;
-  case EltwiseParameter_EltwiseOp_SUM:
-    caffe_set(count, static_cast<real_t>(0), top_data);
-    // TODO(shelhamer) does BLAS optimize to sum for coeff = 1?
-    for (int i = 0; i < bottom.size(); ++i) {
-      caffe_axpy(count, coeffs_[i], bottom[i]->cpu_data(), top_data);
-    }
-    break;
-  case EltwiseParameter_EltwiseOp_MAX:
-    // Initialize
-    caffe_set(count, static_cast<real_t>(-FLT_MAX), top_data);
-    // bottom 0 & 1
-    bottom_data_a = bottom[0]->cpu_data();
-    bottom_data_b = bottom[1]->cpu_data();
-    for (int idx = 0; idx < count; ++idx) {
-      top_data[idx] = std::max(bottom_data_a[idx], bottom_data_b[idx]);
-    }
-    // bottom 2++
-    for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
-      bottom_data_b = bottom[blob_idx]->cpu_data();
-      for (int idx = 0; idx < count; ++idx) {
-        top_data[idx] = std::max(top_data[idx], bottom_data_b[idx]);
+  vector<const real_t*> bottom_data(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_data[i] = bottom[i]->cpu_data();
+  }
+  // every task combines its own slice of the blobs
+  parallel_for(0, count, ParallelGrain(bottom.size()), [&](int64_t begin, int64_t end) {
+    const int n = end - begin;
+    real_t* top_slice = top_data + begin;
+    switch (op_) {
+    case EltwiseParameter_EltwiseOp_PROD:
+      caffe_mul(n, bottom_data[0] + begin, bottom_data[1] + begin, top_slice);
+      for (int i = 2; i < bottom.size(); ++i) {
+        caffe_mul(n, top_slice, bottom_data[i] + begin, top_slice);
       }
+      break;
+    case EltwiseParameter_EltwiseOp_SUM:
+      caffe_set(n, static_cast<real_t>(0), top_slice);
+      // TODO(shelhamer) does BLAS optimize to sum for coeff = 1?
+      for (int i = 0; i < bottom.size(); ++i) {
+        caffe_axpy(n, coeffs_[i], bottom_data[i] + begin, top_slice);
+      }
+      break;
+    case EltwiseParameter_EltwiseOp_MAX:
+      // bottom 0 & 1
+      for (int idx = 0; idx < n; ++idx) {
+        top_slice[idx] = std::max(bottom_data[0][begin + idx], bottom_data[1][begin + idx]);
+      }
+      // bottom 2++
+      for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
+        const real_t* bottom_slice = bottom_data[blob_idx] + begin;
+        for (int idx = 0; idx < n; ++idx) {
+          top_slice[idx] = std::max(top_slice[idx], bottom_slice[idx]);
+        }
+      }
+      break;
+    default:
+      LOG(FATAL) << "Unknown elementwise operation.";
     }
-    break;
-  default:
-    LOG(FATAL) << "Unknown elementwise operation.";
-  }
+  });
 }
 
 #ifndef USE_CUDA
@@ -85,7 +88,9 @@ STUB_GPU(EltwiseLayer);
 // Creator
 static shared_ptr<Layer> CreateLayer(const LayerParameter &param) {
 #ifdef USE_MKLDNN
-  return shared_ptr<Layer>(new MKLDNNEltwiseLayer(param));
+  if (UseMKLDNNEngine(param)) {
+    return shared_ptr<Layer>(new MKLDNNEltwiseLayer(param));
+  }
 #endif
   return shared_ptr<Layer>(new EltwiseLayer(param));
 }
@@ -2,6 +2,8 @@
 #include <vector>
 
 #include "./elu_layer.hpp"
+#include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 
 namespace caffe {
 
@@ -11,10 +13,22 @@ void ELULayer::Forward_cpu(const vector<Blob*>& bottom,
   real_t* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
   real_t alpha = this->layer_param_.elu_param().alpha();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], static_cast<real_t>(0))
-        + alpha * (exp(std::min(bottom_data[i], static_cast<real_t>(0))) - 1);
-  }
+  // exp of blocks kept on the stack runs the vector kernels
+  parallel_for(0, count, ParallelGrain(16), [&](int64_t begin, int64_t end) {
+    const int kBlock = 256;
+    real_t exp_data[kBlock];
+    for (int64_t b = begin; b < end; b += kBlock) {
+      const int n = std::min<int64_t>(kBlock, end - b);
+      for (int i = 0; i < n; ++i) {
+        exp_data[i] = std::min(bottom_data[b + i], static_cast<real_t>(0));
+      }
+      caffe_exp(n, exp_data, exp_data);
+      for (int i = 0; i < n; ++i) {
+        top_data[b + i] = std::max(bottom_data[b + i], static_cast<real_t>(0))
+            + alpha * (exp_data[i] - 1);
+      }
+    }
+  });
 }
 
 #ifndef USE_CUDA
@@ -101,7 +101,9 @@ STUB_GPU(InnerProductLayer);
 // Creator
 static shared_ptr<Layer> CreateLayer(const LayerParameter &param) {
 #ifdef USE_MKLDNN
-  return shared_ptr<Layer>(new MKLDNNInnerProductLayer(param));
+  if (UseMKLDNNEngine(param)) {
+    return shared_ptr<Layer>(new MKLDNNInnerProductLayer(param));
+  }
 #endif
   return shared_ptr<Layer>(new InnerProductLayer(param));
 }
@@ -68,15 +68,14 @@ private:
 
 
 // =====  StreamHolder =======================================
-// singleton
+// singleton per thread, Nets forwarding in different threads don't share
+// the current stream
 class StreamHolder
 {
 public:
     static StreamHolder & Instance()
     {
-        // I's thread-safe in C++11.
-        static StreamHolder myInstance;
-        return myInstance;
+        return *ThreadLocalStore<StreamHolder>::Get();
     }
     StreamHolder(StreamHolder const&) = delete;             // Copy construct
     StreamHolder(StreamHolder&&) = delete;                  // Move construct
@@ -90,6 +89,7 @@ public:
         _current_stream->prepare();
     }
 protected:
+    friend class ThreadLocalStore<StreamHolder>;
     StreamHolder() : _current_stream() {}
     ~StreamHolder() {}
 private:
@@ -311,8 +311,10 @@ void MKLDNNBatchNormLayer::InitBatchNormFwdPrimitive(int idx) {
 void MKLDNNBatchNormLayer::Forward_cpu(const vector<Blob*>& bottom
                                         ,const vector<Blob*>& top)
 {
-    if(BatchNormFwd_pd == NULL || this->reshape)
+    if(BatchNormFwd_pd == NULL || this->reshape) {
         InitBatchNorm(bottom, top);
+        this->reshape = false;
+    }
     bool inplace = (bottom[0] == top[0]);
 
     // making reorders if needed.
@@ -338,5 +340,50 @@ void MKLDNNBatchNormLayer::Forward_cpu(const vector<Blob*>& bottom
       BatchNormFwd[stats_batch_idx].submit();
     }
 }
+// primitives of one input shape, kept by the plan cache of Net
+struct MKLDNNBatchNormLayer::Plan {
+    shared_ptr<MKLDNNData > fwd_top_data, fwd_bottom_data;
+    shared_ptr<batch_normalization_forward::primitive_desc> BatchNormFwd_pd;
+    vector<MKLDNNPrimitive > BatchNormFwd;
+    vector<shared_ptr<memory> > mean_memory, variance_memory;
+    shared_ptr<memory> scaleshift_memory;
+    shared_ptr<memory> output_memory;
+    vector<shared_ptr<memory> > input_stats, output_stats;
+    shared_ptr<primitive> input_primitive;
+};
+
+shared_ptr<void> MKLDNNBatchNormLayer::SavePlan() {
+    if (BatchNormFwd_pd == NULL || this->reshape) return shared_ptr<void>();
+    shared_ptr<Plan> plan(new Plan);
+    plan->fwd_top_data = fwd_top_data;
+    plan->fwd_bottom_data = fwd_bottom_data;
+    plan->BatchNormFwd_pd = BatchNormFwd_pd;
+    plan->BatchNormFwd = BatchNormFwd;
+    plan->mean_memory = mean_memory;
+    plan->variance_memory = variance_memory;
+    plan->scaleshift_memory = scaleshift_memory;
+    plan->output_memory = output_memory;
+    plan->input_stats = input_stats;
+    plan->output_stats = output_stats;
+    plan->input_primitive = input_primitive;
+    return plan;
+}
+
+void MKLDNNBatchNormLayer::RestorePlan(const shared_ptr<void>& plan_ptr) {
+    shared_ptr<Plan> plan = std::static_pointer_cast<Plan>(plan_ptr);
+    fwd_top_data = plan->fwd_top_data;
+    fwd_bottom_data = plan->fwd_bottom_data;
+    BatchNormFwd_pd = plan->BatchNormFwd_pd;
+    BatchNormFwd = plan->BatchNormFwd;
+    mean_memory = plan->mean_memory;
+    variance_memory = plan->variance_memory;
+    scaleshift_memory = plan->scaleshift_memory;
+    output_memory = plan->output_memory;
+    input_stats = plan->input_stats;
+    output_stats = plan->output_stats;
+    input_primitive = plan->input_primitive;
+    this->reshape = false;
+}
+
 }  // namespace caffe
 #endif  // #ifdef MKLDNN_SUPPORTED
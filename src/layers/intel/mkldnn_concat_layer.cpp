@@ -419,8 +419,10 @@ void MKLDNNConcatLayer::InitConcatFwd(const vector<Blob*>& bottom,
 
 void MKLDNNConcatLayer::Forward_cpu(const vector<Blob*>& bottom,
     const vector<Blob*>& top) {
-  if ((NULL == concatFwd_pd) || (true == this->reshape))
+  if ((NULL == concatFwd_pd) || (true == this->reshape)) {
     InitConcatFwd(bottom, top);
+    this->reshape = false;
+  }
 
   for (auto i = 0; i < num_concats_; i++) {
     // making reorders if needed.
@@ -434,6 +436,48 @@ void MKLDNNConcatLayer::Forward_cpu(const vector<Blob*>& bottom,
   }
 }
 
+// primitives of one input shape, kept by the plan cache of Net
+struct MKLDNNConcatLayer::Plan {
+    shared_ptr<concat::primitive_desc> concatFwd_pd;
+    shared_ptr<memory> fwd_output_memory;
+    vector<shared_ptr<primitive>> fwd_input_primitives_;
+    vector<primitive::at> fwd_input_primitives_at_;
+    MKLDNNPrimitive concatFwd;
+    shared_ptr<MKLDNNData > fwd_top_data;
+    vector<shared_ptr<MKLDNNData > > fwd_bottom_data;
+    vector<MKLDNNPrimitive > reorders;
+    bool in_place_;
+};
+
+shared_ptr<void> MKLDNNConcatLayer::SavePlan() {
+    if (concatFwd_pd == NULL || this->reshape) return shared_ptr<void>();
+    shared_ptr<Plan> plan(new Plan);
+    plan->concatFwd_pd = concatFwd_pd;
+    plan->fwd_output_memory = fwd_output_memory;
+    plan->fwd_input_primitives_ = fwd_input_primitives_;
+    plan->fwd_input_primitives_at_ = fwd_input_primitives_at_;
+    plan->concatFwd = concatFwd;
+    plan->fwd_top_data = fwd_top_data;
+    plan->fwd_bottom_data = fwd_bottom_data;
+    plan->reorders = reorders;
+    plan->in_place_ = in_place_;
+    return plan;
+}
+
+void MKLDNNConcatLayer::RestorePlan(const shared_ptr<void>& plan_ptr) {
+    shared_ptr<Plan> plan = std::static_pointer_cast<Plan>(plan_ptr);
+    concatFwd_pd = plan->concatFwd_pd;
+    fwd_output_memory = plan->fwd_output_memory;
+    fwd_input_primitives_ = plan->fwd_input_primitives_;
+    fwd_input_primitives_at_ = plan->fwd_input_primitives_at_;
+    concatFwd = plan->concatFwd;
+    fwd_top_data = plan->fwd_top_data;
+    fwd_bottom_data = plan->fwd_bottom_data;
+    reorders = plan->reorders;
+    in_place_ = plan->in_place_;
+    this->reshape = false;
+}
+
 } // namespace caffe
 
 #endif
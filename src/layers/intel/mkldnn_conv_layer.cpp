@@ -381,8 +381,10 @@ void MKLDNNConvolutionLayer::InitConvolutionFwd(const vector<Blob*>& bottom
 void MKLDNNConvolutionLayer::Forward_cpu(const std::vector<Blob*>& bottom
                                                 , const std::vector<Blob*>& top)
 {
-    if( convFwd_pd == NULL || this->reshape)
+    if( convFwd_pd == NULL || this->reshape) {
         InitConvolutionFwd(bottom, top);
+        this->reshape = false;
+    }
     fwd_bottom_data->sync_before_read();
     fwd_weights_data->sync_before_read();
     if (this->bias_term_)
@@ -393,6 +395,46 @@ void MKLDNNConvolutionLayer::Forward_cpu(const std::vector<Blob*>& bottom
     convFwd.submit();
 }
 
+// primitives of one input shape, kept by the plan cache of Net
+struct MKLDNNConvolutionLayer::Plan {
+    shared_ptr<MKLDNNData > fwd_bottom_data, fwd_top_data, fwd_weights_data, fwd_bias_data;
+    shared_ptr<convolution_forward::primitive_desc> convFwd_pd;
+    MKLDNNPrimitive convFwd;
+    shared_ptr<memory> fwd_top_data_memory;
+    shared_ptr<primitive> fwd_bottom_data_primitive, fwd_weights_data_primitive, fwd_bias_data_primitive;
+};
+
+shared_ptr<void> MKLDNNConvolutionLayer::SavePlan() {
+    if (convFwd_pd == NULL || this->reshape) return shared_ptr<void>();
+    shared_ptr<Plan> plan(new Plan);
+    plan->fwd_bottom_data = fwd_bottom_data;
+    plan->fwd_top_data = fwd_top_data;
+    plan->fwd_weights_data = fwd_weights_data;
+    plan->fwd_bias_data = fwd_bias_data;
+    plan->convFwd_pd = convFwd_pd;
+    plan->convFwd = convFwd;
+    plan->fwd_top_data_memory = fwd_top_data_memory;
+    plan->fwd_bottom_data_primitive = fwd_bottom_data_primitive;
+    plan->fwd_weights_data_primitive = fwd_weights_data_primitive;
+    plan->fwd_bias_data_primitive = fwd_bias_data_primitive;
+    return plan;
+}
+
+void MKLDNNConvolutionLayer::RestorePlan(const shared_ptr<void>& plan_ptr) {
+    shared_ptr<Plan> plan = std::static_pointer_cast<Plan>(plan_ptr);
+    fwd_bottom_data = plan->fwd_bottom_data;
+    fwd_top_data = plan->fwd_top_data;
+    fwd_weights_data = plan->fwd_weights_data;
+    fwd_bias_data = plan->fwd_bias_data;
+    convFwd_pd = plan->convFwd_pd;
+    convFwd = plan->convFwd;
+    fwd_top_data_memory = plan->fwd_top_data_memory;
+    fwd_bottom_data_primitive = plan->fwd_bottom_data_primitive;
+    fwd_weights_data_primitive = plan->fwd_weights_data_primitive;
+    fwd_bias_data_primitive = plan->fwd_bias_data_primitive;
+    this->reshape = false;
+}
+
 }   // namespace caffe
 
 #endif  // USE_CUDNN
@@ -192,8 +192,10 @@ void MKLDNNEltwiseLayer::Forward_cpu(const vector<Blob*>& bottom, const vector<B
 {
 //    VLOG(1) << "MKLDNNEltwiseLayer::Forward_cpu: " << this->layer_param_.name();
 
-    if(eltwiseFwd_pd == NULL || this->reshape)
+    if(eltwiseFwd_pd == NULL || this->reshape) {
         InitEltwiseFwd(bottom, top);
+        this->reshape = false;
+    }
     for (auto i = 0; i < num_bottoms_; i++)
     {
         // making reorders if needed.
@@ -205,5 +207,41 @@ void MKLDNNEltwiseLayer::Forward_cpu(const vector<Blob*>& bottom, const vector<B
     eltwiseFwd.submit();
 }
 
+// primitives of one input shape, kept by the plan cache of Net
+struct MKLDNNEltwiseLayer::Plan {
+    shared_ptr<MKLDNNData > fwd_top_data;
+    vector<shared_ptr<MKLDNNData > > fwd_bottom_data;
+    shared_ptr<sum::primitive_desc> eltwiseFwd_pd;
+    MKLDNNPrimitive eltwiseFwd;
+    shared_ptr<memory> fwd_top_data_memory;
+    vector<shared_ptr<primitive>> fwd_bottom_data_primitives_;
+    vector<primitive::at> fwd_bottom_data_primitives_at_;
+};
+
+shared_ptr<void> MKLDNNEltwiseLayer::SavePlan() {
+    if (eltwiseFwd_pd == NULL || this->reshape) return shared_ptr<void>();
+    shared_ptr<Plan> plan(new Plan);
+    plan->fwd_top_data = fwd_top_data;
+    plan->fwd_bottom_data = fwd_bottom_data;
+    plan->eltwiseFwd_pd = eltwiseFwd_pd;
+    plan->eltwiseFwd = eltwiseFwd;
+    plan->fwd_top_data_memory = fwd_top_data_memory;
+    plan->fwd_bottom_data_primitives_ = fwd_bottom_data_primitives_;
+    plan->fwd_bottom_data_primitives_at_ = fwd_bottom_data_primitives_at_;
+    return plan;
+}
+
+void MKLDNNEltwiseLayer::RestorePlan(const shared_ptr<void>& plan_ptr) {
+    shared_ptr<Plan> plan = std::static_pointer_cast<Plan>(plan_ptr);
+    fwd_top_data = plan->fwd_top_data;
+    fwd_bottom_data = plan->fwd_bottom_data;
+    eltwiseFwd_pd = plan->eltwiseFwd_pd;
+    eltwiseFwd = plan->eltwiseFwd;
+    fwd_top_data_memory = plan->fwd_top_data_memory;
+    fwd_bottom_data_primitives_ = plan->fwd_bottom_data_primitives_;
+    fwd_bottom_data_primitives_at_ = plan->fwd_bottom_data_primitives_at_;
+    this->reshape = false;
+}
+
 }  // namespace caffe
 #endif  // #ifdef MKLDNN_SUPPORTED
@@ -208,8 +208,10 @@ void MKLDNNInnerProductLayer::Forward_cpu(const vector<Blob*>& bottom
     LOG(INFO) << "MKLDNNInnerProductLayer::Forward_cpu: " << this->layer_param_.name();
 #endif
 
-    if( ipFwd_pd == NULL || this->reshape)
+    if( ipFwd_pd == NULL || this->reshape) {
         InitInnerProductFwd(bottom, top);
+        this->reshape = false;
+    }
     // making reorders if needed.
     fwd_bottom_data->sync_before_read();
     fwd_weights_data->sync_before_read();
@@ -220,5 +222,45 @@ void MKLDNNInnerProductLayer::Forward_cpu(const vector<Blob*>& bottom
 
     ipFwd.submit();
 }
+// primitives of one input shape, kept by the plan cache of Net
+struct MKLDNNInnerProductLayer::Plan {
+    shared_ptr<MKLDNNData > fwd_bottom_data, fwd_top_data, fwd_weights_data, fwd_bias_data;
+    shared_ptr<inner_product_forward::primitive_desc> ipFwd_pd;
+    MKLDNNPrimitive ipFwd;
+    shared_ptr<memory> fwd_top_data_memory;
+    shared_ptr<primitive> fwd_bottom_data_primitive, fwd_weights_data_primitive, fwd_bias_data_primitive;
+};
+
+shared_ptr<void> MKLDNNInnerProductLayer::SavePlan() {
+    if (ipFwd_pd == NULL || this->reshape) return shared_ptr<void>();
+    shared_ptr<Plan> plan(new Plan);
+    plan->fwd_bottom_data = fwd_bottom_data;
+    plan->fwd_top_data = fwd_top_data;
+    plan->fwd_weights_data = fwd_weights_data;
+    plan->fwd_bias_data = fwd_bias_data;
+    plan->ipFwd_pd = ipFwd_pd;
+    plan->ipFwd = ipFwd;
+    plan->fwd_top_data_memory = fwd_top_data_memory;
+    plan->fwd_bottom_data_primitive = fwd_bottom_data_primitive;
+    plan->fwd_weights_data_primitive = fwd_weights_data_primitive;
+    plan->fwd_bias_data_primitive = fwd_bias_data_primitive;
+    return plan;
+}
+
+void MKLDNNInnerProductLayer::RestorePlan(const shared_ptr<void>& plan_ptr) {
+    shared_ptr<Plan> plan = std::static_pointer_cast<Plan>(plan_ptr);
+    fwd_bottom_data = plan->fwd_bottom_data;
+    fwd_top_data = plan->fwd_top_data;
+    fwd_weights_data = plan->fwd_weights_data;
+    fwd_bias_data = plan->fwd_bias_data;
+    ipFwd_pd = plan->ipFwd_pd;
+    ipFwd = plan->ipFwd;
+    fwd_top_data_memory = plan->fwd_top_data_memory;
+    fwd_bottom_data_primitive = plan->fwd_bottom_data_primitive;
+    fwd_weights_data_primitive = plan->fwd_weights_data_primitive;
+    fwd_bias_data_primitive = plan->fwd_bias_data_primitive;
+    this->reshape = false;
+}
+
 }  // namespace caffe
 #endif  // #ifdef MKLDNN_SUPPORTED
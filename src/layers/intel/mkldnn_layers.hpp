@@ -13,8 +13,16 @@ namespace caffe {
 //class MKLDNNLayer : public BaseQuantLayer {
 class MKLDNNLayer {
 public:
-    explicit MKLDNNLayer(const LayerParameter &param){};
+    explicit MKLDNNLayer(const LayerParameter &param) : reshape(false) {};
     virtual ~MKLDNNLayer() {}
+    // primitives keep the data pointers they are built with, rebuild them
+    // on next Forward after blob memory is moved
+    void ResetPrimitives() { reshape = true; }
+    // primitives built for current shapes, NULL if they need to be built
+    virtual shared_ptr<void> SavePlan() { return shared_ptr<void>(); }
+    // use primitives of SavePlan again, call after Reshape to the shapes
+    // they are built for
+    virtual void RestorePlan(const shared_ptr<void>& plan) {}
 protected:
     bool reshape;
 };
@@ -36,12 +44,15 @@ public:
     int GetPadWidth()     { return pad_w_; }
     int GetPadHeight()    { return pad_h_; }
     int GetPadDepth()     { return pad_d_; }
+    virtual shared_ptr<void> SavePlan();
+    virtual void RestorePlan(const shared_ptr<void>& plan);
 protected:
     virtual void Forward_cpu(const vector<Blob*>& bottom, const vector<Blob*>& top);
     // Customized methods
     virtual void LayerSetUp(const vector<Blob*>& bottom, const vector<Blob*>& top);
     void Reshape(const vector<Blob*>& bottom, const vector<Blob*>& top);
 private:
+    struct Plan;
     virtual void compute_output_shape();
     virtual void init_properties(const vector<Blob*>& bottom, const vector<Blob*>& top);
     void InitConvolutionFwd(const vector<Blob*>& bottom, const vector<Blob*>& top);
@@ -74,12 +85,15 @@ public:
     , num_(0), width_(0), height_(0), channels_(0) {}
   ~MKLDNNReLULayer() {}
 
+    virtual shared_ptr<void> SavePlan();
+    virtual void RestorePlan(const shared_ptr<void>& plan);
 protected:
     virtual void LayerSetUp(const vector<Blob*>& bottom, const vector<Blob*>& top);
     virtual void Reshape(const vector<Blob*>& bottom, const vector<Blob*>& top);
     virtual inline const char* type() const { return "ReLU"; }
     virtual void Forward_cpu(const vector<Blob*>& bottom, const vector<Blob*>& top);
 private:
+    struct Plan;
     void InitReLUFwd(const vector<Blob*>& bottom, const vector<Blob*>& top);
 
     shared_ptr<MKLDNNData > fwd_top_data, fwd_bottom_data;
@@ -96,12 +110,15 @@ class MKLDNNInnerProductLayer : public MKLDNNLayer , public InnerProductLayer  {
 public:
     explicit MKLDNNInnerProductLayer(const LayerParameter& param);
     virtual ~MKLDNNInnerProductLayer();
+    virtual shared_ptr<void> SavePlan();
+    virtual void RestorePlan(const shared_ptr<void>& plan);
 protected:
     virtual void Forward_cpu(const vector<Blob*>& bottom, const vector<Blob*>& top);
     // Customized methods
     virtual void LayerSetUp(const vector<Blob*>& bottom, const vector<Blob*>& top);
     void Reshape(const vector<Blob*>& bottom, const vector<Blob*>& top);
 private:
+    struct Plan;
     void InitInnerProductFwd(const vector<Blob*>& bottom, const vector<Blob*>& top);
 
     shared_ptr<MKLDNNData > fwd_bottom_data, fwd_top_data, fwd_weights_data, fwd_bias_data;
@@ -131,6 +148,8 @@ public:
             {
             }
     ~MKLDNNPoolingLayer() {}
+    virtual shared_ptr<void> SavePlan();
+    virtual void RestorePlan(const shared_ptr<void>& plan);
 protected:
     virtual void LayerSetUp(const vector<Blob*>& bottom, const vector<Blob*>& top);
     virtual void Reshape(const vector<Blob*>& bottom, const vector<Blob*>& top);
@@ -148,6 +167,7 @@ protected:
     virtual void compute_output_shape(const vector<Blob*>& bottom, const vector<Blob*>& top);
 
 private:
+    struct Plan;
     void InitPoolingFwd(const vector<Blob*>& bottom, const vector<Blob*>& top);
 
     shared_ptr<MKLDNNData> fwd_bottom_data, fwd_top_data;
@@ -179,12 +199,15 @@ public:
     }
     ~MKLDNNBatchNormLayer() {}
 
+    virtual shared_ptr<void> SavePlan();
+    virtual void RestorePlan(const shared_ptr<void>& plan);
 protected:
     virtual void LayerSetUp(const vector<Blob*>& bottom, const vector<Blob*>& top);
     virtual void Reshape(const vector<Blob*>& bottom, const vector<Blob*>& top);
     virtual inline const char* type() const { return "BatchNorm"; }
     virtual void Forward_cpu(const vector<Blob*>& bottom, const vector<Blob*>& top);
 private:
+    struct Plan;
     void InitBatchNorm(const vector<Blob*>& bottom, const vector<Blob*>& top);
     void InitBatchNormFwdPrimitive(int stats_batch_idx);
     shared_ptr<memory> GetStatsBatchMemory(
@@ -226,6 +249,8 @@ public:
   }
   ~MKLDNNEltwiseLayer() {}
 
+    virtual shared_ptr<void> SavePlan();
+    virtual void RestorePlan(const shared_ptr<void>& plan);
 protected:
     virtual void LayerSetUp(const vector<Blob*>& bottom, const vector<Blob*>& top);
     virtual void Reshape(const vector<Blob*>& bottom, const vector<Blob*>& top);
@@ -234,6 +259,7 @@ protected:
     virtual inline int ExactNumTopBlobs() const { return 1; }
     virtual void Forward_cpu(const vector<Blob*>& bottom, const vector<Blob*>& top);
 private:
+    struct Plan;
     void InitEltwiseFwd(const vector<Blob*>& bottom, const vector<Blob*>& top);
     shared_ptr<MKLDNNData > fwd_top_data;
     vector<shared_ptr<MKLDNNData > > fwd_bottom_data;
@@ -262,12 +288,15 @@ public:
             concatFwd_pd(), fwd_output_memory(),
             fwd_top_data(), fwd_bottom_data(), split_dims() {
     }
+    virtual shared_ptr<void> SavePlan();
+    virtual void RestorePlan(const shared_ptr<void>& plan);
 protected:
     virtual void LayerSetUp(const vector<Blob*>& bottom, const vector<Blob*>& top);
     virtual void Reshape(const vector<Blob*>& bottom, const vector<Blob*>& top);
     virtual inline const char* type() const { return "Concat"; }
     virtual void Forward_cpu(const vector<Blob*>& bottom, const vector<Blob*>& top);
 private:
+    struct Plan;
     void InitConcatFwd(const vector<Blob*>& bottom, const vector<Blob*>& top);
 
     shared_ptr<concat::primitive_desc> concatFwd_pd;
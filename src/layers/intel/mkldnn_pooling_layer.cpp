@@ -294,8 +294,10 @@ void MKLDNNPoolingLayer::Forward_cpu(const vector<Blob*>& bottom
     LOG(INFO) << "MKLDNNPoolingLayer::Forward_cpu: " << this->layer_param_.name();
 #endif
 
-    if (NULL == poolingFwd_pd || this->reshape)
+    if (NULL == poolingFwd_pd || this->reshape) {
         InitPoolingFwd(bottom, top);
+        this->reshape = false;
+    }
     // making reorders if needed.
     fwd_bottom_data->sync_before_read();
     // update top that head at prv
@@ -303,5 +305,42 @@ void MKLDNNPoolingLayer::Forward_cpu(const vector<Blob*>& bottom
 
     poolingFwd.submit();
 }
+// primitives of one input shape, kept by the plan cache of Net
+struct MKLDNNPoolingLayer::Plan {
+    shared_ptr<MKLDNNData> fwd_bottom_data, fwd_top_data;
+    shared_ptr<pooling_forward::primitive_desc> poolingFwd_pd;
+    shared_ptr<memory::primitive_desc> indices_pd;
+    shared_ptr<memory> indices_memory, fwd_top_data_memory;
+    MKLDNNPrimitive poolingFwd;
+    shared_ptr<primitive> fwd_bottom_data_primitive;
+};
+
+shared_ptr<void> MKLDNNPoolingLayer::SavePlan() {
+    if (poolingFwd_pd == NULL || this->reshape) return shared_ptr<void>();
+    shared_ptr<Plan> plan(new Plan);
+    plan->fwd_bottom_data = fwd_bottom_data;
+    plan->fwd_top_data = fwd_top_data;
+    plan->poolingFwd_pd = poolingFwd_pd;
+    plan->indices_pd = indices_pd;
+    plan->indices_memory = indices_memory;
+    plan->fwd_top_data_memory = fwd_top_data_memory;
+    plan->poolingFwd = poolingFwd;
+    plan->fwd_bottom_data_primitive = fwd_bottom_data_primitive;
+    return plan;
+}
+
+void MKLDNNPoolingLayer::RestorePlan(const shared_ptr<void>& plan_ptr) {
+    shared_ptr<Plan> plan = std::static_pointer_cast<Plan>(plan_ptr);
+    fwd_bottom_data = plan->fwd_bottom_data;
+    fwd_top_data = plan->fwd_top_data;
+    poolingFwd_pd = plan->poolingFwd_pd;
+    indices_pd = plan->indices_pd;
+    indices_memory = plan->indices_memory;
+    fwd_top_data_memory = plan->fwd_top_data_memory;
+    poolingFwd = plan->poolingFwd;
+    fwd_bottom_data_primitive = plan->fwd_bottom_data_primitive;
+    this->reshape = false;
+}
+
 }  // namespace caffe
 #endif  // #ifdef MKLDNN_SUPPORTED
@@ -124,8 +124,10 @@ void MKLDNNReLULayer::Forward_cpu(const vector<Blob*>& bottom
 //    VLOG(1) << "MKLDNNReLULayer::Forward_cpu: " << this->layer_param_.name();
     std::cout << "MKLDNNReLULayer::Forward_cpu: " << this->layer_param_.name()<<std::endl;
     bool inplace = (bottom[0] == top[0]);
-    if( reluFwd_pd == NULL || this->reshape)
+    if( reluFwd_pd == NULL || this->reshape) {
         InitReLUFwd(bottom, top);
+        this->reshape = false;
+    }
 
     // making reorders if needed.
     fwd_bottom_data->sync_before_read();
@@ -134,5 +136,37 @@ void MKLDNNReLULayer::Forward_cpu(const vector<Blob*>& bottom
 
     reluFwd.submit();
 }
+// primitives of one input shape, kept by the plan cache of Net
+struct MKLDNNReLULayer::Plan {
+    shared_ptr<MKLDNNData > fwd_top_data, fwd_bottom_data;
+    shared_ptr<relu_forward::primitive_desc> reluFwd_pd;
+    MKLDNNPrimitive reluFwd;
+    shared_ptr<memory> fwd_top_data_memory;
+    shared_ptr<primitive> fwd_bottom_data_primitive;
+};
+
+shared_ptr<void> MKLDNNReLULayer::SavePlan() {
+    if (reluFwd_pd == NULL || this->reshape) return shared_ptr<void>();
+    shared_ptr<Plan> plan(new Plan);
+    plan->fwd_top_data = fwd_top_data;
+    plan->fwd_bottom_data = fwd_bottom_data;
+    plan->reluFwd_pd = reluFwd_pd;
+    plan->reluFwd = reluFwd;
+    plan->fwd_top_data_memory = fwd_top_data_memory;
+    plan->fwd_bottom_data_primitive = fwd_bottom_data_primitive;
+    return plan;
+}
+
+void MKLDNNReLULayer::RestorePlan(const shared_ptr<void>& plan_ptr) {
+    shared_ptr<Plan> plan = std::static_pointer_cast<Plan>(plan_ptr);
+    fwd_top_data = plan->fwd_top_data;
+    fwd_bottom_data = plan->fwd_bottom_data;
+    reluFwd_pd = plan->reluFwd_pd;
+    reluFwd = plan->reluFwd;
+    fwd_top_data_memory = plan->fwd_top_data_memory;
+    fwd_bottom_data_primitive = plan->fwd_bottom_data_primitive;
+    this->reshape = false;
+}
+
 }  // namespace caffe
 #endif  // #ifdef MKLDNN_SUPPORTED
@@ -7,6 +7,7 @@
 #include <vector>
 #include "engine_parser.hpp"
 #include "mkldnn_layers.hpp"
+#include "../../util/math_functions.hpp"
 
 namespace caffe {
 
@@ -25,6 +26,10 @@ void MKLDNNSplitLayer::Reshape(const vector<Blob*>& bottom,
         "allow in-place computation.";
     top[i]->ReshapeLike(*bottom[0]);
     CHECK_EQ(count, top[i]->count());
+    // share here so the net places top and bottom as one block
+    if (this->top_aliasable(i)) {
+      top[i]->ShareData(*bottom[0]);
+    }
   }
   size_t dim_src = bottom[0]->shape().size();
   this->reshape = false;
@@ -57,7 +62,12 @@ void MKLDNNSplitLayer::LayerSetUp(const vector<Blob*>& bottom,
 void MKLDNNSplitLayer::Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top) {
   for (int i = 0; i < top.size(); ++i) {
-    top[i]->ShareData(*bottom[0]);
+    if (this->top_aliasable(i)) {
+      top[i]->ShareData(*bottom[0]);
+    }
+    else {
+      caffe_copy(bottom[0]->count(), bottom[0]->cpu_data(), top[i]->mutable_cpu_data());
+    }
   }
 }
 
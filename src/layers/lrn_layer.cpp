@@ -2,6 +2,7 @@
 
 #include "./lrn_layer.hpp"
 #include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 
 #ifdef USE_CUDNN
 #include "./cudnn/cudnn_lcn_layer.hpp"
@@ -81,6 +82,7 @@ void LRNLayer::Reshape(const vector<Blob*>& bottom,
   case LRNParameter_NormRegion_ACROSS_CHANNELS:
     top[0]->Reshape(num_, channels_, height_, width_);
     scale_.Reshape(num_, channels_, height_, width_);
+    padded_square_.Reshape(1, channels_ + size_ - 1, height_, width_);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
     split_layer_->Reshape(bottom, split_top_vec_);
@@ -115,41 +117,49 @@ void LRNLayer::CrossChannelForward_cpu(const vector<Blob*>& bottom,
   for (int i = 0; i < scale_.count(); ++i) {
     scale_data[i] = k_;
   }
-  Blob padded_square(1, channels_ + size_ - 1, height_, width_);
-  real_t* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), static_cast<real_t>(0), padded_square_data);
+  real_t* padded_square_data = padded_square_.mutable_cpu_data();
+  caffe_set(padded_square_.count(), static_cast<real_t>(0), padded_square_data);
   real_t alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy(height_ * width_, alpha_over_size,
-        padded_square_data + padded_square.offset(0, c),
-        scale_data + scale_.offset(n, 0));
-    }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy(height_ * width_,
-        scale_data + scale_.offset(n, c - 1),
-        scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy(height_ * width_, alpha_over_size,
-        padded_square_data + padded_square.offset(0, c + size_ - 1),
-        scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy(height_ * width_, -alpha_over_size,
-        padded_square_data + padded_square.offset(0, c - 1),
-        scale_data + scale_.offset(n, c));
+  // every task normalizes its own tile of pixels across channels
+  const int spatial_dim = height_ * width_;
+  const int64_t grain = ParallelGrain(static_cast<int64_t>(num_) * channels_ * 8);
+  parallel_for(0, spatial_dim, grain, [&](int64_t begin, int64_t end) {
+    const int tile = end - begin;
+    // go through the images
+    for (int n = 0; n < num_; ++n) {
+      // compute the padded square
+      for (int c = 0; c < channels_; ++c) {
+        caffe_sqr(tile, bottom_data + bottom[0]->offset(n, c) + begin,
+            padded_square_data + padded_square_.offset(0, pre_pad_ + c) + begin);
+      }
+      // Create the first channel scale
+      for (int c = 0; c < size_; ++c) {
+        caffe_axpy(tile, alpha_over_size,
+          padded_square_data + padded_square_.offset(0, c) + begin,
+          scale_data + scale_.offset(n, 0) + begin);
+      }
+      for (int c = 1; c < channels_; ++c) {
+        // copy previous scale
+        caffe_copy(tile,
+          scale_data + scale_.offset(n, c - 1) + begin,
+          scale_data + scale_.offset(n, c) + begin);
+        // add head
+        caffe_axpy(tile, alpha_over_size,
+          padded_square_data + padded_square_.offset(0, c + size_ - 1) + begin,
+          scale_data + scale_.offset(n, c) + begin);
+        // subtract tail
+        caffe_axpy(tile, -alpha_over_size,
+          padded_square_data + padded_square_.offset(0, c - 1) + begin,
+          scale_data + scale_.offset(n, c) + begin);
+      }
+      // In the end, compute output
+      for (int c = 0; c < channels_; ++c) {
+        const int offset = scale_.offset(n, c) + begin;
+        caffe_powx(tile, scale_data + offset, -beta_, top_data + offset);
+        caffe_mul(tile, top_data + offset, bottom_data + offset, top_data + offset);
+      }
     }
-  }
-
-  // In the end, compute output
-  caffe_powx(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul(scale_.count(), top_data, bottom_data, top_data);
+  });
 }
 
 void LRNLayer::WithinChannelForward(const vector<Blob*>& bottom,
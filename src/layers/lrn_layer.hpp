@@ -27,6 +27,7 @@ class LRNLayer : public Layer {
   virtual const char* type() const { return "LRN"; }
   virtual int ExactNumBottomBlobs() const { return 1; }
   virtual int ExactNumTopBlobs() const { return 1; }
+  virtual vector<Blob*> GetTempBlobs() { return {&scale_, &padded_square_}; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob*>& bottom,
@@ -54,6 +55,8 @@ class LRNLayer : public Layer {
   // Fields used for normalization ACROSS_CHANNELS
   // scale_ stores the intermediate summing results
   Blob scale_;
+  // padded_square_ holds the squared input of one image padded by zeros
+  Blob padded_square_;
 
   // Fields used for normalization WITHIN_CHANNEL
   shared_ptr<SplitLayer> split_layer_;
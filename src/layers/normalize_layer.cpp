@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <vector>
 
 #include "../filler.hpp"
 #include "./normalize_layer.hpp"
+#include "../util/parallel.hpp"
 
 namespace caffe {
 
@@ -88,50 +90,63 @@ void NormalizeLayer::Forward_cpu(const vector<Blob*>& bottom,
   const real_t* bottom_data = bottom[0]->cpu_data();
   real_t* top_data = top[0]->mutable_cpu_data();
   const real_t* scale = this->blobs_[0]->cpu_data();
-  real_t* buffer_data = buffer_.mutable_cpu_data();
   real_t* norm_data = norm_.mutable_cpu_data();
-  // add eps to avoid overflow
-  caffe_set(norm_.count(), real_t(eps_), norm_data);
-  const real_t* sum_channel_multiplier = sum_channel_multiplier_.cpu_data();
-  const real_t* sum_spatial_multiplier = sum_spatial_multiplier_.cpu_data();
-  int num = bottom[0]->num();
-  int dim = bottom[0]->count() / num;
-  int spatial_dim = bottom[0]->height() * bottom[0]->width();
-  int channels = bottom[0]->channels();
-  for (int n = 0; n < num; ++n) {
-    caffe_sqr(dim, bottom_data, buffer_data);
-    if (across_spatial_) {
+  const int num = bottom[0]->num();
+  const int dim = bottom[0]->count() / num;
+  const int spatial_dim = bottom[0]->height() * bottom[0]->width();
+  const int channels = bottom[0]->channels();
+  if (across_spatial_) {
+    // add eps to avoid overflow
+    parallel_for(0, num, ParallelGrain(dim * 2), [&](int64_t begin, int64_t end) {
+      for (int64_t n = begin; n < end; ++n) {
+        const real_t* x = bottom_data + n * dim;
+        norm_data[n] = pow(caffe_cpu_dot(dim, x, x) + eps_, real_t(0.5));
+      }
+    });
+    // every task scales its own channel planes, also splitting single images
+    parallel_for(0, num * channels, ParallelGrain(spatial_dim * 2),
+                 [&](int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; ++i) {
+        const int64_t offset = i * spatial_dim;
+        caffe_cpu_scale(spatial_dim, real_t(1.0 / norm_data[i / channels]),
+                        bottom_data + offset, top_data + offset);
+        caffe_scal(spatial_dim, scale[channel_shared_ ? 0 : i % channels],
+                   top_data + offset);
+      }
+    });
+    return;
+  }
+  // every task normalizes its own pixels across channels, no pixel range
+  // spans two images so the norms of a task are contiguous
+  parallel_for(0, static_cast<int64_t>(num) * spatial_dim, ParallelGrain(channels * 4),
+               [&](int64_t begin, int64_t end) {
+    while (begin < end) {
+      const int64_t n = begin / spatial_dim;
+      const int p = begin - n * spatial_dim;
+      const int tile = std::min<int64_t>(end - begin, spatial_dim - p);
+      const real_t* x = bottom_data + n * dim + p;
+      real_t* y = top_data + n * dim + p;
+      real_t* norm = norm_data + n * spatial_dim + p;
       // add eps to avoid overflow
-      norm_data[n] = pow(caffe_cpu_asum(dim, buffer_data)+eps_,
-                         real_t(0.5));
-      caffe_cpu_scale(dim, real_t(1.0 / norm_data[n]), bottom_data,
-                             top_data);
-    } else {
-      caffe_cpu_gemv(CblasTrans, channels, spatial_dim, real_t(1),
-                            buffer_data, sum_channel_multiplier, real_t(1),
-                            norm_data);
+      for (int j = 0; j < tile; ++j) {
+        norm[j] = eps_;
+      }
+      for (int c = 0; c < channels; ++c) {
+        const real_t* x_c = x + c * spatial_dim;
+        for (int j = 0; j < tile; ++j) {
+          norm[j] += x_c[j] * x_c[j];
+        }
+      }
       // compute norm
-      caffe_powx(spatial_dim, norm_data, real_t(0.5), norm_data);
-      // scale the layer
-      caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, channels, spatial_dim,
-                            1, real_t(1), sum_channel_multiplier, norm_data,
-                            real_t(0), buffer_data);
-      caffe_div(dim, bottom_data, buffer_data, top_data);
-      norm_data += spatial_dim;
+      caffe_powx(tile, norm, real_t(0.5), norm);
+      // scale the layer and the output
+      for (int c = 0; c < channels; ++c) {
+        caffe_div(tile, x + c * spatial_dim, norm, y + c * spatial_dim);
+        caffe_scal(tile, scale[channel_shared_ ? 0 : c], y + c * spatial_dim);
+      }
+      begin += tile;
     }
-    // scale the output
-    if (channel_shared_) {
-      caffe_scal(dim, scale[0], top_data);
-    } else {
-      caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, channels, spatial_dim,
-                            1, real_t(1), scale, sum_spatial_multiplier,
-                            real_t(0),
-                            buffer_data);
-      caffe_mul(dim, top_data, buffer_data, top_data);
-    }
-    bottom_data += dim;
-    top_data += dim;
-  }
+  });
 }
 
 #ifndef USE_CUDA
@@ -2,6 +2,7 @@
 
 #include "./permute_layer.hpp"
 #include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 
 namespace caffe {
 
@@ -9,16 +10,18 @@ template <typename Dtype>
 void Permute(const int count, Dtype* bottom_data,
              const int* permute_order, const int* old_steps, const int* new_steps,
              const int num_axes, Dtype* top_data) {
-  for (int i = 0; i < count; ++i) {
-    int old_idx = 0;
-    int idx = i;
-    for (int j = 0; j < num_axes; ++j) {
-      int order = permute_order[j];
-      old_idx += (idx / new_steps[j]) * old_steps[order];
-      idx %= new_steps[j];
+  parallel_for(0, count, ParallelGrain(num_axes * 4), [&](int64_t begin, int64_t end) {
+    for (int i = begin; i < end; ++i) {
+      int old_idx = 0;
+      int idx = i;
+      for (int j = 0; j < num_axes; ++j) {
+        int order = permute_order[j];
+        old_idx += (idx / new_steps[j]) * old_steps[order];
+        idx %= new_steps[j];
+      }
+      top_data[i] = bottom_data[old_idx];
     }
-    top_data[i] = bottom_data[old_idx];
-  }
+  });
 }
 
 void PermuteLayer::LayerSetUp(const vector<Blob*>& bottom,
@@ -4,6 +4,7 @@
 
 #include "./pooling_layer.hpp"
 #include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 #ifdef USE_MKLDNN
 #include "./intel/mkldnn_layers.hpp"
 #endif
@@ -116,16 +117,19 @@ void PoolingLayer::Forward_cpu(const vector<Blob*>& bottom,
                                const vector<Blob*>& top) {
   const real_t* bottom_data = bottom[0]->cpu_data();
   real_t* top_data = top[0]->mutable_cpu_data();
-  const int top_count = top[0]->count();
   const int bottom_offset = bottom[0]->offset(0, 1);
   const int top_offset = top[0]->offset(0, 1);
+  // every task pools its own channels
+  const int64_t grain = ParallelGrain(static_cast<int64_t>(top_offset) * kernel_h_ * kernel_w_);
   // Different pooling methods. We explicitly do the switch outside the for
   // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
+    parallel_for(0, bottom[0]->num() * channels_, grain, [&](int64_t begin, int64_t end) {
+      for (int64_t nc = begin; nc < end; ++nc) {
+        const real_t* bottom_plane = bottom_data + nc * bottom_offset;
+        real_t* top_plane = top_data + nc * top_offset;
         for (int ph = 0; ph < pooled_height_; ++ph) {
           for (int pw = 0; pw < pooled_width_; ++pw) {
             int hstart = ph * stride_h_ - pad_h_;
@@ -138,24 +142,22 @@ void PoolingLayer::Forward_cpu(const vector<Blob*>& bottom,
             for (int h = hstart; h < hend; ++h) {
               for (int w = wstart; w < wend; ++w) {
                 const int index = h * width_ + w;
-                top_val = max(top_val, bottom_data[index]);
+                top_val = max(top_val, bottom_plane[index]);
               }
             }
             const int pool_index = ph * pooled_width_ + pw;
-            top_data[pool_index] = top_val;
+            top_plane[pool_index] = top_val;
           }
         }
-        // compute offset
-        bottom_data += bottom_offset;
-        top_data += top_offset;
       }
-    }
+    });
     break;
   case PoolingParameter_PoolMethod_AVE:
-    caffe_set(top_count, 0, top_data);
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
+    parallel_for(0, bottom[0]->num() * channels_, grain, [&](int64_t begin, int64_t end) {
+      for (int64_t nc = begin; nc < end; ++nc) {
+        const real_t* bottom_plane = bottom_data + nc * bottom_offset;
+        real_t* top_plane = top_data + nc * top_offset;
         for (int ph = 0; ph < pooled_height_; ++ph) {
           for (int pw = 0; pw < pooled_width_; ++pw) {
             int hstart = ph * stride_h_ - pad_h_;
@@ -167,19 +169,17 @@ void PoolingLayer::Forward_cpu(const vector<Blob*>& bottom,
             wstart = max(wstart, 0);
             hend = min(hend, height_);
             wend = min(wend, width_);
+            real_t top_val = 0;
             for (int h = hstart; h < hend; ++h) {
               for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] += bottom_data[h * width_ + w];
+                top_val += bottom_plane[h * width_ + w];
               }
             }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
+            top_plane[ph * pooled_width_ + pw] = top_val / pool_size;
           }
         }
-        // compute offset
-        bottom_data += bottom_offset;
-        top_data += top_offset;
       }
-    }
+    });
     break;
   default:
     LOG(FATAL) << "Unknown pooling method.";
@@ -194,7 +194,9 @@ STUB_GPU(PoolingLayer);
 
 static shared_ptr<Layer> CreateLayer(const LayerParameter& param) {
 #ifdef USE_MKLDNN
-  return shared_ptr<Layer>(new MKLDNNPoolingLayer(param));
+  if (UseMKLDNNEngine(param)) {
+    return shared_ptr<Layer>(new MKLDNNPoolingLayer(param));
+  }
 #endif
   return shared_ptr<Layer>(new PoolingLayer(param));
 }
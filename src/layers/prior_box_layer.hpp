@@ -37,6 +37,7 @@ class PriorBoxLayer : public Layer {
   virtual inline const char* type() const { return "PriorBox"; }
   virtual inline int ExactBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool UsesBottomData() const { return false; }
 
  protected:
   /**
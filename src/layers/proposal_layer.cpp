@@ -147,23 +147,25 @@ static void GenerateProposalsCPU(const real_t* score_map,
   }
 }
 
+/*! \brief areas and removed are workspaces of num_proposals elements */
 static void NonMaximumSuppressionCPU(const int num_proposals,
                                      const real_t* proposals,
+                                     real_t* areas,
+                                     int* removed,
                                      int* rois_indices,
                                      int& num_rois,
                                      const real_t nms_th,
                                      const int max_num_rois) {
-  vector<real_t> areas(num_proposals);
   const real_t* proposal = proposals;
   for (int i = 0; i < num_proposals; i++) {
     areas[i] = (proposal[2] - proposal[0] + 1)*(proposal[3] - proposal[1] + 1);
+    removed[i] = 0;
     proposal += 5;
   }
   int counter = 0;
-  vector<bool> removed(num_proposals, false);
   for (int i = 0; i < num_proposals; i++) {
     if (!removed[i]) {
-      removed[i] = true;
+      removed[i] = 1;
       rois_indices[counter++] = i;
       if (counter == max_num_rois) break;
       for (int j = i + 1; j < num_proposals; j++) {
@@ -177,7 +179,7 @@ static void NonMaximumSuppressionCPU(const int num_proposals,
         const real_t h = std::max(0.f, y2 - y1 + 1);
         const real_t area = w*h;
         real_t ov = area / (areas[i] + areas[j] - area);
-        if (ov > nms_th) removed[j] = true;
+        if (ov > nms_th) removed[j] = 1;
       }
     }
   }
@@ -256,6 +258,15 @@ void ProposalLayer::Reshape(const vector<Blob*>& bottom,
     top_shape.pop_back();
     top[1]->Reshape(top_shape);
   }
+  // workspaces of Forward, (x1, y1, x2, y2, score) for each proposal
+  const int num_proposals = anchors_.shape(0) * bottom[0]->height() *
+                            bottom[0]->width();
+  const int pre_nms_topn = std::min(num_proposals, pre_nms_topn_);
+  proposals_.Reshape(vector<int>{num_proposals, 5});
+  nms_areas_.Reshape(vector<int>{pre_nms_topn});
+  nms_mask_.Reshape(vector<int>{pre_nms_topn});
+  rois_shape_.assign({0, 5});
+  scores_shape_.assign({0});
 }
 
 void ProposalLayer::Forward_cpu(const vector<Blob*>& bottom,
@@ -290,8 +301,7 @@ void ProposalLayer::Forward_cpu(const vector<Blob*>& bottom,
   //   (x1, y1, x2, y2, score) for each proposal
   // NOTE: for bottom, only foreground scores are passed
   // also clip bbox inside bbox boundary and filter bbox with min_bbox_size
-  vector<int> proposals_shape{num_proposals, 5};
-  proposals_.Reshape(proposals_shape);
+  CHECK_EQ(proposals_.shape(0), num_proposals);
   GenerateProposalsCPU(anchors_score_map+num_proposals, // score for positive
                        anchors_bbox_map,
                        anchors_.cpu_data(),
@@ -304,18 +314,20 @@ void ProposalLayer::Forward_cpu(const vector<Blob*>& bottom,
   SortBBox(proposals_.mutable_cpu_data(), 0, num_proposals - 1, pre_nms_topn);
 
   NonMaximumSuppressionCPU(pre_nms_topn, proposals_.cpu_data(),
+                           nms_areas_.mutable_cpu_data(),
+                           nms_mask_.mutable_cpu_data(),
                            roi_indices_.mutable_cpu_data(), num_rois,
                            nms_thresh_, post_nms_topn_);
 
   RetrieveRoisCPU(num_rois, proposals_.cpu_data(), roi_indices_.cpu_data(),
                   rois, rois_score);
 
-  // reshape if num_rois < post_nms_topn_
-  vector<int> top_shape{num_rois, 5};
-  top[0]->Reshape(top_shape);
+  // shrink if num_rois < post_nms_topn_, tops keep the memory written above
+  rois_shape_[0] = num_rois;
+  top[0]->Reshape(rois_shape_, false);
   if (top.size() > 1) {
-    top_shape.pop_back();
-    top[1]->Reshape(top_shape);
+    scores_shape_[0] = num_rois;
+    top[1]->Reshape(scores_shape_, false);
   }
 }
 
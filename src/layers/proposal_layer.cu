@@ -241,8 +241,7 @@ void ProposalLayer::Forward_gpu(const vector<Blob*>& bottom,
   //   (x1, y1, x2, y2, score) for each proposal
   // NOTE: for bottom, only foreground scores are passed
   // also clip bbox inside bbox boundary and filter bbox with min_bbox_size
-  vector<int> proposals_shape{num_proposals, 5};
-  proposals_.Reshape(proposals_shape);
+  CHECK_EQ(proposals_.shape(0), num_proposals);
   GenerataProposalsGPU<<<CAFFE_GET_BLOCKS(num_proposals), CAFFE_CUDA_NUM_THREADS>>>(
       num_proposals,
       anchors_score_map+num_proposals, // score for positive
@@ -266,12 +265,12 @@ void ProposalLayer::Forward_gpu(const vector<Blob*>& bottom,
       rois, rois_score);
   CUDA_POST_KERNEL_CHECK;
 
-  // reshape if num_rois < post_nms_topn_
-  vector<int> top_shape{num_rois, 5};
-  top[0]->Reshape(top_shape);
+  // shrink if num_rois < post_nms_topn_, tops keep the memory written above
+  rois_shape_[0] = num_rois;
+  top[0]->Reshape(rois_shape_, false);
   if (top.size() > 1) {
-    top_shape.pop_back();
-    top[1]->Reshape(top_shape);
+    scores_shape_[0] = num_rois;
+    top[1]->Reshape(scores_shape_, false);
   }
 }
 
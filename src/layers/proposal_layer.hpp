@@ -17,6 +17,9 @@ class ProposalLayer : public Layer {
                        const vector<Blob*>& top);
 
   virtual const char* type() const { return "ProposalLayer"; }
+  virtual vector<Blob*> GetTempBlobs() {
+    return {&proposals_, &nms_areas_, &nms_mask_};
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob*>& bottom,
@@ -33,7 +36,11 @@ class ProposalLayer : public Layer {
   Blob anchors_;
   Blob proposals_;
   BlobInt roi_indices_;
+  Blob nms_areas_;
   BlobInt nms_mask_;
+  /// @brief shapes of the tops after nms, kept to reshape without allocating
+  vector<int> rois_shape_;
+  vector<int> scores_shape_;
 };
 
 }  // namespace caffe
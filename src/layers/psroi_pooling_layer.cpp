@@ -7,6 +7,7 @@
 
 #include "./psroi_pooling_layer.hpp"
 #include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 
 using std::max;
 using std::min;
@@ -54,55 +55,59 @@ void PSROIPoolingLayer::Forward_cpu(const vector<Blob*>& bottom,
   caffe_set(top_count, static_cast<real_t>(0), top_data);
 
   // For each ROI R = [batch_index x1, y1, x2, y2]: avg pool over R
-  for (int n = 0; n < num_rois; ++n) {
-    const int roi_batch_ind = bottom_rois[0];
-    const real_t roi_start_w = static_cast<real_t>(round(bottom_rois[1]) * spatial_scale_);
-    const real_t roi_start_h = static_cast<real_t>(round(bottom_rois[2]) * spatial_scale_);
-    const real_t roi_end_w = static_cast<real_t>(round(bottom_rois[3] + 1) * spatial_scale_);
-    const real_t roi_end_h = static_cast<real_t>(round(bottom_rois[4] + 1) * spatial_scale_);
-    CHECK_GE(roi_batch_ind, 0);
-    CHECK_LT(roi_batch_ind, batch_size);
+  const int64_t grain = ParallelGrain(static_cast<int64_t>(top[0]->count(1)) * 4);
+  parallel_for(0, num_rois, grain, [&](int64_t begin, int64_t end) {
+    for (int64_t n = begin; n < end; ++n) {
+      const real_t* roi = bottom_rois + bottom[1]->offset(n);
+      real_t* top_roi = top_data + top[0]->offset(n);
+      const int roi_batch_ind = roi[0];
+      const real_t roi_start_w = static_cast<real_t>(round(roi[1]) * spatial_scale_);
+      const real_t roi_start_h = static_cast<real_t>(round(roi[2]) * spatial_scale_);
+      const real_t roi_end_w = static_cast<real_t>(round(roi[3] + 1) * spatial_scale_);
+      const real_t roi_end_h = static_cast<real_t>(round(roi[4] + 1) * spatial_scale_);
+      CHECK_GE(roi_batch_ind, 0);
+      CHECK_LT(roi_batch_ind, batch_size);
 
-    const real_t roi_height = max(roi_end_h - roi_start_h, static_cast<real_t>(0.1));
-    const real_t roi_width = max(roi_end_w - roi_start_w, static_cast<real_t>(0.1));
-    const real_t bin_size_h = roi_height / static_cast<real_t>(pooled_height_);
-    const real_t bin_size_w = roi_width / static_cast<real_t>(pooled_width_);
+      const real_t roi_height = max(roi_end_h - roi_start_h, static_cast<real_t>(0.1));
+      const real_t roi_width = max(roi_end_w - roi_start_w, static_cast<real_t>(0.1));
+      const real_t bin_size_h = roi_height / static_cast<real_t>(pooled_height_);
+      const real_t bin_size_w = roi_width / static_cast<real_t>(pooled_width_);
 
-    const real_t* batch_data = bottom_data + bottom[0]->offset(roi_batch_ind);
-    for (int c = 0; c < output_dim_; ++c) {
-      for (int ph = 0; ph < pooled_height_; ++ph) {
-        for (int pw = 0; pw < pooled_width_; ++pw) {
-          int hstart = static_cast<int>(floor(static_cast<real_t>(ph)*bin_size_h+roi_start_h));
-          int wstart = static_cast<int>(floor(static_cast<real_t>(pw)*bin_size_w+roi_start_w));
-          int hend = static_cast<int>(ceil(static_cast<real_t>(ph+1)*bin_size_h+roi_start_h));
-          int wend = static_cast<int>(ceil(static_cast<real_t>(pw+1)*bin_size_w+roi_start_w));
-          hstart = min(max(hstart, 0), height_);
-          hend = min(max(hend, 0), height_);
-          wstart = min(max(wstart, 0), width_);
-          wend = min(max(wend, 0), width_);
+      const real_t* batch_data = bottom_data + bottom[0]->offset(roi_batch_ind);
+      for (int c = 0; c < output_dim_; ++c) {
+        for (int ph = 0; ph < pooled_height_; ++ph) {
+          for (int pw = 0; pw < pooled_width_; ++pw) {
+            int hstart = static_cast<int>(floor(static_cast<real_t>(ph)*bin_size_h+roi_start_h));
+            int wstart = static_cast<int>(floor(static_cast<real_t>(pw)*bin_size_w+roi_start_w));
+            int hend = static_cast<int>(ceil(static_cast<real_t>(ph+1)*bin_size_h+roi_start_h));
+            int wend = static_cast<int>(ceil(static_cast<real_t>(pw+1)*bin_size_w+roi_start_w));
+            hstart = min(max(hstart, 0), height_);
+            hend = min(max(hend, 0), height_);
+            wstart = min(max(wstart, 0), width_);
+            wend = min(max(wend, 0), width_);
 
-          const bool is_empty = (hend <= hstart) || (wend <= wstart);
-          const int gw = pw;
-          const int gh = ph;
-          const int fm_c = (c*group_size_ + gh)*group_size_ + gw;
-          const real_t* fm_data = batch_data + fm_c * height_ * width_;
-          real_t out_sum = 0;
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              const int bottom_index = h*width_ + w;
-              out_sum += fm_data[bottom_index];
+            const bool is_empty = (hend <= hstart) || (wend <= wstart);
+            const int gw = pw;
+            const int gh = ph;
+            const int fm_c = (c*group_size_ + gh)*group_size_ + gw;
+            const real_t* fm_data = batch_data + fm_c * height_ * width_;
+            real_t out_sum = 0;
+            for (int h = hstart; h < hend; ++h) {
+              for (int w = wstart; w < wend; ++w) {
+                const int bottom_index = h*width_ + w;
+                out_sum += fm_data[bottom_index];
+              }
             }
+            const int bin_area = (hend - hstart)*(wend - wstart);
+            const int pool_idx = ph * pooled_width_ + pw;
+            out_sum = is_empty ? 0. : out_sum / static_cast<real_t>(bin_area);
+            top_roi[pool_idx] = out_sum;
           }
-          const int bin_area = (hend - hstart)*(wend - wstart);
-          const int pool_idx = ph * pooled_width_ + pw;
-          out_sum = is_empty ? 0. : out_sum / static_cast<real_t>(bin_area);
-          top_data[pool_idx] = out_sum;
         }
+        top_roi += top[0]->offset(0, 1);
       }
-      top_data += top[0]->offset(0, 1);
     }
-    bottom_rois += bottom[1]->offset(1);
-  }
+  });
 }
 
 #ifndef USE_CUDA
@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "./relu_layer.hpp"
+#include "../util/parallel.hpp"
 
 #ifdef USE_CUDNN
 #include "./cudnn/cudnn_relu_layer.hpp"
@@ -18,17 +19,19 @@ void ReLULayer::Forward_cpu(const vector<Blob*>& bottom,
   real_t* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
   real_t negative_slope = this->layer_param_.relu_param().negative_slope();
-  if (std::abs(negative_slope) < 1e-6) {
-    for (int i = 0; i < count; ++i) {
-      top_data[i] = std::max(bottom_data[i], static_cast<real_t>(0));
+  parallel_for(0, count, ParallelGrain(1), [&](int64_t begin, int64_t end) {
+    if (std::abs(negative_slope) < 1e-6) {
+      for (int64_t i = begin; i < end; ++i) {
+        top_data[i] = std::max(bottom_data[i], static_cast<real_t>(0));
+      }
     }
-  }
-  else {
-    for (int i = 0; i < count; ++i) {
-      top_data[i] = std::max(bottom_data[i], static_cast<real_t>(0))
-        + negative_slope * std::min(bottom_data[i], static_cast<real_t>(0));
+    else {
+      for (int64_t i = begin; i < end; ++i) {
+        top_data[i] = std::max(bottom_data[i], static_cast<real_t>(0))
+          + negative_slope * std::min(bottom_data[i], static_cast<real_t>(0));
+      }
     }
-  }
+  });
 }
 
 #ifndef USE_CUDA
@@ -39,7 +42,9 @@ STUB_GPU(ReLULayer);
 
 static shared_ptr<Layer> CreateLayer(const LayerParameter& param) {
 #ifdef USE_MKLDNN
-  return shared_ptr<Layer>(new MKLDNNReLULayer(param));
+  if (UseMKLDNNEngine(param)) {
+    return shared_ptr<Layer>(new MKLDNNReLULayer(param));
+  }
 #endif
 #ifdef USE_CUDNN
   if (Caffe::mode() == Caffe::GPU) {
@@ -85,12 +85,14 @@ void ReshapeLayer::Reshape(const vector<Blob*>& bottom,
   top[0]->Reshape(top_shape);
   CHECK_EQ(top[0]->count(), bottom[0]->count())
       << "output count must match input count";
-  top[0]->ShareData(*bottom[0]);
+  if (this->top_aliasable(0)) {
+    top[0]->ShareData(*bottom[0]);
+  }
 }
 
 void ReshapeLayer::Forward_cpu(const vector<Blob*>& bottom,
                                const vector<Blob*>& top) {
-  if (bottom[0] != top[0]) {
+  if (top[0]->data() != bottom[0]->data()) {
     caffe_copy(bottom[0]->count(), bottom[0]->cpu_data(), top[0]->mutable_cpu_data());
   }
 }
@@ -4,6 +4,7 @@
 
 #include "./roi_pooling_layer.hpp"
 #include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 
 using std::max;
 using std::min;
@@ -46,66 +47,69 @@ void ROIPoolingLayer::Forward_cpu(const vector<Blob*>& bottom,
   caffe_set(top_count, static_cast<real_t>(-FLT_MAX), top_data);
 
   // For each ROI R = [batch_index x1 y1 x2 y2]: max pool over R
-  for (int n = 0; n < num_rois; ++n) {
-    int roi_batch_ind = bottom_rois[0];
-    int roi_start_w = round(bottom_rois[1] * spatial_scale_);
-    int roi_start_h = round(bottom_rois[2] * spatial_scale_);
-    int roi_end_w = round(bottom_rois[3] * spatial_scale_);
-    int roi_end_h = round(bottom_rois[4] * spatial_scale_);
-    CHECK_GE(roi_batch_ind, 0);
-    CHECK_LT(roi_batch_ind, batch_size);
-
-    int roi_height = max(roi_end_h - roi_start_h + 1, 1);
-    int roi_width = max(roi_end_w - roi_start_w + 1, 1);
-    const real_t bin_size_h = static_cast<real_t>(roi_height) /
-                              static_cast<real_t>(pooled_height_);
-    const real_t bin_size_w = static_cast<real_t>(roi_width) /
-                              static_cast<real_t>(pooled_width_);
-
-    const real_t* batch_data = bottom_data + bottom[0]->offset(roi_batch_ind);
-
-    for (int c = 0; c < channels_; ++c) {
-      for (int ph = 0; ph < pooled_height_; ++ph) {
-        for (int pw = 0; pw < pooled_width_; ++pw) {
-          // Compute pooling region for this output unit:
-          //  start (included) = floor(ph * roi_height / pooled_height_)
-          //  end (excluded) = ceil((ph + 1) * roi_height / pooled_height_)
-          int hstart = static_cast<int>(floor(static_cast<real_t>(ph)
-                                              * bin_size_h));
-          int wstart = static_cast<int>(floor(static_cast<real_t>(pw)
-                                              * bin_size_w));
-          int hend = static_cast<int>(ceil(static_cast<real_t>(ph + 1)
-                                           * bin_size_h));
-          int wend = static_cast<int>(ceil(static_cast<real_t>(pw + 1)
-                                           * bin_size_w));
-
-          hstart = min(max(hstart + roi_start_h, 0), height_);
-          hend = min(max(hend + roi_start_h, 0), height_);
-          wstart = min(max(wstart + roi_start_w, 0), width_);
-          wend = min(max(wend + roi_start_w, 0), width_);
-
-          bool is_empty = (hend <= hstart) || (wend <= wstart);
-
-          const int pool_index = ph * pooled_width_ + pw;
-          if (is_empty) {
-            top_data[pool_index] = 0;
-          }
+  const int64_t grain = ParallelGrain(static_cast<int64_t>(top[0]->count(1)) * 4);
+  parallel_for(0, num_rois, grain, [&](int64_t begin, int64_t end) {
+    for (int64_t n = begin; n < end; ++n) {
+      const real_t* roi = bottom_rois + bottom[1]->offset(n);
+      real_t* top_roi = top_data + top[0]->offset(n);
+      int roi_batch_ind = roi[0];
+      int roi_start_w = round(roi[1] * spatial_scale_);
+      int roi_start_h = round(roi[2] * spatial_scale_);
+      int roi_end_w = round(roi[3] * spatial_scale_);
+      int roi_end_h = round(roi[4] * spatial_scale_);
+      CHECK_GE(roi_batch_ind, 0);
+      CHECK_LT(roi_batch_ind, batch_size);
+
+      int roi_height = max(roi_end_h - roi_start_h + 1, 1);
+      int roi_width = max(roi_end_w - roi_start_w + 1, 1);
+      const real_t bin_size_h = static_cast<real_t>(roi_height) /
+                                static_cast<real_t>(pooled_height_);
+      const real_t bin_size_w = static_cast<real_t>(roi_width) /
+                                static_cast<real_t>(pooled_width_);
+
+      const real_t* batch_data = bottom_data + bottom[0]->offset(roi_batch_ind);
+
+      for (int c = 0; c < channels_; ++c) {
+        for (int ph = 0; ph < pooled_height_; ++ph) {
+          for (int pw = 0; pw < pooled_width_; ++pw) {
+            // Compute pooling region for this output unit:
+            //  start (included) = floor(ph * roi_height / pooled_height_)
+            //  end (excluded) = ceil((ph + 1) * roi_height / pooled_height_)
+            int hstart = static_cast<int>(floor(static_cast<real_t>(ph)
+                                                * bin_size_h));
+            int wstart = static_cast<int>(floor(static_cast<real_t>(pw)
+                                                * bin_size_w));
+            int hend = static_cast<int>(ceil(static_cast<real_t>(ph + 1)
+                                             * bin_size_h));
+            int wend = static_cast<int>(ceil(static_cast<real_t>(pw + 1)
+                                             * bin_size_w));
+
+            hstart = min(max(hstart + roi_start_h, 0), height_);
+            hend = min(max(hend + roi_start_h, 0), height_);
+            wstart = min(max(wstart + roi_start_w, 0), width_);
+            wend = min(max(wend + roi_start_w, 0), width_);
+
+            bool is_empty = (hend <= hstart) || (wend <= wstart);
+
+            const int pool_index = ph * pooled_width_ + pw;
+            if (is_empty) {
+              top_roi[pool_index] = 0;
+            }
 
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              const int index = h * width_ + w;
-              top_data[pool_index] = max(top_data[pool_index], batch_data[index]);
+            for (int h = hstart; h < hend; ++h) {
+              for (int w = wstart; w < wend; ++w) {
+                const int index = h * width_ + w;
+                top_roi[pool_index] = max(top_roi[pool_index], batch_data[index]);
+              }
             }
           }
         }
+        // Increment all data pointers by one channel
+        batch_data += bottom[0]->offset(0, 1);
+        top_roi += top[0]->offset(0, 1);
       }
-      // Increment all data pointers by one channel
-      batch_data += bottom[0]->offset(0, 1);
-      top_data += top[0]->offset(0, 1);
     }
-    // Increment ROI data pointer
-    bottom_rois += bottom[1]->offset(1);
-  }
+  });
 }
 
 #ifndef USE_CUDA
@@ -4,6 +4,7 @@
 #include "./scale_layer.hpp"
 #include "../filler.hpp"
 #include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 
 namespace caffe {
 
@@ -54,9 +55,17 @@ void ScaleLayer::LayerSetUp(const vector<Blob*>& bottom,
     bias_bottom_vec_.resize(1);
     bias_bottom_vec_[0] = bottom[0];
     bias_layer_->SetUp(bias_bottom_vec_, top);
-    bias_param_id_ = this->blobs_.size();
-    this->blobs_.resize(bias_param_id_ + 1);
-    this->blobs_[bias_param_id_] = bias_layer_->blobs()[0];
+    if (this->blobs_.size() + bottom.size() < 3) {
+      // case: blobs.size == 1 && bottom.size == 1
+      // or blobs.size == 0 && bottom.size == 2
+      bias_param_id_ = this->blobs_.size();
+      this->blobs_.resize(bias_param_id_ + 1);
+      this->blobs_[bias_param_id_] = bias_layer_->blobs()[0];
+    } else {
+      // bias param already initialized
+      bias_param_id_ = this->blobs_.size() - 1;
+      bias_layer_->blobs()[0] = this->blobs_[bias_param_id_];
+    }
     bias_propagate_down_.resize(1, false);
   }
 }
@@ -99,14 +108,15 @@ void ScaleLayer::Forward_cpu(const vector<Blob*>& bottom,
   const real_t* scale_data =
       ((bottom.size() > 1) ? bottom[1] : this->blobs_[0].get())->cpu_data();
   real_t* top_data = top[0]->mutable_cpu_data();
-  for (int n = 0; n < outer_dim_; ++n) {
-    for (int d = 0; d < scale_dim_; ++d) {
-      const real_t factor = scale_data[d];
-      caffe_cpu_scale(inner_dim_, factor, bottom_data, top_data);
-      bottom_data += inner_dim_;
-      top_data += inner_dim_;
+  // every task scales its own planes
+  parallel_for(0, outer_dim_ * scale_dim_, ParallelGrain(inner_dim_),
+               [&](int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) {
+      const real_t factor = scale_data[i % scale_dim_];
+      caffe_cpu_scale(inner_dim_, factor, bottom_data + i * inner_dim_,
+                      top_data + i * inner_dim_);
     }
-  }
+  });
   if (bias_layer_) {
     bias_layer_->Forward(bias_bottom_vec_, top);
   }
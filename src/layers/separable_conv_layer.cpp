@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "./separable_conv_layer.hpp"
+#include "../filler.hpp"
+#include "../thread_local.hpp"
+#include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
+
+namespace caffe {
+
+namespace {
+
+// a band keeps its depthwise output within this size, half of a typical L2
+const int64_t kBandBytes = 256 << 10;
+
+// depthwise output of the band a thread works on
+struct SeparableBand {
+  vector<real_t> data;
+};
+
+}  // namespace
+
+void SeparableConvolutionLayer::LayerSetUp(const vector<Blob*>& bottom,
+                                           const vector<Blob*>& top) {
+  const bool create_blobs = this->blobs_.empty();
+  ConvolutionDepthwiseLayer::LayerSetUp(bottom, top);
+  const LayerParameter& param = this->layer_param_;
+  const int channels = bottom[0]->channels();
+  num_output_ = param.inner_product_param().num_output();
+  CHECK_GT(num_output_, 0) << "SeparableConvolution needs the num_output of its 1x1 convolution";
+  vector<vector<int> > shapes;
+  shapes.push_back({channels, 1, static_cast<int>(kernel_h_), static_cast<int>(kernel_w_)});
+  if (param.convolution_param().bias_term()) {
+    shapes.push_back({channels});
+  }
+  batch_norm_blob_ = -1;
+  if (param.has_batch_norm_param()) {
+    CHECK(!param.batch_norm_param().has_use_global_stats() ||
+          param.batch_norm_param().use_global_stats())
+        << "SeparableConvolution only fuses BatchNorm with global stats";
+    batch_norm_blob_ = shapes.size();
+    shapes.push_back({channels});
+    shapes.push_back({channels});
+    shapes.push_back({1});
+  }
+  scale_blob_ = -1;
+  if (param.has_scale_param()) {
+    scale_blob_ = shapes.size();
+    shapes.push_back({channels});
+    if (param.scale_param().bias_term()) {
+      shapes.push_back({channels});
+    }
+  }
+  pointwise_blob_ = shapes.size();
+  shapes.push_back({num_output_, channels, 1, 1});
+  if (param.inner_product_param().bias_term()) {
+    shapes.push_back({num_output_});
+  }
+  if (create_blobs) {
+    // the depthwise blobs are filled, the others wait for trained weights
+    for (size_t i = this->blobs_.size(); i < shapes.size(); ++i) {
+      this->blobs_.emplace_back(new Blob(shapes[i]));
+      FillConstant(this->blobs_[i].get(), 0);
+    }
+  }
+  CHECK_EQ(this->blobs_.size(), shapes.size())
+      << "Incompatible number of blobs for layer " << param.name();
+  for (size_t i = 0; i < shapes.size(); ++i) {
+    CHECK(this->blobs_[i]->shape() == shapes[i])
+        << "Blob " << i << " of layer " << param.name() << " mismatch, "
+        << this->blobs_[i]->shape_string();
+  }
+}
+
+void SeparableConvolutionLayer::Reshape(const vector<Blob*>& bottom,
+                                        const vector<Blob*>& top) {
+  const int channels = bottom[0]->channels();
+  const int top_height = (bottom[0]->height() + 2 * pad_h_ -
+                          (dilation_h_ * (kernel_h_ - 1) + 1)) / stride_h_ + 1;
+  const int top_width = (bottom[0]->width() + 2 * pad_w_ -
+                         (dilation_w_ * (kernel_w_ - 1) + 1)) / stride_w_ + 1;
+  top[0]->Reshape({bottom[0]->num(), num_output_, top_height, top_width});
+  affine_.Reshape({2, channels});
+  folded_.Reshape({channels * static_cast<int>(kernel_h_ * kernel_w_ + 1)});
+  // folded again on the next forward, so they follow weights loaded into a
+  // planned net
+  weights_ready_ = false;
+  const int64_t row_bytes = static_cast<int64_t>(channels) * top_width * sizeof(real_t);
+  band_height_ = static_cast<int>(std::max<int64_t>(1, std::min<int64_t>(
+      top_height, kBandBytes / std::max<int64_t>(1, row_bytes))));
+}
+
+void SeparableConvolutionLayer::PrepareWeights(const DepthwiseArgs& args) {
+  const LayerParameter& param = this->layer_param_;
+  const int channels = args.channels;
+  // y = a x + b per channel for BatchNorm then Scale
+  real_t* a = affine_.mutable_cpu_data();
+  real_t* b = a + channels;
+  caffe_set(channels, static_cast<real_t>(1), a);
+  caffe_set(channels, static_cast<real_t>(0), b);
+  if (batch_norm_blob_ >= 0) {
+    const real_t* mean = this->blobs_[batch_norm_blob_]->cpu_data();
+    const real_t* variance = this->blobs_[batch_norm_blob_ + 1]->cpu_data();
+    const real_t factor = this->blobs_[batch_norm_blob_ + 2]->cpu_data()[0];
+    const real_t scale_factor = factor == 0 ? 0 : 1 / factor;
+    const real_t eps = param.batch_norm_param().eps();
+    for (int c = 0; c < channels; ++c) {
+      a[c] = 1 / std::sqrt(variance[c] * scale_factor + eps);
+      b[c] = -mean[c] * scale_factor * a[c];
+    }
+  }
+  if (scale_blob_ >= 0) {
+    const real_t* gamma = this->blobs_[scale_blob_]->cpu_data();
+    const real_t* beta = param.scale_param().bias_term() ?
+        this->blobs_[scale_blob_ + 1]->cpu_data() : NULL;
+    for (int c = 0; c < channels; ++c) {
+      a[c] *= gamma[c];
+      b[c] = b[c] * gamma[c] + (beta ? beta[c] : 0);
+    }
+  }
+  if (FoldsAffine(args)) {
+    const int kernel_dim = kernel_h_ * kernel_w_;
+    real_t* folded_weight = folded_.mutable_cpu_data();
+    real_t* folded_bias = folded_weight + channels * kernel_dim;
+    for (int c = 0; c < channels; ++c) {
+      for (int k = 0; k < kernel_dim; ++k) {
+        folded_weight[c * kernel_dim + k] = a[c] * args.weight[c * kernel_dim + k];
+      }
+      folded_bias[c] = a[c] * (args.bias ? args.bias[c] : 0) + b[c];
+    }
+  }
+}
+
+void SeparableConvolutionLayer::Forward_cpu(const vector<Blob*>& bottom,
+                                            const vector<Blob*>& top) {
+  const LayerParameter& param = this->layer_param_;
+  const int num = bottom[0]->num();
+  const int channels = bottom[0]->channels();
+  DepthwiseArgs args = GetArgs(*bottom[0]);
+  if (!weights_ready_) {
+    PrepareWeights(args);
+    weights_ready_ = true;
+  }
+  const real_t* a = affine_.cpu_data();
+  const real_t* b = a + channels;
+  const bool relu = param.has_relu_param();
+  const real_t negative_slope = param.relu_param().negative_slope();
+  const real_t* weight = this->blobs_[pointwise_blob_]->cpu_data();
+  const real_t* bias = param.inner_product_param().bias_term() ?
+      this->blobs_[pointwise_blob_ + 1]->cpu_data() : NULL;
+
+  // BatchNorm and Scale are folded into the depthwise kernel unless a ReLU
+  // of the depthwise convolution comes first, then they take a pass over
+  // bands, as does a ReLU following the one of the depthwise convolution
+  bool band_pass = false;
+  if (FoldsAffine(args)) {
+    args.weight = folded_.cpu_data();
+    args.bias = args.weight + channels * kernel_h_ * kernel_w_;
+  }
+  else if (batch_norm_blob_ >= 0 || scale_blob_ >= 0) {
+    band_pass = true;
+  }
+  if (relu && !band_pass) {
+    if (args.relu) {
+      band_pass = true;
+    }
+    else {
+      args.relu = true;
+      args.negative_slope = negative_slope;
+    }
+  }
+  const DepthwiseKernel kernel = GetDepthwiseKernel(args);
+  const int top_dim = args.top_height * args.top_width;
+  const int bands = (args.top_height + band_height_ - 1) / band_height_;
+  const int64_t bottom_dim = static_cast<int64_t>(channels) * args.height * args.width;
+  real_t* top_data = top[0]->mutable_cpu_data();
+  // every task runs bands of rows through both convolutions
+  const int64_t band_cost = static_cast<int64_t>(band_height_) * args.top_width * channels *
+                            (kernel_h_ * kernel_w_ + num_output_);
+  parallel_for(0, num * bands, ParallelGrain(band_cost), [&](int64_t begin, int64_t end) {
+    vector<real_t>& band = ThreadLocalStore<SeparableBand>::Get()->data;
+    band.resize(static_cast<size_t>(channels) * band_height_ * args.top_width);
+    for (int64_t i = begin; i < end; ++i) {
+      const int n = i / bands;
+      DepthwiseArgs band_args = args;
+      band_args.bottom = args.bottom + n * bottom_dim;
+      band_args.row_begin = i % bands * band_height_;
+      band_args.row_end = std::min(args.top_height, band_args.row_begin + band_height_);
+      const int band_dim = (band_args.row_end - band_args.row_begin) * args.top_width;
+      band_args.top = band.data();
+      band_args.top_stride = band_dim;
+      kernel(band_args, 0, channels);
+      if (band_pass) {
+        const real_t slope = relu ? negative_slope : 1;
+        for (int c = 0; c < channels; ++c) {
+          real_t* x = band.data() + c * band_dim;
+          for (int j = 0; j < band_dim; ++j) {
+            const real_t y = a[c] * x[j] + b[c];
+            x[j] = y > 0 ? y : y * slope;
+          }
+        }
+      }
+      // top columns of the band, rows of the top are top_dim apart
+      real_t* out = top_data + (static_cast<int64_t>(n) * num_output_ * top_dim +
+                                band_args.row_begin * args.top_width);
+      cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, num_output_, band_dim, channels,
+                  1, weight, channels, band.data(), band_dim, 0, out, top_dim);
+      if (bias) {
+        for (int m = 0; m < num_output_; ++m) {
+          caffe_add_scalar(band_dim, bias[m], out + m * top_dim);
+        }
+      }
+    }
+  });
+}
+
+REGISTER_LAYER_CLASS(SeparableConvolution);
+
+}  // namespace caffe
@@ -0,0 +1,69 @@
+#ifndef CAFFE_SEPARABLE_CONV_LAYER_HPP_
+#define CAFFE_SEPARABLE_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "./conv_dw_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief ConvolutionDepthwise, then optional BatchNorm, Scale and ReLU, then a
+ *        1x1 Convolution, built by Net::CompilationRuleSeparableFusion.
+ *
+ * Runs over bands of output rows: the depthwise output of a band stays in
+ * cache until the pointwise GEMM reads it, the full intermediate feature map
+ * is never written.
+ *
+ * convolution_param is the one of the depthwise convolution,
+ * inner_product_param holds num_output and bias_term of the pointwise one,
+ * batch_norm_param, scale_param and relu_param are set for the layers in
+ * between. Blobs are those of the fused layers in order.
+ */
+class SeparableConvolutionLayer : public ConvolutionDepthwiseLayer {
+ public:
+  explicit SeparableConvolutionLayer(const LayerParameter& param)
+      : ConvolutionDepthwiseLayer(param), weights_ready_(false) {}
+  virtual void LayerSetUp(const vector<Blob*>& bottom,
+                          const vector<Blob*>& top);
+  virtual void Reshape(const vector<Blob*>& bottom,
+                       const vector<Blob*>& top);
+  virtual void ParamsChanged() { weights_ready_ = false; }
+  virtual inline const char* type() const { return "SeparableConvolution"; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob*>& bottom,
+                           const vector<Blob*>& top);
+  virtual void Forward_gpu(const vector<Blob*>& bottom,
+                           const vector<Blob*>& top) {
+    Forward_cpu(bottom, top);
+  }
+
+  /// @brief BatchNorm and Scale go into the depthwise weights, unless a
+  ///        ReLU of the depthwise convolution runs before them
+  bool FoldsAffine(const DepthwiseArgs& args) const {
+    return (batch_norm_blob_ >= 0 || scale_blob_ >= 0) && !args.relu;
+  }
+  /// @brief compute affine_ and folded_ from the weights
+  void PrepareWeights(const DepthwiseArgs& args);
+
+  int num_output_;
+  // index of the first blob of BatchNorm, Scale and the pointwise
+  // convolution, -1 for missing layers
+  int batch_norm_blob_;
+  int scale_blob_;
+  int pointwise_blob_;
+  // output rows of a band
+  int band_height_;
+  // multiplier and shift of BatchNorm and Scale per channel
+  Blob affine_;
+  // depthwise weights and bias with the multiplier and shift folded in
+  Blob folded_;
+  // affine_ and folded_ are computed on the first forward after Reshape or
+  // ParamsChanged
+  bool weights_ready_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_SEPARABLE_CONV_LAYER_HPP_
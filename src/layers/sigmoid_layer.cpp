@@ -2,6 +2,8 @@
 #include <vector>
 
 #include "./sigmoid_layer.hpp"
+#include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 
 #ifdef USE_CUDNN
 #include "./cudnn/cudnn_sigmoid_layer.hpp"
@@ -9,18 +11,14 @@
 
 namespace caffe {
 
-inline real_t sigmoid(real_t x) {
-  return 1. / (1. + exp(-x));
-}
-
 void SigmoidLayer::Forward_cpu(const vector<Blob*>& bottom,
                                const vector<Blob*>& top) {
   const real_t* bottom_data = bottom[0]->cpu_data();
   real_t* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = sigmoid(bottom_data[i]);
-  }
+  parallel_for(0, count, ParallelGrain(16), [&](int64_t begin, int64_t end) {
+    caffe_sigmoid(end - begin, bottom_data + begin, top_data + begin);
+  });
 }
 
 #ifndef USE_CUDA
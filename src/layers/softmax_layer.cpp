@@ -3,6 +3,7 @@
 
 #include "./softmax_layer.hpp"
 #include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 
 #ifdef USE_CUDNN
 #include "./cudnn/cudnn_softmax_layer.hpp"
@@ -31,35 +32,40 @@ void SoftmaxLayer::Forward_cpu(const vector<Blob*>& bottom,
   const real_t* bottom_data = bottom[0]->cpu_data();
   real_t* top_data = top[0]->mutable_cpu_data();
   real_t* scale_data = scale_.mutable_cpu_data();
+  const real_t* multiplier = sum_multiplier_.cpu_data();
   int channels = bottom[0]->shape(softmax_axis_);
   int dim = bottom[0]->count() / outer_num_;
   caffe_copy(bottom[0]->count(), bottom_data, top_data);
   // We need to subtract the max to avoid numerical issues, compute the exp,
-  // and then normalize.
-  for (int i = 0; i < outer_num_; ++i) {
-    // initialize scale_data to the first plane
-    caffe_copy(inner_num_, bottom_data + i * dim, scale_data);
-    for (int j = 0; j < channels; j++) {
-      for (int k = 0; k < inner_num_; k++) {
-        scale_data[k] = std::max(scale_data[k],
-            bottom_data[i * dim + j * inner_num_ + k]);
+  // and then normalize. Every outer slice has its own plane of scale_.
+  parallel_for(0, outer_num_, ParallelGrain(dim * 4), [&](int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) {
+      real_t* top_slice = top_data + i * dim;
+      real_t* scale_slice = scale_data + i * inner_num_;
+      // initialize scale_slice to the first plane
+      caffe_copy(inner_num_, bottom_data + i * dim, scale_slice);
+      for (int j = 0; j < channels; j++) {
+        for (int k = 0; k < inner_num_; k++) {
+          scale_slice[k] = std::max(scale_slice[k],
+              bottom_data[i * dim + j * inner_num_ + k]);
+        }
+      }
+      // subtraction
+      caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, channels, inner_num_,
+        1, static_cast<real_t>(-1), multiplier, scale_slice,
+        static_cast<real_t>(1), top_slice);
+      // exponentiation
+      caffe_exp(dim, top_slice, top_slice);
+      // sum after exp
+      caffe_cpu_gemv(CblasTrans, channels, inner_num_, static_cast<real_t>(1),
+        top_slice, multiplier, static_cast<real_t>(0), scale_slice);
+      // division
+      for (int j = 0; j < channels; j++) {
+        caffe_div(inner_num_, top_slice, scale_slice, top_slice);
+        top_slice += inner_num_;
       }
     }
-    // subtraction
-    caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, channels, inner_num_,
-      1, static_cast<real_t>(-1), sum_multiplier_.cpu_data(), scale_data,
-      static_cast<real_t>(1), top_data);
-    // exponentiation
-    caffe_exp(dim, top_data, top_data);
-    // sum after exp
-    caffe_cpu_gemv(CblasTrans, channels, inner_num_, static_cast<real_t>(1),
-      top_data, sum_multiplier_.cpu_data(), static_cast<real_t>(0), scale_data);
-    // division
-    for (int j = 0; j < channels; j++) {
-      caffe_div(inner_num_, top_data, scale_data, top_data);
-      top_data += inner_num_;
-    }
-  }
+  });
 }
 
 #ifndef USE_CUDA
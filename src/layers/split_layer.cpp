@@ -20,13 +20,19 @@ void SplitLayer::Reshape(const vector<Blob*>& bottom,
         "allow in-place computation.";
     top[i]->ReshapeLike(*bottom[0]);
     CHECK_EQ(count_, top[i]->count());
+    // share here so the net places top and bottom as one block
+    if (this->top_aliasable(i)) {
+      top[i]->ShareData(*bottom[0]);
+    }
   }
 }
 
 void SplitLayer::Forward_cpu(const vector<Blob*>& bottom,
                              const vector<Blob*>& top) {
   for (int i = 0; i < top.size(); ++i) {
-    caffe_copy(bottom[0]->count(), bottom[0]->cpu_data(), top[i]->mutable_cpu_data());
+    if (top[i]->data() != bottom[0]->data()) {
+      caffe_copy(count_, bottom[0]->cpu_data(), top[i]->mutable_cpu_data());
+    }
   }
 }
 
@@ -37,7 +43,9 @@ void SplitLayer::Forward_gpu(const vector<Blob*>& bottom,
 // Creator
 static shared_ptr<Layer> CreateLayer(const LayerParameter &param) {
 #ifdef USE_MKLDNN
-  return shared_ptr<Layer>(new MKLDNNSplitLayer(param));
+  if (UseMKLDNNEngine(param)) {
+    return shared_ptr<Layer>(new MKLDNNSplitLayer(param));
+  }
 #endif
   return shared_ptr<Layer>(new SplitLayer(param));
 }
@@ -8,8 +8,9 @@
 namespace caffe {
 
 /**
- * @brief Creates a "split" path in the network by copying the bottom Blob
- *        into multiple top Blob%s to be used by multiple consuming layers.
+ * @brief Creates a "split" path in the network by sharing the bottom Blob
+ *        with multiple top Blob%s to be used by multiple consuming layers.
+ *        A top written in place by a later layer gets a copy instead.
  *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
@@ -4,6 +4,8 @@
 #include <vector>
 
 #include "./tanh_layer.hpp"
+#include "../util/math_functions.hpp"
+#include "../util/parallel.hpp"
 
 #ifdef USE_CUDNN
 #include "./cudnn/cudnn_tanh_layer.hpp"
@@ -16,9 +18,9 @@ void TanHLayer::Forward_cpu(const vector<Blob*>& bottom,
   const real_t* bottom_data = bottom[0]->cpu_data();
   real_t* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = tanh(bottom_data[i]);
-  }
+  parallel_for(0, count, ParallelGrain(16), [&](int64_t begin, int64_t end) {
+    caffe_tanh(end - begin, bottom_data + begin, top_data + begin);
+  });
 }
 
 #ifndef USE_CUDA
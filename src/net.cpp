@@ -1,6 +1,13 @@
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <list>
 #include <map>
 #include <set>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -10,20 +17,107 @@
 
 #include "caffe/net.hpp"
 #include "caffe/profiler.hpp"
+#include "./filler.hpp"
 #include "./layer.hpp"
 #include "./util/math_functions.hpp"
 #include "./util/upgrade_proto.hpp"
 #include "./proto/caffe.pb.h"
 #include "./util/remove_batch_norm.hpp"
+#include "./layers/concat_layer.hpp"
 #include "util/insert_splits.hpp"
+#include "util/mapped_file.hpp"
+#include "util/parallel.hpp"
+#include "util/thread_pool.hpp"
+#ifdef USE_MKLDNN
+#include "./layers/intel/mkldnn_layers.hpp"
+#endif
 
 namespace caffe {
 
-Net::Net(const string& param_file) {
+Net::Net(const string& param_file)
+    : naive_memory_bytes_(0), planned_memory_bytes_(0), inter_op_threads_(1),
+      intra_op_threads_(1), plan_cache_size_(0), alloc_audit_warmup_(0),
+      alloc_audit_countdown_(0), audited_allocations_(0), plans_placed_(0),
+      model_(NULL), num_contexts_(0) {
   NetParameter param;
   ReadNetParamsFromTextFileOrDie(param_file, &param);
   Init(param);
 }
+
+namespace {
+
+// flat weights file, see Net::SaveFlatWeights
+const char kFlatMagic[8] = {'C', 'A', 'F', 'F', 'E', 'F', 'L', 'T'};
+const uint32_t kFlatVersion = 1;
+const uint64_t kFlatAlign = 64;
+
+struct FlatTensor {
+  string layer;
+  int index;
+  vector<int> shape;
+  uint64_t offset;
+};
+
+bool IsFlatWeightsFile(const string& file) {
+  std::ifstream in(file.c_str(), std::ios::binary);
+  char magic[sizeof(kFlatMagic)];
+  return in.read(magic, sizeof(magic)) &&
+         std::equal(magic, magic + sizeof(magic), kFlatMagic);
+}
+
+// read a value of index, checking it stays in file
+template<typename T>
+T ReadFlat(const MappedFile& file, uint64_t* pos, size_t len = sizeof(T)) {
+  CHECK_LE(*pos + len, file.size()) << "Flat weights file is truncated";
+  T value;
+  std::memcpy(&value, file.data() + *pos, sizeof(T));
+  *pos += len;
+  return value;
+}
+
+void ParseFlatIndex(const MappedFile& file, vector<FlatTensor>* tensors) {
+  uint64_t pos = sizeof(kFlatMagic);
+  CHECK_EQ(ReadFlat<uint32_t>(file, &pos), kFlatVersion)
+      << "Unsupported flat weights version";
+  tensors->resize(ReadFlat<uint32_t>(file, &pos));
+  for (auto& tensor : *tensors) {
+    const uint32_t name_len = ReadFlat<uint32_t>(file, &pos);
+    CHECK_LE(pos + name_len, file.size()) << "Flat weights file is truncated";
+    tensor.layer.assign(file.data() + pos, name_len);
+    pos += name_len;
+    tensor.index = ReadFlat<uint32_t>(file, &pos);
+    tensor.shape.resize(ReadFlat<uint32_t>(file, &pos));
+    uint64_t count = 1;
+    for (auto& dim : tensor.shape) {
+      dim = ReadFlat<int32_t>(file, &pos);
+      CHECK_GE(dim, 0);
+      count *= dim;
+    }
+    tensor.offset = ReadFlat<uint64_t>(file, &pos);
+    CHECK_EQ(tensor.offset % kFlatAlign, 0);
+    CHECK_LE(tensor.offset + count * sizeof(real_t), file.size())
+        << "Flat weights file is truncated";
+  }
+}
+
+}  // namespace
+
+Net::Net(const string& param_file, const string& model_file)
+    : naive_memory_bytes_(0), planned_memory_bytes_(0), inter_op_threads_(1),
+      intra_op_threads_(1), plan_cache_size_(0), alloc_audit_warmup_(0),
+      alloc_audit_countdown_(0), audited_allocations_(0), plans_placed_(0),
+      model_(NULL), num_contexts_(0) {
+  const uint64_t start = Profiler::Get()->Now();
+  NetParameter param, weights;
+  ReadNetParamsFromTextFileOrDie(param_file, &param);
+  if (IsFlatWeightsFile(model_file)) {
+    InitFromFlatWeights(param, model_file);
+    return;
+  }
+  ReadNetParamsFromBinaryFileOrDie(model_file, &weights);
+  LOG(INFO) << "[Load] parse " << (Profiler::Get()->Now() - start) / 1000. << " ms";
+  Init(param, &weights);
+}
 //mkldnn
 void Net::GetBlobConsumers(
                   std::vector<const LayerParameter*>& consumer_blobs,
@@ -686,6 +780,177 @@ void Net::CompilationRuleConvSumFusion(const NetParameter& param,
 
   return;
 }
+
+void Net::CompilationRuleDepthwiseReluFusion(const NetParameter& param,
+                                             NetParameter* param_compiled) {
+  std::set<std::string> layers_to_drop;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    LayerParameter* layer_param =
+        (const_cast<NetParameter&>(param)).mutable_layer(i);
+    if (layers_to_drop.count(layer_param->name())) {
+      LOG(INFO) << "Dropped layer: " << layer_param->name();
+      continue;
+    }
+    // ConvolutionDepthwise applies the ReLU while its output is in registers
+    if (layer_param->type() == "ConvolutionDepthwise" &&
+        layer_param->top_size() == 1 &&
+        !layer_param->convolution_param().relu() &&
+        i + 1 < param.layer_size()) {
+      std::vector<const LayerParameter*> consumers;
+      GetBlobConsumers(consumers, layer_param->top(0), param, i + 1);
+      if (consumers.empty()) {
+        param_compiled->add_layer()->CopyFrom(*layer_param);
+        continue;
+      }
+      const LayerParameter& relu = *consumers[0];
+      const bool in_place = relu.top_size() == 1 && relu.top(0) == relu.bottom(0);
+      // later readers of an in place ReLU see its output, other ones the
+      // depthwise output
+      if (relu.type() == "ReLU" && relu.bottom_size() == 1 &&
+          relu.top_size() == 1 && (in_place || consumers.size() == 1)) {
+        layers_to_drop.insert(relu.name());
+        layer_param->set_top(0, relu.top(0));
+        layer_param->mutable_convolution_param()->set_relu(true);
+        layer_param->mutable_convolution_param()->set_negative_slope(
+            relu.relu_param().negative_slope());
+      }
+    }
+    param_compiled->add_layer()->CopyFrom(*layer_param);
+  }
+}
+
+namespace {
+
+// layers without an MKL engine in MKLDNN builds run the reference code
+#ifdef USE_MKLDNN
+bool UsesReferenceEngine(const LayerParameter& layer) {
+  return layer.engine().compare(0, 5, "CAFFE") == 0;
+}
+#else
+bool UsesReferenceEngine(const LayerParameter& /*layer*/) {
+  return true;
+}
+#endif
+
+// every entry of a repeated size field, or the default without entries
+bool AllEqual(const google::protobuf::RepeatedField<uint32_t>& field, uint32_t value) {
+  for (int i = 0; i < field.size(); ++i) {
+    if (field.Get(i) != value) return false;
+  }
+  return true;
+}
+
+bool IsPointwiseConvolution(const LayerParameter& layer) {
+  const ConvolutionParameter& conv = layer.convolution_param();
+  const bool kernel_1x1 = conv.has_kernel_h() || conv.has_kernel_w() ?
+      conv.kernel_h() == 1 && conv.kernel_w() == 1 :
+      conv.kernel_size_size() > 0 && AllEqual(conv.kernel_size(), 1);
+  const bool stride_1 = conv.has_stride_h() || conv.has_stride_w() ?
+      conv.stride_h() == 1 && conv.stride_w() == 1 : AllEqual(conv.stride(), 1);
+  return layer.type() == "Convolution" && layer.bottom_size() == 1 &&
+         layer.top_size() == 1 && UsesReferenceEngine(layer) && kernel_1x1 &&
+         stride_1 && AllEqual(conv.pad(), 0) && conv.pad_h() == 0 &&
+         conv.pad_w() == 0 && AllEqual(conv.dilation(), 1) && conv.group() == 1 &&
+         conv.axis() == 1 && !conv.relu() && conv.num_output() > 0;
+}
+
+}  // namespace
+
+void Net::CompilationRuleSeparableFusion(const NetParameter& param,
+                                         NetParameter* param_compiled) {
+#ifdef USE_CUDA
+  // the fused layer has no GPU code
+  param_compiled->mutable_layer()->CopyFrom(param.layer());
+  return;
+#endif
+  std::set<std::string> layers_to_drop;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    LayerParameter* layer_param =
+        (const_cast<NetParameter&>(param)).mutable_layer(i);
+    if (layers_to_drop.count(layer_param->name())) {
+      LOG(INFO) << "Dropped layer: " << layer_param->name();
+      continue;
+    }
+    if (layer_param->type() != "ConvolutionDepthwise" ||
+        layer_param->bottom_size() != 1 || layer_param->top_size() != 1) {
+      param_compiled->add_layer()->Swap(layer_param);
+      continue;
+    }
+    // follow the first reader of every top up to the 1x1 convolution
+    vector<int> chain(1, i);
+    int batch_norm = -1, scale = -1, relu = -1, pointwise = -1;
+    while (pointwise < 0) {
+      const LayerParameter& last = param.layer(chain.back());
+      int next = chain.back() + 1;
+      while (next < param.layer_size() &&
+             std::find(param.layer(next).bottom().begin(), param.layer(next).bottom().end(),
+                       last.top(0)) == param.layer(next).bottom().end()) {
+        ++next;
+      }
+      if (next == param.layer_size()) break;
+      const LayerParameter& layer = param.layer(next);
+      const bool unary = layer.bottom_size() == 1 && layer.top_size() == 1;
+      if (layer.type() == "BatchNorm" && unary && batch_norm < 0 && scale < 0 &&
+          relu < 0 && UsesReferenceEngine(layer) &&
+          (!layer.batch_norm_param().has_use_global_stats() ||
+           layer.batch_norm_param().use_global_stats())) {
+        batch_norm = next;
+      } else if (layer.type() == "Scale" && unary && scale < 0 && relu < 0 &&
+                 layer.scale_param().axis() == 1 && layer.scale_param().num_axes() == 1) {
+        scale = next;
+      } else if (layer.type() == "ReLU" && unary && relu < 0 && UsesReferenceEngine(layer)) {
+        relu = next;
+      } else if (IsPointwiseConvolution(layer)) {
+        pointwise = next;
+      } else {
+        break;
+      }
+      chain.push_back(next);
+    }
+    // nothing but the chain may read what it keeps in a band
+    bool fusable = pointwise >= 0;
+    for (size_t j = 0; fusable && j + 1 < chain.size(); ++j) {
+      const string& blob = param.layer(chain[j]).top(0);
+      for (int k = i + 1; fusable && k < param.layer_size(); ++k) {
+        const LayerParameter& reader = param.layer(k);
+        if (std::find(reader.bottom().begin(), reader.bottom().end(), blob) !=
+                reader.bottom().end() &&
+            std::find(chain.begin(), chain.end(), k) == chain.end()) {
+          fusable = false;
+        }
+      }
+    }
+    if (!fusable) {
+      param_compiled->add_layer()->Swap(layer_param);
+      continue;
+    }
+    LayerParameter* fused = param_compiled->add_layer();
+    fused->Swap(layer_param);
+    fused->set_type("SeparableConvolution");
+    fused->set_top(0, param.layer(pointwise).top(0));
+    if (batch_norm >= 0) {
+      fused->mutable_batch_norm_param()->CopyFrom(param.layer(batch_norm).batch_norm_param());
+    }
+    if (scale >= 0) {
+      fused->mutable_scale_param()->CopyFrom(param.layer(scale).scale_param());
+    }
+    if (relu >= 0) {
+      fused->mutable_relu_param()->CopyFrom(param.layer(relu).relu_param());
+    }
+    const ConvolutionParameter& conv = param.layer(pointwise).convolution_param();
+    fused->mutable_inner_product_param()->set_num_output(conv.num_output());
+    fused->mutable_inner_product_param()->set_bias_term(conv.bias_term());
+    // blobs of the fused layers in order, the layer checks their shapes
+    for (size_t j = 1; j < chain.size(); ++j) {
+      LayerParameter* layer = (const_cast<NetParameter&>(param)).mutable_layer(chain[j]);
+      for (int k = 0; k < layer->blobs_size(); ++k) {
+        fused->add_blobs()->Swap(layer->mutable_blobs(k));
+      }
+      layers_to_drop.insert(layer->name());
+    }
+  }
+}
+
 void Net::CompileNet(const NetParameter& param,
     NetParameter* param_compiled) {
 
@@ -695,15 +960,27 @@ void Net::CompileNet(const NetParameter& param,
   #define COMPILE_BN_RELU_FUSION_INDEX 3
   #define COMPILE_SPARSE_INDEX 5
   #define COMPILE_CONV_SUM_FUSION_INDEX 6
+  #define COMPILE_DW_RELU_FUSION_INDEX (NUM_OF_RULES - 2)
+  #define COMPILE_SEPARABLE_FUSION_INDEX (NUM_OF_RULES - 1)
   int i, current = 0;
   NetParameter param_temp[2];
+  // rules of the MKL engines only run in MKLDNN builds
   void (*CompileRules[]) (const NetParameter& param, NetParameter* param_compiled) =
+#ifdef USE_MKLDNN
     {RemoveBNScale,CompilationRuleRemoveScale, CompilationRuleConvReluFusion,
     CompilationRuleFuseBnRelu, CompilationRuleBNInplace, CompilationRuleSparse,
-    CompilationRuleConvSumFusion};
+    CompilationRuleConvSumFusion, CompilationRuleDepthwiseReluFusion,
+    CompilationRuleSeparableFusion};
+#else
+    {CompilationRuleDepthwiseReluFusion, CompilationRuleSeparableFusion};
+#endif
 
-  bool disabled[NUM_OF_RULES] = {true};
+  bool disabled[NUM_OF_RULES] = {false};
+#ifdef USE_MKLDNN
+  disabled[COMPILE_BN_FOLDING_INDEX] = true;
+#endif
 
+#ifdef USE_MKLDNN
 #ifdef DISABLE_BN_FOLDING
   disabled[COMPILE_BN_FOLDING_INDEX] = true;
 #endif
@@ -719,26 +996,50 @@ void Net::CompileNet(const NetParameter& param,
 #ifdef DISABLE_SPARSE
   disabled[COMPILE_SPARSE_INDEX] = true;
 #endif
+#endif  // USE_MKLDNN
+#ifdef DISABLE_DW_RELU_FUSION
+  disabled[COMPILE_DW_RELU_FUSION_INDEX] = true;
+#endif
+#ifdef DISABLE_SEPARABLE_FUSION
+  disabled[COMPILE_SEPARABLE_FUSION_INDEX] = true;
+#endif
 
   param_temp[current].CopyFrom(param);
   for (i = 0; i < NUM_OF_RULES; i++)
     if (!disabled[i]) {
+      // copy all but layers, which may hold weights
+      google::protobuf::RepeatedPtrField<LayerParameter> layers;
+      layers.Swap(param_temp[current].mutable_layer());
       param_temp[1 - current].CopyFrom(param_temp[current]);
-      param_temp[1 - current].clear_layer();   // Remove layers
+      layers.Swap(param_temp[current].mutable_layer());
       (*CompileRules[i]) (param_temp[current], &param_temp[1 - current]);
       current = 1 - current;
     }
-  param_compiled->CopyFrom(param_temp[current]);
+  param_compiled->Swap(&param_temp[current]);
   #undef NUM_OF_RULES
   #undef COMPILE_BN_FOLDING_INDEX
   #undef COMPILE_CONV_RELU_FUSION_INDEX
   #undef COMPILE_BN_RELU_FUSION_INDEX
   #undef COMPILE_SPARSE_INDEX
   #undef COMPILE_CONV_SUM_FUSION_INDEX
+  #undef COMPILE_DW_RELU_FUSION_INDEX
+  #undef COMPILE_SEPARABLE_FUSION_INDEX
 }
 
 
-void Net::Init(NetParameter& param) {
+void Net::Init(NetParameter& param, NetParameter* weights) {
+  const uint64_t start = Profiler::Get()->Now();
+#ifndef USE_MKLDNN
+  uncompiled_param_.reset(new NetParameter);
+  for (const auto& layer_param : param.layer()) {
+    LayerParameter* layer = uncompiled_param_->add_layer();
+    layer->CopyFrom(layer_param);
+    layer->clear_blobs();
+  }
+#endif
+  if (weights) {
+    AttachWeights(&param, weights);
+  }
   //mkldnn
 #ifdef USE_MKLDNN
   static bool executed = false;
@@ -747,10 +1048,12 @@ void Net::Init(NetParameter& param) {
   }
 
   engine_name_ = param.engine();
+#endif
   NetParameter compiled_param;
     // Transform Net (merge layers etc.) improve computational performance
   CompileNet(param, &compiled_param);
-  param = compiled_param;
+  param.Swap(&compiled_param);
+#ifdef USE_MKLDNN
   this->bn_scale_remove_ = param.compile_net_state().bn_scale_remove();
   this->bn_scale_merge_ = param.compile_net_state().bn_scale_merge();
   int kept_bn_layers_num = param.compile_net_state().kept_bn_layers_size();
@@ -759,7 +1062,147 @@ void Net::Init(NetParameter& param) {
   }
 #endif
 
-    std::cout << param.DebugString();
+  const uint64_t compiled = Profiler::Get()->Now();
+  InitLayers(param);
+  LOG(INFO) << "[Load] compile " << (compiled - start) / 1000. << " ms, "
+            << "setup " << layers_.size() << " layers "
+            << (Profiler::Get()->Now() - compiled) / 1000. << " ms";
+}
+
+void Net::AttachWeights(NetParameter* param, NetParameter* weights) {
+  std::map<string, LayerParameter*> layers;
+  for (int i = 0; i < param->layer_size(); ++i) {
+    layers[param->layer(i).name()] = param->mutable_layer(i);
+  }
+  for (int i = 0; i < weights->layer_size(); ++i) {
+    LayerParameter* source_layer = weights->mutable_layer(i);
+    auto it = layers.find(source_layer->name());
+    if (it == layers.end() || source_layer->blobs_size() == 0) continue;
+    it->second->mutable_blobs()->Swap(source_layer->mutable_blobs());
+  }
+}
+
+void Net::InitFromFlatWeights(NetParameter& param, const string& model_file) {
+  const uint64_t start = Profiler::Get()->Now();
+  weights_file_.reset(new MappedFile(model_file));
+  vector<FlatTensor> tensors;
+  ParseFlatIndex(*weights_file_, &tensors);
+  // shape only blobs, layers skip fillers and check shapes as usual
+  NetParameter weights;
+  std::map<string, LayerParameter*> layers;
+  for (const auto& tensor : tensors) {
+    LayerParameter*& layer = layers[tensor.layer];
+    if (!layer) {
+      layer = weights.add_layer();
+      layer->set_name(tensor.layer);
+    }
+    while (layer->blobs_size() <= tensor.index) {
+      layer->add_blobs();
+    }
+    BlobShape* shape = layer->mutable_blobs(tensor.index)->mutable_shape();
+    for (int dim : tensor.shape) {
+      shape->add_dim(dim);
+    }
+  }
+  LOG(INFO) << "[Load] map " << (Profiler::Get()->Now() - start) / 1000. << " ms";
+  {
+    ShapeOnlyWeightsScope shape_only;
+    Init(param, &weights);
+  }
+  // point parameters into the mapping
+  std::set<Blob*> bound;
+  for (const auto& tensor : tensors) {
+    auto it = layer_names_index_.find(tensor.layer);
+    CHECK(it != layer_names_index_.end())
+        << "Unknown layer " << tensor.layer << " in " << model_file;
+    vector<shared_ptr<Blob> >& blobs = layers_[it->second]->blobs();
+    CHECK_LT(tensor.index, blobs.size())
+        << "Unknown blob " << tensor.index << " of layer " << tensor.layer;
+    Blob* blob = blobs[tensor.index].get();
+    CHECK(blob->shape() == tensor.shape)
+        << "Blob " << tensor.index << " of layer " << tensor.layer << " mismatch";
+    bound.insert(blob);
+    if (blob->count() == 0) continue;
+    real_t* data = reinterpret_cast<real_t*>(weights_file_->data() + tensor.offset);
+    if (blob->data()->head() == SyncedMemory::UNINITIALIZED ||
+        blob->data()->own_cpu_data()) {
+      blob->set_cpu_data(data);
+    }
+    else {
+      // param is bound to memory of its layer (e.g. MKLDNN BN scaleshift)
+      caffe_copy(blob->count(), data, blob->mutable_cpu_data());
+    }
+  }
+  CHECK_EQ(bound.size(), params_.size())
+      << "Parameters missing in " << model_file;
+}
+
+Net::Net(const Net* model)
+    : naive_memory_bytes_(0), planned_memory_bytes_(0), inter_op_threads_(1),
+      intra_op_threads_(1), plan_cache_size_(0), alloc_audit_warmup_(0),
+      alloc_audit_countdown_(0), audited_allocations_(0), plans_placed_(0),
+      model_(NULL), num_contexts_(0) {
+  CHECK(model);
+  // layers of model are compiled already, rebuild them with shape only
+  // blobs, layers skip fillers and no weight memory is allocated
+  NetParameter param;
+  param.set_name(model->name_);
+  for (auto& layer : model->layers_) {
+    LayerParameter* layer_param = param.add_layer();
+    layer_param->CopyFrom(layer->layer_param());
+    for (const auto& blob : layer->blobs()) {
+      BlobShape* shape = layer_param->add_blobs()->mutable_shape();
+      for (int dim : blob->shape()) {
+        shape->add_dim(dim);
+      }
+    }
+  }
+#ifdef USE_MKLDNN
+  engine_name_ = model->engine_name_;
+  bn_scale_remove_ = model->bn_scale_remove_;
+  bn_scale_merge_ = model->bn_scale_merge_;
+  kept_bn_layers_ = model->kept_bn_layers_;
+#else
+  uncompiled_param_ = model->uncompiled_param_;
+#endif
+  // blobs have the shapes of the model's, which were checked already
+  const bool kCheckWeights = false;
+  {
+    ShapeOnlyWeightsScope shape_only;
+    InitLayers(param, kCheckWeights);
+  }
+  blob_life_time_ = model->blob_life_time_;
+  // bind parameters to memory of model
+  CHECK_EQ(params_.size(), model->params_.size());
+  for (size_t i = 0; i < params_.size(); ++i) {
+    Blob* blob = params_[i].get();
+    const Blob* source = model->params_[i].get();
+    CHECK(blob->shape() == source->shape())
+        << "Param " << param_display_names_[i] << " mismatch, "
+        << blob->shape_string() << " vs " << source->shape_string();
+    if (blob->count() == 0) continue;
+    if (blob->data()->head() == SyncedMemory::UNINITIALIZED ||
+        blob->data()->own_cpu_data()) {
+      // a fresh SyncedMemory per context keeps MKLDNN private layouts apart
+      blob->set_cpu_data(const_cast<real_t*>(source->cpu_data()));
+    }
+    else {
+      // param is bound to memory of its layer (e.g. MKLDNN BN scaleshift)
+      blob->CopyFrom(*source);
+    }
+  }
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    layers_[i]->ShareDerivedParams(model->layers_[i].get());
+  }
+  model_ = model;
+  model_->num_contexts_ += 1;
+}
+
+Net::~Net() {
+  if (model_) model_->num_contexts_ -= 1;
+}
+
+void Net::InitLayers(NetParameter& param, bool check_weights) {
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   std::map<string, int> blob_name_to_idx;
@@ -770,10 +1213,38 @@ void Net::Init(NetParameter& param) {
   bottom_id_vecs_.resize(param.layer_size());
   top_id_vecs_.resize(param.layer_size());
   param_id_vecs_.resize(param.layer_size());
+  // last layer writing each blob in place, a top sharing memory of its bottom
+  // must not be written by a later layer
+  std::map<string, int> last_in_place_writer;
   for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
-    // Setup layer.
     const LayerParameter& layer_param = param.layer(layer_id);
+    for (const string& top : layer_param.top()) {
+      for (const string& bottom : layer_param.bottom()) {
+        if (top == bottom) last_in_place_writer[top] = layer_id;
+      }
+    }
+  }
+  auto written_after = [&](const string& blob_name, int layer_id) {
+    auto it = last_in_place_writer.find(blob_name);
+    return it != last_in_place_writer.end() && it->second > layer_id;
+  };
+  for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
+    // Setup layer.
+    LayerParameter& layer_param = *param.mutable_layer(layer_id);
+    const int num_weights = layer_param.blobs_size();
     layers_.push_back(LayerRegistry::CreateLayer(layer_param));
+    // the layer holds its weights now
+    layer_param.clear_blobs();
+    bool bottom_written = false;
+    for (const string& bottom : layer_param.bottom()) {
+      if (written_after(bottom, layer_id)) bottom_written = true;
+    }
+    vector<bool> top_aliasable(layer_param.top_size());
+    for (int top_id = 0; top_id < layer_param.top_size(); ++top_id) {
+      top_aliasable[top_id] =
+          !bottom_written && !written_after(layer_param.top(top_id), layer_id);
+    }
+    layers_[layer_id]->set_top_aliasable(top_aliasable);
     layer_names_.push_back(layer_param.name());
     // Figure out this layer's input and output
     const int num_bottom = layer_param.bottom_size();
@@ -786,6 +1257,9 @@ void Net::Init(NetParameter& param) {
     }
     // After this layer is connected, set it up.
     layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+    if (check_weights && num_weights > 0) {
+      CheckLayerWeights(layer_param, layer_id, num_weights);
+    }
     // Layer Parameters
     const int num_param_blobs = layers_[layer_id]->blobs().size();
     for (int param_id = 0; param_id < num_param_blobs; ++param_id) {
@@ -794,30 +1268,131 @@ void Net::Init(NetParameter& param) {
   }
   CHECK_EQ(std::string(layers_[0]->type()), std::string("Input"))
       << "Network\'s first layer should be Input Layer.";
+  net_input_blob_ids_.clear();
+  for (size_t layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (std::strcmp(layers_[layer_id]->type(), "Input") != 0) continue;
+    for (int blob_id : top_id_vecs_[layer_id]) net_input_blob_ids_.push_back(blob_id);
+  }
   // for most case, not fully convolutional network, hold input data will be convenient
-  for (int blob_id : top_id_vecs_[0]) {
+  for (int blob_id : net_input_blob_ids_) {
     blob_life_time_[blob_id] = layers_.size();
   }
   for (size_t blob_id = 0; blob_id < blob_names_.size(); ++blob_id) {
     blob_names_index_[blob_names_[blob_id]] = blob_id;
     blobs_[blob_id]->set_name(blob_names_[blob_id]);
   }
+  profiler_net_id_ = Profiler::Get()->NewNetId(name_);
   for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
+  InternProfilerNames();
+  FindConstantLayers();
+  BuildSchedule(std::map<SyncedMemory*, std::pair<size_t, size_t> >());
+}
+
+void Net::CheckLayerWeights(const LayerParameter& layer_param, int layer_id,
+                            int num_weights) {
+  // most LayerSetUp skip their shape checks when blobs are given, so compare
+  // the blobs the layer ends up with to the ones it creates without weights.
+  // LayerSetUp creates them, unfilled and unallocated in a shape only scope
+  shared_ptr<Layer> reference = LayerRegistry::CreateLayer(layer_param);
+  vector<shared_ptr<Blob> > top_blobs;
+  vector<Blob*> top;
+  for (size_t i = 0; i < top_vecs_[layer_id].size(); ++i) {
+    top_blobs.emplace_back(new Blob);
+    top.push_back(top_blobs.back().get());
+  }
+  {
+    ShapeOnlyFillScope shape_only;
+    reference->LayerSetUp(bottom_vecs_[layer_id], top);
+  }
+  const vector<shared_ptr<Blob> >& expected = reference->blobs();
+  const vector<shared_ptr<Blob> >& blobs = layers_[layer_id]->blobs();
+  CHECK_EQ(num_weights, static_cast<int>(expected.size()))
+      << "Incompatible number of blobs for layer " << layer_param.name();
+  CHECK_EQ(blobs.size(), expected.size())
+      << "Layer " << layer_param.name() << " added blobs to its weights";
+  for (size_t j = 0; j < blobs.size(); ++j) {
+    CHECK(blobs[j]->shape() == expected[j]->shape())
+        << "Cannot use param " << j << " weights of layer '"
+        << layer_param.name() << "'; shape mismatch.  Weights shape is "
+        << blobs[j]->shape_string() << "; layer param shape is "
+        << expected[j]->shape_string() << ".";
+  }
+}
+
+void Net::InternProfilerNames() {
+  Profiler *profiler = Profiler::Get();
+  layer_name_ids_.resize(layers_.size());
+  layer_stats_ids_.resize(layers_.size());
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    layer_name_ids_[i] = profiler->Intern(layer_names_[i].c_str());
+    layer_stats_ids_[i] = profiler->StatsId(layer_name_ids_[i], layers_[i]->type());
+  }
+}
+
+void Net::FindConstantLayers() {
+  const int num_layers = layers_.size();
+  vector<bool> excluded(num_layers, false);
+  // input layers are filled by user, so are the layers reading their tops
+  for (int i = 0; i < num_layers; ++i) {
+    if (std::strcmp(layers_[i]->type(), "Input") == 0) excluded[i] = true;
+  }
+#ifdef USE_MKLDNN
+  // primitives bind blob memory and may move it, e.g. in-place Concat
+  for (int i = 0; i < num_layers; ++i) {
+    if (dynamic_cast<MKLDNNLayer*>(layers_[i].get())) excluded[i] = true;
+  }
+#endif
+  layer_constant_.assign(num_layers, false);
+  bool changed = true;
+  while (changed) {
+    vector<bool> blob_constant(blobs_.size(), false);
+    for (int i = 0; i < num_layers; ++i) {
+      bool constant = !excluded[i];
+      if (constant && layers_[i]->UsesBottomData()) {
+        for (int blob_id : bottom_id_vecs_[i]) {
+          if (!blob_constant[blob_id]) constant = false;
+        }
+      }
+      layer_constant_[i] = constant;
+      for (int blob_id : top_id_vecs_[i]) {
+        blob_constant[blob_id] = constant;
+      }
+    }
+    // a constant top written in place by a later layer changes per request
+    changed = false;
+    vector<bool> written(blobs_.size(), false);
+    for (int i = 0; i < num_layers; ++i) {
+      if (layer_constant_[i]) continue;
+      for (int blob_id : top_id_vecs_[i]) written[blob_id] = true;
+    }
+    for (int i = 0; i < num_layers; ++i) {
+      if (!layer_constant_[i]) continue;
+      for (int blob_id : top_id_vecs_[i]) {
+        if (written[blob_id]) {
+          excluded[i] = true;
+          changed = true;
+        }
+      }
+    }
+  }
+  int num_constant = std::count(layer_constant_.begin(), layer_constant_.end(), true);
+  if (num_constant > 0) {
+    LOG(INFO) << num_constant << " layers only depend on weights and shapes";
+  }
 }
 
 // Helper for Net::Init: add a new top blob to the net.
 void Net::AppendTop(const NetParameter& param, const int layer_id,
                     const int top_id, std::set<string>* available_blobs,
                     std::map<string, int>* blob_name_to_idx) {
-  shared_ptr<LayerParameter> layer_param(
-      new LayerParameter(param.layer(layer_id)));
-  const string& blob_name = (layer_param->top_size() > top_id) ?
-      layer_param->top(top_id) : "(automatic)";
+  const LayerParameter& layer_param = param.layer(layer_id);
+  const string& blob_name = (layer_param.top_size() > top_id) ?
+      layer_param.top(top_id) : "(automatic)";
   // Check if we are doing in-place computation
-  if (blob_name_to_idx && layer_param->bottom_size() > top_id &&
-      blob_name == layer_param->bottom(top_id)) {
+  if (blob_name_to_idx && layer_param.bottom_size() > top_id &&
+      blob_name == layer_param.bottom(top_id)) {
     // In-place computation
     int blob_id = (*blob_name_to_idx)[blob_name];
     top_vecs_[layer_id].push_back(blobs_[blob_id].get());
@@ -881,81 +1456,246 @@ void Net::AppendParam(const NetParameter& param, const int layer_id,
 
 void Net::PlaceMemory() {
   // get shape info
-//  this->Reshape();
-//  // place
-//  using BlobPair = std::pair<size_t, Blob*>;
-//  std::multimap<size_t, Blob*> pool;
-//  for (int i = 0; i < layers_.size(); ++i) {
-//    // blobs used by layer i
-//    DLOG(INFO) << "[MemPlace] Layer " << layer_names_[i];
-//    std::vector<Blob*> temps = layers_[i]->GetTempBlobs();
-//    std::vector<Blob*>& bottoms = bottom_vecs_[i];
-//    std::vector<Blob*>& tops = top_vecs_[i];
-//    // blobs need to place memory
-//    std::vector<BlobPair> blobs;
-//    blobs.reserve(temps.size() + tops.size());
-//    for (auto* blob : temps) {
-//      blob->ResetMemory();
-//      blobs.push_back(std::make_pair(blob->count(), blob));
-//    }
-//    for (auto* blob : tops) {
-//      bool should_place = true;
-//      // check inplace
-//      for (auto* bottom_blob : bottoms) {
-//        if (bottom_blob == blob) {
-//          should_place = false;
-//          break;
-//        }
-//      }
-//      if (should_place) {
-//        blob->ResetMemory();
-//        blobs.push_back(std::make_pair(blob->count(), blob));
-//      }
-//    }
-//    std::sort(blobs.begin(), blobs.end(), [](const BlobPair& x, const BlobPair& y) {
-//      return x.first > y.first;
-//    });
-//    // search pool to place memory if possible
-//    for (auto& p : blobs) {
-//      size_t size = p.first;
-//      Blob* blob = p.second;
-//      auto it = pool.lower_bound(size);
-//      if (it != pool.end() && it->first <= size * 2) {
-//        DLOG(INFO) << "[MemPlace] Share " << blob->name() << "(" << size << ") with " << it->second->name() << "(" << it->first << ")";
-//        Blob* share = it->second;
-//        blob->ShareData(*share);
-//        pool.erase(it);
-//      }
-//      else {
-//        DLOG(INFO) << "[MemPlace] Alloc " << blob->name() << "(" << size << ")";
-//      }
-//    }
-//    // put unused blob to pool
-//    for (int blob_idx : bottom_id_vecs_[i]) {
-//      if (blob_life_time_[blob_idx] <= i) {
-//        DLOG(INFO) << "[MemPlace] Put " << blobs_[blob_idx]->name() << "(" << blobs_[blob_idx]->capacity() << ") to Pool";
-//        pool.insert(std::make_pair(blobs_[blob_idx]->capacity(), blobs_[blob_idx].get()));
-//      }
-//    }
-//    for (auto* blob : temps) {
-//      DLOG(INFO) << "[MemPlace] Put " << blob->name() << "(" << blob->capacity() << ") to Pool";
-//      pool.insert(std::make_pair(blob->capacity(), blob));
-//    }
-//  }
+  this->Reshape();
+  if (Caffe::mode() == Caffe::GPU) {
+    return;
+  }
+  // a block is the memory shared by in-place and aliased blobs
+  struct MemBlock {
+    SyncedMemory* mem;
+    size_t size;
+    int start, end;  // first producer and last consumer layer
+    size_t offset;
+  };
+  std::vector<MemBlock> blocks;
+  std::map<SyncedMemory*, int> block_index;
+  std::set<SyncedMemory*> pinned;
+  // input blobs are filled by user before Forward, keep their own memory
+  for (int blob_id : net_input_blob_ids_) {
+    Blob* blob = blobs_[blob_id].get();
+    if (blob->data()) pinned.insert(blob->data().get());
+  }
+  // so are tops of constant layers, which are computed once per shapes
+  for (size_t i = 1; i < layers_.size(); ++i) {
+    if (!layer_constant_[i]) continue;
+    for (auto* blob : top_vecs_[i]) {
+      if (blob->data()) pinned.insert(blob->data().get());
+    }
+  }
+  std::map<SyncedMemory*, NestedMemory> nested;
+  FindNestedMemory(pinned, &nested);
+  auto add_blob = [&](Blob* blob, int start, int end) {
+    SyncedMemory* mem = blob->data().get();
+    if (blob->count() == 0 || mem == NULL || pinned.count(mem)) return;
+    // nested memory lives as long as the block holding it
+    for (auto it = nested.find(mem); it != nested.end(); it = nested.find(mem)) {
+      mem = it->second.parent;
+    }
+    auto it = block_index.find(mem);
+    if (it == block_index.end()) {
+      const size_t align = 64;
+      MemBlock block;
+      block.mem = mem;
+      block.size = (mem->size() + align - 1) / align * align;
+      block.start = start;
+      block.end = end;
+      block.offset = 0;
+      block_index[mem] = blocks.size();
+      blocks.push_back(block);
+    }
+    else {
+      MemBlock& block = blocks[it->second];
+      block.start = std::min(block.start, start);
+      block.end = std::max(block.end, end);
+    }
+  };
+  for (int i = 1; i < static_cast<int>(layers_.size()); ++i) {
+    for (int blob_id : top_id_vecs_[i]) {
+      add_blob(blobs_[blob_id].get(), i, blob_life_time_[blob_id]);
+    }
+    for (auto* blob : layers_[i]->GetTempBlobs()) {
+      add_blob(blob, i, i);
+    }
+  }
+  // place large blocks first, each at the lowest offset not overlapping
+  // any placed block alive at the same time
+  std::vector<int> order(blocks.size());
+  for (int i = 0; i < static_cast<int>(order.size()); ++i) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](int x, int y) {
+    return blocks[x].size > blocks[y].size;
+  });
+  std::vector<int> placed;
+  size_t naive_size = 0, arena_size = 0;
+  for (int idx : order) {
+    MemBlock& block = blocks[idx];
+    std::vector<std::pair<size_t, size_t> > conflicts;
+    for (int other_idx : placed) {
+      const MemBlock& other = blocks[other_idx];
+      if (other.start <= block.end && block.start <= other.end) {
+        conflicts.push_back(std::make_pair(other.offset, other.offset + other.size));
+      }
+    }
+    std::sort(conflicts.begin(), conflicts.end());
+    size_t offset = 0;
+    for (auto& range : conflicts) {
+      if (offset + block.size <= range.first) break;
+      offset = std::max(offset, range.second);
+    }
+    block.offset = offset;
+    placed.push_back(idx);
+    naive_size += block.size;
+    arena_size = std::max(arena_size, offset + block.size);
+  }
+  // bind blobs to arena, old arena is released after all blobs leave it
+  shared_ptr<SyncedMemory> arena;
+  std::map<SyncedMemory*, std::pair<size_t, size_t> > placed_ranges;
+  if (arena_size > 0) {
+    arena.reset(new SyncedMemory(arena_size));
+    char* base = static_cast<char*>(arena->mutable_cpu_data());
+    for (auto& block : blocks) {
+      block.mem->set_cpu_data(base + block.offset);
+      placed_ranges[block.mem] = std::make_pair(block.offset, block.offset + block.size);
+    }
+    for (auto& entry : nested) {
+      size_t offset = entry.second.offset;
+      SyncedMemory* mem = entry.second.parent;
+      for (auto it = nested.find(mem); it != nested.end(); it = nested.find(mem)) {
+        offset += it->second.offset;
+        mem = it->second.parent;
+      }
+      offset += blocks[block_index[mem]].offset;
+      entry.first->set_cpu_data(base + offset);
+      placed_ranges[entry.first] = std::make_pair(offset, offset + entry.second.size);
+    }
+  }
+  // memory reused by blobs is an ordering between layers too
+  BuildSchedule(placed_ranges);
+  memory_arena_ = arena;
+  naive_memory_bytes_ = naive_size;
+  planned_memory_bytes_ = arena_size;
+  LOG(INFO) << "[MemPlace] " << blocks.size() << " blocks, "
+            << naive_size << " bytes without sharing, "
+            << arena_size << " bytes placed";
+}
+
+void Net::FindNestedMemory(const std::set<SyncedMemory*>& pinned,
+                           std::map<SyncedMemory*, NestedMemory>* nested) const {
+  std::set<SyncedMemory*> unsafe(pinned.begin(), pinned.end());
+#ifdef USE_MKLDNN
+  // MKLDNN layers may leave their tops in a private layout
+  for (int i = 1; i < layers_.size(); ++i) {
+    if (!dynamic_cast<MKLDNNLayer*>(layers_[i].get())) continue;
+    for (auto* blob : top_vecs_[i]) unsafe.insert(blob->data().get());
+  }
+#endif
+  // later Concat first, so the top of a nested Concat is placed already
+  for (int i = layers_.size() - 1; i > 0; --i) {
+    const ConcatLayer* concat = dynamic_cast<const ConcatLayer*>(layers_[i].get());
+    if (!concat || bottom_vecs_[i].size() < 2 || !concat->contiguous() ||
+        !concat->top_aliasable(0)) continue;
+    SyncedMemory* top_mem = top_vecs_[i][0]->data().get();
+    if (top_mem == NULL || unsafe.count(top_mem)) continue;
+    std::set<SyncedMemory*> ancestors;
+    for (SyncedMemory* mem = top_mem; mem; ) {
+      ancestors.insert(mem);
+      auto it = nested->find(mem);
+      mem = it == nested->end() ? NULL : it->second.parent;
+    }
+    size_t offset = 0;
+    for (auto* bottom : bottom_vecs_[i]) {
+      SyncedMemory* mem = bottom->data().get();
+      const size_t size = bottom->count() * sizeof(real_t);
+      if (mem && size > 0 && !unsafe.count(mem) && !nested->count(mem) &&
+          !ancestors.count(mem)) {
+        NestedMemory entry = {top_mem, offset, size};
+        (*nested)[mem] = entry;
+      }
+      offset += size;
+    }
+  }
+}
+
+void Net::UpdatePlan() {
+  // compare in place, Forward with unchanged shapes allocates nothing here
+  bool changed = net_input_blob_ids_.size() != planned_input_shapes_.size();
+  for (size_t i = 0; !changed && i < net_input_blob_ids_.size(); ++i) {
+    changed = blobs_[net_input_blob_ids_[i]]->shape() != planned_input_shapes_[i];
+  }
+  if (changed) {
+    vector<vector<int> > input_shapes;
+    for (int blob_id : net_input_blob_ids_) {
+      input_shapes.push_back(blobs_[blob_id]->shape());
+    }
+    shared_ptr<ExecutionPlan> plan;
+    if (plan_cache_size_ > 0 && Caffe::mode() == Caffe::CPU) {
+      if (!planned_input_shapes_.empty()) {
+        plan_cache_.push_front(std::make_pair(planned_input_shapes_, SavePlan()));
+      }
+      for (auto it = plan_cache_.begin(); it != plan_cache_.end(); ++it) {
+        if (it->first == input_shapes) {
+          plan = it->second;
+          plan_cache_.erase(it);
+          break;
+        }
+      }
+      while (plan_cache_.size() > static_cast<size_t>(plan_cache_size_)) {
+        plan_cache_.pop_back();
+      }
+    }
+    if (plan) {
+      RestorePlan(*plan);
+    }
+    else {
+      PlaceMemory();
+      ++plans_placed_;
+#ifdef USE_MKLDNN
+      // primitives are built on the blob memory placed before
+      for (auto& layer : layers_) {
+        MKLDNNLayer* mkldnn_layer = dynamic_cast<MKLDNNLayer*>(layer.get());
+        if (mkldnn_layer) mkldnn_layer->ResetPrimitives();
+      }
+#endif
+      // tops of constant layers keep their own memory and stay valid until
+      // shapes change, cached plans keep them too
+      for (size_t i = 0; i < layers_.size(); ++i) {
+        if (layer_constant_[i]) layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+      }
+    }
+    planned_input_shapes_ = input_shapes;
+    alloc_audit_countdown_ = alloc_audit_warmup_;
+  }
 }
 
 void Net::Forward(bool reshape) {
-  // static place memory
-  if (reshape) {
-//    PlaceMemory();
+  IntraOpScope intra_op(intra_op_pool_.get());
+  // static place memory, constant layers run there too
+  if (reshape || planned_input_shapes_.empty()) {
+    UpdatePlan();
+  }
+  bool audit = false;
+  if (alloc_audit_warmup_ > 0) {
+    if (alloc_audit_countdown_ > 0) --alloc_audit_countdown_;
+    else audit = true;
   }
   // forward network
   Profiler *profiler = Profiler::Get();
+  if (inter_op_threads_ > 1 && Caffe::mode() == Caffe::CPU && !audit) {
+    ForwardParallel();
+    return;
+  }
   for (int i = 0; i < layers_.size(); ++i) {
+    if (layer_constant_[i]) continue;
     // LOG(INFO) << "Forwarding " << layer_names_[i];
-    profiler->ScopeStart(layer_names_[i].c_str());
+    profiler->ScopeStart(layer_name_ids_[i], profiler_net_id_, layer_stats_ids_[i]);
+    const size_t allocs_before = audit ? AllocationCount() : 0;
     layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    const size_t allocs = audit ? AllocationCount() - allocs_before : 0;
     profiler->ScopeEnd();
+    if (allocs > 0) {
+      audited_allocations_ += allocs;
+      LOG(WARNING) << "Layer " << layer_names_[i] << " (" << layers_[i]->type()
+                   << ") made " << allocs << " host allocations in Forward";
+    }
   }
   // sync gpu data
   if (Caffe::mode() == Caffe::GPU) {
@@ -967,34 +1707,457 @@ void Net::Forward(bool reshape) {
   }
 }
 
+void Net::ForwardTo(const string& name, bool reshape) {
+  auto it = blob_names_index_.find(name);
+  if (it == blob_names_index_.end()) {
+    LOG(FATAL) << "blob (" << name << ") is not availiable in Net";
+  }
+  IntraOpScope intra_op(intra_op_pool_.get());
+  if (reshape || planned_input_shapes_.empty()) {
+    UpdatePlan();
+  }
+  // layers after the producers don't run, memory of the blob is not reused
+  Profiler *profiler = Profiler::Get();
+  for (int i : LayersProducing({it->second})) {
+    if (layer_constant_[i]) continue;
+    profiler->ScopeStart(layer_name_ids_[i], profiler_net_id_, layer_stats_ids_[i]);
+    layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    profiler->ScopeEnd();
+  }
+  if (Caffe::mode() == Caffe::GPU) {
+    profiler->ScopeStart("Sync");
+    blobs_[it->second]->cpu_data();
+    profiler->ScopeEnd();
+  }
+}
+
+vector<int> Net::LayersProducing(std::set<int> blob_ids) const {
+  vector<int> layer_ids;
+  for (int i = layers_.size() - 1; i > 0; --i) {
+    bool needed = false;
+    for (int blob_id : top_id_vecs_[i]) {
+      if (blob_ids.count(blob_id)) needed = true;
+    }
+    if (!needed) continue;
+    layer_ids.push_back(i);
+    blob_ids.insert(bottom_id_vecs_[i].begin(), bottom_id_vecs_[i].end());
+  }
+  // input layer
+  layer_ids.push_back(0);
+  std::reverse(layer_ids.begin(), layer_ids.end());
+  return layer_ids;
+}
+
+struct Net::ExecutionPlan {
+  shared_ptr<SyncedMemory> arena;
+  // share memory of PlacedBlobs, empty for blobs without memory
+  vector<shared_ptr<Blob> > blobs;
+  // MKLDNN primitives of every layer, NULL to build them again
+  vector<shared_ptr<void> > layer_plans;
+  vector<vector<int> > layer_successors;
+  vector<int> layer_num_deps;
+  size_t naive_memory_bytes;
+  size_t planned_memory_bytes;
+};
+
+vector<Blob*> Net::PlacedBlobs() {
+  std::set<int> inputs(net_input_blob_ids_.begin(), net_input_blob_ids_.end());
+  vector<Blob*> placed;
+  for (size_t blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (!inputs.count(blob_id)) placed.push_back(blobs_[blob_id].get());
+  }
+  for (auto& layer : layers_) {
+    for (auto* blob : layer->GetTempBlobs()) placed.push_back(blob);
+  }
+  return placed;
+}
+
+shared_ptr<Net::ExecutionPlan> Net::SavePlan() {
+  shared_ptr<ExecutionPlan> plan(new ExecutionPlan);
+  plan->arena = memory_arena_;
+  for (auto* blob : PlacedBlobs()) {
+    shared_ptr<Blob> saved(new Blob);
+    if (blob->data()) {
+      saved->Reshape(blob->shape());
+      saved->ShareData(*blob);
+      // memory placed next must not move the memory kept by the plan
+      blob->ResetMemory();
+    }
+    plan->blobs.push_back(saved);
+  }
+  plan->layer_plans.resize(layers_.size());
+#ifdef USE_MKLDNN
+  for (int i = 0; i < layers_.size(); ++i) {
+    MKLDNNLayer* mkldnn_layer = dynamic_cast<MKLDNNLayer*>(layers_[i].get());
+    if (mkldnn_layer) plan->layer_plans[i] = mkldnn_layer->SavePlan();
+  }
+#endif
+  plan->layer_successors = layer_successors_;
+  plan->layer_num_deps = layer_num_deps_;
+  plan->naive_memory_bytes = naive_memory_bytes_;
+  plan->planned_memory_bytes = planned_memory_bytes_;
+  return plan;
+}
+
+void Net::RestorePlan(const ExecutionPlan& plan) {
+  vector<Blob*> blobs = PlacedBlobs();
+  CHECK_EQ(blobs.size(), plan.blobs.size());
+  for (size_t i = 0; i < blobs.size(); ++i) {
+    const Blob& saved = *plan.blobs[i];
+    if (!saved.data()) continue;
+    blobs[i]->Reshape(saved.shape());
+    blobs[i]->ShareData(saved);
+  }
+  // shapes match the saved memory now, aliased blobs are shared again
+  this->Reshape();
+  memory_arena_ = plan.arena;
+#ifdef USE_MKLDNN
+  std::set<Blob*> inputs;
+  for (int blob_id : net_input_blob_ids_) inputs.insert(blobs_[blob_id].get());
+  for (int i = 0; i < layers_.size(); ++i) {
+    MKLDNNLayer* mkldnn_layer = dynamic_cast<MKLDNNLayer*>(layers_[i].get());
+    if (!mkldnn_layer) continue;
+    // input blobs are reshaped by user, their memory is new
+    bool reads_input = false;
+    for (auto* blob : bottom_vecs_[i]) {
+      if (inputs.count(blob)) reads_input = true;
+    }
+    if (plan.layer_plans[i] && !reads_input) {
+      mkldnn_layer->RestorePlan(plan.layer_plans[i]);
+    }
+    else {
+      mkldnn_layer->ResetPrimitives();
+    }
+  }
+#endif
+  layer_successors_ = plan.layer_successors;
+  layer_num_deps_ = plan.layer_num_deps;
+  naive_memory_bytes_ = plan.naive_memory_bytes;
+  planned_memory_bytes_ = plan.planned_memory_bytes;
+}
+
+void Net::BuildSchedule(
+    const std::map<SyncedMemory*, std::pair<size_t, size_t> >& placed) {
+  struct Region {
+    SyncedMemory* mem;
+    size_t begin, end;
+    bool placed;
+  };
+  auto region_of = [&](Blob* blob, vector<Region>* regions) {
+    SyncedMemory* mem = blob->data().get();
+    if (mem == NULL) return;
+    Region region = {mem, 0, 0, false};
+    auto it = placed.find(mem);
+    if (it != placed.end()) {
+      region.begin = it->second.first;
+      region.end = it->second.second;
+      region.placed = true;
+    }
+    regions->push_back(region);
+  };
+  auto overlap = [](const vector<Region>& a, const vector<Region>& b) {
+    for (auto& x : a) {
+      for (auto& y : b) {
+        if (x.mem == y.mem) return true;
+        if (x.placed && y.placed && x.begin < y.end && y.begin < x.end) return true;
+      }
+    }
+    return false;
+  };
+  const int num_layers = layers_.size();
+  vector<vector<Region> > reads(num_layers), writes(num_layers);
+  for (int i = 0; i < num_layers; ++i) {
+    for (auto* blob : bottom_vecs_[i]) region_of(blob, &reads[i]);
+    for (auto* blob : top_vecs_[i]) region_of(blob, &writes[i]);
+    for (auto* blob : layers_[i]->GetTempBlobs()) region_of(blob, &writes[i]);
+  }
+  layer_successors_.assign(num_layers, vector<int>());
+  layer_num_deps_.assign(num_layers, 0);
+  for (int j = 1; j < num_layers; ++j) {
+    if (layer_constant_[j]) continue;
+    for (int i = 0; i < j; ++i) {
+      if (layer_constant_[i]) continue;
+      if (overlap(writes[i], reads[j]) || overlap(writes[i], writes[j]) ||
+          overlap(reads[i], writes[j])) {
+        layer_successors_[i].push_back(j);
+        layer_num_deps_[j] += 1;
+      }
+    }
+  }
+}
+
+// state of one parallel Forward, shared by the tasks running it
+struct Net::ForwardState {
+  std::unique_ptr<std::atomic<int>[]> num_deps;
+  std::mutex mutex;
+  std::condition_variable done_cond;
+  int num_layers;  // layers to run, constant layers are not
+  int num_done;
+  std::atomic<bool> failed;
+  std::exception_ptr error;
+};
+
+void Net::ForwardParallel() {
+  const int num_layers = layers_.size();
+  shared_ptr<ForwardState> state = std::make_shared<ForwardState>();
+  state->num_deps.reset(new std::atomic<int>[num_layers]);
+  state->num_layers = 0;
+  state->num_done = 0;
+  state->failed = false;
+  vector<int> ready;
+  for (int i = 0; i < num_layers; ++i) {
+    state->num_deps[i] = layer_num_deps_[i];
+    if (layer_constant_[i]) continue;
+    state->num_layers += 1;
+    if (layer_num_deps_[i] == 0) ready.push_back(i);
+  }
+  for (size_t k = 1; k < ready.size(); ++k) {
+    int i = ready[k];
+    thread_pool_->Run([this, state, i]() { RunLayerChain(state, i); });
+  }
+  if (!ready.empty()) RunLayerChain(state, ready[0]);
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done_cond.wait(lock, [&]() { return state->num_done == state->num_layers; });
+  }
+  if (state->error) std::rethrow_exception(state->error);
+}
+
+void Net::RunLayerChain(shared_ptr<ForwardState> state, int layer_id) {
+  // run a layer, hand extra ready successors to the pool and go on with
+  // the first one in this thread
+  IntraOpScope intra_op(intra_op_pool_.get());
+  while (layer_id >= 0) {
+    if (!state->failed) {
+      Profiler *profiler = Profiler::Get();
+      profiler->ScopeStart(layer_name_ids_[layer_id], profiler_net_id_,
+                           layer_stats_ids_[layer_id]);
+      try {
+        layers_[layer_id]->Forward(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->error) state->error = std::current_exception();
+        state->failed = true;
+      }
+      profiler->ScopeEnd();
+    }
+    int next = -1;
+    for (int j : layer_successors_[layer_id]) {
+      if (--state->num_deps[j] == 0) {
+        if (next < 0) {
+          next = j;
+        }
+        else {
+          thread_pool_->Run([this, state, j]() { RunLayerChain(state, j); });
+        }
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->num_done += 1;
+      if (state->num_done == state->num_layers) state->done_cond.notify_all();
+    }
+    layer_id = next;
+  }
+}
+
+void Net::SetInterOpThreads(int num_threads) {
+  CHECK_GE(num_threads, 1) << "Net needs at least one thread to run";
+  if (num_threads == inter_op_threads_) return;
+  inter_op_threads_ = num_threads;
+  thread_pool_.reset();
+  if (num_threads > 1) {
+    thread_pool_.reset(new ThreadPool(num_threads - 1));
+  }
+}
+
+void Net::SetIntraOpThreads(int num_threads, int spin_us, bool affinity) {
+  CHECK_GE(num_threads, 1) << "Net needs at least one thread to run";
+  intra_op_threads_ = num_threads;
+  intra_op_pool_.reset();
+  if (num_threads > 1) {
+    intra_op_pool_.reset(new IntraOpPool(num_threads, spin_us, affinity));
+  }
+}
+
+void Net::SetAllocAudit(int warmup) {
+  CHECK_GE(warmup, 0) << "Allocation audit warmup can't be negative";
+  alloc_audit_warmup_ = warmup;
+  alloc_audit_countdown_ = warmup;
+  audited_allocations_ = 0;
+}
+
+void Net::SetPlanCacheSize(int size) {
+  CHECK_GE(size, 0) << "Plan cache size can't be negative";
+  plan_cache_size_ = size;
+  while (plan_cache_.size() > static_cast<size_t>(plan_cache_size_)) {
+    plan_cache_.pop_back();
+  }
+}
+
 void Net::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
 }
 
+vector<Net::LayerCost> Net::GetLayerCosts() {
+  vector<LayerCost> costs(layers_.size());
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    Layer* layer = layers_[i].get();
+    LayerCost& cost = costs[i];
+    cost.name = layer_names_[i];
+    cost.type = layer->type();
+    cost.macs = 0;
+    cost.input_bytes = 0;
+    cost.output_bytes = 0;
+    cost.param_bytes = 0;
+    cost.workspace_bytes = 0;
+    if (layer->UsesBottomData()) {
+      for (auto* blob : bottom_vecs_[i]) {
+        cost.input_bytes += blob->count() * sizeof(real_t);
+      }
+    }
+    for (auto* blob : top_vecs_[i]) {
+      cost.output_bytes += blob->count() * sizeof(real_t);
+    }
+    for (auto& blob : layer->blobs()) {
+      cost.param_bytes += blob->count() * sizeof(real_t);
+    }
+    for (auto* blob : layer->GetDerivedParams()) {
+      cost.param_bytes += blob->count() * sizeof(real_t);
+    }
+    for (auto* blob : layer->GetTempBlobs()) {
+      cost.workspace_bytes += blob->count() * sizeof(real_t);
+    }
+    if (layer->blobs().empty()) continue;
+    // every output (input for Deconvolution) element takes a weight per
+    // output channel, so MACs are its count per channel times the weights
+    const int64_t weights = layer->blobs()[0]->count();
+    if (cost.type == "Convolution" || cost.type == "ConvolutionDepthwise") {
+      for (auto* top : top_vecs_[i]) {
+        cost.macs += top->count() / top->shape(1) * weights;
+      }
+    }
+    else if (cost.type == "Deconvolution") {
+      for (auto* bottom : bottom_vecs_[i]) {
+        cost.macs += bottom->count() / bottom->shape(1) * weights;
+      }
+    }
+    else if (cost.type == "InnerProduct") {
+      const int num_output = layer->layer_param().inner_product_param().num_output();
+      cost.macs = top_vecs_[i][0]->count() / num_output * weights;
+    }
+    else if (cost.type == "SeparableConvolution") {
+      // depthwise weights per pixel and channel, then the 1x1 weights
+      const int num_output = layer->layer_param().inner_product_param().num_output();
+      const int64_t pixels = top_vecs_[i][0]->count() / num_output;
+      cost.macs = pixels * (weights + num_output * bottom_vecs_[i][0]->shape(1));
+    }
+  }
+  return costs;
+}
+
+void Net::LogRoofline(double peak_gflops, double peak_gbps) {
+  CHECK_GT(peak_gflops, 0) << "peak GFLOP/s must be positive";
+  CHECK_GT(peak_gbps, 0) << "peak GB/s must be positive";
+  std::map<std::pair<string, string>, double> mean_us;
+  for (auto& stats : Profiler::Get()->GetLayerStats()) {
+    mean_us[std::make_pair(stats.name, stats.type)] = stats.mean;
+  }
+  // arithmetic intensity, in FLOP per byte, where compute becomes the bound
+  const double ridge = peak_gflops / peak_gbps;
+  vector<LayerCost> costs = GetLayerCosts();
+  LayerCost total = LayerCost();
+  total.name = name_;
+  total.type = "Net";
+  double total_us = 0;
+  bool all_timed = true;
+  std::ostringstream os;
+  os << std::fixed << std::setprecision(2)
+     << "[Roofline] " << peak_gflops << " GFLOP/s, " << peak_gbps
+     << " GB/s, ridge at " << ridge << " FLOP/B\n"
+     << "layer type MFLOP MB(in/out/param/workspace) FLOP/B bound attainable-GFLOP/s"
+     << " [us GFLOP/s GB/s %roofline]\n";
+  auto log_cost = [&](const LayerCost& cost, double us) {
+    const double flops = 2. * cost.macs;
+    const double bytes = cost.input_bytes + cost.output_bytes + cost.param_bytes;
+    const double intensity = bytes > 0 ? flops / bytes : 0;
+    const bool memory_bound = intensity < ridge;
+    const double attainable = memory_bound ? intensity * peak_gbps : peak_gflops;
+    os << cost.name << " " << cost.type << " " << flops / 1e6 << " "
+       << cost.input_bytes / 1e6 << "/" << cost.output_bytes / 1e6 << "/"
+       << cost.param_bytes / 1e6 << "/" << cost.workspace_bytes / 1e6 << " "
+       << intensity << " " << (memory_bound ? "memory" : "compute") << " "
+       << attainable;
+    if (us > 0) {
+      const double gflops = flops / us / 1e3;
+      const double gbps = bytes / us / 1e3;
+      // layers without MACs are measured against the bandwidth
+      const double roofline = flops > 0 ? gflops / attainable : gbps / peak_gbps;
+      os << " " << us << " " << gflops << " " << gbps << " " << roofline * 100;
+    }
+    os << "\n";
+  };
+  for (size_t i = 0; i < costs.size(); ++i) {
+    const LayerCost& cost = costs[i];
+    auto it = mean_us.find(std::make_pair(cost.name, cost.type));
+    const bool timed = it != mean_us.end() && !layer_constant_[i];
+    log_cost(cost, timed ? it->second : 0);
+    if (timed) total_us += it->second;
+    else if (!layer_constant_[i]) all_timed = false;
+    total.macs += cost.macs;
+    total.input_bytes += cost.input_bytes;
+    total.output_bytes += cost.output_bytes;
+    total.param_bytes += cost.param_bytes;
+    total.workspace_bytes += cost.workspace_bytes;
+  }
+  // the net time only adds up when every layer running in Forward is timed
+  log_cost(total, all_timed ? total_us : 0);
+  LOG(INFO) << os.str();
+}
+
 void Net::CopyTrainedLayersFrom(const NetParameter& param_inp) {
+  NetParameter weights;
+#ifdef USE_MKLDNN
+  weights = param_inp;
+#else
+  // layers the net doesn't have are ignored anyway
+  std::set<string> names;
+  for (const auto& layer : uncompiled_param_->layer()) {
+    names.insert(layer.name());
+  }
+  for (const auto& layer : param_inp.layer()) {
+    if (layer.blobs_size() == 0 || !names.count(layer.name())) continue;
+    LayerParameter* target = weights.add_layer();
+    target->set_name(layer.name());
+    target->mutable_blobs()->CopyFrom(layer.blobs());
+  }
+#endif
+  CopyTrainedLayersFrom(&weights);
+}
+
+void Net::CopyTrainedLayersFrom(NetParameter* param_inp) {
+  CHECK(model_ == NULL) << "A context reads the weights of its model, load them into the model";
+  CHECK_EQ(num_contexts_.load(), 0)
+      << "Weights can't be changed while contexts read them, destroy the contexts first";
 #ifdef USE_MKLDNN
-  NetParameter param_tmp = param_inp;
-  NetParameter &param = param_tmp;
+  NetParameter &param = *param_inp;
   param.set_engine(engine_name_);
-  param_tmp.mutable_state()->set_phase(TEST);
-  param_tmp.mutable_compile_net_state()->set_is_init(false);
+  param.mutable_state()->set_phase(TEST);
+  param.mutable_compile_net_state()->set_is_init(false);
   for (vector<string>::iterator it = this->kept_bn_layers_.begin(); it != this->kept_bn_layers_.end(); it++) {
-    param_tmp.mutable_compile_net_state()->add_kept_bn_layers(*it);
+    param.mutable_compile_net_state()->add_kept_bn_layers(*it);
   }
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
     LayerParameter* source_layer = param.mutable_layer(i);
-    const string& source_layer_name = source_layer->name();
-    int target_layer_id = 0;
-    while (target_layer_id != layer_names_.size() &&
-        layer_names_[target_layer_id] != source_layer_name) {
-      ++target_layer_id;
-    }
-    if (target_layer_id == layer_names_.size()) {
+    auto it = layer_names_index_.find(source_layer->name());
+    if (it == layer_names_index_.end()) {
       continue;
     }
+    const int target_layer_id = it->second;
     const LayerParameter& layer_param = layers_[target_layer_id]->layer_param();
     const string& engine_name = layer_param.engine();
     source_layer->set_engine(engine_name);
@@ -1005,36 +2168,37 @@ void Net::CopyTrainedLayersFrom(const NetParameter& param_inp) {
   }
   NetParameter param_compiled;
   CompileNet(param, &param_compiled);
-  param = param_compiled;
+  param.Swap(&param_compiled);
   num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
     const LayerParameter& source_layer = param.layer(i);
     const string& source_layer_name = source_layer.name();
-    int target_layer_id = 0;
-    while (target_layer_id != layer_names_.size() &&
-        layer_names_[target_layer_id] != source_layer_name) {
-      ++target_layer_id;
-    }
-    if (target_layer_id == layer_names_.size()) {
+    auto it = layer_names_index_.find(source_layer_name);
+    if (it == layer_names_index_.end()) {
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
+    const int target_layer_id = it->second;
     DLOG(INFO) << "Copying source layer " << source_layer_name;
     vector<shared_ptr<Blob > >& target_blobs =
         layers_[target_layer_id]->blobs();
 #else
-  int num_source_layers = param_inp.layer_size();
+  // compile the weights onto the layers of Init, so fused layers take the
+  // blobs of all layers they replace whatever the layers of param_inp are
+  NetParameter param = *uncompiled_param_;
+  AttachWeights(&param, param_inp);
+  NetParameter param_compiled;
+  CompileNet(param, &param_compiled);
+  param.Swap(&param_compiled);
+  int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
-    const LayerParameter& source_layer = param_inp.layer(i);
+    const LayerParameter& source_layer = param.layer(i);
     const string& source_layer_name = source_layer.name();
-    int target_layer_id = 0;
-    while (target_layer_id != layer_names_.size() &&
-           layer_names_[target_layer_id] != source_layer_name) {
-      ++target_layer_id;
-    }
-    if (target_layer_id == layer_names_.size()) {
+    auto it = layer_names_index_.find(source_layer_name);
+    if (it == layer_names_index_.end() || source_layer.blobs_size() == 0) {
       continue;
     }
+    const int target_layer_id = it->second;
     vector<shared_ptr<Blob> >& target_blobs =
         layers_[target_layer_id]->blobs();
 #endif
@@ -1056,6 +2220,12 @@ void Net::CopyTrainedLayersFrom(const NetParameter& param_inp) {
       target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
     }
   }
+  for (auto& layer : layers_) {
+    layer->ParamsChanged();
+  }
+  // fold constant layers with the new weights on next Forward
+  planned_input_shapes_.clear();
+  plan_cache_.clear();
 }
 
 void Net::MarkOutputs(const std::vector<std::string>& outs) {
@@ -1067,12 +2237,167 @@ void Net::MarkOutputs(const std::vector<std::string>& outs) {
     int blob_id = it->second;
     blob_life_time_[blob_id] = layers_.size();
   }
+  // outputs live longer now, place memory again on next Forward
+  planned_input_shapes_.clear();
+  plan_cache_.clear();
+}
+
+vector<string> Net::output_blob_names() const {
+  std::set<int> inputs(net_input_blob_ids_.begin(), net_input_blob_ids_.end());
+  vector<string> names;
+  for (size_t blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blob_life_time_[blob_id] == static_cast<int>(layers_.size()) && !inputs.count(blob_id)) {
+      names.push_back(blob_names_[blob_id]);
+    }
+  }
+  return names;
+}
+
+void Net::PruneToOutputs(const std::vector<std::string>& outs) {
+  CHECK(!outs.empty()) << "Net needs at least one output";
+  std::set<int> out_ids;
+  for (auto& name : outs) {
+    auto it = blob_names_index_.find(name);
+    if (it == blob_names_index_.end()) {
+      LOG(FATAL) << "blob (" << name << ") is not availiable in Net";
+    }
+    out_ids.insert(it->second);
+  }
+  const vector<int> kept = LayersProducing(out_ids);
+  // rebuild layers and blobs in the order Init creates them, so contexts
+  // built from the pruned net get the same blob ids
+  vector<shared_ptr<Layer> > layers(kept.size());
+  vector<string> layer_names(kept.size());
+  vector<vector<Blob*> > bottom_vecs(kept.size()), top_vecs(kept.size());
+  vector<vector<int> > bottom_id_vecs(kept.size()), top_id_vecs(kept.size());
+  vector<vector<int> > param_id_vecs(kept.size());
+  vector<shared_ptr<Blob> > blobs;
+  vector<string> blob_names;
+  vector<int> blob_life_time;
+  vector<shared_ptr<Blob> > params;
+  vector<string> param_display_names;
+  vector<int> blob_map(blobs_.size(), -1);
+  for (int i = 0; i < static_cast<int>(kept.size()); ++i) {
+    const int layer_id = kept[i];
+    layers[i] = layers_[layer_id];
+    layer_names[i] = layer_names_[layer_id];
+    bottom_vecs[i] = bottom_vecs_[layer_id];
+    top_vecs[i] = top_vecs_[layer_id];
+    for (int blob_id : bottom_id_vecs_[layer_id]) {
+      const int new_id = blob_map[blob_id];
+      CHECK_GE(new_id, 0) << "Producer of blob " << blob_names_[blob_id] << " is removed";
+      bottom_id_vecs[i].push_back(new_id);
+      blob_life_time[new_id] = std::max(blob_life_time[new_id], i);
+    }
+    for (int blob_id : top_id_vecs_[layer_id]) {
+      if (blob_map[blob_id] < 0) {
+        blob_map[blob_id] = blobs.size();
+        blobs.push_back(blobs_[blob_id]);
+        blob_names.push_back(blob_names_[blob_id]);
+        blob_life_time.push_back(i + 1);
+      }
+      const int new_id = blob_map[blob_id];
+      top_id_vecs[i].push_back(new_id);
+      blob_life_time[new_id] = std::max(blob_life_time[new_id], i + 1);
+    }
+    for (int param_id : param_id_vecs_[layer_id]) {
+      param_id_vecs[i].push_back(params.size());
+      params.push_back(params_[param_id]);
+      param_display_names.push_back(param_display_names_[param_id]);
+    }
+  }
+  for (int blob_id : top_id_vecs[0]) {
+    blob_life_time[blob_id] = kept.size();
+  }
+  for (int blob_id : out_ids) {
+    blob_life_time[blob_map[blob_id]] = kept.size();
+  }
+  LOG(INFO) << "Prune " << layers_.size() - kept.size() << " layers and "
+            << blobs_.size() - blobs.size() << " blobs";
+  layers_.swap(layers);
+  layer_names_.swap(layer_names);
+  bottom_vecs_.swap(bottom_vecs);
+  top_vecs_.swap(top_vecs);
+  bottom_id_vecs_.swap(bottom_id_vecs);
+  top_id_vecs_.swap(top_id_vecs);
+  param_id_vecs_.swap(param_id_vecs);
+  blobs_.swap(blobs);
+  blob_names_.swap(blob_names);
+  blob_life_time_.swap(blob_life_time);
+  params_.swap(params);
+  param_display_names_.swap(param_display_names);
+  blob_names_index_.clear();
+  for (size_t blob_id = 0; blob_id < blob_names_.size(); ++blob_id) {
+    blob_names_index_[blob_names_[blob_id]] = blob_id;
+  }
+  layer_names_index_.clear();
+  for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
+    layer_names_index_[layer_names_[layer_id]] = layer_id;
+  }
+  InternProfilerNames();
+  FindConstantLayers();
+  BuildSchedule(std::map<SyncedMemory*, std::pair<size_t, size_t> >());
+  // place memory again on next Forward
+  planned_input_shapes_.clear();
+  plan_cache_.clear();
 }
 
 void Net::CopyTrainedLayersFrom(const string& trained_filename) {
   NetParameter param;
   ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
-  CopyTrainedLayersFrom(param);
+  CopyTrainedLayersFrom(&param);
+}
+
+void Net::SaveFlatWeights(const string& file) const {
+  // index first, then every tensor at an aligned offset
+  uint64_t index_bytes = sizeof(kFlatMagic) + 2 * sizeof(uint32_t);
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    for (const auto& blob : layers_[i]->blobs()) {
+      index_bytes += 3 * sizeof(uint32_t) + layer_names_[i].size() +
+                     blob->num_axes() * sizeof(int32_t) + sizeof(uint64_t);
+    }
+  }
+  std::ofstream out(file.c_str(), std::ios::binary);
+  CHECK(out) << "Can't open " << file;
+  auto write = [&out](const void* data, size_t len) {
+    out.write(static_cast<const char*>(data), len);
+  };
+  const uint32_t num_tensors = params_.size();
+  write(kFlatMagic, sizeof(kFlatMagic));
+  write(&kFlatVersion, sizeof(kFlatVersion));
+  write(&num_tensors, sizeof(num_tensors));
+  uint64_t offset = index_bytes;
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    const vector<shared_ptr<Blob> >& blobs = layers_[i]->blobs();
+    for (uint32_t j = 0; j < blobs.size(); ++j) {
+      const uint32_t name_len = layer_names_[i].size();
+      const uint32_t num_axes = blobs[j]->num_axes();
+      write(&name_len, sizeof(name_len));
+      write(layer_names_[i].data(), name_len);
+      write(&j, sizeof(j));
+      write(&num_axes, sizeof(num_axes));
+      for (int dim : blobs[j]->shape()) {
+        const int32_t dim32 = dim;
+        write(&dim32, sizeof(dim32));
+      }
+      offset = (offset + kFlatAlign - 1) / kFlatAlign * kFlatAlign;
+      write(&offset, sizeof(offset));
+      offset += blobs[j]->count() * sizeof(real_t);
+    }
+  }
+  const char padding[kFlatAlign] = {0};
+  offset = index_bytes;
+  for (size_t i = 0; i < layers_.size(); ++i) {
+    for (const auto& blob : layers_[i]->blobs()) {
+      const uint64_t aligned = (offset + kFlatAlign - 1) / kFlatAlign * kFlatAlign;
+      write(padding, aligned - offset);
+      if (blob->count() > 0) {
+        write(blob->cpu_data(), blob->count() * sizeof(real_t));
+      }
+      offset = aligned + blob->count() * sizeof(real_t);
+    }
+  }
+  CHECK(out) << "Write " << file << " failed";
 }
 
 void Net::ToProto(NetParameter* param) const {
@@ -5,43 +5,300 @@
 #else
 #include <chrono>
 #endif  // _MSC_VER
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <functional>
+#include <thread>
+#endif
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <fstream>
 
+#include "./thread_local.hpp"
+
 namespace caffe {
 
+/*! \brief id of the calling thread as the OS reports it */
+static int CurrentThreadId() {
+#if defined(_WIN32)
+  return static_cast<int>(GetCurrentThreadId());
+#elif defined(__linux__)
+  return static_cast<int>(syscall(SYS_gettid));
+#else
+  return static_cast<int>(std::hash<std::thread::id>()(std::this_thread::get_id()) & 0x7fffffff);
+#endif
+}
+
+struct Profiler::ThreadBuffer {
+  static const int kMaxDepth = 64;
+  static const int kNameCacheSize = 64;
+  struct Event {
+    int name_id;
+    int net_id;
+    int stats_id;
+    uint64_t start_microsec;
+    uint64_t end_microsec;
+  };
+  /*! \brief interned name and its id */
+  struct CachedName {
+    const char *name;
+    int id;
+  };
+  explicit ThreadBuffer(int tid)
+      : tid(tid), exited(false), events(kEventsPerThread), count(0), depth(0), epoch(0) {
+    for (CachedName &cached : names) {
+      cached.name = nullptr;
+      cached.id = -1;
+    }
+  }
+  int tid;
+  /*! \brief the thread exited, guarded by Profiler::mutex_ */
+  bool exited;
+  /*! \brief ring of finished scopes, written only by the owning thread */
+  std::vector<Event> events;
+  /*! \brief scopes ever finished, events[i % kEventsPerThread] is scope i */
+  std::atomic<uint64_t> count;
+  /*! \brief open scopes, deeper ones are counted but not recorded */
+  Event stack[kMaxDepth];
+  int depth;
+  /*! \brief Profiler::epoch_ the open scopes were started in */
+  int epoch;
+  /*! \brief names of ScopeStart by a hash of the name, owning thread only */
+  CachedName names[kNameCacheSize];
+  /*! \brief drop the open scopes if the mode changed since they started,
+   *  their ends may have been skipped */
+  bool Sync(int current_epoch) {
+    if (epoch == current_epoch) return true;
+    depth = 0;
+    epoch = current_epoch;
+    return false;
+  }
+};
+
+/*! \brief latest latencies of a layer, guarded by its own lock */
+struct Profiler::StatsWindow {
+  StatsWindow(int name_id, int type_id)
+      : name_id(name_id), type_id(type_id), count(0), samples(kStatsWindow) {}
+  void Add(float microsec) {
+    std::lock_guard<std::mutex> lock(mutex);
+    samples[count % kStatsWindow] = microsec;
+    count += 1;
+  }
+  int name_id, type_id;
+  std::mutex mutex;
+  uint64_t count;
+  std::vector<float> samples;
+};
+
+/*! \brief hands the buffer of a thread back once the thread exits */
+struct Profiler::ThreadBufferOwner {
+  ThreadBuffer **buffer = nullptr;
+  ~ThreadBufferOwner() {
+    if (buffer && *buffer) {
+      Profiler::Get()->ReleaseThreadBuffer(*buffer);
+      *buffer = nullptr;
+    }
+  }
+};
+
 Profiler::Profiler()
-    : init_(Now()), state_(kNotRunning) {
-  scope_stack_.reserve(10);
-  scopes_.reserve(1024);
+    : num_exited_buffers_(0), num_stats_(0), init_(Now()), mode_(0), epoch_(0) {
+  // id 0 is for scopes outside of nets
+  net_names_.push_back("caffe");
 }
 
 Profiler *Profiler::Get() {
-  static Profiler inst;
-  return &inst;
+  // never destroyed, threads may still end scopes during static destruction
+  static Profiler *inst = new Profiler;
+  return inst;
+}
+
+int Profiler::Intern(const char *name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return InternLocked(name);
+}
+
+int Profiler::InternLocked(const char *name) {
+  auto it = name_ids_.find(name);
+  if (it != name_ids_.end()) return it->second;
+  const int id = names_.size();
+  names_.push_back(name);
+  name_ids_[names_.back()] = id;
+  return id;
+}
+
+int Profiler::NewNetId(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  net_names_.push_back(name);
+  return net_names_.size() - 1;
 }
 
 void Profiler::ScopeStart(const char *name) {
-  if (state_ == kNotRunning) return;
-  ScopePtr scope(new Scope);
-  if (!scope_stack_.empty()) {
-    scope->name = scope_stack_.back()->name + ":" + name;
+  if (mode_.load(std::memory_order_relaxed) == 0) return;
+  ThreadBuffer *buffer = GetThreadBuffer();
+  // FNV-1a of the name picks the cache entry, names never move once interned
+  uint32_t hash = 2166136261u;
+  for (const char *c = name; *c; ++c) {
+    hash = (hash ^ static_cast<unsigned char>(*c)) * 16777619u;
+  }
+  ThreadBuffer::CachedName &cached = buffer->names[hash % ThreadBuffer::kNameCacheSize];
+  if (cached.name == nullptr || std::strcmp(cached.name, name) != 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cached.id = InternLocked(name);
+    cached.name = names_[cached.id].c_str();
+  }
+  Push(cached.id, 0, -1);
+}
+
+int Profiler::StatsId(int name_id, const char *type) {
+  const int type_id = Intern(type);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto key = std::make_pair(name_id, type_id);
+  auto it = stats_ids_.find(key);
+  if (it != stats_ids_.end()) return it->second;
+  if (num_stats_ == kMaxStats) return -1;
+  // published before the id is handed out, Pop reads it without locking
+  stats_[num_stats_] = new StatsWindow(name_id, type_id);
+  stats_ids_[key] = num_stats_;
+  return num_stats_++;
+}
+
+Profiler::ThreadBuffer *Profiler::GetThreadBuffer() {
+  static THREAD_LOCAL ThreadBuffer *buffer = nullptr;
+  if (buffer == nullptr) {
+    buffer = new ThreadBuffer(CurrentThreadId());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      buffers_.push_back(buffer);
+    }
+#if !defined(_MSC_VER) || _MSC_VER > 1800
+    // no thread_local before VS2015, buffers are kept until the process exits
+    static thread_local ThreadBufferOwner owner;
+    owner.buffer = &buffer;
+#endif  // _MSC_VER
   }
-  else{
-    scope->name = name;
+  return buffer;
+}
+
+void Profiler::ReleaseThreadBuffer(ThreadBuffer *buffer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  buffer->exited = true;
+  num_exited_buffers_ += 1;
+  // nothing to dump
+  if (buffer->count.load(std::memory_order_relaxed) == 0) {
+    FreeExitedBuffer(std::find(buffers_.begin(), buffers_.end(), buffer));
   }
-  scope->start_microsec = Now() - init_;
-  scope_stack_.push_back(scope);
+  // oldest first
+  for (auto it = buffers_.begin(); num_exited_buffers_ > kMaxExitedBuffers;) {
+    it = (*it)->exited ? FreeExitedBuffer(it) : it + 1;
+  }
+}
+
+std::vector<Profiler::ThreadBuffer*>::iterator Profiler::FreeExitedBuffer(
+    std::vector<ThreadBuffer*>::iterator it) const {
+  delete *it;
+  num_exited_buffers_ -= 1;
+  return buffers_.erase(it);
+}
+
+int Profiler::num_thread_buffers() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return static_cast<int>(buffers_.size());
 }
 
-void Profiler::ScopeEnd() {
-  if (state_ == kNotRunning) return;
-  CHECK(!scope_stack_.empty());
-  ScopePtr current_scope = scope_stack_.back();
-  current_scope->end_microsec = Now() - init_;
-  scopes_.push_back(current_scope);
-  // pop stack
-  scope_stack_.pop_back();
+void Profiler::Push(int name_id, int net_id, int stats_id) {
+  ThreadBuffer *buffer = GetThreadBuffer();
+  buffer->Sync(epoch_.load(std::memory_order_relaxed));
+  if (buffer->depth < ThreadBuffer::kMaxDepth) {
+    ThreadBuffer::Event &event = buffer->stack[buffer->depth];
+    event.name_id = name_id;
+    event.net_id = net_id;
+    event.stats_id = stats_id;
+    event.start_microsec = Now() - init_;
+  }
+  buffer->depth += 1;
+}
+
+void Profiler::Pop() {
+  ThreadBuffer *buffer = GetThreadBuffer();
+  // the scope started before the profiler was turned on or off
+  if (!buffer->Sync(epoch_.load(std::memory_order_relaxed))) return;
+  if (buffer->depth == 0) return;
+  buffer->depth -= 1;
+  if (buffer->depth >= ThreadBuffer::kMaxDepth) return;
+  const ThreadBuffer::Event &scope = buffer->stack[buffer->depth];
+  const uint64_t end_microsec = Now() - init_;
+  const int mode = mode_.load(std::memory_order_relaxed);
+  if ((mode & kStats) && scope.stats_id >= 0) {
+    stats_[scope.stats_id]->Add(end_microsec - scope.start_microsec);
+  }
+  if (mode & kTrace) {
+    const uint64_t count = buffer->count.load(std::memory_order_relaxed);
+    ThreadBuffer::Event &event = buffer->events[count % kEventsPerThread];
+    event = scope;
+    event.end_microsec = end_microsec;
+    buffer->count.store(count + 1, std::memory_order_release);
+  }
+}
+
+std::vector<Profiler::LayerStats> Profiler::GetLayerStats() const {
+  int num_stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_stats = num_stats_;
+  }
+  std::vector<LayerStats> result;
+  std::vector<float> samples;
+  for (int i = 0; i < num_stats; ++i) {
+    StatsWindow *window = stats_[i];
+    LayerStats stats;
+    {
+      std::lock_guard<std::mutex> lock(window->mutex);
+      stats.count = window->count;
+      const size_t num = std::min<uint64_t>(window->count, kStatsWindow);
+      samples.assign(window->samples.begin(), window->samples.begin() + num);
+    }
+    if (stats.count == 0) continue;
+    std::sort(samples.begin(), samples.end());
+    // nearest rank
+    auto percentile = [&](double q) {
+      const size_t rank = static_cast<size_t>(std::ceil(q * samples.size()));
+      return static_cast<double>(samples[std::max<size_t>(rank, 1) - 1]);
+    };
+    double sum = 0;
+    for (float sample : samples) sum += sample;
+    stats.mean = sum / samples.size();
+    stats.p50 = percentile(0.5);
+    stats.p90 = percentile(0.9);
+    stats.p99 = percentile(0.99);
+    stats.min = samples.front();
+    stats.max = samples.back();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats.name = names_[window->name_id];
+      stats.type = names_[window->type_id];
+    }
+    result.push_back(stats);
+  }
+  return result;
+}
+
+void Profiler::ResetLayerStats() {
+  int num_stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_stats = num_stats_;
+  }
+  for (int i = 0; i < num_stats; ++i) {
+    std::lock_guard<std::mutex> lock(stats_[i]->mutex);
+    stats_[i]->count = 0;
+  }
 }
 
 uint64_t Profiler::Now() const {
@@ -57,22 +314,33 @@ uint64_t Profiler::Now() const {
 }
 
 static void ProfilerWriteEvent(std::ofstream &file,
-                              const char *name,
-                              const char *ph,
-                              uint64_t ts) {
+                               const char *name,
+                               uint64_t ts, uint64_t dur,
+                               int pid, int tid) {
   file << "    {" << std::endl;
   file << "      \"name\": \"" << name << "\"," << std::endl;
   file << "      \"cat\": \"category\"," << std::endl;
-  file << "      \"ph\": \"" << ph << "\"," << std::endl;
+  file << "      \"ph\": \"X\"," << std::endl;
   file << "      \"ts\": " << ts << "," << std::endl;
-  file << "      \"pid\": 0," << std::endl;
-  file << "      \"tid\": 0" << std::endl;
+  file << "      \"dur\": " << dur << "," << std::endl;
+  file << "      \"pid\": " << pid << "," << std::endl;
+  file << "      \"tid\": " << tid << std::endl;
+  file << "    }";
+}
+
+static void ProfilerWriteProcessName(std::ofstream &file,
+                                     const std::string &name, int pid) {
+  file << "    {" << std::endl;
+  file << "      \"name\": \"process_name\"," << std::endl;
+  file << "      \"ph\": \"M\"," << std::endl;
+  file << "      \"pid\": " << pid << "," << std::endl;
+  file << "      \"args\": {\"name\": \"" << name << "\"}" << std::endl;
   file << "    }";
 }
 
 void Profiler::DumpProfile(const char *fn) const {
-  CHECK(scope_stack_.empty());
-  CHECK_EQ(state_, kNotRunning);
+  CHECK(!running()) << "Profile is running.";
+  std::lock_guard<std::mutex> lock(mutex_);
 
   std::ofstream file;
   file.open(fn);
@@ -80,20 +348,31 @@ void Profiler::DumpProfile(const char *fn) const {
   file << "  \"traceEvents\": [";
 
   bool is_first = true;
-  for (auto scope : scopes_) {
-    if (is_first) {
-      file << std::endl;
-      is_first = false;
-    }
-    else {
-      file << "," << std::endl;
+  auto separate = [&]() {
+    file << (is_first ? "" : ",") << std::endl;
+    is_first = false;
+  };
+  for (size_t i = 0; i < net_names_.size(); ++i) {
+    separate();
+    ProfilerWriteProcessName(file, net_names_[i], static_cast<int>(i));
+  }
+  for (const ThreadBuffer *buffer : buffers_) {
+    const uint64_t count = buffer->count.load(std::memory_order_acquire);
+    const uint64_t first = count > kEventsPerThread ? count - kEventsPerThread : 0;
+    for (uint64_t i = first; i < count; ++i) {
+      const ThreadBuffer::Event &event = buffer->events[i % kEventsPerThread];
+      separate();
+      ProfilerWriteEvent(file, names_[event.name_id].c_str(), event.start_microsec,
+                         event.end_microsec - event.start_microsec,
+                         event.net_id, buffer->tid);
     }
-    ProfilerWriteEvent(file, scope->name.c_str(), "B", scope->start_microsec);
-    file << "," << std::endl;
-    ProfilerWriteEvent(file, scope->name.c_str(), "E", scope->end_microsec);
+  }
+  // exited threads record nothing more, their buffers are drained
+  for (auto it = buffers_.begin(); it != buffers_.end();) {
+    it = (*it)->exited ? FreeExitedBuffer(it) : it + 1;
   }
 
-  file << "  ]," << std::endl;
+  file << std::endl << "  ]," << std::endl;
   file << "  \"displayTimeUnit\": \"ms\"" << std::endl;
   file << "}" << std::endl;
 }
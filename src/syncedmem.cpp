@@ -1,36 +1,263 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
 #include <sstream>
 #include <iomanip>
 #include <mutex>
+#ifdef _MSC_VER
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif  // _MSC_VER
 #include "./common.hpp"
 #include "./syncedmem.hpp"
+#include "./thread_local.hpp"
 #include "./util/math_functions.hpp"
 #include "common.hpp"
 
 namespace caffe {
 
+// counted per thread, nets running on other threads don't disturb the audit
+static THREAD_LOCAL size_t allocation_count = 0;
 
-inline void CaffeMallocHost(void** ptr, size_t size) {
+size_t AllocationCount() {
+  return allocation_count;
+}
+
+void AddAllocationCount(size_t n) {
+  allocation_count += n;
+}
+
+}  // namespace caffe
+
+#ifdef USE_ALLOC_AUDIT
+// count every heap allocation of the process for Net::SetAllocAudit
+void* operator new(size_t size) {
+  ++caffe::allocation_count;
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == NULL) throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+#endif  // USE_ALLOC_AUDIT
+
+namespace caffe {
+
+inline std::string MemSize(double size) {
+  std::stringstream os;
+  if (size < 1024.) {
+    os << static_cast<int>(size) << " B";
+  }
+  else {
+    size /= 1024.;
+    os << std::setprecision(3);
+    if (size < 1024.) {
+      os << size << " K";
+    }
+    else {
+      size /= 1024.;
+      os << size << " M";
+    }
+  }
+  return os.str();
+}
+
+/*!
+ * \brief Host memory pool caching freed blocks by size class.
+ *  Classes are 64 bytes apart up to 1K, then 4 classes per power of two,
+ *  so a block wastes at most a quarter of its size. Every class has its own
+ *  lock, cached blocks are freed by Clear.
+ */
+class MemoryPool {
+ public:
+  static MemoryPool* Get() {
+    // never destroyed, SyncedMemory may return blocks during static destruction
+    static MemoryPool* pool = new MemoryPool;
+    return pool;
+  }
+
+  void* Request(size_t size) {
+    int index;
+    const size_t block_size = ClassSize(size, &index);
+    SizeClass& size_class = classes_[index];
+    void* ptr = NULL;
+    ++allocation_count;
+    {
+      std::lock_guard<std::mutex> lock(size_class.mutex);
+      if (!size_class.blocks.empty()) {
+        ptr = size_class.blocks.back();
+        size_class.blocks.pop_back();
+      }
+    }
+    if (ptr) {
+      unused_bytes_ -= block_size;
+      if (logging_) {
+        LOG(INFO) << "[CPU] Requested " << MemSize(size) << ", Get " << MemSize(block_size);
+      }
+      return ptr;
+    }
+    ptr = Allocate(block_size);
+    total_bytes_ += block_size;
+    if (logging_) {
+      LOG(INFO) << "[CPU] Requested " << MemSize(size) << ", Create " << MemSize(block_size);
+    }
+    return ptr;
+  }
+
+  void Return(void* ptr, size_t size) {
+    int index;
+    const size_t block_size = ClassSize(size, &index);
+    SizeClass& size_class = classes_[index];
+    {
+      std::lock_guard<std::mutex> lock(size_class.mutex);
+      size_class.blocks.push_back(ptr);
+    }
+    unused_bytes_ += block_size;
+    if (logging_) {
+      LOG(INFO) << "[CPU] Return " << MemSize(block_size);
+    }
+  }
+
+  void Clear() {
+    for (int index = 0; index < kNumClasses; ++index) {
+      SizeClass& size_class = classes_[index];
+      vector<void*> blocks;
+      {
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        blocks.swap(size_class.blocks);
+      }
+      if (blocks.empty()) continue;
+      const size_t block_size = IndexSize(index);
+      for (void* ptr : blocks) {
+        Deallocate(ptr);
+        total_bytes_ -= block_size;
+        unused_bytes_ -= block_size;
+        if (logging_) {
+          LOG(INFO) << "[CPU] Free " << MemSize(block_size);
+        }
+      }
+    }
+  }
+
+  MemPoolState GetState() const {
+    MemPoolState state;
+    state.gpu_mem = 0;
+    state.unused_gpu_mem = 0;
+    state.cpu_mem = total_bytes_;
+    state.unused_cpu_mem = unused_bytes_;
+    return state;
+  }
+
+  void set_logging(bool logging) { logging_ = logging; }
+  void set_huge_pages(bool huge_pages) { huge_pages_ = huge_pages; }
+
+ private:
+  MemoryPool()
+      : logging_(false), huge_pages_(false), total_bytes_(0), unused_bytes_(0) {}
+
+  static const int kNumClasses = 16 + 4 * 54;
+
+  static size_t ClassSize(size_t size, int* index) {
+    if (size <= 1024) {
+      const size_t steps = size == 0 ? 1 : (size + 63) / 64;
+      *index = static_cast<int>(steps) - 1;
+      return steps * 64;
+    }
+    int log = 10;
+    while ((size - 1) >> (log + 1)) ++log;
+    const size_t base = size_t(1) << log;
+    const size_t step = base / 4;
+    const size_t k = (size - base + step - 1) / step;
+    *index = 16 + (log - 10) * 4 + static_cast<int>(k) - 1;
+    return base + k * step;
+  }
+
+  static size_t IndexSize(int index) {
+    if (index < 16) return (index + 1) * 64;
+    const int log = 10 + (index - 16) / 4;
+    const size_t base = size_t(1) << log;
+    return base + ((index - 16) % 4 + 1) * (base / 4);
+  }
+
+  void* Allocate(size_t size) {
+    const size_t huge_page_size = 2 << 20;
+    const bool huge = huge_pages_ && size >= huge_page_size;
+    const size_t align = huge ? huge_page_size : 64;
+    void* ptr = NULL;
 #ifdef USE_MKL
-    *ptr = mkl_malloc(size ? size : 1, 64);
+    ptr = mkl_malloc(size, align);
+#elif defined(_MSC_VER)
+    ptr = _aligned_malloc(size, align);
 #else
-   *ptr = malloc(size);
+    if (posix_memalign(&ptr, align, size) != 0) ptr = NULL;
 #endif
-  CHECK(*ptr) << "host allocation of size " << size << " failed";
-}
+    CHECK(ptr) << "host allocation of size " << size << " failed";
+#if defined(MADV_HUGEPAGE)
+    if (huge) madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    return ptr;
+  }
 
-static void CaffeFreeHost(void* ptr) {
+  static void Deallocate(void* ptr) {
 #ifdef USE_MKL
     mkl_free(ptr);
+#elif defined(_MSC_VER)
+    _aligned_free(ptr);
 #else
     free(ptr);
 #endif
+  }
+
+  struct SizeClass {
+    std::mutex mutex;
+    vector<void*> blocks;
+  };
+  SizeClass classes_[kNumClasses];
+  std::atomic<bool> logging_;
+  std::atomic<bool> huge_pages_;
+  std::atomic<size_t> total_bytes_;
+  std::atomic<size_t> unused_bytes_;
+};
+
+inline void CaffeMallocHost(void** ptr, size_t size) {
+  *ptr = MemoryPool::Get()->Request(size);
+}
+
+static void CaffeFreeHost(void* ptr, size_t size) {
+  MemoryPool::Get()->Return(ptr, size);
+}
+
+MemPoolState MemPoolGetState() {
+  return MemoryPool::Get()->GetState();
+}
+
+void MemPoolClear() {
+  MemoryPool::Get()->Clear();
+}
+
+void MemPoolSetLogging(bool enable) {
+  MemoryPool::Get()->set_logging(enable);
+}
+
+void MemPoolSetHugePages(bool enable) {
+  MemoryPool::Get()->set_huge_pages(enable);
 }
 
 SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_);
+    CaffeFreeHost(cpu_ptr_, size_);
   }
-
 }
 
 inline void SyncedMemory::to_cpu() {
@@ -59,12 +286,20 @@ inline void SyncedMemory::to_cpu() {
 }
 
 const void* SyncedMemory::cpu_data() {
+  // fast path, cpu_ptr_ is set before head_ moves to a state valid on CPU
+  const SyncedHead head = head_.load(std::memory_order_acquire);
+  if (head == HEAD_AT_CPU || head == SYNCED || head == SYNCED_PRV) {
+    return (const void*)cpu_ptr_;
+  }
   std::lock_guard<std::mutex> lock(mtx);
   to_cpu();
   return (const void*)cpu_ptr_;
 }
 
 void* SyncedMemory::mutable_cpu_data() {
+  if (head_.load(std::memory_order_acquire) == HEAD_AT_CPU) {
+    return cpu_ptr_;
+  }
   std::lock_guard<std::mutex> lock(mtx);
   to_cpu();
   head_ = HEAD_AT_CPU;
@@ -74,37 +309,13 @@ void SyncedMemory::set_cpu_data(void* data) {
   std::lock_guard<std::mutex> lock(mtx);
   CHECK(data);
   if (own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_);
+    CaffeFreeHost(cpu_ptr_, size_);
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
 }
 
-inline std::string MemSize(double size) {
-  std::stringstream os;
-  if (size < 1024.) {
-    os << static_cast<int>(size) << " B";
-  }
-  else {
-    size /= 1024.;
-    os << std::setprecision(3);
-    if (size < 1024.) {
-      os << size << " K";
-    }
-    else {
-      size /= 1024.;
-      os << size << " M";
-    }
-  }
-  return os.str();
-}
-
-inline bool ShouldBorrowMem(size_t has, size_t wants) {
-  const int ratio = 2;
-  return has / 2 <= wants;
-}
-
 //mkdnn
 void SyncedMemory::set_prv_descriptor(shared_ptr<PrvMemDescr> descriptor,
         bool same_data) {
@@ -1,8 +1,10 @@
 #ifndef CAFFE_SYNCEDMEM_HPP_
 #define CAFFE_SYNCEDMEM_HPP_
 
+#include <atomic>
 #include <cstdlib>
 #include <map>
+#include <mutex>
 #include "./common.hpp"
 #include "./thread_local.hpp"
 
@@ -27,6 +29,16 @@ struct PrvMemDescr {
   virtual PrvDescrType get_descr_type() = 0;
 };
 
+/**
+ * @brief Host memory of a Blob, synced with a private (e.g. MKLDNN) layout.
+ *
+ * Thread safety: cpu_data() of memory already valid on CPU and
+ * mutable_cpu_data() of memory with head at CPU only read an atomic head,
+ * so threads reading shared weights never wait for each other. Other state
+ * transitions (first allocation, private layout conversion) are serialized
+ * by a mutex. Writing data, set_cpu_data and private layout changes must
+ * not run concurrently with readers of the same memory.
+ */
 class SyncedMemory {
  public:
   explicit SyncedMemory(size_t size)
@@ -43,11 +55,13 @@ class SyncedMemory {
   void set_prv_descriptor(shared_ptr<PrvMemDescr> descriptor, bool same_data);
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, SYNCED,
                     HEAD_AT_PRV, SYNCED_PRV};
-  SyncedHead head() { return head_; }
+  SyncedHead head() { return head_.load(std::memory_order_acquire); }
+  /// @brief false if cpu data is bound from outside by set_cpu_data
+  bool own_cpu_data() const { return own_cpu_data_; }
  private:
   void to_cpu();
   size_t size_;
-  SyncedHead head_;
+  std::atomic<SyncedHead> head_;
   void* cpu_ptr_;
   bool own_cpu_data_;
   bool own_prv_data_;
@@ -56,6 +70,12 @@ class SyncedMemory {
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
 
+/*!
+ * \brief add n to AllocationCount of the calling thread, for allocations
+ *  made on its behalf by other threads (tasks of IntraOpPool::Run)
+ */
+void AddAllocationCount(size_t n);
+
 }  // namespace caffe
 
 #endif  // CAFFE_SYNCEDMEM_HPP_
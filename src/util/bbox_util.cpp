@@ -341,12 +341,11 @@ void DecodeBBoxes(
   if (num_bboxes >= 1) {
     CHECK_EQ(prior_variances[0].size(), 4);
   }
-  decode_bboxes->clear();
+  decode_bboxes->resize(num_bboxes);
   for (int i = 0; i < num_bboxes; ++i) {
-    NormalizedBBox decode_bbox;
     DecodeBBox(prior_bboxes[i], prior_variances[i], code_type,
-               variance_encoded_in_target, clip_bbox, bboxes[i], &decode_bbox);
-    decode_bboxes->push_back(decode_bbox);
+               variance_encoded_in_target, clip_bbox, bboxes[i],
+               &(*decode_bboxes)[i]);
   }
 }
 
@@ -358,7 +357,6 @@ void DecodeBBoxesAll(const vector<LabelBBox>& all_loc_preds,
     const CodeType code_type, const bool variance_encoded_in_target,
     const bool clip, vector<LabelBBox>* all_decode_bboxes) {
   CHECK_EQ(all_loc_preds.size(), num);
-  all_decode_bboxes->clear();
   all_decode_bboxes->resize(num);
   for (int i = 0; i < num; ++i) {
     // Decode predictions into bboxes.
@@ -386,20 +384,20 @@ template <typename Dtype>
 void GetLocPredictions(const Dtype* loc_data, const int num,
       const int num_preds_per_class, const int num_loc_classes,
       const bool share_location, vector<LabelBBox>* loc_preds) {
-  loc_preds->clear();
   if (share_location) {
     CHECK_EQ(num_loc_classes, 1);
   }
   loc_preds->resize(num);
   for (int i = 0; i < num; ++i) {
     LabelBBox& label_bbox = (*loc_preds)[i];
+    for (int c = 0; c < num_loc_classes; ++c) {
+      int label = share_location ? -1 : c;
+      label_bbox[label].resize(num_preds_per_class);
+    }
     for (int p = 0; p < num_preds_per_class; ++p) {
       int start_idx = p * num_loc_classes * 4;
       for (int c = 0; c < num_loc_classes; ++c) {
         int label = share_location ? -1 : c;
-        if (label_bbox.find(label) == label_bbox.end()) {
-          label_bbox[label].resize(num_preds_per_class);
-        }
         label_bbox[label][p].set_xmin(loc_data[start_idx + c * 4]);
         label_bbox[label][p].set_ymin(loc_data[start_idx + c * 4 + 1]);
         label_bbox[label][p].set_xmax(loc_data[start_idx + c * 4 + 2]);
@@ -419,14 +417,16 @@ template <typename Dtype>
 void GetConfidenceScores(const Dtype* conf_data, const int num,
   const int num_preds_per_class, const int num_classes,
   vector<map<int, vector<float> > >* conf_preds) {
-  conf_preds->clear();
   conf_preds->resize(num);
   for (int i = 0; i < num; ++i) {
     map<int, vector<float> >& label_scores = (*conf_preds)[i];
+    for (int c = 0; c < num_classes; ++c) {
+      label_scores[c].resize(num_preds_per_class);
+    }
     for (int p = 0; p < num_preds_per_class; ++p) {
       int start_idx = p * num_classes;
       for (int c = 0; c < num_classes; ++c) {
-        label_scores[c].push_back(conf_data[start_idx + c]);
+        label_scores[c][p] = conf_data[start_idx + c];
       }
     }
     conf_data += num_preds_per_class * num_classes;
@@ -442,7 +442,6 @@ template <typename Dtype>
 void GetConfidenceScores(const Dtype* conf_data, const int num,
       const int num_preds_per_class, const int num_classes,
       const bool class_major, vector<map<int, vector<float> > >* conf_preds) {
-  conf_preds->clear();
   conf_preds->resize(num);
   for (int i = 0; i < num; ++i) {
     map<int, vector<float> >& label_scores = (*conf_preds)[i];
@@ -452,10 +451,13 @@ void GetConfidenceScores(const Dtype* conf_data, const int num,
         conf_data += num_preds_per_class;
       }
     } else {
+      for (int c = 0; c < num_classes; ++c) {
+        label_scores[c].resize(num_preds_per_class);
+      }
       for (int p = 0; p < num_preds_per_class; ++p) {
         int start_idx = p * num_classes;
         for (int c = 0; c < num_classes; ++c) {
-          label_scores[c].push_back(conf_data[start_idx + c]);
+          label_scores[c][p] = conf_data[start_idx + c];
         }
       }
       conf_data += num_preds_per_class * num_classes;
@@ -472,27 +474,23 @@ template <typename Dtype>
 void GetPriorBBoxes(const Dtype* prior_data, const int num_priors,
       vector<NormalizedBBox>* prior_bboxes,
       vector<vector<float> >* prior_variances) {
-  prior_bboxes->clear();
-  prior_variances->clear();
+  prior_bboxes->resize(num_priors);
+  prior_variances->resize(num_priors);
   for (int i = 0; i < num_priors; ++i) {
     int start_idx = i * 4;
-    NormalizedBBox bbox;
+    NormalizedBBox& bbox = (*prior_bboxes)[i];
     bbox.set_xmin(prior_data[start_idx]);
     bbox.set_ymin(prior_data[start_idx + 1]);
     bbox.set_xmax(prior_data[start_idx + 2]);
     bbox.set_ymax(prior_data[start_idx + 3]);
     float bbox_size = BBoxSize(bbox);
     bbox.set_size(bbox_size);
-    prior_bboxes->push_back(bbox);
   }
 
   for (int i = 0; i < num_priors; ++i) {
     int start_idx = (num_priors + i) * 4;
-    vector<float> var;
-    for (int j = 0; j < 4; ++j) {
-      var.push_back(prior_data[start_idx + j]);
-    }
-    prior_variances->push_back(var);
+    (*prior_variances)[i].assign(prior_data + start_idx,
+                                 prior_data + start_idx + 4);
   }
 }
 
@@ -529,9 +527,12 @@ void GetMaxScoreIndex(const vector<float>& scores, const float threshold,
     }
   }
 
-  // Sort the score pair according to the scores in descending order
-  std::stable_sort(score_index_vec->begin(), score_index_vec->end(),
-                   SortScorePairDescend<int>);
+  // Sort the score pair according to the scores in descending order, ties
+  // keep index order like a stable sort, which would need a temporary buffer
+  std::sort(score_index_vec->begin(), score_index_vec->end(),
+            [](const pair<float, int>& a, const pair<float, int>& b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  });
 
   // Keep top_k scores if needed.
   if (top_k > -1 && top_k < score_index_vec->size()) {
@@ -682,19 +683,28 @@ void ApplyNMSFast(const vector<NormalizedBBox>& bboxes,
       const vector<float>& scores, const float score_threshold,
       const float nms_threshold, const float eta, const int top_k,
       vector<int>* indices) {
+  vector<pair<float, int> > score_index_vec;
+  ApplyNMSFast(bboxes, scores, score_threshold, nms_threshold, eta, top_k,
+               indices, &score_index_vec);
+}
+
+void ApplyNMSFast(const vector<NormalizedBBox>& bboxes,
+      const vector<float>& scores, const float score_threshold,
+      const float nms_threshold, const float eta, const int top_k,
+      vector<int>* indices, vector<pair<float, int> >* score_index_vec) {
   // Sanity check.
   CHECK_EQ(bboxes.size(), scores.size())
       << "bboxes and scores have different size.";
 
   // Get top_k scores (with corresponding indices).
-  vector<pair<float, int> > score_index_vec;
-  GetMaxScoreIndex(scores, score_threshold, top_k, &score_index_vec);
+  score_index_vec->clear();
+  GetMaxScoreIndex(scores, score_threshold, top_k, score_index_vec);
 
   // Do nms.
   float adaptive_threshold = nms_threshold;
   indices->clear();
-  while (score_index_vec.size() != 0) {
-    const int idx = score_index_vec.front().second;
+  for (int i = 0; i < score_index_vec->size(); ++i) {
+    const int idx = (*score_index_vec)[i].second;
     bool keep = true;
     for (int k = 0; k < indices->size(); ++k) {
       if (keep) {
@@ -708,7 +718,6 @@ void ApplyNMSFast(const vector<NormalizedBBox>& bboxes,
     if (keep) {
       indices->push_back(idx);
     }
-    score_index_vec.erase(score_index_vec.begin());
     if (keep && eta < 1 && adaptive_threshold > 0.5) {
       adaptive_threshold *= eta;
     }
@@ -117,6 +117,8 @@ void DecodeBBox(const NormalizedBBox& prior_bbox,
     const NormalizedBBox& bbox, NormalizedBBox* decode_bbox);
 
 // Decode a set of bboxes according to a set of prior bboxes.
+// Output containers of the decode and Get* helpers below are overwritten in
+// place, passing the same ones on every call reuses their storage.
 void DecodeBBoxes(const vector<NormalizedBBox>& prior_bboxes,
     const vector<vector<float> >& prior_variances,
     const CodeType code_type, const bool variance_encoded_in_target,
@@ -251,6 +253,12 @@ void ApplyNMSFast(const vector<NormalizedBBox>& bboxes,
       const float nms_threshold, const float eta, const int top_k,
       vector<int>* indices);
 
+// Same as above, score_index_vec is a workspace kept by the caller.
+void ApplyNMSFast(const vector<NormalizedBBox>& bboxes,
+      const vector<float>& scores, const float score_threshold,
+      const float nms_threshold, const float eta, const int top_k,
+      vector<int>* indices, vector<pair<float, int> >* score_index_vec);
+
 // Do non maximum suppression based on raw bboxes and scores data.
 // Inspired by Piotr Dollar's NMS implementation in EdgeBox.
 // https://goo.gl/jV3JYS
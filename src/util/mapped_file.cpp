@@ -0,0 +1,78 @@
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // _MSC_VER
+
+#include <caffe/logging.hpp>
+
+#include "./mapped_file.hpp"
+
+namespace caffe {
+
+#ifdef _MSC_VER
+
+MappedFile::MappedFile(const std::string& path)
+    : data_(NULL), size_(0), file_(NULL), mapping_(NULL) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  CHECK(file != INVALID_HANDLE_VALUE) << "File not found: " << path;
+  file_ = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    LOG(FATAL) << "Can't get size of " << path;
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  if (size_ == 0) return;
+  // copy-on-write pages, like MAP_PRIVATE
+  mapping_ = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  if (mapping_) {
+    data_ = static_cast<char*>(MapViewOfFile(mapping_, FILE_MAP_COPY, 0, 0, 0));
+  }
+  if (!data_) {
+    if (mapping_) CloseHandle(mapping_);
+    CloseHandle(file);
+    LOG(FATAL) << "Can't map " << path;
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) UnmapViewOfFile(data_);
+  if (mapping_) CloseHandle(mapping_);
+  if (file_) CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+    : data_(NULL), size_(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << path;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    LOG(FATAL) << "Can't get size of " << path;
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  if (size_ > 0) {
+    void* addr = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    CHECK(addr != MAP_FAILED) << "Can't map " << path;
+    data_ = static_cast<char*>(addr);
+  }
+  else {
+    close(fd);
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_) munmap(data_, size_);
+}
+
+#endif  // _MSC_VER
+
+}  // namespace caffe
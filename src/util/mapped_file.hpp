@@ -0,0 +1,37 @@
+#ifndef CAFFE_UTIL_MAPPED_FILE_HPP_
+#define CAFFE_UTIL_MAPPED_FILE_HPP_
+
+#include <string>
+
+#include "caffe/base.hpp"
+
+namespace caffe {
+
+/*!
+ * \brief Private read-write mapping of a whole file.
+ *  Pages are loaded on first touch and shared with the page cache until
+ *  written, writes are never stored to the file.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+  /*! \brief start of mapping, aligned to page size */
+  char* data() const { return data_; }
+  /*! \brief file size in bytes */
+  size_t size() const { return size_; }
+
+ private:
+  char* data_;
+  size_t size_;
+#ifdef _MSC_VER
+  void* file_;
+  void* mapping_;
+#endif  // _MSC_VER
+
+  DISABLE_COPY_AND_ASSIGN(MappedFile);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MAPPED_FILE_HPP_
@@ -103,6 +103,14 @@ void caffe_log(const int n, const float* a, float* y) {
   vsLn(n, a, y);
 }
 
+void caffe_tanh(const int n, const float* a, float* y) {
+  vsTanh(n, a, y);
+}
+
+void caffe_sigmoid(const int n, const float* a, float* y) {
+  VmathSigmoid(n, a, y);
+}
+
 void caffe_abs(const int n, const float* a, float* y) {
     vsAbs(n, a, y);
 }
@@ -55,6 +55,11 @@ void caffe_exp(const int n, const real_t* a, real_t* y);
 
 void caffe_log(const int n, const real_t* a, real_t* y);
 
+void caffe_tanh(const int n, const real_t* a, real_t* y);
+
+// y = 1 / (1 + exp(-a))
+void caffe_sigmoid(const int n, const real_t* a, real_t* y);
+
 void caffe_abs(const int n, const real_t* a, real_t* y);
 
 real_t caffe_cpu_dot(const int n, const real_t* x, const real_t* y);
@@ -6,6 +6,8 @@ extern "C" {
 }
 #include <math.h>
 
+#include "./vmath.hpp"
+
 // A simple way to define the vsl unary functions. The operation should
 // be in the form e.g. y[i] = sqrt(a[i])
 #define DEFINE_VSL_UNARY_FUNC(name, operation) \
@@ -20,24 +22,25 @@ extern "C" {
   }
 
 DEFINE_VSL_UNARY_FUNC(Sqr, y[i] = a[i] * a[i]);
-DEFINE_VSL_UNARY_FUNC(Exp, y[i] = exp(a[i]));
-DEFINE_VSL_UNARY_FUNC(Ln, y[i] = log(a[i]));
 DEFINE_VSL_UNARY_FUNC(Abs, y[i] = fabs(a[i]));
 
-// A simple way to define the vsl unary functions with singular parameter b.
-// The operation should be in the form e.g. y[i] = pow(a[i], b)
-#define DEFINE_VSL_UNARY_FUNC_WITH_PARAM(name, operation) \
-  template<typename Dtype> \
-  void v##name(const int n, const Dtype* a, const Dtype b, Dtype* y) { \
-    CHECK_GT(n, 0); CHECK(a); CHECK(y); \
-    for (int i = 0; i < n; ++i) { operation; } \
-  } \
-  inline void vs##name( \
-    const int n, const float* a, const float b, float* y) { \
-    v##name<float>(n, a, b, y); \
-  }
-
-DEFINE_VSL_UNARY_FUNC_WITH_PARAM(Powx, y[i] = pow(a[i], b));
+// Transcendental functions run the SIMD kernels of vmath.hpp
+inline void vsExp(const int n, const float* a, float* y) {
+  CHECK_GT(n, 0); CHECK(a); CHECK(y);
+  caffe::VmathExp(n, a, y);
+}
+inline void vsLn(const int n, const float* a, float* y) {
+  CHECK_GT(n, 0); CHECK(a); CHECK(y);
+  caffe::VmathLn(n, a, y);
+}
+inline void vsTanh(const int n, const float* a, float* y) {
+  CHECK_GT(n, 0); CHECK(a); CHECK(y);
+  caffe::VmathTanh(n, a, y);
+}
+inline void vsPowx(const int n, const float* a, const float b, float* y) {
+  CHECK_GT(n, 0); CHECK(a); CHECK(y);
+  caffe::VmathPowx(n, a, b, y);
+}
 
 // A simple way to define the vsl binary functions. The operation should
 // be in the form e.g. y[i] = a[i] + b[i]
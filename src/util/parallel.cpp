@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#ifdef _MSC_VER
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif  // _MSC_VER
+
+#include <caffe/logging.hpp>
+
+#include "./parallel.hpp"
+#include "../syncedmem.hpp"
+#include "../thread_local.hpp"
+
+namespace caffe {
+
+// pool of loops on this thread, and whether it is running a task of a loop
+static THREAD_LOCAL IntraOpPool* current_pool = NULL;
+static THREAD_LOCAL bool in_task = false;
+
+struct IntraOpPool::Job {
+  LoopFn fn;
+  /*! \brief tasks not done, the job is on the stack of Run until it is 0 */
+  std::atomic<int64_t> pending;
+  /*! \brief allocations of tasks run by workers */
+  std::atomic<size_t> allocations;
+  std::mutex mutex;
+  std::exception_ptr error;
+
+  explicit Job(LoopFn fn) : fn(fn), pending(0), allocations(0) {}
+};
+
+void IntraOpPool::Queue::PushBack(const Task& task) {
+  if (size == tasks.size()) {
+    // unroll the ring into a larger one
+    std::vector<Task> grown(std::max<size_t>(2 * tasks.size(), 16));
+    for (size_t i = 0; i < size; ++i) {
+      grown[i] = tasks[(head + i) % tasks.size()];
+    }
+    tasks.swap(grown);
+    head = 0;
+  }
+  tasks[(head + size) % tasks.size()] = task;
+  ++size;
+}
+
+IntraOpPool::Task IntraOpPool::Queue::PopFront() {
+  const Task task = tasks[head];
+  head = (head + 1) % tasks.size();
+  --size;
+  return task;
+}
+
+IntraOpPool::Task IntraOpPool::Queue::PopBack() {
+  --size;
+  return tasks[(head + size) % tasks.size()];
+}
+
+static void SetAffinity(std::thread* thread, int core) {
+  const int num_cores = std::max(1u, std::thread::hardware_concurrency());
+  core %= num_cores;
+#ifdef _MSC_VER
+  SetThreadAffinityMask(thread->native_handle(), DWORD_PTR(1) << core);
+#elif defined(__linux__)
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core, &cpus);
+  pthread_setaffinity_np(thread->native_handle(), sizeof(cpus), &cpus);
+#endif
+}
+
+IntraOpPool::IntraOpPool(int num_threads, int spin_us, bool affinity)
+    : queues_(std::max(num_threads - 1, 1)), next_queue_(0), spin_us_(spin_us),
+      num_queued_(0), num_sleeping_(0), stop_(false) {
+  CHECK_GT(num_threads, 0);
+  CHECK_GE(spin_us, 0);
+  // a loop puts at most 4 tasks per thread, spread over the queues
+  for (auto& queue : queues_) {
+    queue.tasks.resize(std::max<size_t>(16, 8 * num_threads / queues_.size()));
+  }
+  for (int i = 0; i < num_threads - 1; ++i) {
+    workers_.emplace_back([this, i]() { WorkerLoop(i); });
+    if (affinity) SetAffinity(&workers_.back(), i + 1);
+  }
+}
+
+IntraOpPool::~IntraOpPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+  }
+  sleep_cond_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+IntraOpPool* IntraOpPool::Current() {
+  return in_task ? NULL : current_pool;
+}
+
+void IntraOpPool::Run(int64_t begin, int64_t end, int64_t grain, LoopFn fn) {
+  const int64_t n = end - begin;
+  if (n <= 0) return;
+  // a few tasks per thread, so threads finishing early steal the rest,
+  // none shorter than grain
+  const int64_t num_tasks = std::min<int64_t>(n / std::max<int64_t>(grain, 1),
+                                              4 * num_threads());
+  if (workers_.empty() || num_tasks <= 1) {
+    fn(begin, end);
+    return;
+  }
+  Job job(fn);
+  job.pending = num_tasks;
+  const int first = next_queue_++;
+  for (int64_t t = 0; t < num_tasks; ++t) {
+    Task task = {&job, begin + n * t / num_tasks, begin + n * (t + 1) / num_tasks};
+    Queue& queue = queues_[(first + t) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.PushBack(task);
+  }
+  num_queued_ += num_tasks;
+  if (num_sleeping_ > 0) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    sleep_cond_.notify_all();
+  }
+  // work on the loop, or on any other, until all tasks of this one are done
+  while (job.pending > 0) {
+    if (RunTask(first % queues_.size(), false)) continue;
+    std::unique_lock<std::mutex> lock(done_mutex_);
+    done_cond_.wait_for(lock, std::chrono::microseconds(100),
+                        [&job]() { return job.pending == 0; });
+  }
+  // tasks run here are counted already
+  if (job.allocations > 0) AddAllocationCount(job.allocations);
+  if (job.error) std::rethrow_exception(job.error);
+}
+
+bool IntraOpPool::RunTask(int id, bool worker) {
+  Task task;
+  bool found = false;
+  // own tasks from the front, stolen ones from the back
+  for (size_t k = 0; k < queues_.size() && !found; ++k) {
+    Queue& queue = queues_[(id + k) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.size == 0) continue;
+    task = k == 0 ? queue.PopFront() : queue.PopBack();
+    found = true;
+  }
+  if (!found) return false;
+  --num_queued_;
+  Job* job = task.job;
+  const bool was_in_task = in_task;
+  in_task = true;
+  const size_t allocations = worker ? AllocationCount() : 0;
+  try {
+    job->fn(task.begin, task.end);
+  }
+  catch (...) {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    if (!job->error) job->error = std::current_exception();
+  }
+  in_task = was_in_task;
+  if (worker) job->allocations += AllocationCount() - allocations;
+  // the job may be gone once pending drops to 0, don't touch it afterwards
+  if (--job->pending == 0) {
+    std::lock_guard<std::mutex> lock(done_mutex_);
+    done_cond_.notify_all();
+  }
+  return true;
+}
+
+void IntraOpPool::WorkerLoop(int id) {
+  typedef std::chrono::steady_clock Clock;
+  while (true) {
+    if (RunTask(id, true)) continue;
+    // poll a while, new loops often come right after the last one
+    const Clock::time_point deadline = Clock::now() + std::chrono::microseconds(spin_us_);
+    bool found = false;
+    while (!found && Clock::now() < deadline) {
+      if (num_queued_ > 0) found = RunTask(id, true);
+      else std::this_thread::yield();
+    }
+    if (found) continue;
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    ++num_sleeping_;
+    sleep_cond_.wait(lock, [this]() { return stop_ || num_queued_ > 0; });
+    --num_sleeping_;
+    if (stop_) return;
+  }
+}
+
+IntraOpScope::IntraOpScope(IntraOpPool* pool)
+    : previous_(current_pool) {
+  current_pool = pool;
+}
+
+IntraOpScope::~IntraOpScope() {
+  current_pool = previous_;
+}
+
+}  // namespace caffe
@@ -0,0 +1,149 @@
+#ifndef CAFFE_UTIL_PARALLEL_HPP_
+#define CAFFE_UTIL_PARALLEL_HPP_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "caffe/base.hpp"
+
+namespace caffe {
+
+/*!
+ * \brief Work stealing pool splitting loops of reference CPU layers, see
+ *  parallel_for. Every worker pops ranges from its own queue and steals from
+ *  the others once it runs dry, the thread running a loop works on it too.
+ *  Several threads may run loops on one pool at the same time.
+ */
+class CAFFE_API IntraOpPool {
+ public:
+  /*!
+   * \param num_threads threads working on a loop, including the calling one
+   * \param spin_us microseconds idle workers poll for work before sleeping
+   * \param affinity pin worker i to core i + 1
+   */
+  IntraOpPool(int num_threads, int spin_us, bool affinity);
+  ~IntraOpPool();
+
+  /*! \brief non-owning reference to a loop body, fn must outlive it */
+  class LoopFn {
+   public:
+    template <typename F>
+    explicit LoopFn(const F& fn) : fn_(&fn), call_(&Call<F>) {}
+    void operator()(int64_t begin, int64_t end) const { call_(fn_, begin, end); }
+
+   private:
+    template <typename F>
+    static void Call(const void* fn, int64_t begin, int64_t end) {
+      (*static_cast<const F*>(fn))(begin, end);
+    }
+    const void* fn_;
+    void (*call_)(const void*, int64_t, int64_t);
+  };
+
+  /*!
+   * \brief run fn over ranges of [begin, end), return once all are done,
+   *  the first exception thrown by fn is rethrown afterwards. Neither fn nor
+   *  the tasks are copied to the heap, loops allocate nothing once the task
+   *  queues are large enough. Allocations of tasks run by workers count for
+   *  the calling thread, see AllocationCount.
+   * \param grain smallest range worth a task, ranges are no shorter
+   */
+  void Run(int64_t begin, int64_t end, int64_t grain, LoopFn fn);
+  template <typename F>
+  void Run(int64_t begin, int64_t end, int64_t grain, const F& fn) {
+    Run(begin, end, grain, LoopFn(fn));
+  }
+  /*! \brief number of threads working on a loop */
+  int num_threads() const { return static_cast<int>(workers_.size()) + 1; }
+
+  /*! \brief pool of loops on the calling thread, NULL inside a task */
+  static IntraOpPool* Current();
+
+ private:
+  friend class IntraOpScope;
+  struct Job;
+  struct Task {
+    Job* job;
+    int64_t begin;
+    int64_t end;
+  };
+  /*! \brief ring of tasks, grows when full and never shrinks */
+  struct Queue {
+    std::mutex mutex;
+    std::vector<Task> tasks;
+    size_t head = 0;
+    size_t size = 0;
+    void PushBack(const Task& task);
+    Task PopFront();
+    Task PopBack();
+  };
+  void WorkerLoop(int id);
+  /*!
+   * \brief run a task of queue `id` or stolen from another, false if none
+   * \param worker whether a worker runs it, not the caller of a Run
+   */
+  bool RunTask(int id, bool worker);
+
+  std::vector<std::thread> workers_;
+  std::vector<Queue> queues_;
+  std::atomic<int> next_queue_;
+  int spin_us_;
+  /*! \brief tasks in all queues, idle workers sleep while there are none */
+  std::atomic<int64_t> num_queued_;
+  std::atomic<int> num_sleeping_;
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cond_;
+  /*! \brief callers of Run wait here for tasks running on workers */
+  std::mutex done_mutex_;
+  std::condition_variable done_cond_;
+  bool stop_;
+
+  DISABLE_COPY_AND_ASSIGN(IntraOpPool);
+};
+
+/*! \brief make `pool` the pool of loops on the calling thread in a scope */
+class CAFFE_API IntraOpScope {
+ public:
+  explicit IntraOpScope(IntraOpPool* pool);
+  ~IntraOpScope();
+
+ private:
+  IntraOpPool* previous_;
+
+  DISABLE_COPY_AND_ASSIGN(IntraOpScope);
+};
+
+/*!
+ * \brief grain of a loop whose items take about `item_cost` flops, so a task
+ *  does enough work to amortize scheduling it
+ */
+inline int64_t ParallelGrain(int64_t item_cost) {
+  const int64_t kMinTaskCost = 16384;
+  return item_cost >= kMinTaskCost ? 1 : kMinTaskCost / (item_cost > 0 ? item_cost : 1);
+}
+
+/*!
+ * \brief Run fn(begin, end) over ranges of [begin, end) on the pool of the
+ *  calling thread. Without a pool, or nested in another loop, fn runs once
+ *  over the whole range. fn is called concurrently on disjoint ranges.
+ * \param grain smallest range worth a task, e.g. to amortize ~1us of
+ *  scheduling
+ */
+template <typename F>
+void parallel_for(int64_t begin, int64_t end, int64_t grain, const F& fn) {
+  if (begin >= end) return;
+  IntraOpPool* pool = IntraOpPool::Current();
+  if (pool == NULL || end - begin <= grain) {
+    fn(begin, end);
+    return;
+  }
+  pool->Run(begin, end, grain, fn);
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PARALLEL_HPP_
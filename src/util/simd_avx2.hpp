@@ -0,0 +1,77 @@
+#ifndef CAFFE_UTIL_SIMD_AVX2_HPP_
+#define CAFFE_UTIL_SIMD_AVX2_HPP_
+
+// SIMD traits of AVX2+FMA for the kernels written over a traits type, see
+// vmath_kernels.hpp. Only included by translation units built for AVX2.
+#include <immintrin.h>
+
+namespace caffe {
+namespace {
+
+struct AVX2 {
+  typedef __m256 F;
+  typedef __m256 M;
+  typedef __m256i I;
+  static const int kWidth = 8;
+
+  static inline F Load(const float* p) { return _mm256_loadu_ps(p); }
+  static inline void Store(float* p, F x) { _mm256_storeu_ps(p, x); }
+  static inline I TailMask(int n) {
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  }
+  static inline F LoadPartial(const float* p, int n) { return _mm256_maskload_ps(p, TailMask(n)); }
+  static inline void StorePartial(float* p, F x, int n) { _mm256_maskstore_ps(p, TailMask(n), x); }
+  // p[0], p[2], ..., p[14] and p[1], p[3], ..., p[15]
+  static inline F LoadEven(const float* p) {
+    const F x = _mm256_shuffle_ps(Load(p), Load(p + 8), _MM_SHUFFLE(2, 0, 2, 0));
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(x), _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+  static inline F LoadOdd(const float* p) {
+    const F x = _mm256_shuffle_ps(Load(p), Load(p + 8), _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(x), _MM_SHUFFLE(3, 1, 2, 0)));
+  }
+
+  static inline F Set(float x) { return _mm256_set1_ps(x); }
+  static inline F Add(F a, F b) { return _mm256_add_ps(a, b); }
+  static inline F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+  static inline F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+  static inline F Div(F a, F b) { return _mm256_div_ps(a, b); }
+  static inline F Fma(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+  // NaN in b is returned
+  static inline F Min(F a, F b) { return _mm256_min_ps(a, b); }
+  static inline F Max(F a, F b) { return _mm256_max_ps(a, b); }
+  static inline F Sqrt(F x) { return _mm256_sqrt_ps(x); }
+  static inline F RSqrtEstimate(F x) { return _mm256_rsqrt_ps(x); }
+  static inline F Round(F x) {
+    return _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  }
+  static inline F Abs(F x) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), x); }
+  static inline F Neg(F x) { return _mm256_xor_ps(_mm256_set1_ps(-0.f), x); }
+  static inline F CopySign(F x, F sign) {
+    const F mask = _mm256_set1_ps(-0.f);
+    return _mm256_or_ps(_mm256_andnot_ps(mask, x), _mm256_and_ps(mask, sign));
+  }
+
+  static inline M Lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static inline M Eq(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+  static inline M NotGe(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_NGE_UQ); }
+  static inline F Select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+
+  static inline I SetInt(int x) { return _mm256_set1_epi32(x); }
+  static inline I AddInt(I a, I b) { return _mm256_add_epi32(a, b); }
+  static inline I SubInt(I a, I b) { return _mm256_sub_epi32(a, b); }
+  static inline I AndInt(I a, I b) { return _mm256_and_si256(a, b); }
+  static inline I OrInt(I a, I b) { return _mm256_or_si256(a, b); }
+  static inline I ShiftLeft(I x, int n) { return _mm256_slli_epi32(x, n); }
+  static inline I ShiftRightArith(I x, int n) { return _mm256_srai_epi32(x, n); }
+  static inline I ShiftRightLogic(I x, int n) { return _mm256_srli_epi32(x, n); }
+  static inline I ToInt(F x) { return _mm256_cvtps_epi32(x); }
+  static inline F ToFloat(I x) { return _mm256_cvtepi32_ps(x); }
+  static inline I AsInt(F x) { return _mm256_castps_si256(x); }
+  static inline F AsFloat(I x) { return _mm256_castsi256_ps(x); }
+};
+
+}  // namespace
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SIMD_AVX2_HPP_
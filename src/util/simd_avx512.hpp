@@ -0,0 +1,84 @@
+#ifndef CAFFE_UTIL_SIMD_AVX512_HPP_
+#define CAFFE_UTIL_SIMD_AVX512_HPP_
+
+// SIMD traits of AVX-512F for the kernels written over a traits type, see
+// vmath_kernels.hpp. Only included by translation units built for AVX-512.
+#include <immintrin.h>
+
+namespace caffe {
+namespace {
+
+struct AVX512 {
+  typedef __m512 F;
+  typedef __mmask16 M;
+  typedef __m512i I;
+  static const int kWidth = 16;
+
+  static inline F Load(const float* p) { return _mm512_loadu_ps(p); }
+  static inline void Store(float* p, F x) { _mm512_storeu_ps(p, x); }
+  static inline M TailMask(int n) { return static_cast<M>((1u << n) - 1); }
+  static inline F LoadPartial(const float* p, int n) {
+    return _mm512_maskz_loadu_ps(TailMask(n), p);
+  }
+  static inline void StorePartial(float* p, F x, int n) {
+    _mm512_mask_storeu_ps(p, TailMask(n), x);
+  }
+  // p[0], p[2], ..., p[30] and p[1], p[3], ..., p[31]
+  static inline F LoadEven(const float* p) {
+    const I index = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14,
+                                      16, 18, 20, 22, 24, 26, 28, 30);
+    return _mm512_permutex2var_ps(Load(p), index, Load(p + 16));
+  }
+  static inline F LoadOdd(const float* p) {
+    const I index = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15,
+                                      17, 19, 21, 23, 25, 27, 29, 31);
+    return _mm512_permutex2var_ps(Load(p), index, Load(p + 16));
+  }
+
+  static inline F Set(float x) { return _mm512_set1_ps(x); }
+  static inline F Add(F a, F b) { return _mm512_add_ps(a, b); }
+  static inline F Sub(F a, F b) { return _mm512_sub_ps(a, b); }
+  static inline F Mul(F a, F b) { return _mm512_mul_ps(a, b); }
+  static inline F Div(F a, F b) { return _mm512_div_ps(a, b); }
+  static inline F Fma(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+  // NaN in b is returned
+  static inline F Min(F a, F b) { return _mm512_min_ps(a, b); }
+  static inline F Max(F a, F b) { return _mm512_max_ps(a, b); }
+  static inline F Sqrt(F x) { return _mm512_sqrt_ps(x); }
+  static inline F RSqrtEstimate(F x) { return _mm512_rsqrt14_ps(x); }
+  static inline F Round(F x) {
+    return _mm512_roundscale_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  }
+  // sign bit operations in integer lanes, float ones need AVX-512DQ
+  static inline F Abs(F x) { return AsFloat(AndInt(AsInt(x), SetInt(0x7fffffff))); }
+  static inline F Neg(F x) {
+    return AsFloat(_mm512_xor_si512(AsInt(x), SetInt(static_cast<int>(0x80000000u))));
+  }
+  static inline F CopySign(F x, F sign) {
+    return AsFloat(OrInt(AndInt(AsInt(x), SetInt(0x7fffffff)),
+                         AndInt(AsInt(sign), SetInt(static_cast<int>(0x80000000u)))));
+  }
+
+  static inline M Lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+  static inline M Eq(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+  static inline M NotGe(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_NGE_UQ); }
+  static inline F Select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+
+  static inline I SetInt(int x) { return _mm512_set1_epi32(x); }
+  static inline I AddInt(I a, I b) { return _mm512_add_epi32(a, b); }
+  static inline I SubInt(I a, I b) { return _mm512_sub_epi32(a, b); }
+  static inline I AndInt(I a, I b) { return _mm512_and_si512(a, b); }
+  static inline I OrInt(I a, I b) { return _mm512_or_si512(a, b); }
+  static inline I ShiftLeft(I x, int n) { return _mm512_slli_epi32(x, n); }
+  static inline I ShiftRightArith(I x, int n) { return _mm512_srai_epi32(x, n); }
+  static inline I ShiftRightLogic(I x, int n) { return _mm512_srli_epi32(x, n); }
+  static inline I ToInt(F x) { return _mm512_cvtps_epi32(x); }
+  static inline F ToFloat(I x) { return _mm512_cvtepi32_ps(x); }
+  static inline I AsInt(F x) { return _mm512_castps_si512(x); }
+  static inline F AsFloat(I x) { return _mm512_castsi512_ps(x); }
+};
+
+}  // namespace
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SIMD_AVX512_HPP_
@@ -0,0 +1,42 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "caffe/base.hpp"
+
+namespace caffe {
+
+/*!
+ * \brief Fixed size pool of worker threads running tasks in FIFO order.
+ *  Tasks must not throw, catch errors inside the task.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+  /*! \brief queue a task, it runs on one of the workers */
+  void Run(std::function<void()> task);
+  /*! \brief number of worker threads */
+  int num_threads() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  void WorkerLoop();
+
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()> > tasks_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stop_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -0,0 +1,164 @@
+#include <math.h>
+#include <stdint.h>
+#include <atomic>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define VMATH_X86
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define VMATH_X86
+#endif
+
+#include "./vmath.hpp"
+
+namespace caffe {
+
+namespace {
+
+// libm loops, the reference and the fallback of CPUs without AVX2
+
+void ExpScalar(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) y[i] = expf(a[i]);
+}
+
+void LnScalar(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) y[i] = logf(a[i]);
+}
+
+void PowxScalar(const int n, const float* a, const float b, float* y) {
+  for (int i = 0; i < n; ++i) y[i] = powf(a[i], b);
+}
+
+void TanhScalar(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) y[i] = tanhf(a[i]);
+}
+
+void SigmoidScalar(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) y[i] = 1.f / (1.f + expf(-a[i]));
+}
+
+void InvSqrtScalar(const int n, const float* a, float* y) {
+  for (int i = 0; i < n; ++i) y[i] = 1.f / sqrtf(a[i]);
+}
+
+#ifdef VMATH_X86
+void Cpuid(int leaf, int regs[4]) {
+#ifdef _MSC_VER
+  __cpuidex(regs, leaf, 0);
+#else
+  unsigned int r[4] = {0, 0, 0, 0};
+  __cpuid_count(leaf, 0, r[0], r[1], r[2], r[3]);
+  for (int i = 0; i < 4; ++i) regs[i] = static_cast<int>(r[i]);
+#endif
+}
+
+// register state the OS saves on context switches
+uint64_t Xgetbv() {
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+#endif  // VMATH_X86
+
+VmathIsa CpuIsa() {
+#ifdef VMATH_X86
+  int regs[4];
+  Cpuid(0, regs);
+  if (regs[0] < 7) return VMATH_SCALAR;
+  Cpuid(1, regs);
+  const bool fma = (regs[2] >> 12) & 1;
+  const bool osxsave = (regs[2] >> 27) & 1;
+  if (!osxsave) return VMATH_SCALAR;
+  const uint64_t xcr0 = Xgetbv();
+  Cpuid(7, regs);
+  const bool avx2 = (regs[1] >> 5) & 1;
+  const bool avx512f = (regs[1] >> 16) & 1;
+  // XMM/YMM, plus opmask and ZMM for AVX-512
+  if (avx512f && (xcr0 & 0xe6) == 0xe6) return VMATH_AVX512;
+  if (avx2 && fma && (xcr0 & 0x6) == 0x6) return VMATH_AVX2;
+#endif  // VMATH_X86
+  return VMATH_SCALAR;
+}
+
+struct Dispatch {
+  VmathKernels kernels[3];
+  bool available[3];
+  VmathIsa detected;
+  std::atomic<int> active;
+
+  Dispatch() {
+    VmathKernels scalar = {ExpScalar, LnScalar, PowxScalar,
+                           TanhScalar, SigmoidScalar, InvSqrtScalar};
+    kernels[VMATH_SCALAR] = scalar;
+    available[VMATH_SCALAR] = true;
+    const VmathIsa cpu = CpuIsa();
+    available[VMATH_AVX2] = cpu >= VMATH_AVX2 && GetVmathKernelsAVX2(&kernels[VMATH_AVX2]);
+    available[VMATH_AVX512] = cpu >= VMATH_AVX512 &&
+                              GetVmathKernelsAVX512(&kernels[VMATH_AVX512]);
+    detected = VMATH_SCALAR;
+    for (int isa = VMATH_AVX512; isa > VMATH_SCALAR; --isa) {
+      if (available[isa]) {
+        detected = static_cast<VmathIsa>(isa);
+        break;
+      }
+    }
+    active = detected;
+  }
+};
+
+Dispatch& Get() {
+  static Dispatch dispatch;
+  return dispatch;
+}
+
+inline const VmathKernels& Kernels() {
+  Dispatch& dispatch = Get();
+  return dispatch.kernels[dispatch.active.load(std::memory_order_relaxed)];
+}
+
+}  // namespace
+
+VmathIsa VmathDetectIsa() {
+  return Get().detected;
+}
+
+VmathIsa VmathGetIsa() {
+  return static_cast<VmathIsa>(Get().active.load());
+}
+
+void VmathSetIsa(VmathIsa isa) {
+  Dispatch& dispatch = Get();
+  int active = isa;
+  while (!dispatch.available[active]) --active;
+  dispatch.active = active;
+}
+
+void VmathExp(const int n, const float* a, float* y) {
+  Kernels().exp(n, a, y);
+}
+
+void VmathLn(const int n, const float* a, float* y) {
+  Kernels().ln(n, a, y);
+}
+
+void VmathPowx(const int n, const float* a, const float b, float* y) {
+  Kernels().powx(n, a, b, y);
+}
+
+void VmathTanh(const int n, const float* a, float* y) {
+  Kernels().tanh(n, a, y);
+}
+
+void VmathSigmoid(const int n, const float* a, float* y) {
+  Kernels().sigmoid(n, a, y);
+}
+
+void VmathInvSqrt(const int n, const float* a, float* y) {
+  Kernels().inv_sqrt(n, a, y);
+}
+
+}  // namespace caffe
@@ -0,0 +1,79 @@
+#ifndef CAFFE_UTIL_VMATH_HPP_
+#define CAFFE_UTIL_VMATH_HPP_
+
+// caffe/base.hpp is not included, the translation units built for an
+// instruction set include this header and must not compile its inline code
+#ifndef CAFFE_API
+#if defined(_MSC_VER) && defined(CAFFE_EXPORTS)
+#define CAFFE_API __declspec(dllexport)
+#elif defined(_MSC_VER)
+#define CAFFE_API __declspec(dllimport)
+#else
+#define CAFFE_API
+#endif
+#endif  // CAFFE_API
+
+namespace caffe {
+
+/*!
+ * \brief Vectorized transcendental functions over float arrays, used by
+ *  vsExp, vsLn and vsPowx of mkl_alternate.hpp and the activation layers.
+ *
+ *  Kernels are built for AVX2+FMA and AVX-512, the best one supported by the
+ *  CPU is picked by CPUID on first use, other CPUs run the libm loops.
+ *  Every element goes through the same code whatever its position in the
+ *  array, so results don't depend on how an array is split into calls.
+ *
+ *  Max error of the SIMD kernels against exact results, measured on every
+ *  61st float of either sign (ulp: unit in the last place of the result):
+ *    VmathExp      1.3 ulp, results below FLT_MIN lose precision gradually
+ *    VmathLn       0.8 ulp
+ *    VmathPowx     2 ulp, ln and exp(b ln a) run in extended precision;
+ *                  b = 0.5, 1, 2, -1 are correctly rounded, -0.5 is
+ *                  VmathInvSqrt, +-0.75 take square roots within 4 ulp.
+ *                  Unlike libm, pow(-inf, b) is NaN and pow(-0, b) is -0
+ *                  for non integral b
+ *    VmathTanh     1.4 ulp
+ *    VmathSigmoid  2.6 ulp
+ *    VmathInvSqrt  4.5 ulp with AVX2, 3 ulp with AVX-512
+ *  Other special values (0, inf, NaN, denormals) give the results of libm.
+ */
+enum VmathIsa {
+  VMATH_SCALAR = 0,
+  VMATH_AVX2 = 1,
+  VMATH_AVX512 = 2,
+};
+
+/*! \brief best instruction set supported by the CPU and the build */
+CAFFE_API VmathIsa VmathDetectIsa();
+/*! \brief instruction set the kernels use */
+CAFFE_API VmathIsa VmathGetIsa();
+/*! \brief use `isa` or the best supported one below it, e.g. to compare with libm */
+CAFFE_API void VmathSetIsa(VmathIsa isa);
+
+CAFFE_API void VmathExp(const int n, const float* a, float* y);
+CAFFE_API void VmathLn(const int n, const float* a, float* y);
+CAFFE_API void VmathPowx(const int n, const float* a, const float b, float* y);
+CAFFE_API void VmathTanh(const int n, const float* a, float* y);
+/*! \brief y = 1 / (1 + exp(-a)) */
+CAFFE_API void VmathSigmoid(const int n, const float* a, float* y);
+/*! \brief y = 1 / sqrt(a) */
+CAFFE_API void VmathInvSqrt(const int n, const float* a, float* y);
+
+/*! \brief kernels of one instruction set */
+struct VmathKernels {
+  void (*exp)(const int n, const float* a, float* y);
+  void (*ln)(const int n, const float* a, float* y);
+  void (*powx)(const int n, const float* a, const float b, float* y);
+  void (*tanh)(const int n, const float* a, float* y);
+  void (*sigmoid)(const int n, const float* a, float* y);
+  void (*inv_sqrt)(const int n, const float* a, float* y);
+};
+
+/*! \brief fill the kernels, false if they are not built for this target */
+bool GetVmathKernelsAVX2(VmathKernels* kernels);
+bool GetVmathKernelsAVX512(VmathKernels* kernels);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_VMATH_HPP_
@@ -0,0 +1,27 @@
+// Built with AVX2 and FMA enabled, see mini-caffe.cmake.
+#include "./vmath.hpp"
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#include "./simd_avx2.hpp"
+#include "./vmath_kernels.hpp"
+
+namespace caffe {
+
+bool GetVmathKernelsAVX2(VmathKernels* kernels) {
+  Vmath<AVX2>::Fill(kernels);
+  return true;
+}
+
+}  // namespace caffe
+
+#else
+
+namespace caffe {
+
+bool GetVmathKernelsAVX2(VmathKernels* /*kernels*/) {
+  return false;
+}
+
+}  // namespace caffe
+
+#endif
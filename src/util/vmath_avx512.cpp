@@ -0,0 +1,27 @@
+// Built with AVX-512 enabled, see mini-caffe.cmake.
+#include "./vmath.hpp"
+
+#if defined(__AVX512F__)
+#include "./simd_avx512.hpp"
+#include "./vmath_kernels.hpp"
+
+namespace caffe {
+
+bool GetVmathKernelsAVX512(VmathKernels* kernels) {
+  Vmath<AVX512>::Fill(kernels);
+  return true;
+}
+
+}  // namespace caffe
+
+#else
+
+namespace caffe {
+
+bool GetVmathKernelsAVX512(VmathKernels* /*kernels*/) {
+  return false;
+}
+
+}  // namespace caffe
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef CAFFE_UTIL_VMATH_KERNELS_HPP_
+#define CAFFE_UTIL_VMATH_KERNELS_HPP_
+
+// Algorithms of the vector math kernels, written once over a SIMD traits
+// type V and included by the translation unit of every instruction set.
+// V provides the vector F, mask M and integer I types, kWidth lanes and the
+// operations used below. Polynomials are those of Cephes (S. Moshier).
+
+#include <math.h>
+
+#include "./vmath.hpp"
+
+namespace caffe {
+namespace {
+
+template <class V>
+struct Vmath {
+  typedef typename V::F F;
+  typedef typename V::M M;
+  typedef typename V::I I;
+
+  // 2^n for integral n in [-252, 254], split in two factors so results
+  // near FLT_MAX and down to denormals don't overflow the exponent
+  static inline void Pow2(F n, F* s1, F* s2) {
+    const I ni = V::ToInt(n);
+    const I half = V::ShiftRightArith(ni, 1);
+    const I bias = V::SetInt(127);
+    *s1 = V::AsFloat(V::ShiftLeft(V::AddInt(half, bias), 23));
+    *s2 = V::AsFloat(V::ShiftLeft(V::AddInt(V::SubInt(ni, half), bias), 23));
+  }
+
+  static inline F Exp(F x) {
+    // below -104 the result rounds to 0, above 89 to inf, NaN passes
+    x = V::Min(V::Set(89.f), V::Max(V::Set(-104.f), x));
+    const F n = V::Round(V::Mul(x, V::Set(1.44269504088896341f)));
+    // x - n ln2 with ln2 in two parts, exact for the first one
+    F r = V::Fma(n, V::Set(-0.693359375f), x);
+    r = V::Fma(n, V::Set(2.12194440e-4f), r);
+    F p = V::Set(1.9875691500E-4f);
+    p = V::Fma(p, r, V::Set(1.3981999507E-3f));
+    p = V::Fma(p, r, V::Set(8.3334519073E-3f));
+    p = V::Fma(p, r, V::Set(4.1665795894E-2f));
+    p = V::Fma(p, r, V::Set(1.6666665459E-1f));
+    p = V::Fma(p, r, V::Set(5.0000001201E-1f));
+    p = V::Fma(p, V::Mul(r, r), V::Add(r, V::Set(1.f)));
+    F s1, s2;
+    Pow2(n, &s1, &s2);
+    return V::Mul(V::Mul(p, s1), s2);
+  }
+
+  // x = 2^e (1 + t) with 1 + t in [sqrt(0.5), sqrt(2)), ln(x) = e ln2 + t + r
+  static inline void LnParts(F x, F* e, F* t, F* r) {
+    // scale denormals up to read their exponent from the bits
+    const M denormal = V::Lt(x, V::Set(1.17549435e-38f));
+    F m = V::Select(denormal, V::Mul(x, V::Set(8388608.f)), x);
+    const I bits = V::AsInt(m);
+    // x = m 2^e with m in [0.5, 1)
+    *e = V::ToFloat(V::SubInt(V::ShiftRightLogic(bits, 23), V::SetInt(126)));
+    *e = V::Sub(*e, V::Select(denormal, V::Set(23.f), V::Set(0.f)));
+    m = V::AsFloat(V::OrInt(V::AndInt(bits, V::SetInt(0x807fffff)),
+                            V::SetInt(0x3f000000)));
+    const M small = V::Lt(m, V::Set(0.707106781186547524f));
+    *e = V::Sub(*e, V::Select(small, V::Set(1.f), V::Set(0.f)));
+    *t = V::Sub(V::Add(m, V::Select(small, m, V::Set(0.f))), V::Set(1.f));
+    const F z = V::Mul(*t, *t);
+    F p = V::Set(7.0376836292E-2f);
+    p = V::Fma(p, *t, V::Set(-1.1514610310E-1f));
+    p = V::Fma(p, *t, V::Set(1.1676998740E-1f));
+    p = V::Fma(p, *t, V::Set(-1.2420140846E-1f));
+    p = V::Fma(p, *t, V::Set(1.4249322787E-1f));
+    p = V::Fma(p, *t, V::Set(-1.6668057665E-1f));
+    p = V::Fma(p, *t, V::Set(2.0000714765E-1f));
+    p = V::Fma(p, *t, V::Set(-2.4999993993E-1f));
+    p = V::Fma(p, *t, V::Set(3.3333331174E-1f));
+    // ln2 in two parts, e times the first one is exact
+    *r = V::Mul(V::Mul(p, *t), z);
+    *r = V::Fma(*e, V::Set(-2.12194440e-4f), *r);
+    *r = V::Fma(z, V::Set(-0.5f), *r);
+  }
+
+  // ln(0) = -inf, ln(inf) = inf, ln(< 0) = ln(NaN) = NaN
+  static inline F LnSpecial(F x, F y) {
+    y = V::Select(V::Eq(x, V::Set(0.f)), V::Set(-HUGE_VALF), y);
+    y = V::Select(V::Eq(x, V::Set(HUGE_VALF)), x, y);
+    return V::Select(V::NotGe(x, V::Set(0.f)), V::Set(NAN), y);
+  }
+
+  static inline F Ln(F x) {
+    F e, t, r;
+    LnParts(x, &e, &t, &r);
+    const F y = V::Fma(e, V::Set(0.693359375f), V::Add(t, r));
+    return LnSpecial(x, y);
+  }
+
+  // ln(x) as hi + lo, keeping the rounding errors of the final sums
+  static inline F LnExtended(F x, F* lo) {
+    F e, t, r;
+    LnParts(x, &e, &t, &r);
+    // |e ln2| >= |t| >= |r| unless e = 0 where the first sum is exact
+    const F a = V::Mul(e, V::Set(0.693359375f));
+    const F s1 = V::Add(a, t);
+    const F err1 = V::Sub(t, V::Sub(s1, a));
+    const F hi = V::Add(s1, r);
+    const F err2 = V::Sub(r, V::Sub(hi, s1));
+    *lo = V::Add(err1, err2);
+    return LnSpecial(x, hi);
+  }
+
+  static inline F Tanh(F x) {
+    const F ax = V::Abs(x);
+    // small |x|: odd polynomial, no cancellation in 1 - 2 / (e^2x + 1)
+    const F z = V::Mul(x, x);
+    F p = V::Set(-5.70498872745E-3f);
+    p = V::Fma(p, z, V::Set(2.06390887954E-2f));
+    p = V::Fma(p, z, V::Set(-5.37397155531E-2f));
+    p = V::Fma(p, z, V::Set(1.33314422036E-1f));
+    p = V::Fma(p, z, V::Set(-3.33332819422E-1f));
+    const F small = V::Fma(V::Mul(p, z), x, x);
+    const F e = Exp(V::Add(ax, ax));
+    const F large = V::Sub(V::Set(1.f), V::Div(V::Set(2.f), V::Add(e, V::Set(1.f))));
+    // the polynomial loses the sign of -0
+    return V::CopySign(V::Select(V::Lt(ax, V::Set(0.625f)), V::Abs(small), large), x);
+  }
+
+  // 1 / (1 + e) or e / (1 + e) with e = exp(-|x|), so exp never overflows
+  // and small results keep their precision
+  static inline F Sigmoid(F x) {
+    const F e = Exp(V::Neg(V::Abs(x)));
+    const F num = V::Select(V::Lt(x, V::Set(0.f)), e, V::Set(1.f));
+    return V::Div(num, V::Add(V::Set(1.f), e));
+  }
+
+  static inline F Sqrt(F x) { return V::Sqrt(x); }
+
+  static inline F InvSqrt(F x) {
+    // the estimate takes denormals for 0, scale them by 2^24 first
+    const M denormal = V::Lt(V::Abs(x), V::Set(1.17549435e-38f));
+    const F sx = V::Select(denormal, V::Mul(x, V::Set(16777216.f)), x);
+    // one Newton step over the hardware estimate
+    const F r = V::RSqrtEstimate(sx);
+    const F hx = V::Mul(sx, V::Set(-0.5f));
+    F y = V::Mul(r, V::Fma(V::Mul(hx, r), r, V::Set(1.5f)));
+    y = V::Select(denormal, V::Mul(y, V::Set(4096.f)), y);
+    // the step turns 1 / sqrt(0) and 1 / sqrt(inf) into NaN
+    y = V::Select(V::Eq(x, V::Set(0.f)), V::Div(V::Set(1.f), x), y);
+    return V::Select(V::Eq(x, V::Set(HUGE_VALF)), V::Set(0.f), y);
+  }
+
+  // apply op to every element, the tail goes through masked loads
+  template <class Op>
+  static inline void Map(const int n, const float* a, float* y, const Op& op) {
+    int i = 0;
+    for (; i + V::kWidth <= n; i += V::kWidth) {
+      V::Store(y + i, op(V::Load(a + i)));
+    }
+    if (i < n) {
+      V::StorePartial(y + i, op(V::LoadPartial(a + i, n - i)), n - i);
+    }
+  }
+
+  struct ExpOp { F operator()(F x) const { return Exp(x); } };
+  struct LnOp { F operator()(F x) const { return Ln(x); } };
+  struct TanhOp { F operator()(F x) const { return Tanh(x); } };
+  struct SigmoidOp { F operator()(F x) const { return Sigmoid(x); } };
+  struct SqrtOp { F operator()(F x) const { return V::Sqrt(x); } };
+  struct InvSqrtOp { F operator()(F x) const { return InvSqrt(x); } };
+  struct SquareOp { F operator()(F x) const { return V::Mul(x, x); } };
+  struct InverseOp {
+    F operator()(F x) const { return V::Div(V::Set(1.f), x); }
+  };
+  // x^0.75 = sqrt(x) sqrt(sqrt(x)), LRN raises to -beta = -0.75 by default
+  struct Pow075Op {
+    F operator()(F x) const {
+      const F s = V::Sqrt(x);
+      return V::Mul(s, V::Sqrt(s));
+    }
+  };
+  struct InvPow075Op {
+    F operator()(F x) const {
+      const F s = V::Sqrt(x);
+      return V::Div(V::Set(1.f), V::Mul(s, V::Sqrt(s)));
+    }
+  };
+  // exp(b ln|x|), negative x keep their sign for odd integral b and give
+  // NaN for non integral b as pow. The low parts of ln and of the product
+  // correct exp(hi) as exp(hi)(1 + lo), else the error of the rounded
+  // product grows with |b ln x|.
+  struct PowOp {
+    F b;
+    bool integral;
+    bool odd;
+    F operator()(F x) const {
+      F ln_lo;
+      const F ln_hi = LnExtended(integral ? V::Abs(x) : x, &ln_lo);
+      const F t = V::Mul(b, ln_hi);
+      F lo = V::Fma(b, ln_hi, V::Neg(t));
+      lo = V::Fma(b, ln_lo, lo);
+      // the low part is NaN for infinite t, inf results need no correction
+      lo = V::Select(V::Lt(V::Abs(lo), V::Set(HUGE_VALF)), lo, V::Set(0.f));
+      F y = Exp(t);
+      y = V::Select(V::Lt(y, V::Set(HUGE_VALF)), V::Fma(y, lo, y), y);
+      return odd ? V::CopySign(y, x) : y;
+    }
+  };
+
+  static void ExpArray(const int n, const float* a, float* y) { Map(n, a, y, ExpOp()); }
+  static void LnArray(const int n, const float* a, float* y) { Map(n, a, y, LnOp()); }
+  static void TanhArray(const int n, const float* a, float* y) { Map(n, a, y, TanhOp()); }
+  static void SigmoidArray(const int n, const float* a, float* y) {
+    Map(n, a, y, SigmoidOp());
+  }
+  static void InvSqrtArray(const int n, const float* a, float* y) {
+    Map(n, a, y, InvSqrtOp());
+  }
+  static void PowxArray(const int n, const float* a, const float b, float* y) {
+    if (b == 1.f) {
+      for (int i = 0; i < n; ++i) y[i] = a[i];
+    }
+    else if (b == 0.f) {
+      for (int i = 0; i < n; ++i) y[i] = 1.f;
+    }
+    else if (b == 2.f) {
+      Map(n, a, y, SquareOp());
+    }
+    else if (b == 0.5f) {
+      Map(n, a, y, SqrtOp());
+    }
+    else if (b == -0.5f) {
+      Map(n, a, y, InvSqrtOp());
+    }
+    else if (b == -1.f) {
+      Map(n, a, y, InverseOp());
+    }
+    else if (b == 0.75f) {
+      Map(n, a, y, Pow075Op());
+    }
+    else if (b == -0.75f) {
+      Map(n, a, y, InvPow075Op());
+    }
+    else if (!(fabsf(b) < HUGE_VALF)) {
+      for (int i = 0; i < n; ++i) y[i] = powf(a[i], b);
+    }
+    else {
+      PowOp op;
+      op.b = V::Set(b);
+      // floats from 2^24 on are even integers
+      const bool large = fabsf(b) >= 16777216.f;
+      op.integral = large || b == static_cast<float>(static_cast<int>(b));
+      op.odd = !large && (static_cast<int>(b) & 1);
+      Map(n, a, y, op);
+    }
+  }
+
+  static void Fill(VmathKernels* kernels) {
+    kernels->exp = ExpArray;
+    kernels->ln = LnArray;
+    kernels->powx = PowxArray;
+    kernels->tanh = TanhArray;
+    kernels->sigmoid = SigmoidArray;
+    kernels->inv_sqrt = InvSqrtArray;
+  }
+};
+
+}  // namespace
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_VMATH_KERNELS_HPP_
@@ -14,12 +14,12 @@ using namespace caffe;
 
 int main(int argc, char *argv[]) {
 
-  auto net = new caffe::Net(argv[1]);
-  net->CopyTrainedLayersFrom(argv[2]);
+  auto net = new caffe::Net(argv[1], argv[2]);
 
   std::shared_ptr<Blob> input = net->blob_by_name("data");
+  real_t* input_data = input->mutable_cpu_data();
   for (int k = 0; k < input->count(); ++k) {
-    input->mutable_cpu_data()[k] = 1;
+    input_data[k] = 1;
   }
   // forward network
   auto st = std::chrono::high_resolution_clock::now();
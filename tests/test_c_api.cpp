@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <caffe/c_api.h>
+#include <caffe/net.hpp>
+
+#include "./test_util.hpp"
+
+using namespace caffe::test;
+
+namespace {
+
+#define CHECK_API(call) CHECK_EQ((call), 0) << CaffeGetLastError()
+
+const char* kNet =
+  "layer { name: 'data' type: 'Input' top: 'data'"
+  "  input_param { shape { dim: 1 dim: 4 dim: 6 dim: 5 } } }"
+  "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv'"
+  "  convolution_param { num_output: 8 kernel_size: 3 pad: 1 bias_term: true } }"
+  "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' }"
+  "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip'"
+  "  inner_product_param { num_output: 10 } }";
+
+NetHandle CreateNet(const char* text) {
+  NetHandle net;
+  CHECK_API(CaffeNetCreateFromBuffer(text, static_cast<int>(std::strlen(text)), "", 0, &net));
+  int n;
+  const char** names;
+  BlobHandle* params;
+  CHECK_API(CaffeNetListParam(net, &n, &names, &params));
+  for (int i = 0; i < n; ++i) {
+    FillUniform(CaffeBlobData(params[i]), CaffeBlobCount(params[i]), -0.3f, 0.3f, i + 1);
+  }
+  return net;
+}
+
+std::vector<float> BlobData(NetHandle net, const char* name) {
+  BlobHandle blob;
+  CHECK_API(CaffeNetGetBlob(net, name, &blob));
+  const float* data = CaffeBlobData(blob);
+  return std::vector<float>(data, data + CaffeBlobCount(blob));
+}
+
+// results of submitted requests, written by the batching thread
+struct Results {
+  std::mutex mutex;
+  std::condition_variable cond;
+  int pending;
+  std::vector<std::vector<float> > outputs;
+  std::vector<std::string> errors;
+};
+
+struct Request {
+  Results* results;
+  int index;
+};
+
+void OnDone(int status, const char* error, int n, const char** names,
+            const real_t** data, const int* counts, void* user_data) {
+  Request* request = static_cast<Request*>(user_data);
+  Results* results = request->results;
+  std::lock_guard<std::mutex> lock(results->mutex);
+  CHECK_EQ(status == 0, error == NULL);
+  if (status == 0) {
+    CHECK_EQ(n, 1);
+    CHECK_EQ(std::string(names[0]), "ip");
+    results->outputs[request->index].assign(data[0], data[0] + counts[0]);
+  }
+  else {
+    results->errors[request->index] = error;
+  }
+  results->pending -= 1;
+  results->cond.notify_all();
+}
+
+void Wait(Results* results) {
+  std::unique_lock<std::mutex> lock(results->mutex);
+  results->cond.wait(lock, [results]() { return results->pending == 0; });
+}
+
+// requests submitted from many threads get the outputs of a forward of
+// their sample alone
+void TestSubmitFromThreads() {
+  const int kThreads = 4;
+  const int kPerThread = 16;
+  const int kRequests = kThreads * kPerThread;
+  NetHandle net = CreateNet(kNet);
+  BlobHandle data;
+  CHECK_API(CaffeNetGetBlob(net, "data", &data));
+  const int sample_count = CaffeBlobCount(data);
+  std::vector<std::vector<float> > samples(kRequests, std::vector<float>(sample_count));
+  std::vector<std::vector<float> > expected(kRequests);
+  for (int i = 0; i < kRequests; ++i) {
+    FillUniform(samples[i].data(), sample_count, -1, 1, 100 + i);
+    std::memcpy(CaffeBlobData(data), samples[i].data(), sample_count * sizeof(float));
+    CHECK_API(CaffeNetForward(net));
+    expected[i] = BlobData(net, "ip");
+  }
+
+  CHECK_API(CaffeNetEnableBatching(net, 8, 2000));
+  Results results;
+  results.pending = kRequests;
+  results.outputs.resize(kRequests);
+  results.errors.resize(kRequests);
+  std::vector<Request> requests(kRequests);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = t * kPerThread; i < (t + 1) * kPerThread; ++i) {
+        requests[i].results = &results;
+        requests[i].index = i;
+        const real_t* inputs[] = {samples[i].data()};
+        CHECK_API(CaffeNetSubmit(net, inputs, OnDone, &requests[i]));
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  Wait(&results);
+  for (int i = 0; i < kRequests; ++i) {
+    CHECK(results.errors[i].empty()) << results.errors[i];
+    CHECK_EQ(results.outputs[i].size(), expected[i].size());
+    // batched GEMM sums in another order, the error is relative to the
+    // largest output
+    float scale = 1e-3f;
+    for (float x : expected[i]) scale = std::max(scale, std::abs(x));
+    const float error = MaxRelativeError(results.outputs[i].data(), expected[i].data(),
+                                         static_cast<int>(expected[i].size()), scale);
+    CHECK_LT(error, 1e-5f) << "request " << i;
+  }
+  CHECK_API(CaffeNetDestroy(net));
+}
+
+// a failed batch hands its error to every callback
+void TestSubmitError() {
+  // a batch of 2 samples keeps 1 row, its output can't be split
+  const char* text =
+    "layer { name: 'data' type: 'Input' top: 'data'"
+    "  input_param { shape { dim: 1 dim: 3 dim: 5 } } }"
+    "layer { name: 'reshape' type: 'Reshape' bottom: 'data' top: 'ip'"
+    "  reshape_param { shape { dim: 1 dim: -1 } } }";
+  NetHandle net = CreateNet(text);
+  CHECK_API(CaffeNetEnableBatching(net, 2, 10000000));
+  Results results;
+  results.pending = 2;
+  results.outputs.resize(2);
+  results.errors.resize(2);
+  Request requests[] = {{&results, 0}, {&results, 1}};
+  std::vector<float> sample(15, 1.f);
+  const real_t* inputs[] = {sample.data()};
+  for (Request& request : requests) {
+    CHECK_API(CaffeNetSubmit(net, inputs, OnDone, &request));
+  }
+  Wait(&results);
+  for (const std::string& error : results.errors) {
+    CHECK(error.find("can't be split") != std::string::npos) << error;
+  }
+  std::cout << "expected error: " << results.errors[0] << std::endl;
+  CHECK_API(CaffeNetDestroy(net));
+}
+
+// batches of every size up to max_batch plan memory once per padded size,
+// outputs of padding samples are dropped
+void TestBatchSizesReusePlans() {
+  const int kMaxBatch = 8;
+  NetHandle net = CreateNet(kNet);
+  BlobHandle data;
+  CHECK_API(CaffeNetGetBlob(net, "data", &data));
+  const int sample_count = CaffeBlobCount(data);
+  std::vector<std::vector<float> > samples(kMaxBatch, std::vector<float>(sample_count));
+  std::vector<std::vector<float> > expected(kMaxBatch);
+  for (int i = 0; i < kMaxBatch; ++i) {
+    FillUniform(samples[i].data(), sample_count, -1, 1, 200 + i);
+    std::memcpy(CaffeBlobData(data), samples[i].data(), sample_count * sizeof(float));
+    CHECK_API(CaffeNetForward(net));
+    expected[i] = BlobData(net, "ip");
+  }
+  const caffe::Net& model = *static_cast<caffe::Net*>(net);
+  const size_t plans_before = model.plans_placed();
+
+  CHECK_API(CaffeNetEnableBatching(net, kMaxBatch, 50000));
+  size_t plans_first_pass = 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int num = 1; num <= kMaxBatch; ++num) {
+      Results results;
+      results.pending = num;
+      results.outputs.resize(num);
+      results.errors.resize(num);
+      std::vector<Request> requests(num);
+      for (int i = 0; i < num; ++i) {
+        requests[i].results = &results;
+        requests[i].index = i;
+        const real_t* inputs[] = {samples[i].data()};
+        CHECK_API(CaffeNetSubmit(net, inputs, OnDone, &requests[i]));
+      }
+      Wait(&results);
+      for (int i = 0; i < num; ++i) {
+        CHECK(results.errors[i].empty()) << results.errors[i];
+        float scale = 1e-3f;
+        for (float x : expected[i]) scale = std::max(scale, std::abs(x));
+        const float error = MaxRelativeError(results.outputs[i].data(), expected[i].data(),
+                                             static_cast<int>(expected[i].size()), scale);
+        CHECK_LT(error, 1e-5f) << "batch of " << num << ", request " << i;
+      }
+    }
+    if (pass == 0) plans_first_pass = model.plans_placed();
+  }
+  // sizes 2, 4 and 8 are new, 1 was planned before batching
+  std::cout << "plans placed: " << plans_first_pass - plans_before << std::endl;
+  CHECK_LE(plans_first_pass - plans_before, 3u);
+  CHECK_EQ(model.plans_placed(), plans_first_pass) << "batch sizes seen before planned again";
+  CHECK_API(CaffeNetDestroy(net));
+}
+
+// accepted requests finish before destroy returns, later ones fail
+void TestDestroyWhileSubmitting() {
+  struct Counts {
+    std::atomic<int> accepted;
+    std::atomic<int> done;
+  } counts;
+  counts.accepted = 0;
+  counts.done = 0;
+  auto on_done = [](int, const char*, int, const char**, const real_t**, const int*,
+                    void* user_data) {
+    static_cast<Counts*>(user_data)->done += 1;
+  };
+  for (int round = 0; round < 5; ++round) {
+    NetHandle net = CreateNet(kNet);
+    BlobHandle data;
+    CHECK_API(CaffeNetGetBlob(net, "data", &data));
+    std::vector<float> sample(CaffeBlobCount(data), 0.5f);
+    CHECK_API(CaffeNetEnableBatching(net, 4, 100));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; ++t) {
+      threads.emplace_back([&]() {
+        const real_t* inputs[] = {sample.data()};
+        // submit until the net is gone
+        while (CaffeNetSubmit(net, inputs, on_done, &counts) == 0) {
+          counts.accepted += 1;
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+      });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK_API(CaffeNetDestroy(net));
+    for (std::thread& thread : threads) thread.join();
+    CHECK_EQ(counts.done.load(), counts.accepted.load());
+  }
+  std::cout << "requests accepted: " << counts.accepted.load() << std::endl;
+}
+
+}  // namespace
+
+int main() {
+  RUN_TEST(TestSubmitFromThreads);
+  RUN_TEST(TestSubmitError);
+  RUN_TEST(TestBatchSizesReusePlans);
+  RUN_TEST(TestDestroyWhileSubmitting);
+  return 0;
+}
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "./test_util.hpp"
+
+using namespace caffe;
+using namespace caffe::test;
+
+namespace {
+
+const char* kNet =
+  "layer { name: 'data' type: 'Input' top: 'data'"
+  "  input_param { shape { dim: 1 dim: 16 dim: 8 dim: 8 } } }"
+  "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv'"
+  "  convolution_param { num_output: 64 kernel_size: 3 pad: 1 bias_term: true } }"
+  "layer { name: 'bn' type: 'BatchNorm' bottom: 'conv' top: 'conv'"
+  "  batch_norm_param { use_global_stats: true } }"
+  "layer { name: 'scale' type: 'Scale' bottom: 'conv' top: 'conv'"
+  "  scale_param { bias_term: true } }"
+  "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' }"
+  "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip'"
+  "  inner_product_param { num_output: 1024 } }";
+
+size_t ParamBytes(const Net& net) {
+  size_t bytes = 0;
+  for (const auto& blob : net.params()) bytes += blob->count() * sizeof(float);
+  return bytes;
+}
+
+std::vector<float> Run(Net* net, unsigned seed) {
+  std::shared_ptr<Blob> data = net->blob_by_name("data");
+  FillUniform(data->mutable_cpu_data(), data->count(), -1, 1, seed);
+  net->Forward();
+  std::shared_ptr<Blob> ip = net->blob_by_name("ip");
+  return std::vector<float>(ip->cpu_data(), ip->cpu_data() + ip->count());
+}
+
+// a context reads the parameters of its model, creating it allocates none
+// of their memory, not even memory returned to the pool right away
+void TestContextAllocatesNoWeights() {
+  MemPoolClear();
+  size_t allocations = AllocationCount();
+  Net model(*ParseNet(kNet));
+  const size_t model_allocations = AllocationCount() - allocations;
+  unsigned seed = 1;
+  for (const auto& blob : model.params()) {
+    FillUniform(blob->mutable_cpu_data(), blob->count(), 0.5f, 1.5f, seed++);
+  }
+  const size_t weight_bytes = ParamBytes(model);
+
+  const size_t before = MemPoolGetState().cpu_mem;
+  allocations = AllocationCount();
+  {
+    Net context(&model);
+    const size_t context_allocations = AllocationCount() - allocations;
+    const size_t held = MemPoolGetState().cpu_mem - before;
+    std::cout << "weights " << weight_bytes << " bytes in " << model.params().size()
+              << " blobs, model " << model_allocations << " allocations, context "
+              << context_allocations << " allocations, pool grew by " << held << std::endl;
+    CHECK_LT(held, weight_bytes / 64);
+    // layers of both allocate the same small buffers, the model its
+    // parameters too
+    CHECK_LT(context_allocations, model_allocations);
+    for (size_t i = 0; i < model.params().size(); ++i) {
+      CHECK(context.params()[i]->cpu_data() == model.params()[i]->cpu_data())
+          << "param " << model.param_names()[i] << " not shared";
+    }
+    CHECK(Run(&context, 7) == Run(&model, 7));
+  }
+  CHECK_LT(MemPoolGetState().cpu_mem - before, weight_bytes / 64 + model.planned_memory_bytes());
+}
+
+// contexts on their own threads compute what the model does
+void TestContextsOnThreads() {
+  Net model(*ParseNet(kNet));
+  unsigned seed = 1;
+  for (const auto& blob : model.params()) {
+    FillUniform(blob->mutable_cpu_data(), blob->count(), 0.5f, 1.5f, seed++);
+  }
+  const int kThreads = 4;
+  std::vector<std::vector<float> > expected(kThreads), results(kThreads);
+  for (int t = 0; t < kThreads; ++t) expected[t] = Run(&model, 100 + t);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&model, &results, t]() {
+      Net context(&model);
+      for (int k = 0; k < 10; ++k) results[t] = Run(&context, 100 + t);
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  for (int t = 0; t < kThreads; ++t) {
+    CHECK(results[t] == expected[t]) << "context on thread " << t;
+  }
+}
+
+// weights can't change under contexts reading them, new contexts see the
+// weights loaded afterwards
+void TestReloadWithContexts() {
+  Net model(*ParseNet(kNet));
+  unsigned seed = 1;
+  for (const auto& blob : model.params()) {
+    FillUniform(blob->mutable_cpu_data(), blob->count(), 0.5f, 1.5f, seed++);
+  }
+  NetParameter weights;
+  model.ToProto(&weights);
+  for (auto& layer : *weights.mutable_layer()) {
+    if (layer.name() != "ip") continue;
+    for (float& value : *layer.mutable_blobs(0)->mutable_data()) value *= 2;
+  }
+  const std::vector<float> before = Run(&model, 3);
+  {
+    Net context(&model);
+    CHECK(Fails([&]() { model.CopyTrainedLayersFrom(weights); }));
+    CHECK(Fails([&]() { context.CopyTrainedLayersFrom(weights); }));
+    CHECK(Run(&context, 3) == before);
+  }
+  // blobs are moved out of the given param
+  model.CopyTrainedLayersFrom(&weights);
+  for (const auto& layer : weights.layer()) {
+    CHECK_EQ(layer.blobs_size(), 0) << layer.name();
+  }
+  const std::vector<float> after = Run(&model, 3);
+  CHECK(after != before);
+  Net context(&model);
+  CHECK(Run(&context, 3) == after);
+}
+
+}  // namespace
+
+int main() {
+  RUN_TEST(TestContextAllocatesNoWeights);
+  RUN_TEST(TestContextsOnThreads);
+  RUN_TEST(TestReloadWithContexts);
+  return 0;
+}
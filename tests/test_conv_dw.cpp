@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../src/util/vmath.hpp"
+#include "./test_util.hpp"
+
+using namespace caffe;
+using namespace caffe::test;
+
+namespace {
+
+// error of the FMA kernels against the separately rounded scalar ones,
+// relative to the largest output
+const float kTolerance = 1e-5f;
+
+struct Shape {
+  int height, width;
+  int kernel, stride, pad;
+  bool bias;
+  // < 0 without ReLU
+  float negative_slope;
+};
+
+std::string DepthwiseNet(const Shape& s) {
+  std::string text =
+    "layer { name: 'data' type: 'Input' top: 'data'"
+    "  input_param { shape { dim: 2 dim: 3 dim: " + std::to_string(s.height) +
+    "  dim: " + std::to_string(s.width) + " } } }"
+    "layer { name: 'conv' type: 'ConvolutionDepthwise' bottom: 'data' top: 'conv'"
+    "  convolution_param { num_output: 3 group: 3"
+    "  kernel_size: " + std::to_string(s.kernel) +
+    "  stride: " + std::to_string(s.stride) + " pad: " + std::to_string(s.pad) +
+    "  bias_term: " + (s.bias ? "true" : "false");
+  if (s.negative_slope >= 0) {
+    text += " relu: true negative_slope: " + std::to_string(s.negative_slope);
+  }
+  return text + " } }";
+}
+
+// plain loops over the definition of the convolution
+std::vector<float> Reference(Net* net, const Shape& s) {
+  const Blob& data = *net->blob_by_name("data");
+  const Blob& conv = *net->blob_by_name("conv");
+  const float* weight = net->params()[0]->cpu_data();
+  const float* bias = s.bias ? net->params()[1]->cpu_data() : NULL;
+  std::vector<float> top(conv.count());
+  const int planes = data.num() * data.channels();
+  const int top_height = conv.height(), top_width = conv.width();
+  for (int p = 0; p < planes; ++p) {
+    const int c = p % data.channels();
+    const float* plane = data.cpu_data() + p * s.height * s.width;
+    for (int oh = 0; oh < top_height; ++oh) {
+      for (int ow = 0; ow < top_width; ++ow) {
+        float value = bias ? bias[c] : 0.f;
+        for (int kh = 0; kh < s.kernel; ++kh) {
+          for (int kw = 0; kw < s.kernel; ++kw) {
+            const int ih = oh * s.stride - s.pad + kh;
+            const int iw = ow * s.stride - s.pad + kw;
+            if (ih < 0 || ih >= s.height || iw < 0 || iw >= s.width) continue;
+            value += weight[(c * s.kernel + kh) * s.kernel + kw] * plane[ih * s.width + iw];
+          }
+        }
+        if (s.negative_slope >= 0 && value < 0) value *= s.negative_slope;
+        top[(p * top_height + oh) * top_width + ow] = value;
+      }
+    }
+  }
+  return top;
+}
+
+// the scalar kernel against the plain loops, then every SIMD kernel the CPU
+// runs against the scalar one
+void Compare(const Shape& s) {
+  Net net(*ParseNet(DepthwiseNet(s)));
+  unsigned seed = 1;
+  for (const auto& blob : net.params()) {
+    FillUniform(blob->mutable_cpu_data(), blob->count(), -0.5f, 0.5f, seed++);
+  }
+  std::shared_ptr<Blob> data = net.blob_by_name("data");
+  FillUniform(data->mutable_cpu_data(), data->count(), -1, 1, seed);
+  const Blob& conv = *net.blob_by_name("conv");
+
+  VmathSetIsa(VMATH_SCALAR);
+  net.Forward();
+  const std::vector<float> scalar(conv.cpu_data(), conv.cpu_data() + conv.count());
+  float scale = 1e-3f;
+  for (float x : scalar) scale = std::max(scale, std::abs(x));
+  const std::vector<float> reference = Reference(&net, s);
+  float error = MaxRelativeError(scalar.data(), reference.data(), conv.count(), scale);
+  CHECK_LT(error, kTolerance) << "scalar kernel differs from the reference";
+
+  std::cout << s.height << "x" << s.width << " kernel " << s.kernel << " stride "
+            << s.stride << " pad " << s.pad << " slope " << s.negative_slope << ":";
+  for (VmathIsa isa : {VMATH_AVX2, VMATH_AVX512}) {
+    VmathSetIsa(isa);
+    if (VmathGetIsa() != isa) continue;
+    net.Forward();
+    error = MaxRelativeError(conv.cpu_data(), scalar.data(), conv.count(), scale);
+    std::cout << " isa " << isa << " " << error;
+    CHECK_LT(error, kTolerance) << "isa " << isa;
+  }
+  std::cout << std::endl;
+  VmathSetIsa(VmathDetectIsa());
+}
+
+void TestWidths() {
+  // narrower than a vector, around one and two vectors of AVX2 and AVX-512,
+  // and odd widths leaving tails
+  for (int width : {1, 3, 7, 8, 9, 15, 16, 17, 31, 33, 40, 67}) {
+    for (int kernel : {3, 5}) {
+      for (int stride : {1, 2}) {
+        Compare({9, width, kernel, stride, kernel / 2, true, -1.f});
+      }
+    }
+  }
+}
+
+void TestPadding() {
+  for (int pad : {0, 1, 2, 3}) {
+    for (int stride : {1, 2}) {
+      Compare({11, 37, 3, stride, pad, true, -1.f});
+      Compare({12, 26, 5, stride, pad, false, -1.f});
+    }
+  }
+  // taps in the padding on both sides of every column
+  Compare({3, 2, 5, 1, 2, true, -1.f});
+  Compare({4, 4, 5, 2, 2, true, -1.f});
+}
+
+void TestRelu() {
+  for (float slope : {0.f, 0.1f, 1.5f}) {
+    for (int stride : {1, 2}) {
+      Compare({10, 35, 3, stride, 1, true, slope});
+      Compare({10, 21, 5, stride, 2, false, slope});
+    }
+  }
+}
+
+}  // namespace
+
+int main() {
+  RUN_TEST(TestWidths);
+  RUN_TEST(TestPadding);
+  RUN_TEST(TestRelu);
+  return 0;
+}
@@ -0,0 +1,185 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../src/util/parallel.hpp"
+#include "./test_util.hpp"
+
+using namespace caffe;
+using namespace caffe::test;
+
+namespace {
+
+typedef std::vector<std::pair<int64_t, int64_t> > Ranges;
+
+// ranges fn was called with by parallel_for
+Ranges Split(int64_t begin, int64_t end, int64_t grain) {
+  std::mutex mutex;
+  Ranges ranges;
+  parallel_for(begin, end, grain, [&](int64_t b, int64_t e) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ranges.emplace_back(b, e);
+  });
+  return ranges;
+}
+
+// ranges cover [begin, end) once, none shorter than grain unless the loop
+// ran in one call
+void CheckSplit(int64_t begin, int64_t end, int64_t grain) {
+  const Ranges ranges = Split(begin, end, grain);
+  std::vector<int> hits(end - begin, 0);
+  for (const auto& range : ranges) {
+    CHECK(begin <= range.first && range.first < range.second && range.second <= end)
+        << "range [" << range.first << ", " << range.second << ")";
+    if (ranges.size() > 1) CHECK_GE(range.second - range.first, grain);
+    for (int64_t i = range.first; i < range.second; ++i) hits[i - begin] += 1;
+  }
+  for (int hit : hits) CHECK_EQ(hit, 1);
+}
+
+void TestGrain() {
+  IntraOpPool pool(4, 50, false);
+  IntraOpScope scope(&pool);
+  for (int64_t n : {1, 2, 3, 7, 10, 16, 100, 1001}) {
+    for (int64_t grain : {-1, 0, 1, 3, 4, 10, 64, 2000}) {
+      CheckSplit(5, 5 + n, grain);
+    }
+  }
+  // a loop no longer than its grain, or shorter than two of them, runs in
+  // one call
+  CHECK_EQ(Split(0, 10, 10).size(), 1u);
+  CHECK_EQ(Split(0, 19, 10).size(), 1u);
+  CHECK_GT(Split(0, 1000, 1).size(), 1u);
+  // 4 tasks per thread at most
+  CHECK_LE(Split(0, 1000, 1).size(), 16u);
+}
+
+void TestEmpty() {
+  IntraOpPool pool(4, 50, false);
+  IntraOpScope scope(&pool);
+  int calls = 0;
+  auto count = [&calls](int64_t, int64_t) { ++calls; };
+  parallel_for(3, 3, 1, count);
+  parallel_for(3, 1, 1, count);
+  pool.Run(3, 3, 1, count);
+  pool.Run(3, 1, 1, count);
+  CHECK_EQ(calls, 0);
+}
+
+// without a pool a loop runs in one call on the calling thread
+void TestNoPool() {
+  CHECK(IntraOpPool::Current() == NULL);
+  const Ranges ranges = Split(0, 100, 1);
+  CHECK_EQ(ranges.size(), 1u);
+  CHECK_EQ(ranges[0].first, 0);
+  CHECK_EQ(ranges[0].second, 100);
+}
+
+// a loop inside a task runs in one call on the thread of the task
+void TestNested() {
+  IntraOpPool pool(4, 50, false);
+  IntraOpScope scope(&pool);
+  std::atomic<int64_t> sum(0);
+  std::atomic<int> inner_calls(0);
+  parallel_for(0, 64, 1, [&](int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) {
+      const std::thread::id outer = std::this_thread::get_id();
+      parallel_for(0, 100, 1, [&](int64_t b, int64_t e) {
+        CHECK(std::this_thread::get_id() == outer);
+        CHECK_EQ(b, 0);
+        CHECK_EQ(e, 100);
+        inner_calls += 1;
+        sum += e - b;
+      });
+    }
+  });
+  CHECK_EQ(inner_calls.load(), 64);
+  CHECK_EQ(sum.load(), 6400);
+  // the pool is the current one again after the loop
+  CHECK(IntraOpPool::Current() == &pool);
+}
+
+// the first exception of a task is rethrown once every task is done, the
+// pool keeps working afterwards
+void TestException() {
+  IntraOpPool pool(4, 50, false);
+  IntraOpScope scope(&pool);
+  std::atomic<int> running(0);
+  std::atomic<int64_t> done(0);
+  bool thrown = Fails([&]() {
+    parallel_for(0, 1000, 1, [&](int64_t begin, int64_t end) {
+      running += 1;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      done += end - begin;
+      running -= 1;
+      CHECK(!(begin <= 500 && 500 < end)) << "task of item 500 fails";
+    });
+  });
+  CHECK(thrown);
+  CHECK_EQ(running.load(), 0) << "rethrown before all tasks were done";
+  CHECK_EQ(done.load(), 1000);
+  CheckSplit(0, 1000, 1);
+}
+
+// loops of several threads share the pool
+void TestConcurrentLoops() {
+  IntraOpPool pool(3, 0, false);
+  std::vector<std::thread> threads;
+  std::atomic<int64_t> sum(0);
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&]() {
+      IntraOpScope scope(&pool);
+      for (int k = 0; k < 50; ++k) {
+        parallel_for(0, 1000, 8, [&](int64_t begin, int64_t end) {
+          int64_t local = 0;
+          for (int64_t i = begin; i < end; ++i) local += i;
+          sum += local;
+        });
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  CHECK_EQ(sum.load(), 4 * 50 * (999 * 1000 / 2));
+}
+
+// blob memory requested by tasks on workers counts for the thread running
+// the loop, loops allocating nothing add nothing once the queues are warm
+void TestAllocationCount() {
+  IntraOpPool pool(4, 0, false);
+  IntraOpScope scope(&pool);
+  std::atomic<int> tasks(0);
+  const size_t before = AllocationCount();
+  parallel_for(0, 1000, 1, [&](int64_t, int64_t) {
+    Blob blob(std::vector<int>(1, 16));
+    blob.mutable_cpu_data();
+    tasks += 1;
+  });
+  CHECK_GT(tasks.load(), 1);
+#ifdef USE_ALLOC_AUDIT
+  // operator new counts too
+  CHECK_GE(AllocationCount() - before, static_cast<size_t>(tasks.load()));
+#else
+  CHECK_EQ(AllocationCount() - before, static_cast<size_t>(tasks.load()));
+#endif  // USE_ALLOC_AUDIT
+  auto empty = [](int64_t, int64_t) {};
+  parallel_for(0, 1000, 1, empty);
+  const size_t warm = AllocationCount();
+  for (int k = 0; k < 100; ++k) parallel_for(0, 1000, 1, empty);
+  CHECK_EQ(AllocationCount(), warm);
+}
+
+}  // namespace
+
+int main() {
+  RUN_TEST(TestGrain);
+  RUN_TEST(TestEmpty);
+  RUN_TEST(TestNoPool);
+  RUN_TEST(TestNested);
+  RUN_TEST(TestException);
+  RUN_TEST(TestConcurrentLoops);
+  RUN_TEST(TestAllocationCount);
+  return 0;
+}
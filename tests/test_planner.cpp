@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./test_util.hpp"
+
+using namespace caffe;
+using namespace caffe::test;
+
+namespace {
+
+// a residual block keeps conv1 alive across conv2 and conv3, in-place ReLUs
+// share memory with the blobs they read, prob and aux are outputs
+const char* kResidualNet =
+  "layer { name: 'data' type: 'Input' top: 'data'"
+  "  input_param { shape { dim: 1 dim: 8 dim: 16 dim: 16 } } }"
+  "layer { name: 'conv1' type: 'Convolution' bottom: 'data' top: 'conv1'"
+  "  convolution_param { num_output: 16 kernel_size: 3 pad: 1 } }"
+  "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' }"
+  "layer { name: 'conv2' type: 'Convolution' bottom: 'conv1' top: 'conv2'"
+  "  convolution_param { num_output: 16 kernel_size: 3 pad: 1 } }"
+  "layer { name: 'relu2' type: 'ReLU' bottom: 'conv2' top: 'conv2' }"
+  "layer { name: 'conv3' type: 'Convolution' bottom: 'conv2' top: 'conv3'"
+  "  convolution_param { num_output: 16 kernel_size: 3 pad: 1 } }"
+  "layer { name: 'sum' type: 'Eltwise' bottom: 'conv1' bottom: 'conv3' top: 'sum' }"
+  "layer { name: 'pool' type: 'Pooling' bottom: 'sum' top: 'pool'"
+  "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } }"
+  "layer { name: 'conv4' type: 'Convolution' bottom: 'pool' top: 'conv4'"
+  "  convolution_param { num_output: 32 kernel_size: 3 pad: 1 } }"
+  "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv4' top: 'ip'"
+  "  inner_product_param { num_output: 10 } }"
+  "layer { name: 'prob' type: 'Softmax' bottom: 'ip' top: 'prob' }"
+  "layer { name: 'aux' type: 'InnerProduct' bottom: 'pool' top: 'aux'"
+  "  inner_product_param { num_output: 4 } }";
+
+// the per-channel factor doesn't depend on the input, Parameter and Power run
+// when memory is planned, Scale on every request
+const char* kConstantNet =
+  "layer { name: 'data' type: 'Input' top: 'data'"
+  "  input_param { shape { dim: 1 dim: 3 dim: 4 dim: 4 } } }"
+  "layer { name: 'factor' type: 'Parameter' top: 'factor'"
+  "  parameter_param { shape { dim: 3 } } }"
+  "layer { name: 'double' type: 'Power' bottom: 'factor' top: 'double'"
+  "  power_param { scale: 2 } }"
+  "layer { name: 'scale' type: 'Scale' bottom: 'data' bottom: 'double' top: 'scale'"
+  "  scale_param { axis: 1 } }";
+
+// a second input feeds Power, which depends on data written by the user
+const char* kTwoInputNet =
+  "layer { name: 'data' type: 'Input' top: 'data'"
+  "  input_param { shape { dim: 1 dim: 3 dim: 4 dim: 4 } } }"
+  "layer { name: 'extra' type: 'Input' top: 'extra'"
+  "  input_param { shape { dim: 1 dim: 2 } } }"
+  "layer { name: 'double' type: 'Power' bottom: 'extra' top: 'double'"
+  "  power_param { scale: 2 } }"
+  "layer { name: 'relu' type: 'ReLU' bottom: 'data' top: 'relu' }";
+
+// concat2 takes concat1 as its first bottom, with one image the branches can
+// be written straight into the memory of concat2
+const char* kNestedConcatNet =
+  "layer { name: 'data' type: 'Input' top: 'data'"
+  "  input_param { shape { dim: 1 dim: 4 dim: 6 dim: 6 } } }"
+  "layer { name: 'a' type: 'Convolution' bottom: 'data' top: 'a'"
+  "  convolution_param { num_output: 3 kernel_size: 1 } }"
+  "layer { name: 'b' type: 'Convolution' bottom: 'data' top: 'b'"
+  "  convolution_param { num_output: 5 kernel_size: 3 pad: 1 } }"
+  "layer { name: 'c' type: 'Convolution' bottom: 'data' top: 'c'"
+  "  convolution_param { num_output: 2 kernel_size: 1 } }"
+  "layer { name: 'concat1' type: 'Concat' bottom: 'a' bottom: 'b' top: 'concat1' }"
+  "layer { name: 'concat2' type: 'Concat' bottom: 'concat1' bottom: 'c' top: 'concat2' }";
+
+// four branches of an inception module run side by side, their memory is
+// reused by the layers after the concat
+const char* kInceptionNet =
+  "layer { name: 'data' type: 'Input' top: 'data'"
+  "  input_param { shape { dim: 2 dim: 8 dim: 12 dim: 12 } } }"
+  "layer { name: 'b1' type: 'Convolution' bottom: 'data' top: 'b1'"
+  "  convolution_param { num_output: 8 kernel_size: 1 } }"
+  "layer { name: 'b1_relu' type: 'ReLU' bottom: 'b1' top: 'b1' }"
+  "layer { name: 'b2_reduce' type: 'Convolution' bottom: 'data' top: 'b2_reduce'"
+  "  convolution_param { num_output: 6 kernel_size: 1 } }"
+  "layer { name: 'b2_relu' type: 'ReLU' bottom: 'b2_reduce' top: 'b2_reduce' }"
+  "layer { name: 'b2' type: 'Convolution' bottom: 'b2_reduce' top: 'b2'"
+  "  convolution_param { num_output: 8 kernel_size: 3 pad: 1 } }"
+  "layer { name: 'b3_reduce' type: 'Convolution' bottom: 'data' top: 'b3_reduce'"
+  "  convolution_param { num_output: 4 kernel_size: 1 } }"
+  "layer { name: 'b3' type: 'Convolution' bottom: 'b3_reduce' top: 'b3'"
+  "  convolution_param { num_output: 8 kernel_size: 5 pad: 2 } }"
+  "layer { name: 'b4_pool' type: 'Pooling' bottom: 'data' top: 'b4_pool'"
+  "  pooling_param { pool: MAX kernel_size: 3 stride: 1 pad: 1 } }"
+  "layer { name: 'b4' type: 'Convolution' bottom: 'b4_pool' top: 'b4'"
+  "  convolution_param { num_output: 8 kernel_size: 1 } }"
+  "layer { name: 'concat' type: 'Concat' bottom: 'b1' bottom: 'b2' bottom: 'b3'"
+  "  bottom: 'b4' top: 'concat' }"
+  "layer { name: 'conv' type: 'Convolution' bottom: 'concat' top: 'conv'"
+  "  convolution_param { num_output: 16 kernel_size: 3 pad: 1 } }"
+  "layer { name: 'left' type: 'Convolution' bottom: 'conv' top: 'left'"
+  "  convolution_param { num_output: 16 kernel_size: 1 } }"
+  "layer { name: 'right' type: 'Pooling' bottom: 'conv' top: 'right'"
+  "  pooling_param { pool: AVE kernel_size: 2 stride: 2 } }"
+  "layer { name: 'left_pool' type: 'Pooling' bottom: 'left' top: 'left_pool'"
+  "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } }"
+  "layer { name: 'sum' type: 'Eltwise' bottom: 'left_pool' bottom: 'right' top: 'sum'"
+  "  eltwise_param { operation: SUM } }";
+
+void FillParams(Net* net) {
+  unsigned seed = 1;
+  for (const auto& blob : net->params()) {
+    FillUniform(blob->mutable_cpu_data(), blob->count(), -0.2f, 0.2f, seed++);
+  }
+}
+
+void FillInput(Net* net, unsigned seed) {
+  std::shared_ptr<Blob> data = net->blob_by_name("data");
+  FillUniform(data->mutable_cpu_data(), data->count(), -1, 1, seed);
+}
+
+// blobs alive at the same time, one producing layer to the last consuming
+// one, outputs to the end, hold disjoint bytes unless they share memory or
+// one lies inside a blob computed from it (nested Concat)
+void CheckNoOverlap(const Net& net) {
+  const int num_layers = static_cast<int>(net.top_vecs().size());
+  const int num_blobs = static_cast<int>(net.blobs().size());
+  std::vector<std::pair<int, int> > life(num_blobs, std::make_pair(-1, -1));
+  for (int i = 0; i < num_layers; ++i) {
+    for (int id : net.bottom_ids(i)) life[id].second = std::max(life[id].second, i);
+    for (int id : net.top_ids(i)) {
+      if (life[id].first < 0) life[id].first = i;
+      life[id].second = std::max(life[id].second, i);
+    }
+  }
+  std::map<std::string, int> ids;
+  for (int id = 0; id < num_blobs; ++id) ids[net.blob_names()[id]] = id;
+  for (const std::string& name : net.output_blob_names()) life[ids[name]].second = num_layers;
+  // reaches[x][y]: y is computed from x
+  std::vector<std::vector<bool> > reaches(num_blobs, std::vector<bool>(num_blobs, false));
+  for (int i = 0; i < num_layers; ++i) {
+    for (int top : net.top_ids(i)) {
+      for (int bottom : net.bottom_ids(i)) {
+        if (bottom == top) continue;
+        reaches[bottom][top] = true;
+        for (int id = 0; id < num_blobs; ++id) {
+          if (reaches[id][bottom]) reaches[id][top] = true;
+        }
+      }
+    }
+  }
+
+  for (int a = 0; a < num_blobs; ++a) {
+    for (int b = a + 1; b < num_blobs; ++b) {
+      const Blob& x = *net.blobs()[a];
+      const Blob& y = *net.blobs()[b];
+      if (x.count() == 0 || y.count() == 0 || x.data() == y.data()) continue;
+      if (life[a].second < life[b].first || life[b].second < life[a].first) continue;
+      const real_t* x_begin = x.cpu_data();
+      const real_t* y_begin = y.cpu_data();
+      const bool disjoint = x_begin + x.count() <= y_begin || y_begin + y.count() <= x_begin;
+      const bool x_in_y = y_begin <= x_begin && x_begin + x.count() <= y_begin + y.count();
+      const bool y_in_x = x_begin <= y_begin && y_begin + y.count() <= x_begin + x.count();
+      const bool nested = (x_in_y && reaches[a][b]) || (y_in_x && reaches[b][a]);
+      CHECK(disjoint || nested) << net.blob_names()[a] << " and " << net.blob_names()[b]
+                      << " overlap while both are alive";
+    }
+  }
+}
+
+// placed memory of live blobs never overlaps, for every planned shape
+void TestArenaNoOverlap() {
+  Net net(*ParseNet(kResidualNet));
+  FillParams(&net);
+  std::shared_ptr<Blob> data = net.blob_by_name("data");
+  for (const std::vector<int>& shape : {std::vector<int>{1, 8, 16, 16},
+                                        std::vector<int>{3, 8, 16, 16},
+                                        std::vector<int>{1, 8, 16, 16}}) {
+    data->Reshape(shape);
+    FillInput(&net, 1);
+    net.Forward();
+    std::cout << "input " << data->shape_string() << ": naive " << net.naive_memory_bytes()
+              << " bytes, planned " << net.planned_memory_bytes() << std::endl;
+    CHECK_LT(net.planned_memory_bytes(), net.naive_memory_bytes()) << "no memory reused";
+    CheckNoOverlap(net);
+  }
+}
+
+// outputs of every input through Forward, layers one by one or inter_op at a
+// time
+std::vector<std::vector<float> > Outputs(Net* net, int inter_op, int num_inputs) {
+  net->SetInterOpThreads(inter_op);
+  std::shared_ptr<Blob> data = net->blob_by_name("data");
+  std::vector<std::vector<float> > outputs;
+  for (int k = 0; k < num_inputs; ++k) {
+    data->Reshape(std::vector<int>{1 + k % 3, 8, 12, 12});
+    FillInput(net, 10 + k);
+    net->Forward();
+    for (const std::string& name : net->output_blob_names()) {
+      const Blob& blob = *net->blob_by_name(name);
+      outputs.emplace_back(blob.cpu_data(), blob.cpu_data() + blob.count());
+    }
+  }
+  return outputs;
+}
+
+// layers running concurrently compute the same bits as in order, reused
+// memory isn't written before its last reader is done
+void TestParallelMatchesSequential() {
+  Net net(*ParseNet(kInceptionNet));
+  FillParams(&net);
+  const std::vector<std::vector<float> > expected = Outputs(&net, 1, 6);
+  CheckNoOverlap(net);
+  for (int round = 0; round < 20; ++round) {
+    const std::vector<std::vector<float> > outputs = Outputs(&net, 4, 6);
+    CHECK_EQ(outputs.size(), expected.size());
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      CHECK_EQ(outputs[i].size(), expected[i].size());
+      CHECK(std::memcmp(outputs[i].data(), expected[i].data(),
+                        outputs[i].size() * sizeof(float)) == 0)
+          << "output " << i << " of round " << round << " differs";
+    }
+  }
+}
+
+// scale is data times twice the factor of its channel, for a factor of
+// channel c
+void CheckScaled(const Net& net, const float* factor) {
+  const Blob& data = *net.blob_by_name("data");
+  const Blob& scale = *net.blob_by_name("scale");
+  CHECK_EQ(scale.count(), data.count());
+  const int dim = data.count(2);
+  for (int i = 0; i < data.count(); ++i) {
+    const int c = (i / dim) % data.channels();
+    CHECK_EQ(scale.cpu_data()[i], data.cpu_data()[i] * (2 * factor[c])) << "item " << i;
+  }
+}
+
+// layers not depending on the input run once when memory is planned for a
+// shape, not on every Forward nor when a cached plan is restored
+void TestConstantLayersOncePerPlan() {
+  Net net(*ParseNet(kConstantNet));
+  net.SetPlanCacheSize(2);
+  CHECK_EQ(net.params().size(), 1u);
+  float* factor = net.params()[0]->mutable_cpu_data();
+  const float first[] = {1.f, -2.f, 0.5f};
+  const float second[] = {3.f, 0.25f, -1.f};
+  std::copy(first, first + 3, factor);
+  FillInput(&net, 1);
+  net.Forward();
+  CheckScaled(net, first);
+  const size_t plans = net.plans_placed();
+
+  // same shape, the factor isn't read again
+  std::copy(second, second + 3, factor);
+  FillInput(&net, 2);
+  net.Forward();
+  CHECK_EQ(net.plans_placed(), plans);
+  CheckScaled(net, first);
+
+  // a new shape places memory and runs them again
+  std::shared_ptr<Blob> data = net.blob_by_name("data");
+  data->Reshape(std::vector<int>{2, 3, 5, 5});
+  FillInput(&net, 3);
+  net.Forward();
+  CHECK_EQ(net.plans_placed(), plans + 1);
+  CheckScaled(net, second);
+
+  // the cached plan of the first shape keeps what they computed for it
+  data->Reshape(std::vector<int>{1, 3, 4, 4});
+  FillInput(&net, 4);
+  net.Forward();
+  CHECK_EQ(net.plans_placed(), plans + 1) << "cached plan placed again";
+  CheckScaled(net, first);
+}
+
+// write `value` to all of blob
+void FillValue(Blob* blob, float value) {
+  std::fill(blob->mutable_cpu_data(), blob->mutable_cpu_data() + blob->count(), value);
+}
+
+// every value of blob `name` is `value`
+void CheckValue(const Net& net, const char* name, float value) {
+  const Blob& blob = *net.blob_by_name(name);
+  for (int i = 0; i < blob.count(); ++i) {
+    CHECK_EQ(blob.cpu_data()[i], value) << name << " at " << i;
+  }
+}
+
+// tops of every Input layer key the plans and keep the data written to them
+void TestSecondInputPlanned() {
+  Net net(*ParseNet(kTwoInputNet));
+  net.SetPlanCacheSize(2);
+  std::shared_ptr<Blob> extra = net.blob_by_name("extra");
+  FillInput(&net, 1);
+  FillValue(extra.get(), 1.f);
+  net.Forward();
+  CheckValue(net, "extra", 1.f);
+  CheckValue(net, "double", 2.f);
+  const size_t plans = net.plans_placed();
+
+  // reshaping only the second input places memory for its shape
+  extra->Reshape(std::vector<int>{1, 5});
+  FillValue(extra.get(), 3.f);
+  net.Forward();
+  CHECK_EQ(net.plans_placed(), plans + 1) << "second input shape not planned";
+  CHECK_EQ(net.blob_by_name("double")->count(), 5);
+  CheckValue(net, "extra", 3.f);
+  CheckValue(net, "double", 6.f);
+
+  // the cached plan of the first shape leaves the input memory alone
+  extra->Reshape(std::vector<int>{1, 2});
+  FillValue(extra.get(), 5.f);
+  net.Forward();
+  CHECK_EQ(net.plans_placed(), plans + 1) << "cached plan placed again";
+  CheckValue(net, "extra", 5.f);
+  CheckNoOverlap(net);
+}
+
+// layers reading any input, not only the first one, run on every Forward
+void TestSecondInputNotConstant() {
+  Net net(*ParseNet(kTwoInputNet));
+  for (int iter = 1; iter <= 3; ++iter) {
+    FillInput(&net, iter);
+    FillValue(net.blob_by_name("extra").get(), static_cast<float>(iter));
+    net.Forward();
+    CheckValue(net, "double", 2.f * iter);
+  }
+}
+
+// concat2 holds a, b and c of every image one after the other along channels
+void CheckConcatenated(const Net& net) {
+  const Blob& top = *net.blob_by_name("concat2");
+  const int num = top.num();
+  int channel = 0;
+  for (const char* name : {"a", "b", "c"}) {
+    const Blob& bottom = *net.blob_by_name(name);
+    for (int n = 0; n < num; ++n) {
+      const float* expected = bottom.cpu_data() + bottom.offset(n);
+      const float* actual = top.cpu_data() + top.offset(n, channel);
+      CHECK(std::memcmp(actual, expected, bottom.count(1) * sizeof(float)) == 0)
+          << name << " of image " << n << " misplaced in concat2";
+    }
+    channel += bottom.channels();
+  }
+  CHECK_EQ(channel, top.channels());
+}
+
+// bottoms of nested Concats alias the top at their offsets and aren't
+// copied, tops holding several images are still filled by copies
+void TestNestedConcat() {
+  Net net(*ParseNet(kNestedConcatNet));
+  FillParams(&net);
+  FillInput(&net, 1);
+  net.Forward();
+  const float* top = net.blob_by_name("concat2")->cpu_data();
+  CHECK(net.blob_by_name("concat1")->cpu_data() == top) << "concat1 not at offset 0";
+  int offset = 0;
+  for (const char* name : {"a", "b", "c"}) {
+    const Blob& bottom = *net.blob_by_name(name);
+    CHECK(bottom.cpu_data() == top + offset) << name << " not at offset " << offset;
+    offset += bottom.count();
+  }
+  CHECK_EQ(offset, net.blob_by_name("concat2")->count());
+  CheckConcatenated(net);
+  CheckNoOverlap(net);
+
+  // the channels of one image aren't contiguous in the top of two
+  net.blob_by_name("data")->Reshape(std::vector<int>{2, 4, 6, 6});
+  FillInput(&net, 2);
+  net.Forward();
+  const float* a = net.blob_by_name("a")->cpu_data();
+  top = net.blob_by_name("concat2")->cpu_data();
+  CHECK(a < top || a >= top + net.blob_by_name("concat2")->count())
+      << "a placed inside concat2 with 2 images";
+  CheckConcatenated(net);
+  CheckNoOverlap(net);
+}
+
+}  // namespace
+
+int main() {
+  RUN_TEST(TestArenaNoOverlap);
+  RUN_TEST(TestParallelMatchesSequential);
+  RUN_TEST(TestConstantLayersOncePerPlan);
+  RUN_TEST(TestSecondInputPlanned);
+  RUN_TEST(TestSecondInputNotConstant);
+  RUN_TEST(TestNestedConcat);
+  return 0;
+}
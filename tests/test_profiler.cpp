@@ -0,0 +1,146 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <caffe/profiler.hpp>
+
+#include "./test_util.hpp"
+
+using namespace caffe;
+using namespace caffe::test;
+
+namespace {
+
+// calls recorded for the statistics of `name`
+uint64_t StatsCount(const std::string& name) {
+  for (const Profiler::LayerStats& stats : Profiler::Get()->GetLayerStats()) {
+    if (stats.name == name) return stats.count;
+  }
+  return 0;
+}
+
+// scopes whose ends are skipped while the profiler is off are dropped, they
+// neither pile up on the stack nor end later scopes
+void TestTurnOffMidScope() {
+  Profiler* profiler = Profiler::Get();
+  const int outer = profiler->Intern("outer");
+  const int inner = profiler->Intern("inner");
+  const int outer_stats = profiler->StatsId(outer, "Test");
+  const int inner_stats = profiler->StatsId(inner, "Test");
+  profiler->ResetLayerStats();
+  // more than ThreadBuffer::kMaxDepth open scopes ended while off
+  for (int i = 0; i < 100; ++i) {
+    profiler->EnableLayerStats(true);
+    profiler->ScopeStart(outer, 0, outer_stats);
+    profiler->EnableLayerStats(false);
+    profiler->ScopeEnd();
+  }
+  profiler->EnableLayerStats(true);
+  profiler->ScopeStart(inner, 0, inner_stats);
+  profiler->ScopeEnd();
+  CHECK_EQ(StatsCount("inner"), 1u) << "scopes are not recorded after turning off mid-scope";
+  CHECK_EQ(StatsCount("outer"), 0u);
+
+  // a scope open while the trace is turned off and on again is dropped
+  // rather than ended with the time it was off
+  profiler->ResetLayerStats();
+  profiler->TurnON();
+  profiler->ScopeStart(outer, 0, outer_stats);
+  profiler->TurnOFF();
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  profiler->TurnON();
+  profiler->ScopeStart(inner, 0, inner_stats);
+  profiler->ScopeEnd();
+  profiler->ScopeEnd();
+  profiler->TurnOFF();
+  CHECK_EQ(StatsCount("inner"), 1u);
+  CHECK_EQ(StatsCount("outer"), 0u) << "scope open across TurnOFF was recorded";
+
+  // nested scopes record as usual
+  profiler->ResetLayerStats();
+  profiler->ScopeStart(outer, 0, outer_stats);
+  profiler->ScopeStart(inner, 0, inner_stats);
+  profiler->ScopeEnd();
+  profiler->ScopeEnd();
+  CHECK_EQ(StatsCount("inner"), 1u);
+  CHECK_EQ(StatsCount("outer"), 1u);
+  profiler->EnableLayerStats(false);
+}
+
+// trace events of the dumped profile named `name`
+int DumpedEvents(const std::string& name) {
+  const char* path = "test_profiler.json";
+  Profiler::Get()->DumpProfile(path);
+  std::ifstream file(path);
+  std::stringstream text;
+  text << file.rdbuf();
+  file.close();
+  std::remove(path);
+  const std::string json = text.str();
+  const std::string key = "\"name\": \"" + name + "\"";
+  int count = 0;
+  for (size_t pos = json.find(key); pos != std::string::npos; pos = json.find(key, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+// names given by pointer are looked up in the cache of the thread, names
+// sharing a cache entry and copies of a name at other addresses keep their ids
+void TestScopeNames() {
+  Profiler* profiler = Profiler::Get();
+  profiler->TurnON();
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < 100; ++i) {
+      const std::string name = "scope" + std::to_string(i);
+      profiler->ScopeStart(name.c_str());
+      profiler->ScopeEnd();
+    }
+  }
+  profiler->TurnOFF();
+  for (int i : {0, 7, 63, 64, 99}) {
+    CHECK_EQ(DumpedEvents("scope" + std::to_string(i)), 2) << "scope" << i;
+  }
+}
+
+// buffers of exited threads are freed once dumped, at most kMaxExitedBuffers
+// of them wait for it, those of threads which recorded nothing go at once
+void TestThreadBuffersFreed() {
+  Profiler* profiler = Profiler::Get();
+  const int before = profiler->num_thread_buffers();
+  auto run_threads = [profiler]() {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+      threads.emplace_back([profiler]() {
+        profiler->ScopeStart("thread");
+        profiler->ScopeEnd();
+      });
+    }
+    for (std::thread& thread : threads) thread.join();
+  };
+  profiler->TurnON();
+  for (int round = 0; round < 4; ++round) run_threads();
+  profiler->TurnOFF();
+  CHECK_EQ(profiler->num_thread_buffers(), before + Profiler::kMaxExitedBuffers);
+  CHECK_EQ(DumpedEvents("thread"), Profiler::kMaxExitedBuffers);
+  CHECK_EQ(profiler->num_thread_buffers(), before);
+
+  // statistics only, the trace stays empty
+  profiler->EnableLayerStats(true);
+  run_threads();
+  profiler->EnableLayerStats(false);
+  CHECK_EQ(profiler->num_thread_buffers(), before);
+}
+
+}  // namespace
+
+int main() {
+  RUN_TEST(TestTurnOffMidScope);
+  RUN_TEST(TestScopeNames);
+  RUN_TEST(TestThreadBuffersFreed);
+  return 0;
+}
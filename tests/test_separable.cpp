@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "./test_util.hpp"
+
+using namespace caffe;
+using namespace caffe::test;
+
+namespace {
+
+const int kChannels = 8;
+const int kOutputs = 12;
+
+std::string Input() {
+  return "layer { name: 'data' type: 'Input' top: 'data'"
+         "  input_param { shape { dim: 2 dim: 8 dim: 13 dim: 11 } } }";
+}
+
+std::string Depthwise(int stride) {
+  return "layer { name: 'dw' type: 'ConvolutionDepthwise' bottom: 'data' top: 'dw'"
+         "  convolution_param { num_output: 8 group: 8 kernel_size: 3 pad: 1 bias_term: true"
+         "  stride: " + std::to_string(stride) + " } }";
+}
+
+std::string ReLU(const std::string& name, float slope) {
+  return "layer { name: '" + name + "' type: 'ReLU' bottom: 'dw' top: 'dw'"
+         "  relu_param { negative_slope: " + std::to_string(slope) + " } }";
+}
+
+std::string BatchNormScale() {
+  return "layer { name: 'bn' type: 'BatchNorm' bottom: 'dw' top: 'dw'"
+         "  batch_norm_param { use_global_stats: true } }"
+         "layer { name: 'scale' type: 'Scale' bottom: 'dw' top: 'dw'"
+         "  scale_param { bias_term: true } }";
+}
+
+std::string Pointwise() {
+  return "layer { name: 'pw' type: 'Convolution' bottom: 'dw' top: 'pw'"
+         "  convolution_param { num_output: 12 kernel_size: 1 bias_term: true } }";
+}
+
+// a second reader of the depthwise output keeps the chain from fusing
+std::string Probe() {
+  return "layer { name: 'probe' type: 'Power' bottom: 'dw' top: 'probe' }";
+}
+
+void AddBlob(LayerParameter* layer, const std::vector<int>& shape,
+             float lo, float hi, unsigned seed) {
+  Blob blob(shape);
+  FillUniform(blob.mutable_cpu_data(), blob.count(), lo, hi, seed);
+  blob.ToProto(layer->add_blobs());
+}
+
+NetParameter Weights() {
+  NetParameter weights;
+  LayerParameter* dw = weights.add_layer();
+  dw->set_name("dw");
+  AddBlob(dw, {kChannels, 1, 3, 3}, -1, 1, 1);
+  AddBlob(dw, {kChannels}, -0.5, 0.5, 2);
+  LayerParameter* bn = weights.add_layer();
+  bn->set_name("bn");
+  AddBlob(bn, {kChannels}, -0.5, 0.5, 3);
+  AddBlob(bn, {kChannels}, 0.5, 1.5, 4);
+  AddBlob(bn, {1}, 1, 1, 5);
+  LayerParameter* scale = weights.add_layer();
+  scale->set_name("scale");
+  AddBlob(scale, {kChannels}, -1.5, 1.5, 6);
+  AddBlob(scale, {kChannels}, -0.5, 0.5, 7);
+  LayerParameter* pw = weights.add_layer();
+  pw->set_name("pw");
+  AddBlob(pw, {kOutputs, kChannels, 1, 1}, -1, 1, 8);
+  AddBlob(pw, {kOutputs}, -0.5, 0.5, 9);
+  return weights;
+}
+
+// output of pw with the chain fused, and with fusion blocked
+void Compare(const std::string& chain) {
+  const std::string text = Input() + chain + Pointwise();
+  NetParameter compiled;
+  Net::CompileNet(*ParseNet(text), &compiled);
+  int fused = 0;
+  for (const auto& layer : compiled.layer()) {
+    if (layer.type() == "SeparableConvolution") ++fused;
+  }
+  CHECK_EQ(fused, 1) << "chain was not fused";
+
+  std::vector<float> input(2 * kChannels * 13 * 11);
+  FillUniform(input.data(), static_cast<int>(input.size()), -2, 2, 10);
+  std::vector<std::vector<float> > outputs;
+  for (const std::string& net_text : {text, text + Probe()}) {
+    NetParameter weights = Weights();
+    Net net(*ParseNet(net_text), &weights);
+    std::shared_ptr<Blob> data = net.blob_by_name("data");
+    std::copy(input.begin(), input.end(), data->mutable_cpu_data());
+    net.Forward();
+    std::shared_ptr<Blob> pw = net.blob_by_name("pw");
+    outputs.emplace_back(pw->cpu_data(), pw->cpu_data() + pw->count());
+  }
+  CHECK_EQ(outputs[0].size(), outputs[1].size());
+  const float error = MaxRelativeError(outputs[0].data(), outputs[1].data(),
+                                       static_cast<int>(outputs[0].size()), 1);
+  CHECK_LT(error, 1e-5f) << "fused output differs for chain " << chain;
+}
+
+void TestPlain() {
+  Compare(Depthwise(1));
+  Compare(Depthwise(2));
+}
+
+void TestBatchNormScale() {
+  Compare(Depthwise(1) + BatchNormScale());
+  Compare(Depthwise(1) + BatchNormScale() + ReLU("relu", 0));
+  Compare(Depthwise(2) + BatchNormScale() + ReLU("relu", 0.1f));
+}
+
+void TestLeakyReLU() {
+  Compare(Depthwise(1) + ReLU("relu", 0.2f));
+  Compare(Depthwise(2) + ReLU("relu", 0.2f));
+}
+
+void TestDoubleReLU() {
+  Compare(Depthwise(1) + ReLU("relu1", 0) + ReLU("relu2", 0.1f));
+  Compare(Depthwise(1) + ReLU("relu1", 0.2f) + ReLU("relu2", 0.1f));
+  Compare(Depthwise(2) + ReLU("relu1", 0.2f) + BatchNormScale() + ReLU("relu2", 0.1f));
+}
+
+// weights loaded into a planned net are folded again
+void TestReloadWeights() {
+  const std::string text = Input() + Depthwise(1) + BatchNormScale() + Pointwise();
+  NetParameter weights = Weights();
+  Net net(*ParseNet(text), &weights);
+  net.Forward();
+  NetParameter changed = Weights();
+  for (auto& layer : *changed.mutable_layer()) {
+    if (layer.name() != "scale") continue;
+    for (float& value : *layer.mutable_blobs(0)->mutable_data()) value *= 2;
+  }
+  NetParameter reference_weights = changed;
+  Net reference(*ParseNet(text + Probe()), &reference_weights);
+  net.CopyTrainedLayersFrom(changed);
+  for (Net* n : {&net, &reference}) {
+    std::shared_ptr<Blob> data = n->blob_by_name("data");
+    FillUniform(data->mutable_cpu_data(), data->count(), -2, 2, 11);
+    n->Forward();
+  }
+  std::shared_ptr<Blob> a = net.blob_by_name("pw");
+  std::shared_ptr<Blob> b = reference.blob_by_name("pw");
+  CHECK_LT(MaxRelativeError(a->cpu_data(), b->cpu_data(), a->count(), 1), 1e-5f);
+}
+
+}  // namespace
+
+int main() {
+  RUN_TEST(TestPlain);
+  RUN_TEST(TestBatchNormScale);
+  RUN_TEST(TestLeakyReLU);
+  RUN_TEST(TestDoubleReLU);
+  RUN_TEST(TestReloadWeights);
+  return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef CAFFE_TESTS_TEST_UTIL_HPP_
+#define CAFFE_TESTS_TEST_UTIL_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <caffe/logging.hpp>
+#include <caffe/net.hpp>
+
+namespace caffe {
+namespace test {
+
+/*! \brief parse a NetParameter in text format */
+inline std::shared_ptr<NetParameter> ParseNet(const std::string& text) {
+  return ReadTextNetParameterFromBuffer(text.c_str(), static_cast<int>(text.size()));
+}
+
+/*! \brief fill `n` floats with uniform values in [lo, hi) */
+inline void FillUniform(float* data, int n, float lo, float hi, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> dist(lo, hi);
+  for (int i = 0; i < n; ++i) data[i] = dist(rng);
+}
+
+/*! \brief true if fn fails a CHECK */
+template <typename F>
+bool Fails(const F& fn) {
+  try {
+    fn();
+  }
+  catch (const Error& e) {
+    std::cout << "expected error: " << e.what() << std::endl;
+    return true;
+  }
+  return false;
+}
+
+/*! \brief largest |a - b| over max(|b|, floor), relative error with a floor
+ *   for values close to 0 */
+inline float MaxRelativeError(const float* a, const float* b, int n, float floor) {
+  float max_error = 0.f;
+  for (int i = 0; i < n; ++i) {
+    const float scale = std::max(std::abs(b[i]), floor);
+    max_error = std::max(max_error, std::abs(a[i] - b[i]) / scale);
+  }
+  return max_error;
+}
+
+/*! \brief run a test function, print its name */
+#define RUN_TEST(fn)                          \
+  do {                                        \
+    std::cout << "[ RUN  ] " #fn << std::endl; \
+    fn();                                     \
+    std::cout << "[  OK  ] " #fn << std::endl; \
+  } while (0)
+
+}  // namespace test
+}  // namespace caffe
+
+#endif  // CAFFE_TESTS_TEST_UTIL_HPP_
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/util/vmath.hpp"
+#include "./test_util.hpp"
+
+using namespace caffe;
+using namespace caffe::test;
+
+namespace {
+
+typedef std::function<void(int, const float*, float*)> VmathFn;
+typedef std::function<double(double)> ExactFn;
+
+float FromBits(uint32_t bits) {
+  float x;
+  std::memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+uint32_t ToBits(float x) {
+  uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+// floats of either sign among those the bounds of vmath.hpp were measured
+// on, special values, denormals and the floats around the clamps of the kernels
+std::vector<float> Inputs() {
+  std::vector<float> inputs;
+  for (uint32_t bits = 0; bits < 0x7f800000u; bits += 61 * 53) {
+    inputs.push_back(FromBits(bits));
+    inputs.push_back(-FromBits(bits));
+  }
+  const float edges[] = {
+    0.f, FromBits(1), 1e-40f, FLT_MIN / 2, FLT_MIN, 1.f, FLT_MAX, HUGE_VALF,
+    // exp: clamps, denormal, normal and overflowing results
+    104.f, 103.28f, 89.f, 88.73f, 88.72f, 87.34f, 87.33f,
+    // tanh: end of the polynomial, results rounding to 1
+    0.625f, 9.01f,
+  };
+  for (float edge : edges) {
+    for (float x : {edge, std::nextafter(edge, 0.f), std::nextafter(edge, HUGE_VALF)}) {
+      inputs.push_back(x);
+      inputs.push_back(-x);
+    }
+  }
+  inputs.push_back(NAN);
+  inputs.push_back(-NAN);
+  return inputs;
+}
+
+// |y - exact| in units of the last place of the float closest to exact,
+// inf counts as 2^128 where floats round to it
+double UlpError(float y, double exact) {
+  const double kInf = std::ldexp(1.0, 128);
+  const double yd = std::isinf(y) ? std::copysign(kInf, y) : y;
+  if (std::fabs(exact) > kInf) exact = std::copysign(kInf, exact);
+  const double magnitude = std::max(std::fabs(exact), static_cast<double>(FLT_MIN));
+  int exponent;
+  std::frexp(magnitude, &exponent);
+  // frexp gives [0.5, 1), floats have 24 bits
+  const double ulp = std::ldexp(1.0, std::min(exponent, 128) - 24);
+  return std::fabs(yd - exact) / ulp;
+}
+
+bool SameSpecial(float a, float b) {
+  if (std::isnan(a) || std::isnan(b)) return std::isnan(a) && std::isnan(b);
+  return ToBits(a) == ToBits(b);
+}
+
+// run fn with every instruction set, the results of the SIMD kernels stay
+// within max_ulp of exact, special inputs and domain errors give the results
+// of VMATH_SCALAR (libm); `libm_differs` marks the inputs documented to differ
+void CheckFunction(const std::string& name, const VmathFn& fn, const ExactFn& exact,
+                   double max_ulp, double max_ulp_avx2,
+                   const std::function<bool(float)>& libm_differs = nullptr) {
+  const std::vector<float> inputs = Inputs();
+  const int n = static_cast<int>(inputs.size());
+  std::vector<float> scalar(inputs.size()), simd(inputs.size()), split(inputs.size());
+  VmathSetIsa(VMATH_SCALAR);
+  fn(n, inputs.data(), scalar.data());
+  for (VmathIsa isa : {VMATH_AVX2, VMATH_AVX512}) {
+    VmathSetIsa(isa);
+    if (VmathGetIsa() != isa) {
+      std::cout << name << " isa " << isa << ": not supported, skipped" << std::endl;
+      continue;
+    }
+    const double bound = isa == VMATH_AVX2 ? max_ulp_avx2 : max_ulp;
+    fn(n, inputs.data(), simd.data());
+    // results don't depend on how the array is split into calls
+    for (int i = 0; i < n; i += 7) {
+      fn(std::min(7, n - i), inputs.data() + i, split.data() + i);
+    }
+    double max_error = 0;
+    float worst = 0;
+    for (int i = 0; i < n; ++i) {
+      const float x = inputs[i];
+      CHECK(SameSpecial(simd[i], split[i])) << name << "(" << x << ") depends on the split";
+      if (libm_differs && libm_differs(x)) continue;
+      const double y = exact(x);
+      if (std::isnan(y) || std::isinf(x) || x == 0.f) {
+        CHECK(SameSpecial(simd[i], scalar[i]))
+            << name << "(" << x << ") = " << simd[i] << ", libm " << scalar[i];
+        continue;
+      }
+      const double error = UlpError(simd[i], y);
+      if (error > max_error) {
+        max_error = error;
+        worst = x;
+      }
+    }
+    std::cout << name << " isa " << isa << ": " << max_error << " ulp at " << worst << std::endl;
+    CHECK_LE(max_error, bound) << name << "(" << worst << ") with isa " << isa;
+  }
+  VmathSetIsa(VmathDetectIsa());
+}
+
+void TestExp() {
+  CheckFunction("exp", VmathExp, [](double x) { return std::exp(x); }, 1.3, 1.3);
+}
+
+void TestLn() {
+  CheckFunction("ln", VmathLn, [](double x) { return std::log(x); }, 0.8, 0.8);
+}
+
+void TestTanh() {
+  CheckFunction("tanh", VmathTanh, [](double x) { return std::tanh(x); }, 1.4, 1.4);
+}
+
+void TestSigmoid() {
+  CheckFunction("sigmoid", VmathSigmoid,
+                [](double x) { return 1 / (1 + std::exp(-x)); }, 2.6, 2.6);
+}
+
+void TestInvSqrt() {
+  CheckFunction("inv_sqrt", VmathInvSqrt,
+                [](double x) { return 1 / std::sqrt(x); }, 3, 4.5);
+}
+
+void TestPowx() {
+  struct Case {
+    float b;
+    double max_ulp;
+    double max_ulp_avx2;
+  };
+  const Case cases[] = {
+    {0.5f, 0.5, 0.5}, {1.f, 0.5, 0.5}, {2.f, 0.5, 0.5}, {-1.f, 0.5, 0.5},
+    {-0.5f, 3, 4.5}, {0.75f, 4, 4}, {-0.75f, 4, 4},
+    {0.f, 0.5, 0.5}, {3.f, 2, 2}, {-2.f, 2, 2}, {0.3f, 2, 2}, {-1.7f, 2, 2}, {2.5f, 2, 2},
+  };
+  for (const Case& c : cases) {
+    const float b = c.b;
+    const bool integral = b == std::floor(b);
+    // pow(-inf, b) is NaN and pow(-0, b) is -0 for non integral b
+    auto libm_differs = [integral](float x) {
+      return !integral && std::signbit(x) && (x == 0.f || std::isinf(x));
+    };
+    CheckFunction("pow(x, " + std::to_string(b) + ")",
+                  [b](int n, const float* a, float* y) { VmathPowx(n, a, b, y); },
+                  [b](double x) { return std::pow(x, static_cast<double>(b)); },
+                  c.max_ulp, c.max_ulp_avx2, libm_differs);
+  }
+}
+
+// BNLL layer on every instruction set, small results of negative inputs keep
+// their relative precision
+void TestBnll() {
+  const float xs[] = {-100.f, -30.f, -20.f, -17.5f, -5.f, -1e-3f, 0.f, 1e-3f, 2.f, 20.f, 100.f};
+  const int n = sizeof(xs) / sizeof(xs[0]);
+  Net net(*ParseNet("layer { name: 'data' type: 'Input' top: 'data'"
+                    "  input_param { shape { dim: " + std::to_string(n) + " } } }"
+                    "layer { name: 'bnll' type: 'BNLL' bottom: 'data' top: 'bnll' }"));
+  std::copy(xs, xs + n, net.blob_by_name("data")->mutable_cpu_data());
+  std::vector<float> exact(n);
+  for (int i = 0; i < n; ++i) {
+    const double x = xs[i];
+    exact[i] = x > 0 ? x + std::log1p(std::exp(-x)) : std::log1p(std::exp(x));
+  }
+  for (VmathIsa isa : {VMATH_SCALAR, VMATH_AVX2, VMATH_AVX512}) {
+    VmathSetIsa(isa);
+    if (VmathGetIsa() != isa) continue;
+    net.Forward();
+    const float* y = net.blob_by_name("bnll")->cpu_data();
+    CHECK_GT(y[2], 0.f) << "bnll(-20) with isa " << isa;
+    const float error = MaxRelativeError(y, exact.data(), n, FLT_MIN);
+    std::cout << "bnll isa " << isa << ": " << error << std::endl;
+    CHECK_LT(error, 1e-6f) << "isa " << isa;
+  }
+  VmathSetIsa(VmathDetectIsa());
+}
+
+}  // namespace
+
+int main() {
+  RUN_TEST(TestExp);
+  RUN_TEST(TestLn);
+  RUN_TEST(TestTanh);
+  RUN_TEST(TestSigmoid);
+  RUN_TEST(TestInvSqrt);
+  RUN_TEST(TestPowx);
+  RUN_TEST(TestBnll);
+  return 0;
+}
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "./test_util.hpp"
+
+using namespace caffe;
+using namespace caffe::test;
+
+namespace {
+
+const char* kNet =
+  "layer { name: 'data' type: 'Input' top: 'data'"
+  "  input_param { shape { dim: 2 dim: 64 } } }"
+  "layer { name: 'ip' type: 'InnerProduct' bottom: 'data' top: 'ip'"
+  "  inner_product_param { num_output: 1000 } }"
+  "layer { name: 'scale' type: 'Scale' bottom: 'ip' top: 'ip'"
+  "  scale_param { bias_term: true } }";
+
+// weights of layer `name` with blobs of the given shapes
+void AddWeights(NetParameter* weights, const std::string& name,
+                const std::vector<std::vector<int> >& shapes) {
+  LayerParameter* layer = weights->add_layer();
+  layer->set_name(name);
+  for (const auto& shape : shapes) {
+    Blob blob(shape);
+    std::fill(blob.mutable_cpu_data(), blob.mutable_cpu_data() + blob.count(), 0.f);
+    blob.ToProto(layer->add_blobs());
+  }
+}
+
+void TestMatchingWeights() {
+  auto param = ParseNet(kNet);
+  NetParameter weights;
+  AddWeights(&weights, "ip", {{1000, 64}, {1000}});
+  AddWeights(&weights, "scale", {{1000}, {1000}});
+  Net net(*param, &weights);
+  net.Forward();
+  CHECK_EQ(net.blob_by_name("ip")->count(), 2 * 1000);
+}
+
+void TestWrongWeightShape() {
+  auto param = ParseNet(kNet);
+  NetParameter weights;
+  AddWeights(&weights, "ip", {{2, 2}, {1000}});
+  CHECK(Fails([&]() { Net net(*param, &weights); }))
+      << "InnerProduct accepted a 2x2 weight";
+}
+
+void TestWrongBlobCount() {
+  auto param = ParseNet(kNet);
+  NetParameter weights;
+  AddWeights(&weights, "scale", {{1000}});
+  CHECK(Fails([&]() { Net net(*param, &weights); }))
+      << "Scale with bias_term accepted a single blob";
+}
+
+// checking given weights allocates no second copy of them
+void TestCheckAllocatesNoWeights() {
+  auto param = ParseNet(
+    "layer { name: 'data' type: 'Input' top: 'data'"
+    "  input_param { shape { dim: 1 dim: 4096 } } }"
+    "layer { name: 'ip' type: 'InnerProduct' bottom: 'data' top: 'ip'"
+    "  inner_product_param { num_output: 1024 } }");
+  NetParameter weights;
+  AddWeights(&weights, "ip", {{1024, 4096}, {1024}});
+  const size_t weight_bytes = (1024 * 4096 + 1024) * sizeof(float);
+  MemPoolClear();
+  const size_t before = MemPoolGetState().cpu_mem;
+  Net net(*param, &weights);
+  const size_t held = MemPoolGetState().cpu_mem - before;
+  std::cout << "weights " << weight_bytes << " bytes, pool grew by " << held << std::endl;
+  CHECK_GE(held, weight_bytes);
+  CHECK_LT(held, weight_bytes + weight_bytes / 8);
+}
+
+// parameters of a flat weights file read its mapping, loading allocates
+// none of their memory
+void TestFlatWeightsMapped() {
+  const std::string text =
+    "layer { name: 'data' type: 'Input' top: 'data'"
+    "  input_param { shape { dim: 1 dim: 4096 } } }"
+    "layer { name: 'ip' type: 'InnerProduct' bottom: 'data' top: 'ip'"
+    "  inner_product_param { num_output: 1024 } }"
+    "layer { name: 'scale' type: 'Scale' bottom: 'ip' top: 'ip'"
+    "  scale_param { bias_term: true } }";
+  const std::string net_file = "test_weights_flat.prototxt";
+  const std::string weights_file = "test_weights_flat.bin";
+  std::ofstream(net_file.c_str()) << text;
+  const size_t weight_bytes = (1024 * 4096 + 3 * 1024) * sizeof(float);
+  std::vector<float> expected;
+  {
+    Net saved(*ParseNet(text));
+    unsigned seed = 1;
+    for (const auto& blob : saved.params()) {
+      FillUniform(blob->mutable_cpu_data(), blob->count(), -1, 1, seed++);
+    }
+    saved.SaveFlatWeights(weights_file);
+    FillUniform(saved.blob_by_name("data")->mutable_cpu_data(), 4096, -1, 1, 100);
+    saved.Forward();
+    std::shared_ptr<Blob> ip = saved.blob_by_name("ip");
+    expected.assign(ip->cpu_data(), ip->cpu_data() + ip->count());
+  }
+  MemPoolClear();
+  const size_t before = MemPoolGetState().cpu_mem;
+  Net loaded(net_file, weights_file);
+  const size_t held = MemPoolGetState().cpu_mem - before;
+  std::cout << "weights " << weight_bytes << " bytes, pool grew by " << held << std::endl;
+  CHECK_LT(held, weight_bytes / 64);
+  FillUniform(loaded.blob_by_name("data")->mutable_cpu_data(), 4096, -1, 1, 100);
+  loaded.Forward();
+  std::shared_ptr<Blob> ip = loaded.blob_by_name("ip");
+  CHECK(std::equal(expected.begin(), expected.end(), ip->cpu_data()));
+  std::remove(net_file.c_str());
+  std::remove(weights_file.c_str());
+}
+
+// a caffemodel blob with a shape but no data is truncated, not bound later
+// like the shape only blobs of flat weights
+void TestShapeOnlyBlobRejected() {
+  const std::string net_file = "test_weights_shape_only.prototxt";
+  const std::string weights_file = "test_weights_shape_only.caffemodel";
+  std::ofstream(net_file.c_str()) << kNet;
+  NetParameter weights;
+  AddWeights(&weights, "ip", {{1000, 64}, {1000}});
+  weights.mutable_layer(0)->mutable_blobs(0)->clear_data();
+  {
+    std::ofstream out(weights_file.c_str(), std::ios::binary);
+    CHECK(weights.SerializeToOstream(&out));
+  }
+  CHECK(Fails([&]() { Net net(net_file, weights_file); }))
+      << "caffemodel blob without data accepted";
+  auto param = ParseNet(kNet);
+  CHECK(Fails([&]() { Net net(*param, &weights); }))
+      << "weights blob without data accepted";
+  std::remove(net_file.c_str());
+  std::remove(weights_file.c_str());
+}
+
+// layers with parameters, set up from given weights, keep exactly them
+void TestRoundTrip() {
+  auto param = ParseNet(
+    "layer { name: 'data' type: 'Input' top: 'data'"
+    "  input_param { shape { dim: 2 dim: 4 dim: 7 dim: 5 } } }"
+    "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv'"
+    "  convolution_param { num_output: 6 kernel_size: 3 pad: 1 bias_term: true } }"
+    "layer { name: 'bn' type: 'BatchNorm' bottom: 'conv' top: 'conv'"
+    "  batch_norm_param { use_global_stats: true } }"
+    "layer { name: 'scale' type: 'Scale' bottom: 'conv' top: 'conv'"
+    "  scale_param { bias_term: true } }"
+    "layer { name: 'prelu' type: 'PReLU' bottom: 'conv' top: 'conv' }"
+    "layer { name: 'bias' type: 'Bias' bottom: 'conv' top: 'bias' }"
+    "layer { name: 'deconv' type: 'Deconvolution' bottom: 'bias' top: 'deconv'"
+    "  convolution_param { num_output: 3 kernel_size: 2 stride: 2 bias_term: true } }"
+    "layer { name: 'ip' type: 'InnerProduct' bottom: 'deconv' top: 'ip'"
+    "  inner_product_param { num_output: 10 } }");
+  Net filled(*param);
+  unsigned seed = 1;
+  for (const auto& blob : filled.params()) {
+    FillUniform(blob->mutable_cpu_data(), blob->count(), 0.5f, 1.5f, seed++);
+  }
+  NetParameter weights;
+  filled.ToProto(&weights);
+  Net loaded(*param, &weights);
+  CHECK_EQ(loaded.params().size(), filled.params().size());
+  for (size_t i = 0; i < filled.params().size(); ++i) {
+    const Blob& a = *filled.params()[i];
+    const Blob& b = *loaded.params()[i];
+    CHECK(a.shape() == b.shape()) << "param " << loaded.param_names()[i];
+    CHECK(std::equal(a.cpu_data(), a.cpu_data() + a.count(), b.cpu_data()))
+        << "param " << loaded.param_names()[i] << " differs";
+  }
+  for (Net* net : {&filled, &loaded}) {
+    std::shared_ptr<Blob> data = net->blob_by_name("data");
+    FillUniform(data->mutable_cpu_data(), data->count(), -1, 1, 100);
+    net->Forward();
+  }
+  std::shared_ptr<Blob> a = filled.blob_by_name("ip");
+  std::shared_ptr<Blob> b = loaded.blob_by_name("ip");
+  CHECK(std::equal(a->cpu_data(), a->cpu_data() + a->count(), b->cpu_data()));
+}
+
+}  // namespace
+
+int main() {
+  RUN_TEST(TestMatchingWeights);
+  RUN_TEST(TestWrongWeightShape);
+  RUN_TEST(TestWrongBlobCount);
+  RUN_TEST(TestCheckAllocatesNoWeights);
+  RUN_TEST(TestFlatWeightsMapped);
+  RUN_TEST(TestShapeOnlyBlobRejected);
+  RUN_TEST(TestRoundTrip);
+  return 0;
+}
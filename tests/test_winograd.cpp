@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "./test_util.hpp"
+
+using namespace caffe;
+using namespace caffe::test;
+
+namespace {
+
+// error of F(4x4, 3x3) relative to the largest output, kWinogradF43Error
+// with margin
+const float kTolerance = 1e-4f;
+
+std::string ConvNet(int channels, int height, int width, int group, int pad,
+                    const std::string& algorithm) {
+  std::string text =
+    "layer { name: 'data' type: 'Input' top: 'data'"
+    "  input_param { shape { dim: 2 dim: " + std::to_string(channels) +
+    "  dim: " + std::to_string(height) + " dim: " + std::to_string(width) + " } } }"
+    "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv'"
+    "  convolution_param { num_output: 16 kernel_size: 3 bias_term: true"
+    "  pad: " + std::to_string(pad) + " group: " + std::to_string(group);
+  if (!algorithm.empty()) {
+    text += " conv_algorithm: '" + algorithm + "'";
+  }
+  return text + " } }";
+}
+
+// random parameters of a net, fillers only set constants
+NetParameter RandomWeights(Net* net, unsigned seed) {
+  for (const auto& blob : net->params()) {
+    FillUniform(blob->mutable_cpu_data(), blob->count(), -0.2f, 0.2f, seed++);
+  }
+  NetParameter weights;
+  net->ToProto(&weights);
+  return weights;
+}
+
+void FillInput(Net* net, unsigned seed) {
+  std::shared_ptr<Blob> data = net->blob_by_name("data");
+  FillUniform(data->mutable_cpu_data(), data->count(), -1, 1, seed);
+}
+
+float MaxAbs(const Blob& blob) {
+  float value = 0.f;
+  for (int i = 0; i < blob.count(); ++i) {
+    value = std::max(value, std::abs(blob.cpu_data()[i]));
+  }
+  return value;
+}
+
+// largest difference of conv between a and b, relative to the largest output of b
+float ConvError(Net* a, Net* b) {
+  const Blob& x = *a->blob_by_name("conv");
+  const Blob& y = *b->blob_by_name("conv");
+  CHECK(x.shape() == y.shape());
+  return MaxRelativeError(x.cpu_data(), y.cpu_data(), x.count(), MaxAbs(y));
+}
+
+void Compare(int channels, int height, int width, int group, int pad) {
+  Net direct(*ParseNet(ConvNet(channels, height, width, group, pad, "direct")));
+  NetParameter weights = RandomWeights(&direct, 10);
+  Net winograd(*ParseNet(ConvNet(channels, height, width, group, pad, "winograd")), &weights);
+  FillInput(&direct, 1);
+  FillInput(&winograd, 1);
+  direct.Forward();
+  winograd.Forward();
+  const float error = ConvError(&winograd, &direct);
+  std::cout << channels << "x" << height << "x" << width << " group " << group
+            << " pad " << pad << ": " << error << std::endl;
+  CHECK_LT(error, kTolerance);
+}
+
+void TestShapes() {
+  Compare(16, 16, 16, 1, 1);
+  Compare(16, 13, 11, 1, 1);
+  Compare(8, 9, 7, 1, 0);
+  Compare(32, 17, 23, 2, 1);
+  Compare(16, 5, 19, 4, 0);
+}
+
+// the default tolerance is 0, convolutions stay exact until it is raised
+void TestOptIn() {
+  CHECK_EQ(GetConvTolerance(), 0.f);
+  Net direct(*ParseNet(ConvNet(16, 32, 32, 1, 1, "direct")));
+  NetParameter weights = RandomWeights(&direct, 20);
+  Net net(*ParseNet(ConvNet(16, 32, 32, 1, 1, "")), &weights);
+  FillInput(&direct, 2);
+  FillInput(&net, 2);
+  direct.Forward();
+  net.Forward();
+  CHECK_EQ(ConvError(&net, &direct), 0.f);
+  // picked up on the next reshape
+  SetConvTolerance(1e-4f);
+  std::shared_ptr<Blob> data = net.blob_by_name("data");
+  data->Reshape({1, 16, 31, 31});
+  direct.blob_by_name("data")->Reshape({1, 16, 31, 31});
+  FillInput(&direct, 3);
+  FillInput(&net, 3);
+  direct.Forward();
+  net.Forward();
+  const float error = ConvError(&net, &direct);
+  SetConvTolerance(0.f);
+  CHECK_GT(error, 0.f) << "tolerance did not switch to Winograd";
+  CHECK_LT(error, kTolerance);
+}
+
+// contexts share the transformed weights of the model, and new weights are
+// transformed again
+void TestContextAndNewWeights() {
+  const std::string text = ConvNet(16, 20, 20, 2, 1, "winograd");
+  Net direct(*ParseNet(ConvNet(16, 20, 20, 2, 1, "direct")));
+  NetParameter weights = RandomWeights(&direct, 30);
+  Net model(*ParseNet(text), &weights);
+  {
+    Net context(&model);
+    for (Net* net : {&direct, &model, &context}) {
+      FillInput(net, 4);
+      net->Forward();
+    }
+    CHECK_LT(ConvError(&model, &direct), kTolerance);
+    CHECK_EQ(ConvError(&context, &model), 0.f);
+  }
+
+  Net other(*ParseNet(ConvNet(16, 20, 20, 2, 1, "direct")));
+  NetParameter other_weights = RandomWeights(&other, 40);
+  model.CopyTrainedLayersFrom(other_weights);
+  Net context(&model);
+  for (Net* net : {&other, &model, &context}) {
+    FillInput(net, 5);
+    net->Forward();
+  }
+  CHECK_LT(ConvError(&model, &other), kTolerance);
+  CHECK_EQ(ConvError(&context, &model), 0.f);
+}
+
+}  // namespace
+
+int main() {
+  RUN_TEST(TestShapes);
+  RUN_TEST(TestOptIn);
+  RUN_TEST(TestContextAndNewWeights);
+  return 0;
+}
@@ -6,3 +6,10 @@ if(MSVC)
 else(MSVC)
     target_link_libraries(run_net caffe pthread)
 endif(MSVC)
+
+# unit tests, run by ctest
+foreach(test_name weights separable winograd profiler vmath conv_dw c_api parallel context planner)
+  add_executable(test_${test_name} ${CMAKE_CURRENT_LIST_DIR}/test_${test_name}.cpp)
+  target_link_libraries(test_${test_name} caffe)
+  add_test(NAME ${test_name} COMMAND test_${test_name})
+endforeach()
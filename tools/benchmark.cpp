@@ -1,17 +1,268 @@
 #include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <caffe/net.hpp>
 #include <caffe/profiler.hpp>
 
+namespace {
+
+const char *kUsage =
+  "[Usage]: ./benchmark net.prototxt [iterations] [gpu_id] [options]\n"
+  "  --weights=net.caffemodel  load weights, caffemodel or flat weights\n"
+  "  --iterations=50           timed forwards per instance\n"
+  "  --warmup=5                forwards per instance before timing\n"
+  "  --gpu=-1                  device id, -1 runs on CPU\n"
+  "  --batch=1,8               batch sizes to sweep, default from prototxt\n"
+  "  --resolution=224x224,...  input height x width to sweep\n"
+  "  --threads=1,2             inter-op threads of every instance to sweep\n"
+  "  --intra_threads=1         threads splitting reference layers of every instance\n"
+  "  --instances=1             nets running concurrently, sharing weights\n"
+  "  --layers=1                per layer breakdown from profiler statistics\n"
+  "  --json=result.json        write results\n"
+  "  --baseline=base.json      compare with results written by --json\n"
+  "  --tolerance=0.1           slowdown reported as regression";
+
+struct Config {
+  int batch;  // 0 keeps the prototxt shape
+  int height;
+  int width;
+  int threads;
+};
+
+struct Result {
+  Config config;
+  std::string key;
+  double mean_ms, p50_ms, p90_ms, p99_ms, min_ms, max_ms;
+  double throughput;  // images per second over all instances
+  std::vector<caffe::Profiler::LayerStats> layers;
+};
+
+std::vector<std::string> Split(const std::string &str, char delim) {
+  std::vector<std::string> parts;
+  std::stringstream ss(str);
+  std::string part;
+  while (std::getline(ss, part, delim)) {
+    if (!part.empty()) parts.push_back(part);
+  }
+  return parts;
+}
+
+std::vector<int> ParseInts(const std::string &str) {
+  std::vector<int> values;
+  for (auto &part : Split(str, ',')) values.push_back(atoi(part.c_str()));
+  return values;
+}
+
+/*! \brief nearest rank percentile of sorted values */
+double Percentile(const std::vector<double> &sorted, double p) {
+  int rank = static_cast<int>(std::ceil(p * sorted.size())) - 1;
+  rank = std::max(0, std::min(rank, static_cast<int>(sorted.size()) - 1));
+  return sorted[rank];
+}
+
+std::string ConfigKey(const Config &config, int instances) {
+  std::ostringstream os;
+  os << "b" << config.batch << "_" << config.height << "x" << config.width
+     << "_t" << config.threads << "_i" << instances;
+  return os.str();
+}
+
+/*! \brief reshape inputs to a config and fill them with random data */
+void SetInputs(caffe::Net *net, const std::vector<std::string> &inputs,
+               const Config &config, std::mt19937 *rng) {
+  std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+  for (auto &name : inputs) {
+    auto blob = net->blob_by_name(name);
+    std::vector<int> shape = blob->shape();
+    // only image like inputs follow the sweep, e.g. im_info keeps its shape
+    if (shape.size() == 4) {
+      if (config.batch > 0) shape[0] = config.batch;
+      if (config.height > 0) shape[2] = config.height;
+      if (config.width > 0) shape[3] = config.width;
+      blob->Reshape(shape);
+    }
+    float *data = blob->mutable_cpu_data();
+    for (int i = 0; i < blob->count(); ++i) data[i] = uniform(*rng);
+  }
+}
+
+Result Run(const std::vector<caffe::Net*> &nets,
+           const std::vector<std::string> &inputs, const Config &config,
+           int warmup, int iterations, bool layers) {
+  const int instances = nets.size();
+  caffe::Profiler *profiler = caffe::Profiler::Get();
+  std::vector<std::vector<double> > latencies(instances);
+  for (int i = 0; i < instances; ++i) {
+    std::mt19937 rng(i);
+    nets[i]->SetInterOpThreads(config.threads);
+    SetInputs(nets[i], inputs, config, &rng);
+    for (int k = 0; k < warmup; ++k) nets[i]->Forward();
+  }
+  // report the shapes run, the sweep may keep those of the prototxt
+  const std::vector<int> shape = nets[0]->blob_by_name(inputs[0])->shape();
+  const int batch = shape[0];
+  profiler->ResetLayerStats();
+  profiler->EnableLayerStats(layers);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < instances; ++i) {
+    threads.emplace_back([&, i]() {
+      latencies[i].reserve(iterations);
+      for (int k = 0; k < iterations; ++k) {
+        auto tic = std::chrono::steady_clock::now();
+        nets[i]->Forward();
+        auto toc = std::chrono::steady_clock::now();
+        latencies[i].push_back(
+          std::chrono::duration<double, std::milli>(toc - tic).count());
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  auto stop = std::chrono::steady_clock::now();
+  profiler->EnableLayerStats(false);
+
+  std::vector<double> all;
+  for (auto &latency : latencies) all.insert(all.end(), latency.begin(), latency.end());
+  std::sort(all.begin(), all.end());
+  Result result;
+  result.config = config;
+  result.config.batch = batch;
+  if (shape.size() == 4) {
+    result.config.height = shape[2];
+    result.config.width = shape[3];
+  }
+  result.key = ConfigKey(result.config, instances);
+  double sum = 0;
+  for (double latency : all) sum += latency;
+  result.mean_ms = sum / all.size();
+  result.p50_ms = Percentile(all, 0.5);
+  result.p90_ms = Percentile(all, 0.9);
+  result.p99_ms = Percentile(all, 0.99);
+  result.min_ms = all.front();
+  result.max_ms = all.back();
+  const double seconds = std::chrono::duration<double>(stop - start).count();
+  result.throughput = static_cast<double>(batch) * all.size() / seconds;
+  if (layers) result.layers = profiler->GetLayerStats();
+  return result;
+}
+
+/*! \brief quoted json string, windows paths have backslashes */
+std::string Quote(const std::string &str) {
+  std::string quoted = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') quoted += '\\';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+void WriteJson(const std::string &fn, const std::string &proto,
+               const std::string &weights, int warmup, int iterations,
+               int instances, const std::vector<Result> &results) {
+  std::ofstream out(fn);
+  CHECK(out) << "can't write " << fn;
+  out << std::fixed << std::setprecision(4);
+  out << "{\n  \"net\": " << Quote(proto) << ",\n  \"weights\": " << Quote(weights)
+      << ",\n  \"warmup\": " << warmup << ",\n  \"iterations\": " << iterations
+      << ",\n  \"instances\": " << instances << ",\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result &r = results[i];
+    out << (i ? "," : "") << "\n    {\n      \"config\": \"" << r.key << "\",\n"
+        << "      \"batch\": " << r.config.batch << ", \"height\": " << r.config.height
+        << ", \"width\": " << r.config.width << ", \"threads\": " << r.config.threads << ",\n"
+        << "      \"mean_ms\": " << r.mean_ms << ", \"p50_ms\": " << r.p50_ms
+        << ", \"p90_ms\": " << r.p90_ms << ", \"p99_ms\": " << r.p99_ms
+        << ", \"min_ms\": " << r.min_ms << ", \"max_ms\": " << r.max_ms << ",\n"
+        << "      \"throughput\": " << r.throughput << ",\n      \"layers\": [";
+    for (size_t j = 0; j < r.layers.size(); ++j) {
+      const caffe::Profiler::LayerStats &l = r.layers[j];
+      out << (j ? "," : "") << "\n        {\"name\": " << Quote(l.name) << ", \"type\": "
+          << Quote(l.type) << ", \"count\": " << l.count << ", \"mean_us\": " << l.mean
+          << ", \"p50_us\": " << l.p50 << ", \"p90_us\": " << l.p90
+          << ", \"p99_us\": " << l.p99 << ", \"max_us\": " << l.max << "}";
+    }
+    out << (r.layers.empty() ? "" : "\n      ") << "]\n    }";
+  }
+  out << "\n  ]\n}\n";
+}
+
+/*! \brief value of `"key": value` following position `pos` */
+double JsonNumber(const std::string &json, const std::string &key, size_t pos) {
+  pos = json.find("\"" + key + "\":", pos);
+  CHECK_NE(pos, std::string::npos) << "baseline misses " << key;
+  return atof(json.c_str() + pos + key.size() + 3);
+}
+
+/*! \brief p50 and throughput of every config in a file written by WriteJson */
+std::map<std::string, std::pair<double, double> > ReadBaseline(const std::string &fn) {
+  std::ifstream in(fn);
+  CHECK(in) << "can't read baseline " << fn;
+  std::stringstream ss;
+  ss << in.rdbuf();
+  const std::string json = ss.str();
+  std::map<std::string, std::pair<double, double> > baseline;
+  const std::string tag = "\"config\": \"";
+  for (size_t pos = json.find(tag); pos != std::string::npos; pos = json.find(tag, pos)) {
+    pos += tag.size();
+    const std::string key = json.substr(pos, json.find('"', pos) - pos);
+    baseline[key] = std::make_pair(JsonNumber(json, "p50_ms", pos),
+                                   JsonNumber(json, "throughput", pos));
+  }
+  return baseline;
+}
+
+}  // namespace
+
 int main(int argc, char *argv[]) {
-  CHECK_EQ(argc, 4) << "[Usage]: ./benchmark net.prototxt iterations gpu_id";
+  CHECK_GE(argc, 2) << kUsage;
   std::string proto = argv[1];
-  int iters = atoi(argv[2]);
-  int gpu_id = atoi(argv[3]);
+  std::map<std::string, std::string> options = {
+    {"iterations", "50"}, {"warmup", "5"}, {"gpu", "-1"}, {"batch", "0"},
+    {"threads", "1"}, {"intra_threads", "1"}, {"instances", "1"}, {"layers", "1"},
+    {"tolerance", "0.1"},
+  };
+  // positional iterations and gpu_id of the old command line
+  const char *positional[] = {"iterations", "gpu"};
+  int num_positional = 0;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.compare(0, 2, "--") != 0) {
+      CHECK_LT(num_positional, 2) << kUsage;
+      options[positional[num_positional++]] = arg;
+      continue;
+    }
+    size_t eq = arg.find('=');
+    CHECK_NE(eq, std::string::npos) << kUsage;
+    const std::string key = arg.substr(2, eq - 2);
+    CHECK(key == "weights" || key == "resolution" || key == "json" ||
+          key == "baseline" || options.count(key)) << "unknown option " << arg << "\n" << kUsage;
+    options[key] = arg.substr(eq + 1);
+  }
+  const int iterations = atoi(options["iterations"].c_str());
+  const int warmup = atoi(options["warmup"].c_str());
+  const int instances = atoi(options["instances"].c_str());
+  const int intra_threads = atoi(options["intra_threads"].c_str());
+  const bool layers = atoi(options["layers"].c_str()) != 0;
+  const double tolerance = atof(options["tolerance"].c_str());
+  int gpu_id = atoi(options["gpu"].c_str());
+  CHECK_GT(iterations, 0) << "iterations must be positive";
+  CHECK_GE(warmup, 0) << "warmup can't be negative";
+  CHECK_GT(instances, 0) << "instances must be positive";
+  CHECK_GT(intra_threads, 0) << "intra_threads must be positive";
   LOG(INFO) << "net prototxt: " << proto;
-  LOG(INFO) << "net forward iterations: " << iters;
-  LOG(INFO) << "run on device " << gpu_id;
+  LOG(INFO) << "net forward iterations: " << iterations << ", warmup " << warmup;
 
   if (gpu_id >= 0 && caffe::GPUAvailable()) {
     caffe::SetMode(caffe::GPU, gpu_id);
@@ -19,22 +270,79 @@ int main(int argc, char *argv[]) {
   else {
     gpu_id = -1;
   }
+  LOG(INFO) << "run on device " << gpu_id;
+
+  // inputs are tops of Input layers, sweeps reshape them before Forward
+  std::vector<std::string> inputs;
+  auto param = caffe::ReadTextNetParameterFromFile(proto);
+  for (int i = 0; i < param->layer_size(); ++i) {
+    if (param->layer(i).type() != "Input") continue;
+    for (int j = 0; j < param->layer(i).top_size(); ++j) {
+      inputs.push_back(param->layer(i).top(j));
+    }
+  }
+  CHECK(!inputs.empty()) << "no Input layer in " << proto;
 
-  caffe::Net net(proto);
-//  caffe::Profiler* profiler = caffe::Profiler::Get();
-  //profiler->TurnON();
-//  uint64_t tic = profiler->Now();
-  auto st = std::chrono::high_resolution_clock::now();
-  for (int i = 0; i < iters; i++) {
-    net.Forward();
+  const std::string weights = options["weights"];
+  std::unique_ptr<caffe::Net> model(weights.empty() ? new caffe::Net(proto)
+                                                    : new caffe::Net(proto, weights));
+  // more instances run contexts sharing the weights of the model
+  std::vector<std::unique_ptr<caffe::Net> > contexts;
+  std::vector<caffe::Net*> nets = {model.get()};
+  for (int i = 1; i < instances; ++i) {
+    contexts.emplace_back(new caffe::Net(model.get()));
+    nets.push_back(contexts.back().get());
   }
-  auto et = std::chrono::high_resolution_clock::now();
-  auto ms = std::chrono::duration_cast<std::chrono::milliseconds> (et - st).count();
-  std::cout <<  "spend --- "<< ms / 1.0 / iters<< " ---ms" << std::endl;
+  for (auto *net : nets) net->SetIntraOpThreads(intra_threads);
 
-  //uint64_t toc = profiler->Now();
-//  profiler->TurnOFF();
-//  profiler->DumpProfile("./profile.json");
-//  LOG(INFO) << "Forward costs " << (toc - tic) / 1000. / iters << " ms";
-  return 0;
+  std::vector<std::pair<int, int> > resolutions;
+  for (auto &res : Split(options["resolution"], ',')) {
+    auto hw = Split(res, 'x');
+    CHECK_EQ(hw.size(), 2u) << "resolution is height x width, got " << res;
+    resolutions.push_back(std::make_pair(atoi(hw[0].c_str()), atoi(hw[1].c_str())));
+  }
+  if (resolutions.empty()) resolutions.push_back(std::make_pair(0, 0));
+
+  std::vector<Result> results;
+  for (int batch : ParseInts(options["batch"])) {
+    for (auto &resolution : resolutions) {
+      for (int threads : ParseInts(options["threads"])) {
+        Config config = {batch, resolution.first, resolution.second, threads};
+        Result r = Run(nets, inputs, config, warmup, iterations, layers);
+        std::cout << std::fixed << std::setprecision(3) << r.key
+                  << ": mean " << r.mean_ms << " ms, p50 " << r.p50_ms
+                  << " ms, p90 " << r.p90_ms << " ms, p99 " << r.p99_ms
+                  << " ms, " << r.throughput << " images/s" << std::endl;
+        for (auto &l : r.layers) {
+          std::cout << "  " << l.name << " (" << l.type << "): mean " << l.mean
+                    << " us, p99 " << l.p99 << " us" << std::endl;
+        }
+        results.push_back(r);
+      }
+    }
+  }
+
+  if (!options["json"].empty()) {
+    WriteJson(options["json"], proto, weights, warmup, iterations, instances, results);
+  }
+  int regressions = 0;
+  if (!options["baseline"].empty()) {
+    auto baseline = ReadBaseline(options["baseline"]);
+    for (auto &r : results) {
+      auto it = baseline.find(r.key);
+      if (it == baseline.end()) {
+        std::cout << r.key << ": not in baseline" << std::endl;
+        continue;
+      }
+      const double p50 = it->second.first;
+      const double throughput = it->second.second;
+      const bool slower = r.p50_ms > p50 * (1 + tolerance) ||
+                          r.throughput < throughput * (1 - tolerance);
+      std::cout << r.key << ": p50 " << p50 << " -> " << r.p50_ms << " ms, "
+                << throughput << " -> " << r.throughput << " images/s"
+                << (slower ? "  REGRESSION" : "") << std::endl;
+      regressions += slower;
+    }
+  }
+  return regressions > 0 ? 1 : 0;
 }
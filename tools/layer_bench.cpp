@@ -0,0 +1,318 @@
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include <caffe/net.hpp>
+#include "../src/layer.hpp"
+
+namespace {
+
+const char *kUsage =
+  "[Usage]: ./layer_bench [options]\n"
+  "  --filter=Convolution      only cases whose type or name contain this\n"
+  "  --engine=all              CAFFE, MKLDNN or all\n"
+  "  --max_time=1              seconds spent at most on every case\n"
+  "  --json=layers.json        write results";
+
+/*! \brief a layer with bottoms of a representative shape */
+struct Case {
+  std::string name;
+  /*! \brief layer parameter in text format, without bottoms and tops */
+  std::string layer;
+  std::vector<std::vector<int> > bottoms;
+  /*! \brief values repeated over a bottom, random in [0, 1) if empty */
+  std::vector<std::vector<float> > values;
+};
+
+const std::vector<Case> &Cases() {
+  static const std::vector<Case> cases = {
+    // ResNet-50
+    {"resnet conv1 7x7/2", "type: 'Convolution' convolution_param { num_output: 64 kernel_size: 7 stride: 2 pad: 3 }",
+     {{1, 3, 224, 224}}, {}},
+    {"resnet 3x3", "type: 'Convolution' convolution_param { num_output: 64 kernel_size: 3 pad: 1 }",
+     {{1, 64, 56, 56}}, {}},
+    {"resnet 3x3 direct", "type: 'Convolution' convolution_param { num_output: 64 kernel_size: 3 pad: 1 "
+                          "conv_algorithm: 'direct' }",
+     {{1, 64, 56, 56}}, {}},
+    {"resnet 1x1 expand", "type: 'Convolution' convolution_param { num_output: 256 kernel_size: 1 }",
+     {{1, 64, 56, 56}}, {}},
+    {"resnet 1x1/2 reduce", "type: 'Convolution' convolution_param { num_output: 128 kernel_size: 1 stride: 2 }",
+     {{1, 256, 56, 56}}, {}},
+    {"resnet bn", "type: 'BatchNorm' batch_norm_param { use_global_stats: true }",
+     {{1, 256, 56, 56}}, {}},
+    {"resnet scale", "type: 'Scale' scale_param { bias_term: true }",
+     {{1, 256, 56, 56}}, {}},
+    {"resnet relu", "type: 'ReLU'", {{1, 256, 56, 56}}, {}},
+    {"resnet shortcut", "type: 'Eltwise' eltwise_param { operation: SUM }",
+     {{1, 256, 56, 56}, {1, 256, 56, 56}}, {}},
+    {"resnet pool1", "type: 'Pooling' pooling_param { pool: MAX kernel_size: 3 stride: 2 }",
+     {{1, 64, 112, 112}}, {}},
+    {"resnet global pool", "type: 'Pooling' pooling_param { pool: AVE global_pooling: true }",
+     {{1, 2048, 7, 7}}, {}},
+    {"resnet fc1000", "type: 'InnerProduct' inner_product_param { num_output: 1000 }",
+     {{1, 2048}}, {}},
+    {"resnet prob", "type: 'Softmax'", {{1, 1000}}, {}},
+    // MobileNet
+    {"mobilenet dw 3x3", "type: 'ConvolutionDepthwise' convolution_param { num_output: 32 group: 32 kernel_size: 3 pad: 1 }",
+     {{1, 32, 112, 112}}, {}},
+    {"mobilenet dw 3x3/2", "type: 'ConvolutionDepthwise' convolution_param { num_output: 64 group: 64 kernel_size: 3 stride: 2 pad: 1 }",
+     {{1, 64, 112, 112}}, {}},
+    {"mobilenet grouped dw 3x3", "type: 'Convolution' convolution_param { num_output: 256 group: 256 kernel_size: 3 pad: 1 }",
+     {{1, 256, 28, 28}}, {}},
+    {"mobilenet pw 1x1", "type: 'Convolution' convolution_param { num_output: 64 kernel_size: 1 }",
+     {{1, 32, 112, 112}}, {}},
+    {"mobilenet relu", "type: 'ReLU'", {{1, 64, 112, 112}}, {}},
+    {"mobilenet separable 3x3", "type: 'SeparableConvolution' convolution_param { kernel_size: 3 pad: 1 } "
+                                "batch_norm_param { use_global_stats: true } scale_param { bias_term: true } "
+                                "relu_param { } inner_product_param { num_output: 128 }",
+     {{1, 64, 112, 112}}, {}},
+    // SSD 300
+    {"ssd conv4_3", "type: 'Convolution' convolution_param { num_output: 512 kernel_size: 3 pad: 1 }",
+     {{1, 512, 38, 38}}, {}},
+    {"ssd conv4_3 norm", "type: 'Normalize' norm_param { across_spatial: false channel_shared: false }",
+     {{1, 512, 38, 38}}, {}},
+    {"ssd mbox permute", "type: 'Permute' permute_param { order: 0 order: 2 order: 3 order: 1 }",
+     {{1, 16, 38, 38}}, {}},
+    {"ssd mbox flatten", "type: 'Flatten'", {{1, 38, 38, 16}}, {}},
+    {"ssd priorbox", "type: 'PriorBox' prior_box_param { min_size: 30 max_size: 60 aspect_ratio: 2 "
+                     "flip: true clip: false variance: 0.1 variance: 0.1 variance: 0.2 variance: 0.2 }",
+     {{1, 512, 38, 38}, {1, 3, 300, 300}}, {}},
+    {"ssd mbox concat", "type: 'Concat' concat_param { axis: 1 }",
+     {{1, 5776 * 21}, {1, 2166 * 21}, {1, 600 * 21}, {1, 150 * 21}, {1, 36 * 21}, {1, 4 * 21}}, {}},
+    {"ssd conf softmax", "type: 'Softmax' softmax_param { axis: 2 }", {{1, 8732, 21}}, {}},
+    {"ssd detection output", "type: 'DetectionOutput' detection_output_param { num_classes: 21 "
+                             "nms_param { nms_threshold: 0.45 top_k: 400 } code_type: CENTER_SIZE "
+                             "keep_top_k: 200 confidence_threshold: 0.01 }",
+     {{1, 8732 * 4}, {1, 8732 * 21}, {1, 2, 8732 * 4}}, {{}, {}, {0.1f, 0.1f, 0.3f, 0.3f}}},
+    // FCN
+    {"fcn upscore 4x4/2", "type: 'Deconvolution' convolution_param { num_output: 21 kernel_size: 4 stride: 2 }",
+     {{1, 21, 34, 34}}, {}},
+    {"fcn score crop", "type: 'Crop' crop_param { axis: 2 offset: 5 }",
+     {{1, 21, 70, 70}, {1, 3, 60, 60}}, {}},
+    // Faster R-CNN and R-FCN heads
+    {"faster-rcnn proposal", "type: 'Proposal' proposal_param { feat_stride: 16 ratio: 0.5 ratio: 1 ratio: 2 "
+                             "scale: 8 scale: 16 scale: 32 }",
+     {{1, 18, 38, 50}, {1, 36, 38, 50}, {1, 3}}, {{}, {}, {600, 800, 1}}},
+    {"faster-rcnn roi pooling", "type: 'ROIPooling' roi_pooling_param { pooled_h: 7 pooled_w: 7 spatial_scale: 0.0625 }",
+     {{1, 512, 38, 50}, {300, 5}}, {{}, {0, 16, 16, 400, 300}}},
+    {"faster-rcnn fc7", "type: 'InnerProduct' inner_product_param { num_output: 4096 }",
+     {{64, 4096}}, {}},
+    {"faster-rcnn cls prob", "type: 'Softmax'", {{300, 21}}, {}},
+    {"r-fcn psroi pooling", "type: 'PSROIPooling' psroi_pooling_param { spatial_scale: 0.0625 output_dim: 21 group_size: 7 }",
+     {{1, 1029, 38, 50}, {300, 5}}, {{}, {0, 16, 16, 400, 300}}},
+    // layers needing parameters to run
+    {"input", "type: 'Input' input_param { shape { dim: 1 dim: 3 dim: 224 dim: 224 } }", {}, {}},
+    {"parameter", "type: 'Parameter' parameter_param { shape { dim: 1 dim: 256 } }", {}, {}},
+    {"reshape", "type: 'Reshape' reshape_param { shape { dim: 0 dim: -1 } }", {{1, 64, 56, 56}}, {}},
+    {"tile", "type: 'Tile' tile_param { axis: 1 tiles: 2 }", {{1, 64, 56, 56}}, {}},
+    {"spp", "type: 'SPP' spp_param { pyramid_height: 3 }", {{1, 256, 13, 13}}, {}},
+    {"embed", "type: 'Embed' embed_param { num_output: 256 input_dim: 1000 }", {{64, 1}}, {}},
+  };
+  return cases;
+}
+
+/*! \brief bottom of layers without a case in Cases */
+const std::vector<int> kDefaultShape = {1, 64, 56, 56};
+
+struct Result {
+  std::string name;
+  std::string type;
+  std::string engine;
+  std::string shapes;
+  int samples;
+  double mean_us, ci_us, p50_us, p90_us, min_us;
+};
+
+std::string ShapeString(const std::vector<std::vector<int> > &shapes) {
+  std::ostringstream os;
+  for (size_t i = 0; i < shapes.size(); ++i) {
+    os << (i ? " " : "");
+    for (size_t j = 0; j < shapes[i].size(); ++j) os << (j ? "x" : "") << shapes[i][j];
+  }
+  return os.str();
+}
+
+std::shared_ptr<caffe::Layer> CreateLayer(const std::string &layer, const std::string &engine,
+                                          std::shared_ptr<caffe::NetParameter> *param) {
+  const std::string text = "layer { name: 'bench' engine: '" + engine + "' " + layer + " }";
+  *param = caffe::ReadTextNetParameterFromBuffer(text.data(), text.size());
+  return caffe::LayerRegistry::CreateLayer((*param)->layer(0));
+}
+
+void Fill(caffe::Blob *blob, const std::vector<float> &values, std::mt19937 *rng) {
+  std::uniform_real_distribution<float> uniform(0.f, 1.f);
+  float *data = blob->mutable_cpu_data();
+  for (int i = 0; i < blob->count(); ++i) {
+    data[i] = values.empty() ? uniform(*rng) : values[i % values.size()];
+  }
+}
+
+/*!
+ * \brief time Forward of a layer
+ *
+ * Every sample runs enough Forward calls to take at least 200us, samples are
+ * taken until the 95% confidence interval of the mean is within 2% of it, or
+ * the time budget is spent.
+ */
+void Bench(caffe::Layer *layer, const Case &c, double max_time, Result *result) {
+  std::mt19937 rng(0);
+  std::vector<std::unique_ptr<caffe::Blob> > bottom_blobs, top_blobs;
+  std::vector<caffe::Blob*> bottom, top;
+  for (size_t i = 0; i < c.bottoms.size(); ++i) {
+    bottom_blobs.emplace_back(new caffe::Blob(c.bottoms[i]));
+    bottom.push_back(bottom_blobs.back().get());
+    Fill(bottom.back(), i < c.values.size() ? c.values[i] : std::vector<float>(), &rng);
+  }
+  const int num_top = std::max(1, std::max(layer->ExactNumTopBlobs(), layer->MinTopBlobs()));
+  for (int i = 0; i < num_top; ++i) {
+    top_blobs.emplace_back(new caffe::Blob());
+    top.push_back(top_blobs.back().get());
+  }
+  layer->SetUp(bottom, top);
+  for (auto &blob : layer->blobs()) Fill(blob.get(), {}, &rng);
+
+  typedef std::chrono::steady_clock Clock;
+  auto elapsed_us = [](Clock::time_point since) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - since).count();
+  };
+  // warmup also runs the one time setup of MKLDNN primitives
+  auto start = Clock::now();
+  int warmup = 0;
+  while (warmup < 3 || (warmup < 100 && elapsed_us(start) < 50000)) {
+    layer->Forward(bottom, top);
+    ++warmup;
+  }
+  const double call_us = std::max(elapsed_us(start) / warmup, 0.01);
+  const int calls = std::max(1, static_cast<int>(std::ceil(200. / call_us)));
+
+  std::vector<double> samples;
+  double sum = 0, sum_sq = 0, ci = 0;
+  start = Clock::now();
+  while (true) {
+    auto tic = Clock::now();
+    for (int k = 0; k < calls; ++k) layer->Forward(bottom, top);
+    const double us = elapsed_us(tic) / calls;
+    samples.push_back(us);
+    sum += us;
+    sum_sq += us * us;
+    const int n = samples.size();
+    if (n < 10) continue;
+    const double mean = sum / n;
+    const double var = std::max(0., (sum_sq - n * mean * mean) / (n - 1));
+    ci = 1.96 * std::sqrt(var / n);
+    if (ci < 0.02 * mean || elapsed_us(start) > max_time * 1e6 || n >= 10000) break;
+  }
+  std::sort(samples.begin(), samples.end());
+  const int n = samples.size();
+  result->samples = n;
+  result->mean_us = sum / n;
+  result->ci_us = ci;
+  result->p50_us = samples[n / 2];
+  result->p90_us = samples[std::min(n - 1, static_cast<int>(0.9 * n))];
+  result->min_us = samples.front();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::map<std::string, std::string> options = {
+    {"filter", ""}, {"engine", "all"}, {"max_time", "1"}, {"json", ""},
+  };
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    CHECK(arg.compare(0, 2, "--") == 0 && eq != std::string::npos) << kUsage;
+    const std::string key = arg.substr(2, eq - 2);
+    CHECK(options.count(key)) << "unknown option " << arg << "\n" << kUsage;
+    options[key] = arg.substr(eq + 1);
+  }
+  const std::string filter = options["filter"];
+  const std::string engine = options["engine"];
+  const double max_time = atof(options["max_time"].c_str());
+  CHECK(engine == "all" || engine == "CAFFE" || engine == "MKLDNN") << kUsage;
+
+  // every registered type runs its cases, or a default shape without one
+  std::vector<Case> cases;
+  std::set<std::string> covered;
+  for (auto &c : Cases()) {
+    const std::string text = "layer { " + c.layer + " }";
+    covered.insert(caffe::ReadTextNetParameterFromBuffer(text.data(), text.size())->layer(0).type());
+    cases.push_back(c);
+  }
+  for (auto &type : caffe::LayerRegistry::LayerTypeList()) {
+    if (covered.count(type)) continue;
+    cases.push_back({type, "type: '" + type + "'", {kDefaultShape}, {}});
+  }
+
+  std::vector<Result> results;
+  for (auto &c : cases) {
+    Result r;
+    r.name = c.name;
+    r.shapes = ShapeString(c.bottoms);
+    r.samples = 0;
+    r.mean_us = r.ci_us = r.p50_us = r.p90_us = r.min_us = 0;
+    try {
+      std::shared_ptr<caffe::NetParameter> param, mkldnn_param;
+      std::shared_ptr<caffe::Layer> reference = CreateLayer(c.layer, "CAFFE", &param);
+      r.type = reference->type();
+      if (!filter.empty() && r.type.find(filter) == std::string::npos &&
+          r.name.find(filter) == std::string::npos) {
+        continue;
+      }
+      std::vector<std::pair<std::string, std::shared_ptr<caffe::Layer> > > engines;
+      if (engine != "MKLDNN") engines.push_back(std::make_pair("CAFFE", reference));
+      if (engine != "CAFFE") {
+        std::shared_ptr<caffe::Layer> mkldnn = CreateLayer(c.layer, "MKLDNN", &mkldnn_param);
+        // layers without an MKLDNN version are the same class in both engines
+        if (typeid(*mkldnn) != typeid(*reference)) {
+          engines.push_back(std::make_pair("MKLDNN", mkldnn));
+        }
+      }
+      for (auto &e : engines) {
+        r.engine = e.first;
+        Bench(e.second.get(), c, max_time, &r);
+        std::cout << std::fixed << std::setprecision(2) << std::left << std::setw(28) << r.name
+                  << std::setw(8) << r.engine << std::setw(24) << r.shapes
+                  << " mean " << r.mean_us << " +- " << r.ci_us << " us, p50 " << r.p50_us
+                  << " us, p90 " << r.p90_us << " us, min " << r.min_us << " us, "
+                  << r.samples << " samples" << std::endl;
+        results.push_back(r);
+      }
+    } catch (const caffe::Error &err) {
+      // layers needing parameters or other bottoms than the default shape
+      if (!filter.empty() && r.name.find(filter) == std::string::npos) continue;
+      const std::string error = err.what();
+      std::cout << std::left << std::setw(28) << r.name << std::setw(8) << r.engine
+                << "skipped, " << error.substr(0, error.find('\n')) << std::endl;
+    }
+  }
+
+  if (!options["json"].empty()) {
+    std::ofstream out(options["json"]);
+    CHECK(out) << "can't write " << options["json"];
+    out << std::fixed << std::setprecision(3) << "[";
+    bool first = true;
+    for (auto &r : results) {
+      out << (first ? "" : ",") << "\n  {\"name\": \"" << r.name << "\", \"type\": \"" << r.type
+          << "\", \"engine\": \"" << r.engine << "\", \"shapes\": \"" << r.shapes
+          << "\", \"samples\": " << r.samples << ", \"mean_us\": " << r.mean_us
+          << ", \"ci_us\": " << r.ci_us << ", \"p50_us\": " << r.p50_us
+          << ", \"p90_us\": " << r.p90_us << ", \"min_us\": " << r.min_us << "}";
+      first = false;
+    }
+    out << "\n]\n";
+  }
+  return 0;
+}
@@ -18,7 +18,7 @@ class MemStatistic(object):
 
     A Memory Entry (type, device, time, size1, size2)
     For hit request: ('hit', device, time, has, wants)
-    For miss request: ('miss', device, time, creates, wants), creates == wants
+    For miss request: ('miss', device, time, creates, wants), creates >= wants
     For return: ('return', device, time, rets, rets)
     For free: ('free', device, time, freed, freed)
     """
@@ -144,7 +144,7 @@ if __name__ == '__main__':
                         assert len(g) == 4
                         wants = convert(float(g[0]), g[1])
                         creates = convert(float(g[2]), g[3])
-                        assert wants == creates
+                        assert wants <= creates
                         statistic.request_miss(dev, creates, wants)
                 elif 'Return' in line:
                     # return memory
@@ -1,3 +1,7 @@
 # benchmark
 add_executable(benchmark ${CMAKE_CURRENT_LIST_DIR}/benchmark.cpp)
 target_link_libraries(benchmark caffe)
+
+# layer_bench
+add_executable(layer_bench ${CMAKE_CURRENT_LIST_DIR}/layer_bench.cpp)
+target_link_libraries(layer_bench caffe)